@@ -0,0 +1,18 @@
+#ifndef SCAR_BENCH_COUNT_ALLOCS_H
+#define SCAR_BENCH_COUNT_ALLOCS_H
+
+#include <stddef.h>
+
+// The number of calls to malloc, calloc and realloc so far,
+// in the whole process, including the ones libscar makes.
+// Counting only works with glibc, whose allocator can be wrapped;
+// elsewhere, COUNTS_ALLOCS is 0 and the count stays at 0.
+extern size_t alloc_count;
+
+#ifdef __GLIBC__
+#define COUNTS_ALLOCS 1
+#else
+#define COUNTS_ALLOCS 0
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+// Benchmark for the gzip engines scar was built with.
+// Compresses a generated segment of tar-like data as one gzip member,
+// the way the writer compresses a checkpoint segment, then decompresses it
+// from memory, the way verify and recompress do. Every engine's output
+// is also decompressed by every other engine, to check that they agree.
+// Reports the throughput in MB/s of uncompressed data.
+//
+// Usage: bench-gzip-engines [MiB] [level]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compression.h"
+#include "io.h"
+#include "ioutil.h"
+
+// How many times each engine compresses and decompresses the segment
+#define ROUNDS 5
+
+static const char *engine_names[] = {"zlib", "libdeflate"};
+
+// Text with paths, numbers and some noise, which compresses
+// about as well as source code does
+static unsigned char *make_data(size_t len)
+{
+	static const char *words[] = {
+		"src/", "include/", "test/", "static ", "int ", "return ",
+		"struct ", "scar_", "reader", "writer", "(", ")", "{\n", "}\n",
+		"\t", "if ", "else ", "for ", "size_t ", "const ", "char *", "; ",
+		"0", "1", "-1", "NULL", "buf", "len", "// ", "\n",
+	};
+
+	unsigned char *data = malloc(len);
+	if (!data) {
+		return NULL;
+	}
+
+	unsigned int state = 12345;
+	size_t pos = 0;
+	while (pos < len) {
+		state = state * 1103515245 + 12345;
+		unsigned int x = state >> 16;
+		if (x % 16 == 0) {
+			data[pos++] = (unsigned char)(x >> 4);
+			continue;
+		}
+
+		const char *word = words[x % (sizeof(words) / sizeof(*words))];
+		for (size_t i = 0; word[i] && pos < len; ++i) {
+			data[pos++] = (unsigned char)word[i];
+		}
+	}
+
+	return data;
+}
+
+static double mbps(size_t len, clock_t ticks)
+{
+	double secs = (double)ticks / CLOCKS_PER_SEC;
+	return secs > 0 ? (double)len * ROUNDS / secs / 1e6 : 0;
+}
+
+// Compress 'data' into 'out' as one gzip member, ROUNDS times
+static int compress(
+	struct scar_compression *comp, int level,
+	const unsigned char *data, size_t len, struct scar_mem_writer *out,
+	clock_t *ticks
+) {
+	clock_t start = clock();
+	for (int i = 0; i < ROUNDS; ++i) {
+		out->len = 0;
+		struct scar_compressor *c = comp->create_compressor(&out->w, level);
+		if (!c) {
+			return -1;
+		}
+
+		int ret = 0;
+		if (
+			c->w.write(&c->w, data, len) < 0 ||
+			c->finish(c) < 0
+		) {
+			ret = -1;
+		}
+
+		comp->destroy_compressor(c);
+		if (ret < 0) {
+			return -1;
+		}
+	}
+
+	*ticks = clock() - start;
+	return 0;
+}
+
+// Decompress 'in' ROUNDS times, and check that it gives back 'data'
+static int decompress(
+	struct scar_compression *comp, const void *in, size_t in_len,
+	const unsigned char *data, size_t len, unsigned char *buf,
+	clock_t *ticks
+) {
+	clock_t start = clock();
+	for (int i = 0; i < ROUNDS; ++i) {
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, in, in_len);
+		struct scar_decompressor *d = comp->create_decompressor(&mr.r);
+		if (!d) {
+			return -1;
+		}
+
+		size_t done = 0;
+		while (done < len) {
+			scar_ssize n = d->r.read(&d->r, &buf[done], len - done);
+			if (n <= 0) {
+				break;
+			}
+
+			done += (size_t)n;
+		}
+
+		comp->destroy_decompressor(d);
+		if (done != len) {
+			return -1;
+		}
+	}
+
+	*ticks = clock() - start;
+	return memcmp(buf, data, len) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	size_t mib = 10;
+	int level = 6;
+	if (argc > 1) {
+		mib = (size_t)strtoull(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		level = atoi(argv[2]);
+	}
+
+	size_t len = mib * 1024 * 1024;
+	unsigned char *data = make_data(len);
+	unsigned char *buf = malloc(len);
+	if (!data || !buf) {
+		fprintf(stderr, "Failed to allocate %zu MiB\n", mib);
+		return 1;
+	}
+
+	printf("segment: %zu MiB, level %d\n", mib, level);
+
+	size_t nengines = sizeof(engine_names) / sizeof(*engine_names);
+	struct scar_mem_writer out[sizeof(engine_names) / sizeof(*engine_names)];
+	bool available[sizeof(engine_names) / sizeof(*engine_names)];
+	for (size_t i = 0; i < nengines; ++i) {
+		scar_mem_writer_init(&out[i]);
+		enum scar_gzip_engine engine;
+		struct scar_compression comp;
+		available[i] =
+			scar_gzip_engine_from_name(engine_names[i], &engine) &&
+			scar_compression_init_gzip_engine(&comp, engine);
+		if (!available[i]) {
+			printf("%s: not built in\n", engine_names[i]);
+			continue;
+		}
+
+		clock_t cticks, dticks;
+		if (compress(&comp, level, data, len, &out[i], &cticks) < 0) {
+			fprintf(stderr, "%s: Failed to compress\n", engine_names[i]);
+			return 1;
+		}
+
+		if (decompress(
+			&comp, out[i].buf, out[i].len, data, len, buf, &dticks) < 0
+		) {
+			fprintf(stderr, "%s: Failed to decompress\n", engine_names[i]);
+			return 1;
+		}
+
+		printf("%s:\n", engine_names[i]);
+		printf("  ratio:       %.3f\n", (double)out[i].len / (double)len);
+		printf("  compress:    %.1f MB/s\n", mbps(len, cticks));
+		printf("  decompress:  %.1f MB/s\n", mbps(len, dticks));
+	}
+
+	// Every engine reads every other engine's members
+	for (size_t i = 0; i < nengines; ++i) {
+		for (size_t j = 0; j < nengines; ++j) {
+			if (i == j || !available[i] || !available[j]) {
+				continue;
+			}
+
+			enum scar_gzip_engine engine;
+			struct scar_compression comp;
+			scar_gzip_engine_from_name(engine_names[j], &engine);
+			scar_compression_init_gzip_engine(&comp, engine);
+			clock_t ticks;
+			if (decompress(
+				&comp, out[i].buf, out[i].len, data, len, buf, &ticks) < 0
+			) {
+				fprintf(
+					stderr, "%s: Failed to decompress %s's output\n",
+					engine_names[j], engine_names[i]);
+				return 1;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < nengines; ++i) {
+		free(out[i].buf);
+	}
+
+	free(buf);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,276 @@
+// Benchmark for reading and copying entry metadata,
+// with every string on the heap, with a scar_meta_arena,
+// and with an arena and shared global metadata.
+// The headers start with a global header with a long comment,
+// which the first two copy into every entry.
+// Reports the time per entry and how many heap allocations
+// each entry needed.
+//
+// Usage: bench-read-meta [count]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "io.h"
+#include "ioutil.h"
+#include "meta.h"
+#include "meta-arena.h"
+#include "pax.h"
+#include "ustar.h"
+
+#include "count-allocs.h"
+
+// The headers of this many entries are generated once,
+// then read over and over
+#define TEMPLATE_ENTRIES 1000
+
+// The size of the global comment
+#define COMMENT_SIZE 4000
+
+// A reader which repeats a buffer of headers 'repeats' times,
+// followed by the end-of-archive indicator
+struct repeat_reader {
+	struct scar_io_reader r;
+	const unsigned char *buf;
+	size_t len;
+	size_t pos;
+	size_t repeats;
+	size_t trailer;
+};
+
+static scar_ssize repeat_read(struct scar_io_reader *r, void *buf, size_t len)
+{
+	struct repeat_reader *rr = (struct repeat_reader *)r;
+	unsigned char *dest = buf;
+	size_t done = 0;
+	while (done < len) {
+		if (rr->repeats > 0) {
+			size_t n = rr->len - rr->pos;
+			if (n > len - done) {
+				n = len - done;
+			}
+
+			memcpy(&dest[done], &rr->buf[rr->pos], n);
+			done += n;
+			rr->pos += n;
+			if (rr->pos == rr->len) {
+				rr->pos = 0;
+				rr->repeats -= 1;
+			}
+		} else if (rr->trailer > 0) {
+			size_t n = rr->trailer < len - done ? rr->trailer : len - done;
+			memset(&dest[done], 0, n);
+			done += n;
+			rr->trailer -= n;
+		} else {
+			break;
+		}
+	}
+
+	return (scar_ssize)done;
+}
+
+static void repeat_reader_init(
+	struct repeat_reader *rr, const void *buf, size_t len, size_t repeats
+) {
+	scar_io_reader_init(&rr->r, repeat_read);
+	rr->buf = buf;
+	rr->len = len;
+	rr->pos = 0;
+	rr->repeats = repeats;
+	rr->trailer = 1024;
+}
+
+// A 'g' header with a comment=ccc... record
+static int write_global(struct scar_mem_writer *mw)
+{
+	// The length of the record has four digits
+	char record[COMMENT_SIZE + 32];
+	size_t len = COMMENT_SIZE + strlen("0000 comment=\n");
+	int n = snprintf(record, sizeof(record), "%zu comment=", len);
+	memset(&record[n], 'c', COMMENT_SIZE);
+	record[len - 1] = '\n';
+
+	unsigned char block[512] = {0};
+	memcpy(&block[SCAR_UST_MAGIC.start], "ustar", 6);
+	block[SCAR_UST_TYPEFLAG.start] = 'g';
+	snprintf((char *)&block[SCAR_UST_SIZE.start], 12, "%011zo", len);
+	scar_ustar_write_checksum(block);
+	if (scar_mem_writer_write(&mw->w, block, 512) < 0) {
+		return -1;
+	}
+
+	memset(block, 0, sizeof(block));
+	size_t pad = (512 - len % 512) % 512;
+	if (
+		scar_mem_writer_write(&mw->w, record, len) < 0 ||
+		scar_mem_writer_write(&mw->w, block, pad) < 0
+	) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Every entry has the same user and group, and every tenth one
+// has a path which is too long for ustar, so it gets a pax header
+static int make_template(struct scar_mem_writer *mw)
+{
+	scar_mem_writer_init(mw);
+	if (write_global(mw) < 0) {
+		return -1;
+	}
+	char uname[] = "alice";
+	char gname[] = "staff";
+	for (size_t i = 0; i < TEMPLATE_ENTRIES; ++i) {
+		char path[256];
+		if (i % 10 == 0) {
+			snprintf(
+				path, sizeof(path), "src/%0120zu/long-file-%zu.c", i / 10, i);
+		} else {
+			snprintf(path, sizeof(path), "src/module-%zu/file-%zu.c", i / 10, i);
+		}
+
+		struct scar_meta meta;
+		scar_meta_init_empty(&meta);
+		meta.type = SCAR_FT_FILE;
+		meta.path = path;
+		meta.size = 0;
+		meta.mode = 0644;
+		meta.uid = 1000;
+		meta.gid = 1000;
+		meta.uname = uname;
+		meta.gname = gname;
+		meta.mtime = 1700000000 + (double)i;
+		if (scar_pax_write_meta(&meta, &mw->w) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void report(const char *name, size_t count, clock_t ticks, size_t allocs)
+{
+	double secs = (double)ticks / CLOCKS_PER_SEC;
+	printf("%s:\n", name);
+	printf("  time per entry:    %.1f ns\n", secs * 1e9 / (double)count);
+	if (COUNTS_ALLOCS) {
+		printf("  allocations:       %zu\n", allocs);
+		printf("  allocs per entry:  %.6f\n", (double)allocs / (double)count);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = 1000000;
+	if (argc > 1) {
+		count = (size_t)strtoull(argv[1], NULL, 10);
+	}
+
+	size_t repeats = (count + TEMPLATE_ENTRIES - 1) / TEMPLATE_ENTRIES;
+	count = repeats * TEMPLATE_ENTRIES;
+
+	struct scar_mem_writer tmpl;
+	if (make_template(&tmpl) < 0) {
+		fprintf(stderr, "Failed to generate headers\n");
+		return 1;
+	}
+
+	printf("entries: %zu\n", count);
+
+	// Every string on the heap: read, copy, then free both
+	struct repeat_reader rr;
+	repeat_reader_init(&rr, tmpl.buf, tmpl.len, repeats);
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+
+	size_t allocs_before = alloc_count;
+	clock_t start = clock();
+	size_t n = 0;
+	while (1) {
+		struct scar_meta meta, copy;
+		int r = scar_pax_read_meta(&rr.r, &global, &meta);
+		if (r < 0) {
+			fprintf(stderr, "Failed to read entry %zu\n", n);
+			return 1;
+		} else if (r == 0) {
+			break;
+		}
+
+		scar_meta_copy(&copy, &meta);
+		scar_meta_destroy(&copy);
+		scar_meta_destroy(&meta);
+		n += 1;
+	}
+	report("heap", n, clock() - start, alloc_count - allocs_before);
+	scar_meta_destroy(&global);
+
+	// Strings in an arena which is reset for every entry
+	repeat_reader_init(&rr, tmpl.buf, tmpl.len, repeats);
+	scar_meta_init_empty(&global);
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	if (!arena) {
+		fprintf(stderr, "Failed to create arena\n");
+		return 1;
+	}
+
+	allocs_before = alloc_count;
+	start = clock();
+	n = 0;
+	while (1) {
+		struct scar_meta meta, copy;
+		scar_meta_arena_reset(arena);
+		int r = scar_pax_read_meta_arena(&rr.r, &global, &meta, arena);
+		if (r < 0) {
+			fprintf(stderr, "Failed to read entry %zu\n", n);
+			return 1;
+		} else if (r == 0) {
+			break;
+		}
+
+		if (scar_meta_copy_arena(&copy, &meta, arena) < 0) {
+			fprintf(stderr, "Failed to copy entry %zu\n", n);
+			return 1;
+		}
+		n += 1;
+	}
+	report("arena", n, clock() - start, alloc_count - allocs_before);
+	scar_meta_destroy(&global);
+
+	// Strings in an arena, except for the global ones,
+	// which every entry shares
+	repeat_reader_init(&rr, tmpl.buf, tmpl.len, repeats);
+	struct scar_meta empty;
+	scar_meta_init_empty(&empty);
+	struct scar_meta_global *shared = scar_meta_global_create(&empty);
+	if (!shared) {
+		fprintf(stderr, "Failed to create global metadata\n");
+		return 1;
+	}
+
+	allocs_before = alloc_count;
+	start = clock();
+	n = 0;
+	while (1) {
+		struct scar_meta meta;
+		scar_meta_arena_reset(arena);
+		int r = scar_pax_read_meta_shared(&rr.r, &shared, &meta, arena);
+		if (r < 0) {
+			fprintf(stderr, "Failed to read entry %zu\n", n);
+			return 1;
+		} else if (r == 0) {
+			break;
+		}
+
+		n += 1;
+	}
+	report("shared global", n, clock() - start, alloc_count - allocs_before);
+
+	scar_meta_global_unref(shared);
+	scar_meta_arena_free(arena);
+	free(tmpl.buf);
+	return 0;
+}
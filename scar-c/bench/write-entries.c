@@ -0,0 +1,117 @@
+// Benchmark for scar_writer's per-entry write path.
+// Writes lots of tiny entries, like an archive of a source tree or
+// a maildir would have, and reports the time per entry
+// and how many heap allocations each entry needed.
+//
+// Usage: bench-write-entries [count] [plain|gzip]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compression.h"
+#include "ioutil.h"
+#include "meta.h"
+#include "scar-writer.h"
+
+#include "count-allocs.h"
+
+// Entries written before we start measuring,
+// so that buffers have grown to their steady-state size
+#define WARMUP_ENTRIES 1000
+
+// A writer which throws everything away
+static scar_ssize null_write(
+	struct scar_io_writer *w, const void *buf, size_t len)
+{
+	(void)w;
+	(void)buf;
+	return (scar_ssize)len;
+}
+
+static int write_entry(struct scar_writer *sw, size_t i)
+{
+	static const char content[] = "Hello, world!\n";
+
+	// The path lives on the stack and the meta is never destroyed,
+	// so that the benchmark itself doesn't allocate
+	char path[64];
+	snprintf(path, sizeof(path), "src/module-%zu/file-%zu.c", i / 100, i);
+
+	struct scar_meta meta;
+	scar_meta_init_empty(&meta);
+	meta.type = SCAR_FT_FILE;
+	meta.path = path;
+	meta.size = sizeof(content) - 1;
+	meta.mode = 0644;
+	meta.uid = 1000;
+	meta.gid = 1000;
+	meta.mtime = 1700000000 + (double)i;
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, content, sizeof(content) - 1);
+	return scar_writer_write_entry(sw, &meta, &mr.r);
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = 1000000;
+	if (argc > 1) {
+		count = (size_t)strtoull(argv[1], NULL, 10);
+	}
+
+	// Without compression, formatting and allocation
+	// are all that's left to measure
+	const char *comp_name = argc > 2 ? argv[2] : "plain";
+	struct scar_compression comp;
+	if (!scar_compression_init_from_name(&comp, comp_name)) {
+		fprintf(stderr, "Unknown compression: %s\n", comp_name);
+		return 1;
+	}
+
+	struct scar_io_writer w = {null_write};
+	struct scar_writer *sw = scar_writer_create_opts(
+		&w, &comp, 1, SCAR_WRITER_META);
+	if (!sw) {
+		fprintf(stderr, "Failed to create scar writer\n");
+		return 1;
+	}
+
+	size_t i;
+	for (i = 0; i < WARMUP_ENTRIES; ++i) {
+		if (write_entry(sw, i) < 0) {
+			fprintf(stderr, "Failed to write entry %zu\n", i);
+			return 1;
+		}
+	}
+
+	size_t allocs_before = alloc_count;
+	clock_t start = clock();
+	for (; i < WARMUP_ENTRIES + count; ++i) {
+		if (write_entry(sw, i) < 0) {
+			fprintf(stderr, "Failed to write entry %zu\n", i);
+			return 1;
+		}
+	}
+	clock_t end = clock();
+	size_t allocs = alloc_count - allocs_before;
+
+	if (scar_writer_finish(sw) < 0) {
+		fprintf(stderr, "Failed to finish archive\n");
+		return 1;
+	}
+	scar_writer_free(sw);
+
+	double secs = (double)(end - start) / CLOCKS_PER_SEC;
+	printf("entries:           %zu (%s)\n", count, comp_name);
+	printf("time per entry:    %.1f ns\n", secs * 1e9 / (double)count);
+	if (COUNTS_ALLOCS) {
+		// The footer sections' buffers still double now and then,
+		// so a handful of allocations over the whole run is expected
+		printf("allocations:       %zu\n", allocs);
+		printf("allocs per entry:  %.6f\n", (double)allocs / (double)count);
+	}
+
+	return 0;
+}
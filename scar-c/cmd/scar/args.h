@@ -7,11 +7,33 @@
 
 struct args {
 	struct scar_file_handle input;
+
+	// If set, the input is read through this preader instead of 'input',
+	// which is the case for regular files and URLs
+	struct scar_io_preader *input_pr;
+	char *input_url;
+
+	// The path of the input file, and its sidecar index
+	// if there is one next to it
+	char *input_path;
+	void *sidecar;
+	size_t sidecar_len;
+
 	struct scar_file_handle output;
 	struct scar_compression comp;
 	char *chdir;
 	int level;
+	int jobs;
+	unsigned int queue_depth;
+	enum scar_gzip_engine gzip_engine;
+	bool parallel_inflate;
+	int writer_opts;
 	bool force;
+	bool long_list;
+	bool write_sidecar;
 };
 
+/// Create a reader for the input archive.
+struct scar_reader *args_create_reader(struct args *args);
+
 #endif
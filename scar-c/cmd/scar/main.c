@@ -8,6 +8,7 @@
 
 #include "subcmds.h"
 #include "args.h"
+#include "platform.h"
 #include "util.h"
 
 static const char *usageText =
@@ -15,26 +16,56 @@ static const char *usageText =
 	"\n"
 	"Commands:\n"
 	"  ls [files...]      List the contents of directories in the archive.\n"
+	"                     Use -l,--long to show mode, size and mtime.\n"
 	"  cat <files...>     Read the contents of files in the archive.\n"
 	"  tree               List all the entries in the archive.\n"
 	"  create <files...>  Create a new scar archive.\n"
 	"  convert            Convert a tar/pax file to a scar file.\n"
 	"  extract [files...] Extract a scar archive.\n"
+	"  index --sidecar    Write a sidecar index next to the -i file, which\n"
+	"                     is used to open the archive instantly from then on.\n"
+	"  recompress         Re-encode a scar archive with a new compression.\n"
+	"  verify             Check the integrity of a scar archive.\n"
 	"  t                  Alias of tree.\n"
 	"  c <files...>       Alias of create.\n"
 	"  x [files...]       Alias of extract.\n"
 	"\n"
 	"Options:\n"
-	"  -i,--in        <file>  Input file (default: stdin)\n"
+	"  -i,--in        <file>  Input file or http(s) URL (default: stdin)\n"
 	"  -o,--out       <file>  Output file (default: stdout)\n"
 	"  -c,--comp      <gzip>  Compression algorithm (default: gzip)\n"
 	"  -l,--level     <level> Compression level (default: 6)\n"
+	"  -j,--jobs      <n>     Number of threads to use (default: CPU count)\n"
+	"     --queue-depth <n>   Number of reads to keep in flight when verifying\n"
+	"                         or recompressing a file (default: 32)\n"
+	"     --gzip-engine <e>   Library to use for gzip: zlib, or libdeflate\n"
+	"                         if scar was built with it (default: zlib)\n"
+	"     --parallel-inflate  Decompress each big gzip segment with -j threads,\n"
+	"                         for archives with few checkpoints\n"
 	"  -C,--directory <path>  Create/extract archive relative to <path>\n"
 	"                         (does not affect -i/-o)\n"
+	"     --checksums         Add a checksum of each segment to new archives\n"
+	"     --meta              Add each entry's mode, size and mtime to the footer\n"
+	"                         of new archives, for fast 'ls -l'\n"
+	"     --bloom             Add a Bloom filter of all paths to new archives\n"
+	"     --sidecar           Write a sidecar index (with 'index')\n"
 	"  -f,--force             Perform the task even if sanity checks fail\n"
-	"                         (for example, write binary data to stdout)\n"
+	"                         (for example, write binary data to stdout,\n"
+	"                         or convert a tar with bad header checksums)\n"
 	"  -h,--help              Show this help output\n";
 
+// Values for long options which don't have a short form
+enum {
+	OPT_CHECKSUMS = 256,
+	OPT_META,
+	OPT_BLOOM,
+	OPT_QUEUE_DEPTH,
+	OPT_LONG,
+	OPT_SIDECAR,
+	OPT_GZIP_ENGINE,
+	OPT_PARALLEL_INFLATE,
+};
+
 static void usage(FILE *f, char *argv0)
 {
 	fprintf(f, usageText, argv0);
@@ -58,42 +89,78 @@ static char *dupstr(const char *str)
 	return buf;
 }
 
-int main(int argc, char **argv)
-{
-	char *argv0 = argv[0];
-	int ret = 0;
-
-	struct args args;
-	scar_file_handle_init(&args.input, stdin);
-	scar_file_handle_init(&args.output, stdout);
-	scar_compression_init_gzip(&args.comp);
-	args.chdir = NULL;
-	args.level = 6;
-	args.force = false;
+static struct option opts[] = {
+	{"in",          required_argument, NULL, 'i'},
+	{"out",         required_argument, NULL, 'o'},
+	{"comp",        required_argument, NULL, 'c'},
+	{"level",       required_argument, NULL, 'l'},
+	{"jobs",        required_argument, NULL, 'j'},
+	{"directory",   required_argument, NULL, 'C'},
+	{"queue-depth", required_argument, NULL, OPT_QUEUE_DEPTH},
+	{"gzip-engine", required_argument, NULL, OPT_GZIP_ENGINE},
+	{"parallel-inflate", no_argument,  NULL, OPT_PARALLEL_INFLATE},
+	{"checksums",   no_argument,       NULL, OPT_CHECKSUMS},
+	{"meta",        no_argument,       NULL, OPT_META},
+	{"bloom",       no_argument,       NULL, OPT_BLOOM},
+	{"sidecar",     no_argument,       NULL, OPT_SIDECAR},
+	{"force",       no_argument,       NULL, 'f'},
+	{"help",        no_argument,       NULL, 'h'},
+	{0},
+};
 
-	static struct option opts[] = {
-		{"in",        required_argument, NULL, 'i'},
-		{"out",       required_argument, NULL, 'o'},
-		{"comp" ,     required_argument, NULL, 'c'},
-		{"level",     required_argument, NULL, 'l'},
-		{"directory", required_argument, NULL, 'C'},
-		{"force",     no_argument,       NULL, 'f'},
-		{"help",      no_argument,       NULL, 'h'},
-		{0},
-	};
+// The 'ls' subcommand uses '-l' for long output instead of the level
+static struct option ls_opts[] = {
+	{"in",          required_argument, NULL, 'i'},
+	{"out",         required_argument, NULL, 'o'},
+	{"comp",        required_argument, NULL, 'c'},
+	{"long",        no_argument,       NULL, OPT_LONG},
+	{"jobs",        required_argument, NULL, 'j'},
+	{"gzip-engine", required_argument, NULL, OPT_GZIP_ENGINE},
+	{"parallel-inflate", no_argument,  NULL, OPT_PARALLEL_INFLATE},
+	{"directory",   required_argument, NULL, 'C'},
+	{"force",       no_argument,       NULL, 'f'},
+	{"help",        no_argument,       NULL, 'h'},
+	{0},
+};
 
+// Parse options into 'args'.
+// Returns 0 on success, 1 if the program should exit successfully
+// (such as after '--help'), and -1 on error.
+static int parse_opts(
+	struct args *args, int argc, char **argv, char *argv0,
+	const char *optstring, const struct option *longopts, bool is_ls
+) {
 	int ch;
-	while ((ch = getopt_long(argc, argv, "i:o:c:l:C:fh", opts, NULL)) != -1) {
+	while ((ch = getopt_long(argc, argv, optstring, longopts, NULL)) != -1) {
 		switch (ch) {
 		case 'i':
 			if (streq(optarg, "-")) {
 				break;
 			}
 
-			args.input.f = fopen(optarg, "rb");
-			if (!args.input.f) {
+			if (scar_http_is_url(optarg)) {
+				free(args->input_url);
+				args->input_url = dupstr(optarg);
+				if (!args->input_url) {
+					return -1;
+				}
+				break;
+			}
+
+			if (args->input.f && args->input.f != stdin) {
+				fclose(args->input.f);
+			}
+
+			args->input.f = fopen(optarg, "rb");
+			if (!args->input.f) {
 				fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
-				goto err;
+				return -1;
+			}
+
+			free(args->input_path);
+			args->input_path = dupstr(optarg);
+			if (!args->input_path) {
+				return -1;
 			}
 			break;
 		case 'o':
@@ -101,38 +168,176 @@ int main(int argc, char **argv)
 				break;
 			}
 
-			args.output.f = fopen(optarg, "wb");
-			if (!args.output.f) {
+			if (args->output.f && args->output.f != stdout) {
+				fclose(args->output.f);
+			}
+
+			args->output.f = fopen(optarg, "wb");
+			if (!args->output.f) {
 				fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
-				goto err;
+				return -1;
 			}
 			break;
 		case 'c':
-			if (!scar_compression_init_from_name(&args.comp, optarg)) {
+			if (!scar_compression_init_from_name(&args->comp, optarg)) {
 				fprintf(stderr, "%s: Unknown compression\n", optarg);
-				goto err;
+				return -1;
 			}
 			break;
 		case 'l':
-			args.level = atoi(optarg);
+			if (is_ls) {
+				args->long_list = true;
+			} else {
+				args->level = atoi(optarg);
+			}
+			break;
+		case OPT_LONG:
+			args->long_list = true;
+			break;
+		case 'j':
+			args->jobs = atoi(optarg);
+			if (args->jobs < 1) {
+				fprintf(stderr, "%s: Invalid number of jobs\n", optarg);
+				return -1;
+			}
+			break;
+		case OPT_QUEUE_DEPTH:
+			if (atoi(optarg) < 1) {
+				fprintf(stderr, "%s: Invalid queue depth\n", optarg);
+				return -1;
+			}
+			args->queue_depth = (unsigned int)atoi(optarg);
+			break;
+		case OPT_GZIP_ENGINE:
+			if (!scar_gzip_engine_from_name(optarg, &args->gzip_engine)) {
+				fprintf(stderr, "%s: Unknown gzip engine\n", optarg);
+				return -1;
+			}
+			break;
+		case OPT_PARALLEL_INFLATE:
+			args->parallel_inflate = true;
 			break;
 		case 'C':
-			args.chdir = dupstr(optarg);
-			if (!args.chdir) {
-				goto err;
+			free(args->chdir);
+			args->chdir = dupstr(optarg);
+			if (!args->chdir) {
+				return -1;
 			}
 			break;
+		case OPT_CHECKSUMS:
+			args->writer_opts |= SCAR_WRITER_CHECKSUMS;
+			break;
+		case OPT_META:
+			args->writer_opts |= SCAR_WRITER_META;
+			break;
+		case OPT_BLOOM:
+			args->writer_opts |= SCAR_WRITER_BLOOM;
+			break;
+		case OPT_SIDECAR:
+			args->write_sidecar = true;
+			break;
 		case 'f':
-			args.force = true;
+			args->force = true;
 			break;
 		case 'h':
 			usage(stdout, argv0);
-			goto exit;
+			return 1;
 		default:
-			goto err;
+			return -1;
 		}
 	}
 
+	return 0;
+}
+
+// Map the input file's sidecar index, if it has one.
+static void map_sidecar(struct args *args)
+{
+	size_t len = strlen(args->input_path);
+	size_t suffix_len = strlen(SCAR_SIDECAR_SUFFIX);
+	char *path = malloc(len + suffix_len + 1);
+	if (!path) {
+		return;
+	}
+
+	memcpy(path, args->input_path, len);
+	memcpy(path + len, SCAR_SIDECAR_SUFFIX, suffix_len + 1);
+	args->sidecar = scar_map_file(path, &args->sidecar_len);
+	free(path);
+}
+
+struct scar_reader *args_create_reader(struct args *args)
+{
+	// A sidecar index which is stale is ignored by the reader
+	struct scar_sidecar_stamp stamp;
+	if (
+		args->input_pr && args->input_path && !args->sidecar &&
+		scar_file_stamp(args->input.f, &stamp) >= 0
+	) {
+		map_sidecar(args);
+	}
+
+	struct scar_reader *sr;
+	if (args->input_pr && args->sidecar) {
+		sr = scar_reader_create_p_sidecar(
+			args->input_pr, args->sidecar, args->sidecar_len, &stamp);
+	} else if (args->input_pr) {
+		// Read the whole footer at once,
+		// which matters most for remote archives
+		sr = scar_reader_create_p_window(
+			args->input_pr, SCAR_FOOTER_DEFAULT_WINDOW);
+	} else {
+		sr = scar_reader_create(&args->input.r, &args->input.s);
+	}
+
+	if (sr && scar_reader_set_gzip_engine(sr, args->gzip_engine) < 0) {
+		scar_reader_free(sr);
+		return NULL;
+	}
+
+	if (sr && args->parallel_inflate) {
+		scar_reader_set_parallel_inflate(sr, (unsigned int)args->jobs, 0);
+	}
+
+	return sr;
+}
+
+int main(int argc, char **argv)
+{
+	char *argv0 = argv[0];
+	int ret = 0;
+	struct scar_fd_preader input_fd;
+	struct scar_io_preader *input_http = NULL;
+
+	struct args args;
+	scar_file_handle_init(&args.input, stdin);
+	args.input_pr = NULL;
+	args.input_url = NULL;
+	args.input_path = NULL;
+	args.sidecar = NULL;
+	args.sidecar_len = 0;
+	scar_file_handle_init(&args.output, stdout);
+	scar_compression_init_gzip(&args.comp);
+	args.chdir = NULL;
+	args.level = 6;
+	args.jobs = scar_cpu_count();
+	args.queue_depth = 0;
+	args.gzip_engine = SCAR_GZIP_ZLIB;
+	args.parallel_inflate = false;
+	args.writer_opts = 0;
+	args.force = false;
+	args.long_list = false;
+	args.write_sidecar = false;
+
+	// Options before the subcommand; stop at the first non-option
+	int optret = parse_opts(
+		&args, argc, argv, argv0, "+i:o:c:l:j:C:fh", opts, false);
+	if (optret < 0) {
+		goto err;
+	} else if (optret > 0) {
+		goto exit;
+	}
+
 	argv += optind;
 	argc -= optind;
 
@@ -142,8 +347,53 @@ int main(int argc, char **argv)
 	}
 
 	const char *subcmd = argv[0];
-	argv += 1;
-	argc -= 1;
+
+	// Options after the subcommand, which may be mixed with its arguments
+	bool is_ls = streq(subcmd, "ls");
+	optind = 0;
+	if (is_ls) {
+		optret = parse_opts(
+			&args, argc, argv, argv0, "i:o:c:j:C:fhl", ls_opts, true);
+	} else {
+		optret = parse_opts(
+			&args, argc, argv, argv0, "i:o:c:l:j:C:fh", opts, false);
+	}
+	if (optret < 0) {
+		goto err;
+	} else if (optret > 0) {
+		goto exit;
+	}
+
+	argv += optind;
+	argc -= optind;
+
+	// '-c' may come before or after '--gzip-engine'
+	if (
+		scar_compression_is_gzip(&args.comp) &&
+		!scar_compression_init_gzip_engine(&args.comp, args.gzip_engine)
+	) {
+		goto err;
+	}
+
+	// Remote archives are read through a block cache, so that opening
+	// one and reading a file from it only takes a few requests.
+	// Regular files are read with pread(), so that many segments
+	// can be read at once.
+	if (args.input_url) {
+		input_http = scar_http_preader_create(args.input_url);
+		if (!input_http) {
+			fprintf(stderr, "%s: Failed to open URL\n", args.input_url);
+			goto err;
+		}
+
+		args.input_pr = scar_block_cache_create(input_http, 0, 0);
+		if (!args.input_pr) {
+			fprintf(stderr, "Failed to create block cache\n");
+			goto err;
+		}
+	} else if (scar_file_preader_init(&input_fd, args.input.f) >= 0) {
+		args.input_pr = &input_fd.pr;
+	}
 
 	if (streq(subcmd, "ls") ) {
 		ret = cmd_ls(&args, argv, argc);
@@ -157,6 +407,12 @@ int main(int argc, char **argv)
 		ret = cmd_convert(&args, argv, argc);
 	} else if (streq(subcmd, "extract") || streq(subcmd, "x")) {
 		ret = cmd_extract(&args, argv, argc);
+	} else if (streq(subcmd, "index")) {
+		ret = cmd_index(&args, argv, argc);
+	} else if (streq(subcmd, "recompress")) {
+		ret = cmd_recompress(&args, argv, argc);
+	} else if (streq(subcmd, "verify")) {
+		ret = cmd_verify(&args, argv, argc);
 	} else {
 		fprintf(stderr, "Unknown subcommand: %s\n", subcmd);
 		usage(stderr, argv0);
@@ -164,6 +420,21 @@ int main(int argc, char **argv)
 	}
 
 exit:
+	free(args.chdir);
+
+	if (input_http) {
+		if (args.input_pr) {
+			scar_block_cache_free(args.input_pr);
+		}
+		scar_http_preader_free(input_http);
+	}
+	free(args.input_url);
+	free(args.input_path);
+
+	if (args.sidecar) {
+		scar_unmap_file(args.sidecar, args.sidecar_len);
+	}
+
 	if (args.input.f && args.input.f != stdin) {
 		fclose(args.input.f);
 	}
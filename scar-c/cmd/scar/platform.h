@@ -9,6 +9,29 @@ struct scar_dir;
 
 bool scar_is_file_tty(FILE *f);
 
+int scar_cpu_count(void);
+
+/// Set up a preader which reads from the file behind 'f' with pread(),
+/// if it's a regular file and the platform supports that.
+/// Returns 0 on success, -1 if the file has to be read as a stream.
+int scar_file_preader_init(struct scar_fd_preader *fp, FILE *f);
+
+/// Get the size and mtime of the regular file behind 'f',
+/// to tell whether a sidecar index was made for it.
+/// Returns 0 on success, -1 if it's not a regular file
+/// or the platform doesn't support that.
+int scar_file_stamp(FILE *f, struct scar_sidecar_stamp *stamp);
+
+/// Map the file at 'path' into memory, read-only.
+/// Returns NULL if the file doesn't exist, can't be mapped,
+/// or the platform doesn't support that.
+void *scar_map_file(const char *path, size_t *len);
+void scar_unmap_file(void *data, size_t len);
+
+/// Get the time in seconds from some arbitrary point,
+/// suitable for measuring how long something takes.
+double scar_time_monotonic(void);
+
 struct scar_dir *scar_dir_open(const char *path);
 struct scar_dir *scar_dir_open_at(struct scar_dir *dir, const char *name);
 struct scar_dir *scar_dir_open_cwd(void);
@@ -20,12 +20,14 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <time.h>
 
 #include "../util.h"
 
@@ -82,6 +84,78 @@ bool scar_is_file_tty(FILE *f)
 	return isatty(fileno(f));
 }
 
+int scar_file_preader_init(struct scar_fd_preader *fp, FILE *f)
+{
+	struct stat st;
+	if (fstat(fileno(f), &st) < 0 || !S_ISREG(st.st_mode)) {
+		return -1;
+	}
+
+	return scar_fd_preader_init(fp, fileno(f));
+}
+
+int scar_file_stamp(FILE *f, struct scar_sidecar_stamp *stamp)
+{
+	struct stat st;
+	if (fstat(fileno(f), &st) < 0 || !S_ISREG(st.st_mode)) {
+		return -1;
+	}
+
+	stamp->size = (uint64_t)st.st_size;
+	stamp->mtime_sec = (int64_t)st.st_mtime;
+#ifdef __APPLE__
+	stamp->mtime_nsec = 0;
+#else
+	stamp->mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+#endif
+	return 0;
+}
+
+void *scar_map_file(const char *path, size_t *len)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NULL;
+	}
+
+	*len = (size_t)st.st_size;
+	return data;
+}
+
+void scar_unmap_file(void *data, size_t len)
+{
+	munmap(data, len);
+}
+
+int scar_cpu_count(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1) {
+		return 1;
+	}
+
+	return (int)n;
+}
+
+double scar_time_monotonic(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+}
+
 struct scar_dir *scar_dir_open(const char *path)
 {
 	int dirfd = open(path, O_RDONLY);
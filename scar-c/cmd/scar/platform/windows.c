@@ -2,9 +2,57 @@
 
 #include <fileapi.h>
 #include <io.h>
+#include <profileapi.h>
+#include <sysinfoapi.h>
 
 bool scar_is_file_tty(FILE *f)
 {
 	HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
 	return GetFileType(h) == FILE_TYPE_CHAR;
 }
+
+int scar_cpu_count(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	if (info.dwNumberOfProcessors < 1) {
+		return 1;
+	}
+
+	return (int)info.dwNumberOfProcessors;
+}
+
+int scar_file_preader_init(struct scar_fd_preader *fp, FILE *f)
+{
+	(void)fp;
+	(void)f;
+	return -1;
+}
+
+int scar_file_stamp(FILE *f, struct scar_sidecar_stamp *stamp)
+{
+	(void)f;
+	(void)stamp;
+	return -1;
+}
+
+void *scar_map_file(const char *path, size_t *len)
+{
+	(void)path;
+	(void)len;
+	return NULL;
+}
+
+void scar_unmap_file(void *data, size_t len)
+{
+	(void)data;
+	(void)len;
+}
+
+double scar_time_monotonic(void)
+{
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+}
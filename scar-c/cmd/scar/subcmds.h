@@ -9,5 +9,8 @@ int cmd_tree(struct args *args, char **argv, int argc);
 int cmd_create(struct args *args, char **argv, int argc);
 int cmd_convert(struct args *args, char **argv, int argc);
 int cmd_extract(struct args *args, char **argv, int argc);
+int cmd_index(struct args *args, char **argv, int argc);
+int cmd_recompress(struct args *args, char **argv, int argc);
+int cmd_verify(struct args *args, char **argv, int argc);
 
 #endif
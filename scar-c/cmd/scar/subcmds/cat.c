@@ -11,20 +11,26 @@ int cmd_cat(struct args *args, char **argv, int argc)
 	int ret = 0;
 	struct scar_reader *sr = NULL;
 	struct scar_index_iterator *it = NULL;
-	struct scar_meta meta = {0};
+	struct scar_meta_arena *arena = NULL;
 
 	if (argc == 0) {
 		fprintf(stderr, "Expected at least 1 argument\n");
 		goto err;
 	}
 
-	sr = scar_reader_create(&args->input.r, &args->input.s);
+	sr = args_create_reader(args);
 	if (!sr) {
 		fprintf(stderr, "Failed to create scar reader.\n");
 		fprintf(stderr, "Is the file a scar archive?\n");
 		goto err;
 	}
 
+	arena = scar_meta_arena_create();
+	if (!arena) {
+		fprintf(stderr, "Failed to create metadata arena\n");
+		goto err;
+	}
+
 	for (int i = 0; i < argc; ++i) {
 		struct rx *rx = rx_build(argv[i], 0);
 		if (!rx) {
@@ -48,10 +54,11 @@ int cmd_cat(struct args *args, char **argv, int argc)
 				continue;
 			}
 
-			scar_meta_destroy(&meta);
-			if (scar_reader_read_meta(
-				sr, entry.offset, entry.global, &meta) < 0
-			) { 
+			struct scar_meta meta;
+			scar_meta_arena_reset(arena);
+			if (scar_reader_read_meta_shared(
+				sr, entry.offset, entry.shared_global, &meta, arena) < 0
+			) {
 				fprintf(stderr, "Failed to read '%s'\n", entry.name);
 				continue;
 			}
@@ -71,7 +78,9 @@ int cmd_cat(struct args *args, char **argv, int argc)
 	}
 
 exit:
-	scar_meta_destroy(&meta);
+	if (arena) {
+		scar_meta_arena_free(arena);
+	}
 
 	if (it) {
 		scar_index_iterator_free(it);
@@ -9,8 +9,9 @@
 int cmd_convert(struct args *args, char **argv, int argc)
 {
 	int ret = 0;
-	struct scar_meta global = {0};
-	struct scar_meta meta = {0};
+	struct scar_meta_global *global = NULL;
+	struct scar_meta meta;
+	struct scar_meta_arena *arena = NULL;
 	struct scar_writer *sw = NULL;
 
 	if (argc > 0) {
@@ -24,16 +25,41 @@ int cmd_convert(struct args *args, char **argv, int argc)
 		goto err;
 	}
 
-	sw = scar_writer_create(&args->output.w, &args->comp, args->level);
+	sw = scar_writer_create_opts(
+		&args->output.w, &args->comp, args->level, args->writer_opts);
 	if (sw == NULL) {
 		fprintf(stderr, "Failed to create writer\n");
 		goto err;
 	}
 
-	scar_meta_init_empty(&global);
+	// Archives can have enough entries for the index not to fit in memory
+	scar_writer_set_spill_threshold(sw, SCAR_WRITER_DEFAULT_SPILL_THRESHOLD);
+
+	// Each entry's strings only live until it has been written,
+	// so the arena is reset for every entry, and its memory re-used
+	arena = scar_meta_arena_create();
+	if (!arena) {
+		fprintf(stderr, "Failed to create metadata arena\n");
+		goto err;
+	}
+
+	// Entries point at the global metadata's strings instead of copying them
+	scar_meta_init_empty(&meta);
+	global = scar_meta_global_create(&meta);
+	if (!global) {
+		fprintf(stderr, "Failed to create global metadata\n");
+		goto err;
+	}
+
+	// Header checksums are checked unless we're told not to
+	int read_opts = args->force ? SCAR_PAX_IGNORE_CHECKSUM : 0;
+
 	while (1) {
-		int r = scar_pax_read_meta(&args->input.r, &global, &meta);
+		scar_meta_arena_reset(arena);
+		int r = scar_pax_read_meta_shared_opts(
+			&args->input.r, &global, &meta, arena, read_opts);
 		if (r < 0) {
+			fprintf(stderr, "Failed to read tar entry\n");
 			goto err;
 		} else if (r == 0) {
 			break;
@@ -43,8 +69,6 @@ int cmd_convert(struct args *args, char **argv, int argc)
 			fprintf(stderr, "Failed to write SCAR entry\n");
 			goto err;
 		}
-
-		scar_meta_destroy(&meta);
 	}
 
 	if (scar_writer_finish(sw) < 0) {
@@ -57,8 +81,11 @@ exit:
 		scar_writer_free(sw);
 	}
 
-	scar_meta_destroy(&meta);
-	scar_meta_destroy(&global);
+	if (arena) {
+		scar_meta_arena_free(arena);
+	}
+
+	scar_meta_global_unref(global);
 
 	return ret;
 
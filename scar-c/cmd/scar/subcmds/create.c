@@ -180,12 +180,16 @@ int cmd_create(struct args *args, char **argv, int argc)
 		goto err;
 	}
 
-	sw = scar_writer_create(&args->output.w, &args->comp, args->level);
+	sw = scar_writer_create_opts(
+		&args->output.w, &args->comp, args->level, args->writer_opts);
 	if (sw == NULL) {
 		fprintf(stderr, "Failed to create writer\n");
 		goto err;
 	}
 
+	// Archives can have enough entries for the index not to fit in memory
+	scar_writer_set_spill_threshold(sw, SCAR_WRITER_DEFAULT_SPILL_THRESHOLD);
+
 	if (args->chdir) {
 		dir = scar_dir_open(args->chdir);
 	} else {
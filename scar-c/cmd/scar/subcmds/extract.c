@@ -33,7 +33,7 @@ int cmd_extract(struct args *args, char **argv, int argc)
 		rxc += 1;
 	}
 
-	sr = scar_reader_create(&args->input.r, &args->input.s);
+	sr = args_create_reader(args);
 	if (!sr) {
 		fprintf(stderr, "Failed to create scar reader.\n");
 		fprintf(stderr, "Is the file a scar archive?\n");
@@ -0,0 +1,108 @@
+#include "../subcmds.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <scar/scar.h>
+
+#include "../platform.h"
+#include "../util.h"
+
+int cmd_index(struct args *args, char **argv, int argc)
+{
+	int ret = 0;
+	struct scar_reader *sr = NULL;
+	char *path = NULL;
+	char *tmp_path = NULL;
+	struct scar_file_handle out;
+	out.f = NULL;
+
+	if (argc > 0) {
+		fprintf(stderr, "Unexpected argument: '%s'\n", argv[0]);
+		goto err;
+	}
+
+	if (!args->write_sidecar) {
+		fprintf(stderr, "Nothing to do; use '--sidecar' to write a sidecar.\n");
+		goto err;
+	}
+
+	struct scar_sidecar_stamp stamp;
+	if (
+		!args->input_path || !args->input_pr ||
+		scar_file_stamp(args->input.f, &stamp) < 0
+	) {
+		fprintf(stderr, "A sidecar can only be written for a regular file.\n");
+		fprintf(stderr, "Use '-i' to choose the archive.\n");
+		goto err;
+	}
+
+	// Read the archive itself, not an existing sidecar
+	sr = scar_reader_create_p(args->input_pr);
+	if (!sr) {
+		fprintf(stderr, "Failed to create scar reader.\n");
+		fprintf(stderr, "Is the file a scar archive?\n");
+		goto err;
+	}
+
+	size_t len = strlen(args->input_path);
+	path = malloc(len + strlen(SCAR_SIDECAR_SUFFIX) + 1);
+	tmp_path = malloc(len + strlen(SCAR_SIDECAR_SUFFIX ".tmp") + 1);
+	if (!path || !tmp_path) {
+		SCAR_PERROR("malloc");
+		goto err;
+	}
+
+	sprintf(path, "%s" SCAR_SIDECAR_SUFFIX, args->input_path);
+	sprintf(tmp_path, "%s" SCAR_SIDECAR_SUFFIX ".tmp", args->input_path);
+
+	// Write to a temporary file and rename it into place,
+	// so that readers never see a partial sidecar
+	FILE *f = fopen(tmp_path, "wb");
+	if (!f) {
+		SCAR_PERROR(tmp_path);
+		goto err;
+	}
+	scar_file_handle_init(&out, f);
+
+	if (scar_sidecar_write(sr, &stamp, &out.w) < 0) {
+		fprintf(stderr, "Failed to write sidecar index\n");
+		goto err_remove;
+	}
+
+	out.f = NULL;
+	if (fclose(f) != 0) {
+		SCAR_PERROR(tmp_path);
+		goto err_remove;
+	}
+
+	if (rename(tmp_path, path) < 0) {
+		SCAR_PERROR(path);
+		goto err_remove;
+	}
+
+exit:
+	if (out.f) {
+		fclose(out.f);
+	}
+
+	if (sr) {
+		scar_reader_free(sr);
+	}
+
+	free(path);
+	free(tmp_path);
+	return ret;
+
+err_remove:
+	if (out.f) {
+		fclose(out.f);
+		out.f = NULL;
+	}
+	remove(tmp_path);
+
+err:
+	ret = 1;
+	goto exit;
+}
@@ -3,13 +3,110 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <scar/scar.h>
 
 #include "../rx.h"
 #include "../util.h"
 
-static int do_print_roots(FILE *out, struct scar_reader *sr)
+// The file type character used by 'ls -l'
+static char filetype_char(enum scar_meta_filetype ft)
+{
+	switch (ft) {
+	case SCAR_FT_UNKNOWN:
+		return '?';
+	case SCAR_FT_FILE:
+		return '-';
+	case SCAR_FT_HARDLINK:
+		return 'h';
+	case SCAR_FT_SYMLINK:
+		return 'l';
+	case SCAR_FT_CHARDEV:
+		return 'c';
+	case SCAR_FT_BLOCKDEV:
+		return 'b';
+	case SCAR_FT_DIRECTORY:
+		return 'd';
+	case SCAR_FT_FIFO:
+		return 'p';
+	}
+
+	return '?';
+}
+
+// Print an entry in the long format: mode, size, mtime and name.
+// Archives written with '--meta' have all of that in the index,
+// other archives need to have the entry's header read.
+static int print_long_entry(
+	FILE *out, struct scar_reader *sr, struct scar_index_entry *entry
+) {
+	uint32_t mode = entry->mode;
+	uint64_t size = entry->size;
+	double mtime = entry->mtime;
+
+	if (
+		!SCAR_META_IS_UINT(mode) && !SCAR_META_IS_UINT(size) &&
+		!SCAR_META_IS_FLOAT(mtime)
+	) {
+		struct scar_meta meta;
+		if (scar_reader_read_meta(sr, entry->offset, entry->global, &meta) < 0) {
+			fprintf(stderr, "%s: Failed to read metadata\n", entry->name);
+			return -1;
+		}
+
+		mode = meta.mode;
+		size = meta.size;
+		mtime = meta.mtime;
+		scar_meta_destroy(&meta);
+	}
+
+	char modestr[11];
+	modestr[0] = filetype_char(entry->ft);
+
+	const char *rwx = "rwxrwxrwx";
+	for (int i = 0; i < 9; ++i) {
+		if (SCAR_META_IS_UINT(mode) && (mode & (0400u >> i))) {
+			modestr[i + 1] = rwx[i];
+		} else {
+			modestr[i + 1] = '-';
+		}
+	}
+	modestr[10] = '\0';
+
+	char sizestr[32];
+	if (SCAR_META_IS_UINT(size)) {
+		snprintf(sizestr, sizeof(sizestr), "%llu", (unsigned long long)size);
+	} else {
+		snprintf(sizestr, sizeof(sizestr), "-");
+	}
+
+	char timestr[32] = "-";
+	if (SCAR_META_IS_FLOAT(mtime)) {
+		time_t t = (time_t)mtime;
+		struct tm *tm = localtime(&t);
+		if (tm) {
+			strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M", tm);
+		}
+	}
+
+	fprintf(out, "%s %10s %16s %s\n", modestr, sizestr, timestr, entry->name);
+	return 0;
+}
+
+static int print_entry(
+	FILE *out, struct scar_reader *sr, struct scar_index_entry *entry,
+	bool long_list
+) {
+	if (long_list) {
+		return print_long_entry(out, sr, entry);
+	}
+
+	fprintf(out, "%s\n", entry->name);
+	return 0;
+}
+
+static int do_print_roots(FILE *out, struct scar_reader *sr, bool long_list)
 {
 	int ret = 0;
 	struct scar_index_iterator *it = NULL;
@@ -37,10 +134,17 @@ static int do_print_roots(FILE *out, struct scar_reader *sr)
 			memcpy(new_prev_root, entry.name, prev_root_len + 1);
 			prev_root = new_prev_root;
 
-			fprintf(out, "%s\n", entry.name);
+			if (print_entry(out, sr, &entry, long_list) < 0) {
+				goto err;
+			}
 		}
 	}
 
+	if (ret < 0) {
+		fprintf(stderr, "Failed to iterate index\n");
+		goto err;
+	}
+
 exit:
 	if (prev_root) {
 		free(prev_root);
@@ -61,7 +165,8 @@ static int do_print_matching(
 	FILE *out,
 	struct scar_reader *sr,
 	int patternc,
-	char **patternv
+	char **patternv,
+	bool long_list
 ) {
 	int ret = 0;
 	struct scar_index_iterator *it = NULL;
@@ -85,7 +190,10 @@ static int do_print_matching(
 				continue;
 			}
 
-			fprintf(out, "%s\n", entry.name);
+			if (print_entry(out, sr, &entry, long_list) < 0) {
+				rx_free(rx);
+				goto err;
+			}
 		}
 
 		rx_free(rx);
@@ -113,7 +221,7 @@ int cmd_ls(struct args *args, char **argv, int argc)
 	int ret = 0;
 	struct scar_reader *sr = NULL;
 
-	sr = scar_reader_create(&args->input.r, &args->input.s);
+	sr = args_create_reader(args);
 	if (!sr) {
 		fprintf(stderr, "Failed to create scar reader.\n");
 		fprintf(stderr, "Is the file a scar archive?\n");
@@ -121,9 +229,10 @@ int cmd_ls(struct args *args, char **argv, int argc)
 	}
 
 	if (argc == 0) {
-		ret = do_print_roots(args->output.f, sr);
+		ret = do_print_roots(args->output.f, sr, args->long_list);
 	} else {
-		ret = do_print_matching(args->output.f, sr, argc, argv);
+		ret = do_print_matching(
+			args->output.f, sr, argc, argv, args->long_list);
 	}
 
 exit:
@@ -0,0 +1,60 @@
+#include "../subcmds.h"
+
+#include <stdio.h>
+
+#include <scar/scar.h>
+
+#include "../platform.h"
+
+int cmd_recompress(struct args *args, char **argv, int argc)
+{
+	int ret = 0;
+	struct scar_reader *sr = NULL;
+	struct scar_pool *pool = NULL;
+
+	if (argc > 0) {
+		fprintf(stderr, "Unexpected argument: '%s'\n", argv[0]);
+		goto err;
+	}
+
+	if (scar_is_file_tty(args->output.f) && !args->force) {
+		fprintf(stderr, "Refusing to write to a TTY.\n");
+		fprintf(stderr, "Re-run with '--force' to ignore this check.\n");
+		goto err;
+	}
+
+	sr = args_create_reader(args);
+	if (!sr) {
+		fprintf(stderr, "Failed to create scar reader.\n");
+		fprintf(stderr, "Is the file a scar archive?\n");
+		goto err;
+	}
+
+	scar_reader_set_queue_depth(sr, args->queue_depth);
+
+	pool = scar_pool_create(args->jobs);
+	if (!pool) {
+		fprintf(stderr, "Failed to create thread pool\n");
+		goto err;
+	}
+
+	if (scar_recompress(sr, &args->output.w, &args->comp, args->level, pool) < 0) {
+		fprintf(stderr, "Failed to recompress SCAR archive\n");
+		goto err;
+	}
+
+exit:
+	if (pool) {
+		scar_pool_free(pool);
+	}
+
+	if (sr) {
+		scar_reader_free(sr);
+	}
+
+	return ret;
+
+err:
+	ret = 1;
+	goto exit;
+}
@@ -15,7 +15,7 @@ int cmd_tree(struct args *args, char **argv, int argc)
 		goto err;
 	}
 
-	sr = scar_reader_create(&args->input.r, &args->input.s);
+	sr = args_create_reader(args);
 	if (!sr) {
 		fprintf(stderr, "Failed to create scar reader.\n");
 		fprintf(stderr, "Is the file a scar archive?\n");
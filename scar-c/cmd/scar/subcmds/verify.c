@@ -0,0 +1,85 @@
+#include "../subcmds.h"
+
+#include <stdio.h>
+
+#include <scar/scar.h>
+
+#include "../platform.h"
+
+int cmd_verify(struct args *args, char **argv, int argc)
+{
+	int ret = 0;
+	struct scar_reader *sr = NULL;
+	struct scar_pool *pool = NULL;
+
+	if (argc > 0) {
+		fprintf(stderr, "Unexpected argument: '%s'\n", argv[0]);
+		goto err;
+	}
+
+	sr = args_create_reader(args);
+	if (!sr) {
+		fprintf(stderr, "Failed to create scar reader.\n");
+		fprintf(stderr, "Is the file a scar archive?\n");
+		goto err;
+	}
+
+	scar_reader_set_queue_depth(sr, args->queue_depth);
+
+	pool = scar_pool_create(args->jobs);
+	if (!pool) {
+		fprintf(stderr, "Failed to create thread pool\n");
+		goto err;
+	}
+
+	double start = scar_time_monotonic();
+	struct scar_verify_result result;
+	int r = scar_verify(sr, pool, &result);
+	double elapsed = scar_time_monotonic() - start;
+
+	if (r < 0) {
+		if (result.bad_offset >= 0) {
+			fprintf(
+				stderr, "Archive is corrupt at offset %lld: %s\n",
+				result.bad_offset, result.message);
+		} else {
+			fprintf(stderr, "Archive is corrupt: %s\n", result.message);
+		}
+		goto err;
+	}
+
+	double mib = (double)result.uncompressed_size / (1024.0 * 1024.0);
+	double cmib = (double)result.compressed_size / (1024.0 * 1024.0);
+	if (elapsed <= 0) {
+		elapsed = 1e-9;
+	}
+
+	fprintf(
+		args->output.f, "OK: %zu entries in %zu segments\n",
+		result.entry_count, result.segment_count);
+	if (result.checksummed_segment_count > 0) {
+		fprintf(
+			args->output.f, "%zu segments matched their checksums\n",
+			result.checksummed_segment_count);
+	}
+	fprintf(
+		args->output.f,
+		"Checked %.1f MiB (%.1f MiB compressed) in %.2fs: "
+		"%.1f MiB/s (%.1f MiB/s compressed)\n",
+		mib, cmib, elapsed, mib / elapsed, cmib / elapsed);
+
+exit:
+	if (pool) {
+		scar_pool_free(pool);
+	}
+
+	if (sr) {
+		scar_reader_free(sr);
+	}
+
+	return ret;
+
+err:
+	ret = 1;
+	goto exit;
+}
@@ -0,0 +1,50 @@
+#ifndef SCAR_BLOCK_CACHE_H
+#define SCAR_BLOCK_CACHE_H
+
+#include <stddef.h>
+
+#include "io.h"
+
+/// The default size of a scar_block_cache block.
+#define SCAR_BLOCK_CACHE_DEFAULT_BLOCK_SIZE (64 * 1024)
+
+/// The default number of blocks a scar_block_cache holds.
+#define SCAR_BLOCK_CACHE_DEFAULT_BLOCKS 256
+
+/// When a read reaches the last block of the data, this many blocks
+/// at the end are fetched at once, since that's where the tail,
+/// the checkpoints and the index of an archive are.
+#define SCAR_BLOCK_CACHE_TAIL_BLOCKS 4
+
+/// Statistics about how a scar_block_cache has been used.
+struct scar_block_cache_stats {
+	/// The number of blocks which were found in the cache,
+	/// and the number which had to be read.
+	size_t hits;
+	size_t misses;
+
+	/// The number of reads from the underlying preader.
+	size_t inner_reads;
+};
+
+/// Create a preader which reads through 'inner', and keeps up to
+/// 'nblocks' aligned blocks of 'block_size' bytes in memory,
+/// evicting the least recently used block when it's full.
+/// Runs of adjacent blocks which are missing from the cache
+/// are fetched with one read from 'inner'.
+/// This is meant for preaders where every read is expensive,
+/// such as 'scar_http_preader_create'.
+/// A 'block_size' or 'nblocks' of 0 means the default.
+/// The cache can be used from several threads at once
+/// if 'inner' can be. 'inner' must outlive the cache.
+struct scar_io_preader *scar_block_cache_create(
+	struct scar_io_preader *inner, size_t block_size, size_t nblocks);
+
+/// Get the cache's statistics.
+void scar_block_cache_get_stats(
+	struct scar_io_preader *pr, struct scar_block_cache_stats *stats);
+
+/// Free a preader created by 'scar_block_cache_create'.
+void scar_block_cache_free(struct scar_io_preader *pr);
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 
 #include "io.h"
+#include "types.h"
 
 #define SCAR_COMPRESSOR_NAMES \
 	X(plain) \
@@ -20,6 +21,38 @@ struct scar_decompressor {
 	struct scar_io_reader r;
 };
 
+/// A good distance between access points: with a 32 KiB window each,
+/// they take up about 3% of the data they cover.
+#define SCAR_ACCESS_POINT_DEFAULT_SPAN (1024 * 1024)
+
+/// An access point is a place in the middle of a compressed stream
+/// where decompression can pick up, like in zlib's zran example.
+struct scar_access_point {
+	/// The compressed and uncompressed offsets of the point.
+	/// A decompressor reports them relative to where it started.
+	scar_offset in;
+	scar_offset out;
+
+	/// The number of bits of the byte before 'in'
+	/// which belong to the data after the point.
+	int bits;
+
+	/// The uncompressed data leading up to the point,
+	/// which the data after it may refer back to.
+	const unsigned char *window;
+	size_t window_len;
+};
+
+/// Receives the access points a decompressor passes
+/// while it's decompressing.
+struct scar_access_point_sink {
+	/// The minimum amount of uncompressed data between access points.
+	scar_offset span;
+	void (*add)(
+		struct scar_access_point_sink *sink,
+		const struct scar_access_point *ap);
+};
+
 struct scar_compression {
 	struct scar_compressor *(*create_compressor)(struct scar_io_writer *w, int level);
 	void (*destroy_compressor)(struct scar_compressor *c);
@@ -27,6 +60,35 @@ struct scar_compression {
 	struct scar_decompressor *(*create_decompressor)(struct scar_io_reader *r);
 	void (*destroy_decompressor)(struct scar_decompressor *d);
 
+	/// Create a decompressor which starts at access point 'ap',
+	/// if it's not NULL, and which reports access points to 'sink',
+	/// if it's not NULL. When starting at an access point, 'r' must be
+	/// positioned at 'ap->in', or one byte before it if 'ap->bits' isn't 0.
+	/// NULL if the compression doesn't support access points.
+	struct scar_decompressor *(*create_decompressor_at)(
+		struct scar_io_reader *r, const struct scar_access_point *ap,
+		struct scar_access_point_sink *sink);
+
+	/// Start a new stream with a compressor which has been used before,
+	/// writing to 'w', at the level it was created with.
+	/// This is cheaper than destroying it and creating a new one.
+	/// Returns 0 on success, or -1 on error, after which the compressor
+	/// can only be destroyed. NULL if the compression can't reset
+	/// its compressors.
+	int (*reset_compressor)(struct scar_compressor *c, struct scar_io_writer *w);
+
+	/// Start over with a decompressor which has been used before,
+	/// as if it was created anew by 'create_decompressor_at'
+	/// with the same arguments. 'ap' and 'sink' must be NULL
+	/// if the compression doesn't support access points.
+	/// Returns 0 on success, or -1 on error, after which the decompressor
+	/// can only be destroyed. NULL if the compression can't reset
+	/// its decompressors.
+	int (*reset_decompressor)(
+		struct scar_decompressor *d, struct scar_io_reader *r,
+		const struct scar_access_point *ap,
+		struct scar_access_point_sink *sink);
+
 	const unsigned char *magic;
 	size_t magic_len;
 	const unsigned char *eof_marker;
@@ -36,6 +98,40 @@ struct scar_compression {
 void scar_compression_init_gzip(struct scar_compression *comp);
 void scar_compression_init_plain(struct scar_compression *comp);
 
+/// The libraries the gzip compression can be built on.
+/// They all read and write ordinary gzip members, so an archive written
+/// with one engine can be read with any other, or with gzip itself.
+enum scar_gzip_engine {
+	/// zlib, which is always available, and streams everything.
+	SCAR_GZIP_ZLIB,
+
+	/// libdeflate, if scar was built with it. It compresses each member
+	/// in one go, which means checkpoint segments are kept in memory
+	/// until they're done. It decompresses a member in one go
+	/// if the reader can lend out all of it, which is the case when
+	/// verifying or recompressing, and falls back to zlib otherwise.
+	/// Decompressors which record access points always use zlib.
+	SCAR_GZIP_LIBDEFLATE,
+};
+
+/// Like 'scar_compression_init_gzip', but with a specific engine.
+/// Returns false if scar wasn't built with it.
+bool scar_compression_init_gzip_engine(
+	struct scar_compression *comp, enum scar_gzip_engine engine);
+
+/// Look up a gzip engine by name ("zlib" or "libdeflate").
+/// Returns false if there's no such engine, or if scar wasn't built with it.
+bool scar_gzip_engine_from_name(
+	const char *name, enum scar_gzip_engine *engine);
+
+/// Check whether 'comp' is gzip, with any engine.
+bool scar_compression_is_gzip(const struct scar_compression *comp);
+
+/// Check whether 'comp' is the plain "compression", which stores data
+/// as it is, so that the data can be copied without a compressor
+/// or decompressor in between.
+bool scar_compression_is_plain(const struct scar_compression *comp);
+
 /// Initialize compression from human readable name.
 /// Returns true if one was found, false otherwise.
 bool scar_compression_init_from_name(
@@ -0,0 +1,13 @@
+#ifndef SCAR_CRC32C_H
+#define SCAR_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Update a CRC-32C (Castagnoli) checksum with the bytes in 'buf'.
+/// Start with a 'crc' of 0, and pass the result of one call
+/// as the 'crc' of the next call to checksum data in chunks.
+/// Uses the SSE 4.2 crc32 instruction when the CPU supports it.
+uint32_t scar_crc32c(uint32_t crc, const void *buf, size_t len);
+
+#endif
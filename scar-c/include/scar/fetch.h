@@ -0,0 +1,59 @@
+#ifndef SCAR_FETCH_H
+#define SCAR_FETCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "io.h"
+#include "types.h"
+
+/// The default number of reads a scar_fetcher keeps in flight.
+#define SCAR_FETCH_DEFAULT_DEPTH 32
+
+/// The scar_fetcher is an opaque type which reads runs of bytes from
+/// a preader, with up to a fixed number of reads in flight at once.
+/// On Linux, when libscar is built with io_uring support and the preader
+/// is a 'scar_fd_preader', the reads are submitted to the kernel through
+/// an io_uring, and complete in whatever order the device finishes them.
+/// Otherwise, each read is done synchronously when it's submitted.
+/// A fetcher must only be used from one thread at a time.
+struct scar_fetcher;
+
+/// Create a fetcher which keeps up to 'depth' reads from 'pr' in flight.
+/// A 'depth' of 0 means SCAR_FETCH_DEFAULT_DEPTH.
+/// If the io_uring can't be set up (for example because the kernel
+/// is too old or doesn't allow it), the fetcher silently falls back
+/// to synchronous reads.
+struct scar_fetcher *scar_fetcher_create(
+	struct scar_io_preader *pr, unsigned int depth);
+
+/// Get the number of reads the fetcher can have in flight.
+unsigned int scar_fetcher_depth(struct scar_fetcher *f);
+
+/// Check whether the fetcher's reads are asynchronous.
+bool scar_fetcher_is_async(struct scar_fetcher *f);
+
+/// Get the number of reads which have been submitted,
+/// but not yet returned by 'scar_fetcher_wait'.
+unsigned int scar_fetcher_pending(struct scar_fetcher *f);
+
+/// Start reading 'len' bytes at 'offset' into 'buf'.
+/// 'buf' must stay valid until the read is returned by 'scar_fetcher_wait'.
+/// 'tag' is returned along with the read when it completes.
+/// Fails if 'depth' reads are already pending.
+/// Returns 0 on success, -1 on error.
+int scar_fetcher_submit(
+	struct scar_fetcher *f, scar_offset offset, void *buf, size_t len,
+	void *tag);
+
+/// Wait until one of the pending reads has completed,
+/// and set '*tag' to the tag it was submitted with.
+/// Reads which hit the end of the file before 'len' bytes are errors.
+/// Returns 0 if the read succeeded, and -1 if it failed or if there
+/// are no pending reads; '*tag' is set to NULL in the latter case.
+int scar_fetcher_wait(struct scar_fetcher *f, void **tag);
+
+/// Wait for any reads which are still in flight, then free the fetcher.
+void scar_fetcher_free(struct scar_fetcher *f);
+
+#endif
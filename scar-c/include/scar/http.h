@@ -0,0 +1,31 @@
+#ifndef SCAR_HTTP_H
+#define SCAR_HTTP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "io.h"
+
+/// Check whether 'str' looks like a URL which
+/// 'scar_http_preader_create' can read from.
+bool scar_http_is_url(const char *str);
+
+/// Create a preader which reads byte ranges of the file at 'url'
+/// with HTTP 'Range' requests, one request per read.
+/// The size of the file is found with a HEAD request the first time
+/// it's needed. Servers which ignore 'Range' work, but every read
+/// then transfers the file from the start.
+/// Every request is a round trip, so this is normally wrapped in
+/// a 'scar_block_cache_create'.
+/// The preader can be used from several threads at once,
+/// but only does one request at a time.
+/// Returns NULL on error, or if libscar was built without libcurl.
+struct scar_io_preader *scar_http_preader_create(const char *url);
+
+/// Get the number of HTTP requests which have been made so far.
+size_t scar_http_preader_request_count(struct scar_io_preader *pr);
+
+/// Free a preader created by 'scar_http_preader_create'.
+void scar_http_preader_free(struct scar_io_preader *pr);
+
+#endif
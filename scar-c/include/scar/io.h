@@ -10,12 +10,34 @@ enum scar_io_whence {
 };
 
 /// Abstract stream reader style type which allows reading data.
+/// The library lends from a reader's buffer whenever 'fill_buf' isn't NULL,
+/// so a reader which only implements 'read' must be set up with
+/// 'scar_io_reader_init', or be zero-initialised, like with a designated
+/// initializer.
 struct scar_io_reader {
 	/// Read up to 'len' bytes into 'buf'.
 	/// Return the number of bytes read, or -1 on error.
 	scar_ssize (*read)(struct scar_io_reader *r, void *buf, size_t len);
+
+	/// Optional, NULL for readers without a buffer of their own.
+	/// Point '*buf' at the reader's buffered data, filling the buffer first
+	/// if it's empty, so that it can be used without copying it out.
+	/// The data stays valid until the next call to 'read' or 'fill_buf'.
+	/// Return the number of bytes available (0 at the end of the stream),
+	/// or -1 on error.
+	scar_ssize (*fill_buf)(struct scar_io_reader *r, const void **buf);
+
+	/// Optional, set if 'fill_buf' is.
+	/// Mark the first 'len' bytes of what 'fill_buf' returned as read.
+	void (*consume)(struct scar_io_reader *r, size_t len);
 };
 
+/// Set up a reader which only implements 'read',
+/// leaving 'fill_buf' and 'consume' NULL.
+void scar_io_reader_init(
+	struct scar_io_reader *r,
+	scar_ssize (*read)(struct scar_io_reader *r, void *buf, size_t len));
+
 /// Abstract stream writer style type which allows writing data.
 struct scar_io_writer {
 	/// Write up to 'len' bytes from 'buf'.
@@ -39,4 +61,18 @@ struct scar_io_seeker {
 	scar_offset (*tell)(struct scar_io_seeker *s);
 };
 
+/// Abstract positional reader style type which allows reading data
+/// from any offset. Unlike a reader and seeker pair, a preader has no
+/// position of its own, so it can be shared by many users at once.
+struct scar_io_preader {
+	/// Read up to 'len' bytes from 'offset' into 'buf'.
+	/// Return the number of bytes read (0 at the end of the data),
+	/// or -1 on error.
+	scar_ssize (*read_at)(
+		struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len);
+
+	/// Return the total size of the data, or -1 on error.
+	scar_offset (*size)(struct scar_io_preader *pr);
+};
+
 #endif
@@ -23,7 +23,34 @@ scar_ssize scar_io_vprintf(struct scar_io_writer *w, const char *fmt, va_list ap
 /// Calls the write method with 'strlen(str)' as the size.
 scar_ssize scar_io_puts(struct scar_io_writer *w, const char *str);
 
-/// Write everything from one reader to a writer.
+/// The most characters scar_format_u64, scar_format_i64
+/// or scar_format_octal can write.
+#define SCAR_FORMAT_MAX 24
+
+/// Write 'num' in decimal to 'buf', which must have room
+/// for SCAR_FORMAT_MAX characters. No NUL terminator is written.
+/// These are meant for hot paths where printf is too slow:
+/// they never allocate, and don't look at the locale.
+/// Returns the number of characters written.
+size_t scar_format_u64(char *buf, uint64_t num);
+size_t scar_format_i64(char *buf, int64_t num);
+
+/// Write 'num' in octal to 'buf', like scar_format_u64.
+size_t scar_format_octal(char *buf, uint64_t num);
+
+/// How much data bulk copies move per read and write call.
+/// Big enough that the per-call overhead of each layer of readers
+/// and writers disappears next to the cost of the data itself.
+#define SCAR_IO_CHUNK_SIZE (256 * 1024)
+
+/// Read until 'buf' is full or the reader runs out of data.
+/// Returns the number of bytes read, which is less than 'len'
+/// only at the end of the data, or -1 on error.
+scar_ssize scar_io_read_full(struct scar_io_reader *r, void *buf, size_t len);
+
+/// Write everything from one reader to a writer,
+/// SCAR_IO_CHUNK_SIZE bytes at a time.
+/// Returns the number of bytes copied, or -1 on error.
 scar_ssize scar_io_copy(struct scar_io_reader *r, struct scar_io_writer *w);
 
 /// A wrapper around a FILE* which implements reader, writer and seeker.
@@ -41,6 +68,21 @@ int scar_file_handle_seek(
 	struct scar_io_seeker *s, scar_offset offset, enum scar_io_whence whence);
 scar_offset scar_file_handle_tell(struct scar_io_seeker *s);
 
+/// Copy 'len' bytes of the file 'fd', starting at 'offset', to 'w'
+/// in the kernel, without going through user space, if 'w' is
+/// a 'scar_file_handle' and the platform supports that for these files.
+/// Returns 1 if it was copied, 0 if nothing was copied because it has to
+/// be copied some other way, and -1 on error, including when 'fd'
+/// runs out of data.
+int scar_io_copy_fd(
+	int fd, scar_offset offset, uint64_t len, struct scar_io_writer *w);
+
+/// Like scar_io_copy_fd, but copy the next 'len' bytes of 'r',
+/// if it's a 'scar_file_handle' for a file which has a position,
+/// and move 'r' past them.
+int scar_file_handle_copy_to(
+	struct scar_io_reader *r, struct scar_io_writer *w, uint64_t len);
+
 /// An in-memory buffer which can be read from as a reader
 /// and seeked as a seeker.
 struct scar_mem_reader {
@@ -55,10 +97,71 @@ void scar_mem_reader_init(
 	struct scar_mem_reader *mr, const void *buf, size_t len);
 scar_ssize scar_mem_reader_read(
 	struct scar_io_reader *r, void *buf, size_t len);
+scar_ssize scar_mem_reader_fill_buf(
+	struct scar_io_reader *r, const void **buf);
+void scar_mem_reader_consume(struct scar_io_reader *r, size_t len);
 int scar_mem_reader_seek(
 	struct scar_io_seeker *s, scar_offset offset, enum scar_io_whence whence);
 scar_offset scar_mem_reader_tell(struct scar_io_seeker *s);
 
+/// An in-memory buffer which can be read from as a preader.
+struct scar_mem_preader {
+	struct scar_io_preader pr;
+	const void *buf;
+	size_t len;
+};
+
+void scar_mem_preader_init(
+	struct scar_mem_preader *mp, const void *buf, size_t len);
+scar_ssize scar_mem_preader_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len);
+scar_offset scar_mem_preader_size(struct scar_io_preader *pr);
+
+/// A file descriptor which can be read from as a preader, using pread(),
+/// so the file descriptor's offset is never used or changed.
+/// It can be used from several threads at once.
+/// Not supported on Windows.
+struct scar_fd_preader {
+	struct scar_io_preader pr;
+	int fd;
+};
+
+/// Returns 0 on success, -1 on error.
+int scar_fd_preader_init(struct scar_fd_preader *fp, int fd);
+scar_ssize scar_fd_preader_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len);
+scar_offset scar_fd_preader_size(struct scar_io_preader *pr);
+
+/// A memory-mapped file which can be read from as a preader.
+/// It can be used from several threads at once.
+/// Not supported on Windows.
+struct scar_mmap_preader {
+	struct scar_mem_preader mp;
+};
+
+/// Map the whole file 'fd' into memory.
+/// The file descriptor may be closed afterwards.
+/// Returns 0 on success, -1 on error.
+int scar_mmap_preader_init(struct scar_mmap_preader *mm, int fd);
+void scar_mmap_preader_destroy(struct scar_mmap_preader *mm);
+
+/// A reader and seeker on top of a preader, with its own position.
+/// Several of these can share one preader without affecting each other.
+struct scar_preader_stream {
+	struct scar_io_reader r;
+	struct scar_io_seeker s;
+	struct scar_io_preader *pr;
+	scar_offset pos;
+};
+
+void scar_preader_stream_init(
+	struct scar_preader_stream *ps, struct scar_io_preader *pr);
+scar_ssize scar_preader_stream_read(
+	struct scar_io_reader *r, void *buf, size_t len);
+int scar_preader_stream_seek(
+	struct scar_io_seeker *s, scar_offset offset, enum scar_io_whence whence);
+scar_offset scar_preader_stream_tell(struct scar_io_seeker *s);
+
 /// An in-memory buffer which can be written to as a writer.
 struct scar_mem_writer {
 	struct scar_io_writer w;
@@ -73,6 +176,33 @@ scar_ssize scar_mem_writer_write(
 int scar_mem_writer_put(struct scar_mem_writer *mw, unsigned char ch);
 void *scar_mem_writer_get_buffer(struct scar_mem_writer *mw, size_t len);
 
+/// A writer which keeps what's written to it in memory until it passes
+/// 'threshold' bytes, and moves it all to an anonymous temporary file then,
+/// so that memory use stays flat no matter how much is written.
+/// A 'threshold' of 0 means it never spills.
+struct scar_spill_writer {
+	struct scar_io_writer w;
+	struct scar_mem_writer mem;
+	FILE *f;
+	size_t threshold;
+	scar_offset len;
+};
+
+void scar_spill_writer_init(struct scar_spill_writer *sw, size_t threshold);
+scar_ssize scar_spill_writer_write(
+	struct scar_io_writer *w, const void *buf, size_t len);
+
+/// Write everything which has been written to 'sw' to 'w'.
+/// If it has spilled, and 'w' is a 'scar_file_handle' for a regular file,
+/// the data is copied from file to file in the kernel where the platform
+/// supports that, without going through user space.
+/// Returns 0 on success, -1 on error.
+int scar_spill_writer_copy_to(
+	struct scar_spill_writer *sw, struct scar_io_writer *w);
+
+/// Free the memory and close the temporary file.
+void scar_spill_writer_destroy(struct scar_spill_writer *sw);
+
 /// A writer wrapper which counts the number of bytes written.
 struct scar_counting_writer {
 	struct scar_io_writer w;
@@ -85,6 +215,18 @@ void scar_counting_writer_init(
 scar_ssize scar_counting_writer_write(
 	struct scar_io_writer *w, const void *buf, size_t len);
 
+/// A writer wrapper which keeps a CRC-32C of the bytes written.
+struct scar_crc32c_writer {
+	struct scar_io_writer w;
+	struct scar_io_writer *backing_w;
+	uint32_t crc;
+};
+
+void scar_crc32c_writer_init(
+	struct scar_crc32c_writer *cw, struct scar_io_writer *w);
+scar_ssize scar_crc32c_writer_write(
+	struct scar_io_writer *w, const void *buf, size_t len);
+
 /// A reader wrapper which counts the number of bytes read.
 struct scar_counting_reader {
 	struct scar_io_reader r;
@@ -96,6 +238,9 @@ void scar_counting_reader_init(
 	struct scar_counting_reader *cr, struct scar_io_reader *r);
 scar_ssize scar_counting_reader_read(
 	struct scar_io_reader *r, void *buf, size_t len);
+scar_ssize scar_counting_reader_fill_buf(
+	struct scar_io_reader *r, const void **buf);
+void scar_counting_reader_consume(struct scar_io_reader *r, size_t len);
 
 /// A reader wrapper which limits the number of bytes read.
 struct scar_limited_reader {
@@ -109,16 +254,25 @@ void scar_limited_reader_init(
 	scar_offset limit);
 scar_ssize scar_limited_reader_read(
 	struct scar_io_reader *r, void *buf, size_t len);
+scar_ssize scar_limited_reader_fill_buf(
+	struct scar_io_reader *r, const void **buf);
+void scar_limited_reader_consume(struct scar_io_reader *r, size_t len);
 
-/// A wrapper around a reader which reads 512-byte blocks
+/// A wrapper around a reader for parsing it a byte at a time.
+/// 'next' is the next byte, or EOF at the end or after an error.
+/// If the backing reader can lend out its buffer, the bytes are parsed
+/// straight out of that, otherwise they're read 512 bytes at a time.
 struct scar_block_reader {
 	struct scar_io_reader r;
 	struct scar_io_reader *backing_r;
 	int next;
 	int error;
 
-	int index;
-	int bufcap;
+	// The buffered data which 'next' came from, 'index' bytes into it:
+	// either borrowed from 'backing_r', or 'block'
+	const unsigned char *buf;
+	size_t index;
+	size_t len;
 	unsigned char block[512];
 };
 
@@ -0,0 +1,66 @@
+#ifndef SCAR_META_ARENA_H
+#define SCAR_META_ARENA_H
+
+#include <stddef.h>
+
+struct scar_meta;
+struct scar_meta_global;
+
+/// The scar_meta_arena is an opaque type which owns the strings
+/// of any number of scar_meta structs.
+/// Strings are bump-allocated from big chunks, and the strings which
+/// repeat in almost every header (uname, gname, charset, hdrcharset)
+/// are interned, so that each distinct value is only stored once.
+///
+/// A scar_meta whose strings live in an arena must not be passed to
+/// 'scar_meta_destroy'; its strings go away when the arena is reset
+/// or freed. Resetting the arena between entries keeps its memory,
+/// so that reading or copying metadata doesn't allocate
+/// once the arena has grown big enough.
+struct scar_meta_arena;
+
+/// Create an empty arena.
+/// Returns NULL on error.
+struct scar_meta_arena *scar_meta_arena_create(void);
+
+/// Allocate 'size' bytes from the arena.
+/// Returns NULL on error.
+char *scar_meta_arena_alloc(struct scar_meta_arena *arena, size_t size);
+
+/// Copy the 'len' first bytes of 'str' into the arena,
+/// followed by a NUL terminator.
+/// Returns NULL on error.
+char *scar_meta_arena_strndup(
+	struct scar_meta_arena *arena, const char *str, size_t len);
+
+/// Get an interned string equal to the 'len' bytes of 'str'.
+/// Equal strings give the same pointer until the arena is reset.
+/// If 'str' is the arena's most recent allocation, it's used
+/// as the interned string if there's none yet, and given back
+/// to the arena if there is. Otherwise, the string is copied.
+/// Returns NULL on error.
+char *scar_meta_arena_intern(
+	struct scar_meta_arena *arena, const char *str, size_t len);
+
+/// Copy a scar_meta to 'dest' from 'src', with the strings in the arena.
+/// Returns 0 on success, -1 on error.
+int scar_meta_copy_arena(
+	struct scar_meta *dest, const struct scar_meta *src,
+	struct scar_meta_arena *arena);
+
+/// Keep a reference to 'global' until the arena is reset or freed,
+/// so that metadata in the arena can point at its strings
+/// instead of copying them.
+/// Returns 0 on success, -1 on error.
+int scar_meta_arena_hold(
+	struct scar_meta_arena *arena, struct scar_meta_global *global);
+
+/// Forget every string in the arena, and drop the references it holds,
+/// but keep its memory around.
+void scar_meta_arena_reset(struct scar_meta_arena *arena);
+
+/// Free the arena and every string in it,
+/// and drop the references it holds.
+void scar_meta_arena_free(struct scar_meta_arena *arena);
+
+#endif
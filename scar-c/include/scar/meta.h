@@ -52,6 +52,14 @@ struct scar_meta {
 	uint64_t size;
 	uint64_t uid;
 	char *uname;
+
+	/// Pax records which aren't any of the fields above,
+	/// but which are carried over when the metadata is written,
+	/// such as 'SCHILY.xattr.*' and 'LIBARCHIVE.*' records.
+	/// They're kept verbatim and back to back, so this isn't a C string;
+	/// its length is 'records_len'. Missing records are a null pointer.
+	char *records;
+	size_t records_len;
 };
 
 #define SCAR_META_IS_UINT(val) (!!(~(val)))
@@ -114,4 +122,33 @@ void scar_meta_print(struct scar_meta *meta, struct scar_io_writer *w);
 /// as if by 'scar_meta_init_empty'.
 void scar_meta_destroy(struct scar_meta *meta);
 
+/// Global metadata, from pax 'g' headers, shared by every entry
+/// it applies to. It's reference counted and never changes once created:
+/// a 'g' header makes a new one with the changes applied,
+/// so anything which still holds the old one keeps seeing
+/// the metadata which applied to its entries.
+/// References may be taken and dropped from different threads.
+struct scar_meta_global {
+	struct scar_meta meta;
+
+	/// Use 'scar_meta_global_ref' and 'scar_meta_global_unref'
+	/// rather than touching this.
+	unsigned long refs;
+};
+
+/// Create global metadata with a reference count of one,
+/// taking over the strings of 'meta', which is left empty.
+/// Returns NULL on error, in which case 'meta' is left as it was.
+struct scar_meta_global *scar_meta_global_create(struct scar_meta *meta);
+
+/// Take a reference to global metadata.
+/// Returns 'global'.
+struct scar_meta_global *scar_meta_global_ref(
+	struct scar_meta_global *global);
+
+/// Drop a reference to global metadata,
+/// freeing it when it was the last one.
+/// Does nothing if 'global' is NULL.
+void scar_meta_global_unref(struct scar_meta_global *global);
+
 #endif
@@ -4,6 +4,8 @@
 #include <stdint.h>
 
 struct scar_meta;
+struct scar_meta_global;
+struct scar_meta_arena;
 struct scar_io_reader;
 struct scar_block_reader;
 
@@ -12,4 +14,21 @@ struct scar_block_reader;
 int scar_pax_parse(
 	struct scar_meta *meta, struct scar_io_reader *r, uint64_t size);
 
+/// Like scar_pax_parse, but allocate the strings in 'arena',
+/// interning the ones which tend to repeat.
+/// Strings which get overwritten are left in the arena.
+/// With a NULL 'arena', this is the same as scar_pax_parse.
+int scar_pax_parse_arena(
+	struct scar_meta *meta, struct scar_io_reader *r, uint64_t size,
+	struct scar_meta_arena *arena);
+
+/// Apply pax extended attributes to shared global metadata.
+/// '*global' is never modified: it's copied, the attributes are parsed
+/// into the copy, and '*global' is replaced with the copy,
+/// dropping the reference to the old one.
+/// On error, '*global' is left as it was.
+int scar_pax_parse_global(
+	struct scar_meta_global **global, struct scar_io_reader *r,
+	uint64_t size);
+
 #endif
@@ -5,7 +5,17 @@
 
 struct scar_io_reader;
 struct scar_io_writer;
+struct scar_mem_writer;
 struct scar_meta;
+struct scar_meta_arena;
+struct scar_meta_global;
+
+/// Options for 'scar_pax_read_meta_shared_opts', which can be OR'd together.
+enum scar_pax_read_opts {
+	/// Accept header blocks whose checksum doesn't match.
+	/// Without it, a bad checksum is an error.
+	SCAR_PAX_IGNORE_CHECKSUM = 1 << 0,
+};
 
 /// Read all the metadata for the next pax entry.
 /// 'global' is expected to be initialized. Its fields will be overwritten
@@ -17,12 +27,45 @@ struct scar_meta;
 /// before being overwritten.
 /// The reader 'r' is expected to be positioned right at the start
 /// of an archive entry.
+/// Every header block's checksum is verified.
 /// Returns 1 on success, 0 if the end-of-archive indicator was reached,
 /// -1 on error.
 int scar_pax_read_meta(
 	struct scar_io_reader *r,
 	struct scar_meta *global, struct scar_meta *meta);
 
+/// Like scar_pax_read_meta, but allocate the strings of 'meta'
+/// in 'arena', so that 'meta' must not be destroyed.
+/// 'global' outlives the entry, so it still owns its strings.
+/// With a NULL 'arena', this is the same as scar_pax_read_meta.
+int scar_pax_read_meta_arena(
+	struct scar_io_reader *r,
+	struct scar_meta *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena);
+
+/// Like scar_pax_read_meta_arena, but with shared global metadata.
+/// The global strings aren't copied: 'meta' points at the strings
+/// of '*global', and 'arena' holds a reference to it until it's reset,
+/// so only the entry's own metadata is allocated.
+/// A 'g' header replaces '*global' with new global metadata
+/// (see 'scar_pax_parse_global'). 'arena' must not be NULL.
+int scar_pax_read_meta_shared(
+	struct scar_io_reader *r,
+	struct scar_meta_global **global, struct scar_meta *meta,
+	struct scar_meta_arena *arena);
+
+/// Like scar_pax_read_meta_shared, with 'opts' being a bitmask
+/// of 'enum scar_pax_read_opts' values.
+int scar_pax_read_meta_shared_opts(
+	struct scar_io_reader *r,
+	struct scar_meta_global **global, struct scar_meta *meta,
+	struct scar_meta_arena *arena, int opts);
+
+/// Check whether the checksum field of a 512-byte ustar header block
+/// matches the contents of the block.
+/// Returns 1 if the checksum is valid, 0 if it isn't.
+int scar_pax_block_checksum_ok(const unsigned char *block);
+
 /// Read the contents of an archive entry.
 /// This will basically copy up to 'size' bytes from 'r' to 'w',
 /// but will round up the amount of data read to 512-byte blocks.
@@ -39,6 +82,15 @@ int scar_pax_read_content(
 int scar_pax_write_meta(
 	const struct scar_meta *meta, struct scar_io_writer *w);
 
+/// Like scar_pax_write_meta, but build any pax extended header
+/// in 'scratch' rather than in a fresh heap buffer.
+/// Its buffer is kept around for the next call, so writing many entries
+/// with the same 'scratch' doesn't allocate once it has grown big enough.
+/// The caller frees 'scratch->buf' when done.
+int scar_pax_write_meta_scratch(
+	const struct scar_meta *meta, struct scar_io_writer *w,
+	struct scar_mem_writer *scratch);
+
 /// Write the contents of an archive entry.
 /// This will basically copy up to 'size' bytes from 'r' to 'w',
 /// but will round up the amount of data written to fill 512-byte blocks.
@@ -51,6 +103,11 @@ int scar_pax_write_entry(
 	struct scar_meta *meta, struct scar_io_reader *r,
 	struct scar_io_writer *w);
 
+/// Write a header + content, using scar_pax_write_meta_scratch.
+int scar_pax_write_entry_scratch(
+	struct scar_meta *meta, struct scar_io_reader *r,
+	struct scar_io_writer *w, struct scar_mem_writer *scratch);
+
 /// Write the end-of-archive indicator.
 /// That basically means writing 1024 0-bytes to 'w'.
 int scar_pax_write_end(struct scar_io_writer *w);
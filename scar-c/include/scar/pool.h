@@ -0,0 +1,29 @@
+#ifndef SCAR_POOL_H
+#define SCAR_POOL_H
+
+/// The scar_pool is an opaque type which represents a pool of worker threads.
+struct scar_pool;
+
+/// A job which can be submitted to a scar_pool.
+typedef void (*scar_pool_fn)(void *arg);
+
+/// Create a pool with 'nthreads' worker threads.
+/// If 'nthreads' is 1 or less, no threads are created,
+/// and jobs are run synchronously by 'scar_pool_submit'.
+struct scar_pool *scar_pool_create(int nthreads);
+
+/// Get the number of threads which will run jobs in parallel.
+int scar_pool_size(struct scar_pool *pool);
+
+/// Submit a job to the pool. 'fn' will be called with 'arg'
+/// on one of the pool's worker threads.
+/// Returns 0 on success, -1 on error.
+int scar_pool_submit(struct scar_pool *pool, scar_pool_fn fn, void *arg);
+
+/// Wait until every job which has been submitted so far has finished.
+void scar_pool_wait(struct scar_pool *pool);
+
+/// Wait for all jobs to finish, then stop the threads and free the pool.
+void scar_pool_free(struct scar_pool *pool);
+
+#endif
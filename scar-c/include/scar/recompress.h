@@ -0,0 +1,20 @@
+#ifndef SCAR_RECOMPRESS_H
+#define SCAR_RECOMPRESS_H
+
+#include "compression.h"
+#include "io.h"
+
+struct scar_reader;
+struct scar_pool;
+
+/// Re-encode the archive read by 'sr' using the compression 'comp'
+/// at level 'clevel', and write the new archive to 'w'.
+/// Every segment is decompressed and recompressed independently on 'pool'.
+/// The tar body and the index are not changed, since they only refer
+/// to uncompressed offsets; only the checkpoints and the tail are rewritten.
+/// Returns 0 on success, -1 on error.
+int scar_recompress(
+	struct scar_reader *sr, struct scar_io_writer *w,
+	struct scar_compression *comp, int clevel, struct scar_pool *pool);
+
+#endif
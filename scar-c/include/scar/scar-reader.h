@@ -1,12 +1,32 @@
 #ifndef SCAR_READER_H
 #define SCAR_READER_H
 
+#include <stdbool.h>
+
+#include "compression.h"
 #include "io.h"
 #include "meta.h"
 
+struct scar_meta_arena;
+struct scar_sidecar_stamp;
+
 /// The scar_reader is an opaque type which is used to read a SCAR archive.
+/// Once created, the reader's tail offsets and checkpoints never change,
+/// so the reader can be shared between threads which each use
+/// their own 'scar_cursor'.
+/// The scar_reader_* functions which read from the archive go through
+/// the reader's own cursor, so they must not be called concurrently.
 struct scar_reader;
 
+/// The scar_cursor is an opaque type which reads from a shared scar_reader
+/// through its own stream, with its own decompressor and position.
+/// Cursors are cheap to create. Different cursors on the same reader
+/// can be used from different threads at the same time,
+/// as long as they don't share a stream.
+/// Cursors created with 'scar_cursor_create_p' all have streams of their
+/// own on top of the reader's preader.
+struct scar_cursor;
+
 /// The scar_index_iterator is an opaque type which is used to iterate
 /// through the index of a SCAR archive.
 struct scar_index_iterator;
@@ -17,12 +37,80 @@ struct scar_index_entry {
 	char *name;
 	scar_offset offset;
 	const struct scar_meta *global;
+
+	/// The same global metadata as 'global', as a shared handle.
+	/// The iterator only holds on to it until the next global header,
+	/// so take a reference with 'scar_meta_global_ref' to keep it longer.
+	struct scar_meta_global *shared_global;
+
+	/// Metadata from the archive's SCAR-META section,
+	/// which lets you avoid reading the entry's header.
+	/// Missing values are represented the same way as in 'scar_meta',
+	/// which is also the case when the archive has no SCAR-META section.
+	uint32_t mode;
+	uint64_t size;
+	double mtime;
+};
+
+/// The scar_segment describes a run of compressed data which starts
+/// at a checkpoint, and which can be decompressed independently
+/// of the rest of the archive.
+struct scar_segment {
+	scar_offset compressed_start;
+	scar_offset compressed_end;
+
+	/// The offsets into the uncompressed stream which the segment covers.
+	/// Either may be -1 if it isn't recorded in the archive;
+	/// this is usually the case for the end of the last segment
+	/// of the tar body, and always the case for footer sections.
+	scar_offset uncompressed_start;
+	scar_offset uncompressed_end;
 };
 
 /// Create a scar_reader.
 struct scar_reader *scar_reader_create(
 	struct scar_io_reader *r, struct scar_io_seeker *s);
 
+/// Create a scar_reader which reads through a positional reader.
+/// Cursors for such a reader can be created with 'scar_cursor_create_p',
+/// and all share the preader, so it must support concurrent use
+/// if the cursors are used from different threads.
+/// The preader must outlive the reader.
+struct scar_reader *scar_reader_create_p(struct scar_io_preader *pr);
+
+/// The default size of the window 'scar_reader_create_p_window' reads.
+#define SCAR_FOOTER_DEFAULT_WINDOW (256 * 1024)
+
+/// The most 'scar_reader_create_p_window' grows its window to.
+#define SCAR_FOOTER_MAX_WINDOW (64 * 1024 * 1024)
+
+/// Like 'scar_reader_create_p', but read the last 'window' bytes
+/// of the archive with a single read, and parse the tail, the checkpoints
+/// and later the index and the other footer sections from memory.
+/// If the footer sections start before the window, it's grown to cover
+/// them with one more read, as long as that makes it no bigger than
+/// SCAR_FOOTER_MAX_WINDOW. On storage where every read is a round trip,
+/// such as network file systems, this makes opening an archive
+/// and listing its contents take one or two round trips.
+/// The reader's cursors read through the window too.
+/// See SCAR_FOOTER_DEFAULT_WINDOW.
+struct scar_reader *scar_reader_create_p_window(
+	struct scar_io_preader *pr, size_t window);
+
+/// Like 'scar_reader_create_p', but take the index, global metadata
+/// and checkpoints from the sidecar index in 'sidecar'
+/// (see 'scar_sidecar_write') instead of parsing them from the archive,
+/// as long as the sidecar is valid and fresh: its stamp must match 'stamp',
+/// which describes the archive file, and it must match the archive's tail.
+/// Otherwise the sidecar is ignored, as if 'scar_reader_create_p'
+/// was called. The sidecar is used in place, so it must outlive the reader.
+struct scar_reader *scar_reader_create_p_sidecar(
+	struct scar_io_preader *pr, const void *sidecar, size_t len,
+	const struct scar_sidecar_stamp *stamp);
+
+/// Check whether the reader uses a sidecar index.
+bool scar_reader_has_sidecar(struct scar_reader *sr);
+
 /// Start iterating through the index.
 struct scar_index_iterator *scar_reader_iterate(struct scar_reader *sr);
 
@@ -34,6 +122,15 @@ int scar_index_iterator_next(
 /// Free a scar_index_iterator.
 void scar_index_iterator_free(struct scar_index_iterator *it);
 
+/// Find the entry with the given path. If the path occurs more than once,
+/// the last entry wins, like it does when extracting.
+/// With a sidecar index, this is a binary search; otherwise, it reads
+/// through the whole index. The entry's name and global metadata are owned
+/// by the reader, and are valid until the next call.
+/// Returns 1 if the entry was found, 0 if it wasn't, -1 on error.
+int scar_reader_find_entry(
+	struct scar_reader *sr, const char *path, struct scar_index_entry *entry);
+
 /// Read all the metadata for the entry at a given offset.
 /// 'global' is expected to be initialized, and contain whatever
 /// global attributes apply to the given entry
@@ -45,12 +142,245 @@ int scar_reader_read_meta(
 	struct scar_reader *sr, scar_offset offset,
 	const struct scar_meta *global, struct scar_meta *meta);
 
+/// Like 'scar_reader_read_meta', but with the strings of 'meta'
+/// allocated in 'arena' (see 'scar_pax_read_meta_arena').
+int scar_reader_read_meta_arena(
+	struct scar_reader *sr, scar_offset offset,
+	const struct scar_meta *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena);
+
+/// Like 'scar_reader_read_meta_arena', but with shared global metadata,
+/// whose strings 'meta' points at rather than copying them
+/// (see 'scar_pax_read_meta_shared'). 'arena' must not be NULL.
+/// 'global' is left alone, even if the entry has a 'g' header.
+int scar_reader_read_meta_shared(
+	struct scar_reader *sr, scar_offset offset,
+	struct scar_meta_global *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena);
+
 /// Read all the content for the next pax entry.
 /// 'scar_reader_read_meta' must have been called
 /// just before 'scar_reader_read_content'.
 int scar_reader_read_content(
 	struct scar_reader *sr, struct scar_io_writer *w, uint64_t size);
 
+/// Get the compression used by the archive.
+struct scar_compression *scar_reader_compression(struct scar_reader *sr);
+
+/// Get the preader the reader was created with,
+/// or NULL if it was created with a reader and seeker.
+struct scar_io_preader *scar_reader_preader(struct scar_reader *sr);
+
+/// Set how many segment reads 'scar_verify' and 'scar_recompress'
+/// keep in flight at once when the reader was created with a preader.
+/// See 'scar_fetcher_create'. The default of 0 means
+/// SCAR_FETCH_DEFAULT_DEPTH. This must not be called while
+/// the reader is being used from other threads.
+void scar_reader_set_queue_depth(struct scar_reader *sr, unsigned int depth);
+
+/// Get the queue depth set by 'scar_reader_set_queue_depth'.
+unsigned int scar_reader_queue_depth(struct scar_reader *sr);
+
+/// The default amount of compressed data 'scar_recompress'
+/// reads into memory at once.
+#define SCAR_DEFAULT_BATCH_BYTES (256 * 1024 * 1024)
+
+/// Set how much compressed data 'scar_verify' and 'scar_recompress'
+/// read into memory at once. Segments are handed to the workers in batches
+/// of at most 'bytes' compressed bytes, and each of 'scar_recompress'
+/// workers' output moves to a temporary file once it's bigger than its
+/// share of 'bytes'. A segment which is bigger
+/// than 'bytes' gets a batch of its own, and is read as it's decompressed
+/// if the reader was created with a preader. The default of 0 means
+/// SCAR_DEFAULT_BATCH_BYTES. This must not be called while the reader
+/// is being used from other threads.
+void scar_reader_set_batch_bytes(struct scar_reader *sr, size_t bytes);
+
+/// Get the amount set by 'scar_reader_set_batch_bytes'.
+size_t scar_reader_batch_bytes(struct scar_reader *sr);
+
+/// Record access points roughly every 'span' bytes of uncompressed data
+/// whenever the reader or one of its cursors decompresses the tar body,
+/// like zlib's zran example does. Later reads which land in the same
+/// segment then start decompressing at the closest access point before
+/// them, instead of at the segment's checkpoint, which makes random access
+/// fast even for archives with few checkpoints. The access points only
+/// live in memory, and each one keeps a 32 KiB window.
+/// See SCAR_ACCESS_POINT_DEFAULT_SPAN. Compressions which don't support
+/// access points (like plain) ignore this.
+/// A 'span' of 0 (the default) turns it off, and drops the access points
+/// recorded so far. This must not be called while the reader is being used
+/// from other threads.
+void scar_reader_set_access_points(struct scar_reader *sr, scar_offset span);
+
+/// Get the number of access points recorded so far.
+size_t scar_reader_access_point_count(struct scar_reader *sr);
+
+/// Decompress a gzip archive with 'engine' from now on.
+/// Archives which aren't gzip are left alone. This must not be called
+/// while the reader is being used from other threads.
+/// Returns 0 on success, or -1 if scar wasn't built with the engine.
+int scar_reader_set_gzip_engine(
+	struct scar_reader *sr, enum scar_gzip_engine engine);
+
+/// The default amount of compressed data each thread of a parallel
+/// inflate starts on.
+#define SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK (4 * 1024 * 1024)
+
+/// Decompress big gzip segments with 'nthreads' threads, the way pugz does:
+/// the segment is cut into chunks of about 'chunk_size' compressed bytes
+/// (0 means SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK), and each thread guesses
+/// where the first deflate block in its chunk starts, and fills in the data
+/// it refers back to once the chunk before it is done. This is for archives
+/// with few checkpoints, such as ones converted from a single gzip stream,
+/// where one segment can be gigabytes. It applies to 'scar_verify' and
+/// 'scar_recompress', and when the reader or a cursor has to decompress
+/// at least a chunk's worth of a segment of at least two chunks from its
+/// start to get to an entry. Decompressing from an access point still
+/// happens on one thread. Each thread keeps a few times 'chunk_size' of
+/// compressed data in memory, and the chunks which are decompressed at once
+/// share about 256 MiB between them. There's only one set of threads per
+/// reader: while one cursor or segment is using them, the others are
+/// decompressed the usual way.
+/// An 'nthreads' of 1 or less (the default) turns it off. This must not be
+/// called while the reader is being used from other threads.
+void scar_reader_set_parallel_inflate(
+	struct scar_reader *sr, unsigned int nthreads, size_t chunk_size);
+
+/// Get the number of threads set by 'scar_reader_set_parallel_inflate',
+/// and the chunk size, if 'chunk_size' isn't NULL.
+unsigned int scar_reader_parallel_inflate(
+	struct scar_reader *sr, size_t *chunk_size);
+
+/// Counters for a reader's page cache.
+struct scar_page_cache_stats {
+	/// Reads which were served from a cached page,
+	/// and reads which had to decompress their page.
+	size_t hits;
+	size_t misses;
+
+	/// The amount of decompressed data currently cached.
+	size_t bytes;
+};
+
+/// Cache up to 'max_bytes' of decompressed tar body in the reader,
+/// shared by the reader and all its cursors.
+/// The data is cached in fixed-size pages of each segment,
+/// and the least recently used pages are evicted first,
+/// so reading the same entries again is a copy out of memory
+/// instead of decompressing from the checkpoint.
+/// A 'max_bytes' of 0 (the default) turns the cache off.
+/// This must not be called while the reader is being used
+/// from other threads.
+/// Returns 0 on success, -1 on error.
+int scar_reader_set_page_cache(struct scar_reader *sr, size_t max_bytes);
+
+/// Get the page cache counters. They're all 0 if there's no page cache.
+void scar_reader_page_cache_stats(
+	struct scar_reader *sr, struct scar_page_cache_stats *stats);
+
+/// Get the number of segments the tar body is split into.
+/// Returns -1 on error.
+scar_ssize scar_reader_segment_count(struct scar_reader *sr);
+
+/// Get the location of segment number 'idx' of the tar body.
+/// Returns 0 on success, -1 on error.
+int scar_reader_get_segment(
+	struct scar_reader *sr, size_t idx, struct scar_segment *seg);
+
+/// Get the location of the footer section called 'name'
+/// (such as "SCAR-INDEX" or "SCAR-CHECKPOINTS").
+/// Returns 1 if the section was found, 0 if the archive doesn't have it.
+int scar_reader_find_section(
+	struct scar_reader *sr, const char *name, struct scar_segment *seg);
+
+/// Get the number of extension sections listed in the archive's tail.
+size_t scar_reader_extension_count(struct scar_reader *sr);
+
+/// Get the name and location of extension section number 'idx'.
+/// The name is owned by the reader.
+/// Returns 0 on success, -1 on error.
+int scar_reader_get_extension(
+	struct scar_reader *sr, size_t idx,
+	const char **name, struct scar_segment *seg);
+
+/// Get the CRC-32C of the uncompressed data in segment number 'idx'
+/// of the tar body, as recorded in the archive's SCAR-CHECKSUMS section.
+/// Returns 1 if the checksum was found, 0 if the archive has no checksums,
+/// -1 on error.
+int scar_reader_segment_checksum(
+	struct scar_reader *sr, size_t idx, uint32_t *crc);
+
+/// Check whether the archive might contain an entry with the given path.
+/// Trailing slashes are ignored, so "dir" and "dir/" are the same path.
+/// Only the archive's SCAR-BLOOM section is read, and only the first time;
+/// the index isn't touched.
+/// Returns 0 if the path is definitely not in the archive,
+/// 1 if it might be (which is always the answer for archives without
+/// a SCAR-BLOOM section), -1 on error.
+int scar_reader_may_contain(struct scar_reader *sr, const char *path);
+
+/// Read the compressed bytes of a segment into 'buf',
+/// which must have room for 'compressed_end - compressed_start' bytes.
+/// Returns 0 on success, -1 on error.
+int scar_reader_read_compressed(
+	struct scar_reader *sr, const struct scar_segment *seg, void *buf);
+
+/// Create a cursor which reads the archive through 'r' and 's',
+/// which must read the same file as the reader's streams do.
+/// The cursor must be freed before the reader.
+struct scar_cursor *scar_cursor_create(
+	struct scar_reader *sr, struct scar_io_reader *r, struct scar_io_seeker *s);
+
+/// Create a cursor which reads through the preader the reader was
+/// created with (see 'scar_reader_create_p').
+/// Returns NULL if the reader wasn't created with a preader.
+struct scar_cursor *scar_cursor_create_p(struct scar_reader *sr);
+
+/// Like 'scar_reader_iterate', but reading through the cursor.
+/// The iterator uses the cursor's stream, so the cursor must not be used
+/// for anything else while the iterator is in use.
+struct scar_index_iterator *scar_cursor_iterate(struct scar_cursor *c);
+
+/// Like 'scar_reader_read_meta', but reading through the cursor.
+int scar_cursor_read_meta(
+	struct scar_cursor *c, scar_offset offset,
+	const struct scar_meta *global, struct scar_meta *meta);
+
+/// Like 'scar_reader_read_meta_arena', but reading through the cursor.
+int scar_cursor_read_meta_arena(
+	struct scar_cursor *c, scar_offset offset,
+	const struct scar_meta *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena);
+
+/// Like 'scar_reader_read_meta_shared', but reading through the cursor.
+int scar_cursor_read_meta_shared(
+	struct scar_cursor *c, scar_offset offset,
+	struct scar_meta_global *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena);
+
+/// Like 'scar_reader_read_content', but reading through the cursor.
+/// 'scar_cursor_read_meta' must have been called on the same cursor
+/// just before 'scar_cursor_read_content'.
+int scar_cursor_read_content(
+	struct scar_cursor *c, struct scar_io_writer *w, uint64_t size);
+
+/// Like 'scar_reader_segment_checksum', but reading through the cursor.
+int scar_cursor_segment_checksum(
+	struct scar_cursor *c, size_t idx, uint32_t *crc);
+
+/// Like 'scar_reader_may_contain', but reading through the cursor.
+int scar_cursor_may_contain(struct scar_cursor *c, const char *path);
+
+/// Like 'scar_reader_read_compressed', but reading through the cursor.
+int scar_cursor_read_compressed(
+	struct scar_cursor *c, const struct scar_segment *seg, void *buf);
+
+/// Free a scar_cursor.
+/// Does not free the 'scar_io_reader' or 'scar_io_seeker'
+/// that was passed in to the scar_cursor_create function.
+void scar_cursor_free(struct scar_cursor *c);
+
 /// Free a scar_reader.
 /// Does not free the 'scar_io_reader' or 'scar_io_seeker'
 /// that was passed in to the scar_reader_create function;
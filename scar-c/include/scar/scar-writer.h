@@ -8,10 +8,48 @@
 /// The scar_writer is an opaque type which is used to create a SCAR archive.
 struct scar_writer;
 
+/// Options for 'scar_writer_create_opts', which can be OR'd together.
+enum scar_writer_opts {
+	/// Write a SCAR-CHECKSUMS section, with a CRC-32C of the uncompressed
+	/// data in each segment of the tar body.
+	SCAR_WRITER_CHECKSUMS = 1 << 0,
+
+	/// Write a SCAR-META section, with the mode, size and mtime
+	/// of each entry, so that readers can list them from the footer alone.
+	SCAR_WRITER_META = 1 << 1,
+
+	/// Write a SCAR-BLOOM section, a Bloom filter over every path,
+	/// which lets readers rule out missing paths without reading the index.
+	SCAR_WRITER_BLOOM = 1 << 2,
+};
+
 /// Create a scar_writer.
 struct scar_writer *scar_writer_create(
 	struct scar_io_writer *w, struct scar_compression *comp, int clevel);
 
+/// Create a scar_writer with options.
+/// 'opts' is a bitmask of 'enum scar_writer_opts' values.
+struct scar_writer *scar_writer_create_opts(
+	struct scar_io_writer *w, struct scar_compression *comp, int clevel,
+	int opts);
+
+/// A spill threshold which keeps the writer's memory use modest,
+/// for use with 'scar_writer_set_spill_threshold'.
+#define SCAR_WRITER_DEFAULT_SPILL_THRESHOLD (64 * 1024 * 1024)
+
+/// Keep at most 'threshold' bytes of each footer section which grows
+/// with the number of entries (the index, the checkpoints and SCAR-META)
+/// in memory. Once a section passes that, it's moved to an anonymous
+/// temporary file and the rest of it is appended there, so that
+/// resident memory stays flat no matter how many entries are written.
+/// 'scar_writer_finish' copies the sections from the temporary files,
+/// from file to file in the kernel if the writer writes to a regular
+/// file through a 'scar_file_handle' and the platform supports that.
+/// A threshold of 0 (the default) keeps everything in memory.
+/// The Bloom filter's path hashes (see SCAR_WRITER_BLOOM) are always
+/// kept in memory.
+void scar_writer_set_spill_threshold(struct scar_writer *sw, size_t threshold);
+
 /// Write an entry to the SCAR archive.
 int scar_writer_write_entry(
 	struct scar_writer *sw, struct scar_meta *meta, struct scar_io_reader *r);
@@ -1,16 +1,25 @@
 #ifndef SCAR_H
 #define SCAR_H
 
+#include "block-cache.h"
 #include "compression.h"
+#include "crc32c.h"
+#include "fetch.h"
+#include "http.h"
 #include "io.h"
 #include "ioutil.h"
 #include "meta.h"
+#include "meta-arena.h"
 #include "pax-syntax.h"
 #include "pax.h"
+#include "pool.h"
+#include "recompress.h"
 #include "scar-reader.h"
 #include "scar-writer.h"
+#include "sidecar.h"
 #include "types.h"
 #include "ustar.h"
 #include "util.h"
+#include "verify.h"
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef SCAR_SIDECAR_H
+#define SCAR_SIDECAR_H
+
+#include <stdint.h>
+
+#include "io.h"
+
+struct scar_reader;
+
+/// The suffix of a sidecar index's file name:
+/// the sidecar for 'foo.scar' is 'foo.scar.scari'.
+#define SCAR_SIDECAR_SUFFIX ".scari"
+
+/// A sidecar index is a binary file which holds everything a reader
+/// otherwise has to parse out of an archive's SCAR-INDEX,
+/// SCAR-CHECKPOINTS and SCAR-META sections: every entry's path, type,
+/// offset and metadata, the global metadata which applies to it,
+/// the entries sorted by path, and the checkpoints.
+/// It's laid out so that it can be used straight from a memory mapping,
+/// which makes opening an archive with millions of entries instant.
+///
+/// The stamp describes the archive file the sidecar was made for,
+/// so that a sidecar for an archive which has since been replaced
+/// is recognized as stale and ignored.
+struct scar_sidecar_stamp {
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+};
+
+/// Write a sidecar index for the archive 'sr' reads to 'w'.
+/// 'stamp' should describe the archive file.
+/// Returns 0 on success, -1 on error.
+int scar_sidecar_write(
+	struct scar_reader *sr, const struct scar_sidecar_stamp *stamp,
+	struct scar_io_writer *w);
+
+#endif
@@ -2,6 +2,7 @@
 #define SCAR_USTAR_FIELDS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "io.h"
 
@@ -27,4 +28,35 @@ static const struct scar_ustar_field SCAR_UST_DEVMAJOR = {329, 8};
 static const struct scar_ustar_field SCAR_UST_DEVMINOR = {337, 8};
 static const struct scar_ustar_field SCAR_UST_PREFIX = {345, 155};
 
+/// Read the octal number at the start of a field of a header block.
+/// The number ends at the first character which isn't an octal digit,
+/// or at the end of the field.
+uint64_t scar_ustar_read_octal(
+	const unsigned char *block, struct scar_ustar_field field);
+
+/// Like scar_ustar_read_octal, but also understand GNU's base-256
+/// encoding, which is used for sizes which don't fit in octal.
+uint64_t scar_ustar_read_size(
+	const unsigned char *block, struct scar_ustar_field field);
+
+/// Write 'num' as a zero-padded, NUL-terminated octal number
+/// which fills the field. Like snprintf would, a number which doesn't fit
+/// is cut short, keeping its most significant digits.
+void scar_ustar_write_octal(
+	unsigned char *block, struct scar_ustar_field field, uint64_t num);
+
+/// Check whether a 512-byte block is all zeroes.
+/// Returns 1 if it is, 0 if it isn't.
+int scar_ustar_block_is_zero(const unsigned char *block);
+
+/// Sum the bytes of a 512-byte header block, as if the checksum field
+/// was all spaces. 'usum' gets the sum of the bytes as unsigned chars,
+/// and 'ssum' the sum as signed chars, which some historic
+/// implementations used.
+void scar_ustar_block_sums(
+	const unsigned char *block, uint64_t *usum, int64_t *ssum);
+
+/// Fill in the checksum field of a 512-byte header block.
+void scar_ustar_write_checksum(unsigned char *block);
+
 #endif
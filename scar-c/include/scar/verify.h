@@ -0,0 +1,48 @@
+#ifndef SCAR_VERIFY_H
+#define SCAR_VERIFY_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+struct scar_reader;
+struct scar_pool;
+
+/// The result of verifying an archive.
+struct scar_verify_result {
+	/// The offset into the uncompressed tar body of the first problem
+	/// which was found, or -1 if the problem can't be pinned to an offset
+	/// (or if no problem was found).
+	scar_offset bad_offset;
+
+	/// A description of the first problem which was found,
+	/// or an empty string if the archive is intact.
+	char message[256];
+
+	/// The amount of compressed and uncompressed tar body data
+	/// which was checked.
+	scar_offset compressed_size;
+	scar_offset uncompressed_size;
+
+	size_t segment_count;
+	size_t entry_count;
+
+	/// The number of segments whose content was checked against
+	/// the archive's SCAR-CHECKSUMS section.
+	size_t checksummed_segment_count;
+};
+
+/// Check the integrity of the archive read by 'sr'.
+/// Every segment of the tar body is decompressed on 'pool',
+/// its length is checked against the checkpoints section,
+/// and the checksum of every ustar header block in it is validated.
+/// If the archive has a SCAR-CHECKSUMS section, the CRC-32C
+/// of each segment is checked too.
+/// Finally, every index entry is checked against the header at its offset.
+/// Returns 0 if the archive is intact, -1 if it isn't
+/// or if it couldn't be read; 'result' describes the first problem.
+int scar_verify(
+	struct scar_reader *sr, struct scar_pool *pool,
+	struct scar_verify_result *result);
+
+#endif
@@ -0,0 +1,397 @@
+#include "block-cache.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal-util.h"
+#include "util.h"
+
+struct cache_block {
+	uint64_t idx;
+	unsigned char *data;
+	size_t len;
+	bool used;
+
+	// The next block in the same hash bucket
+	struct cache_block *hnext;
+
+	// The LRU list, most recently used first
+	struct cache_block *prev;
+	struct cache_block *next;
+};
+
+struct block_cache {
+	struct scar_io_preader pr;
+	struct scar_io_preader *inner;
+	size_t block_size;
+
+	pthread_mutex_t mut;
+
+	// The size of the inner data, or -1 until it's known
+	scar_offset size;
+
+	struct cache_block *blocks;
+	size_t nblocks;
+	struct cache_block **buckets;
+	size_t nbuckets;
+	struct cache_block *lru_head;
+	struct cache_block *lru_tail;
+
+	// Sequential reads (like a decompressor working through a segment)
+	// get a read-ahead window which doubles every time the next miss
+	// is right after the last fill
+	uint64_t ra_next;
+	uint64_t ra_blocks;
+
+	struct scar_block_cache_stats stats;
+};
+
+static size_t bucket_of(struct block_cache *bc, uint64_t idx)
+{
+	return (size_t)(idx * 0x9e3779b97f4a7c15ull) & (bc->nbuckets - 1);
+}
+
+static void lru_unlink(struct block_cache *bc, struct cache_block *b)
+{
+	if (b->prev) {
+		b->prev->next = b->next;
+	} else {
+		bc->lru_head = b->next;
+	}
+
+	if (b->next) {
+		b->next->prev = b->prev;
+	} else {
+		bc->lru_tail = b->prev;
+	}
+
+	b->prev = NULL;
+	b->next = NULL;
+}
+
+static void lru_push_front(struct block_cache *bc, struct cache_block *b)
+{
+	b->prev = NULL;
+	b->next = bc->lru_head;
+	if (bc->lru_head) {
+		bc->lru_head->prev = b;
+	} else {
+		bc->lru_tail = b;
+	}
+	bc->lru_head = b;
+}
+
+static struct cache_block *cache_find(struct block_cache *bc, uint64_t idx)
+{
+	struct cache_block *b = bc->buckets[bucket_of(bc, idx)];
+	while (b && b->idx != idx) {
+		b = b->hnext;
+	}
+
+	return b;
+}
+
+static void cache_remove(struct block_cache *bc, struct cache_block *b)
+{
+	struct cache_block **link = &bc->buckets[bucket_of(bc, b->idx)];
+	while (*link != b) {
+		link = &(*link)->hnext;
+	}
+
+	*link = b->hnext;
+	b->hnext = NULL;
+	b->used = false;
+}
+
+// Store a copy of block 'idx', evicting the least recently used block
+// if the cache is full.
+static int cache_insert(
+	struct block_cache *bc, uint64_t idx, const unsigned char *data,
+	size_t len
+) {
+	// The LRU list holds every slot, with the unused ones at the end
+	struct cache_block *b = bc->lru_tail;
+	if (b->used) {
+		cache_remove(bc, b);
+	}
+
+	if (!b->data) {
+		b->data = malloc(bc->block_size);
+		if (!b->data) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	memcpy(b->data, data, len);
+	b->idx = idx;
+	b->len = len;
+	b->used = true;
+
+	size_t bucket = bucket_of(bc, idx);
+	b->hnext = bc->buckets[bucket];
+	bc->buckets[bucket] = b;
+
+	lru_unlink(bc, b);
+	lru_push_front(bc, b);
+	return 0;
+}
+
+// Copy the part of block 'idx' which overlaps the read into 'buf'.
+static void copy_block(
+	struct block_cache *bc, uint64_t idx, const unsigned char *data,
+	size_t len, scar_offset offset, unsigned char *buf, size_t buflen
+) {
+	scar_offset start = (scar_offset)(idx * bc->block_size);
+	scar_offset end = start + (scar_offset)len;
+	if (start < offset) {
+		start = offset;
+	}
+	if (end > offset + (scar_offset)buflen) {
+		end = offset + (scar_offset)buflen;
+	}
+	if (end <= start) {
+		return;
+	}
+
+	memcpy(
+		&buf[start - offset],
+		&data[start - (scar_offset)(idx * bc->block_size)],
+		(size_t)(end - start));
+}
+
+// Read blocks 'first' to 'last' from the inner preader in one go,
+// copy them into the caller's buffer and store them in the cache.
+// Must be called with 'mut' held.
+static int cache_fill(
+	struct block_cache *bc, uint64_t first, uint64_t last,
+	scar_offset offset, unsigned char *buf, size_t buflen
+) {
+	scar_offset start = (scar_offset)(first * bc->block_size);
+	scar_offset end = (scar_offset)((last + 1) * bc->block_size);
+	if (end > bc->size) {
+		end = bc->size;
+	}
+
+	size_t len = (size_t)(end - start);
+	unsigned char *tmp = malloc(len);
+	if (!tmp) {
+		SCAR_ERETURN(-1);
+	}
+
+	bc->stats.inner_reads += 1;
+	scar_ssize n = bc->inner->read_at(bc->inner, start, tmp, len);
+	if (n < 0 || (size_t)n < len) {
+		free(tmp);
+		SCAR_ERETURN(-1);
+	}
+
+	for (uint64_t idx = first; idx <= last; ++idx) {
+		size_t boff = (size_t)(idx - first) * bc->block_size;
+		size_t blen = len - boff < bc->block_size ? len - boff : bc->block_size;
+		copy_block(bc, idx, &tmp[boff], blen, offset, buf, buflen);
+		if (cache_insert(bc, idx, &tmp[boff], blen) < 0) {
+			free(tmp);
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	free(tmp);
+	return 0;
+}
+
+// Must be called with 'mut' held.
+static scar_offset cache_size(struct block_cache *bc)
+{
+	if (bc->size < 0) {
+		bc->size = bc->inner->size(bc->inner);
+	}
+
+	return bc->size;
+}
+
+static scar_ssize block_cache_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	struct block_cache *bc = SCAR_BASE(struct block_cache, pr);
+	if (offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	pthread_mutex_lock(&bc->mut);
+
+	scar_offset size = cache_size(bc);
+	if (size < 0) {
+		pthread_mutex_unlock(&bc->mut);
+		SCAR_ERETURN(-1);
+	}
+
+	if (offset >= size || len == 0) {
+		pthread_mutex_unlock(&bc->mut);
+		return 0;
+	}
+
+	if ((scar_offset)len > size - offset) {
+		len = (size_t)(size - offset);
+	}
+
+	uint64_t first = (uint64_t)offset / bc->block_size;
+	uint64_t last = ((uint64_t)offset + len - 1) / bc->block_size;
+	uint64_t final = ((uint64_t)size - 1) / bc->block_size;
+
+	// Reads which are big compared to the cache would only push out
+	// everything else, so they go straight through
+	if (last - first + 1 > bc->nblocks / 2) {
+		bc->stats.misses += (size_t)(last - first + 1);
+		bc->stats.inner_reads += 1;
+		pthread_mutex_unlock(&bc->mut);
+		return bc->inner->read_at(bc->inner, offset, buf, len);
+	}
+
+	uint64_t idx = first;
+	while (idx <= last) {
+		struct cache_block *b = cache_find(bc, idx);
+		if (b) {
+			bc->stats.hits += 1;
+			copy_block(bc, idx, b->data, b->len, offset, buf, len);
+			lru_unlink(bc, b);
+			lru_push_front(bc, b);
+			idx += 1;
+			continue;
+		}
+
+		// Coalesce the whole run of missing blocks into one read
+		uint64_t end = idx;
+		while (end < last && !cache_find(bc, end + 1)) {
+			end += 1;
+		}
+		bc->stats.misses += (size_t)(end - idx + 1);
+
+		if (idx == bc->ra_next) {
+			bc->ra_blocks *= 2;
+			if (bc->ra_blocks > bc->nblocks / 4) {
+				bc->ra_blocks = bc->nblocks / 4;
+			}
+		} else {
+			bc->ra_blocks = 1;
+		}
+
+		while (
+			end < final && end - idx + 1 < bc->ra_blocks &&
+			!cache_find(bc, end + 1)
+		) {
+			end += 1;
+		}
+		bc->ra_next = end + 1;
+
+		// Near the end of the data, grab the whole footer at once
+		uint64_t start = idx;
+		if (end == final) {
+			while (
+				start > 0 && final - (start - 1) < SCAR_BLOCK_CACHE_TAIL_BLOCKS &&
+				final - (start - 1) < bc->nblocks / 2 && !cache_find(bc, start - 1)
+			) {
+				start -= 1;
+			}
+		}
+
+		if (cache_fill(bc, start, end, offset, buf, len) < 0) {
+			pthread_mutex_unlock(&bc->mut);
+			SCAR_ERETURN(-1);
+		}
+
+		idx = end + 1;
+	}
+
+	pthread_mutex_unlock(&bc->mut);
+	return (scar_ssize)len;
+}
+
+static scar_offset block_cache_size(struct scar_io_preader *pr)
+{
+	struct block_cache *bc = SCAR_BASE(struct block_cache, pr);
+	pthread_mutex_lock(&bc->mut);
+	scar_offset size = cache_size(bc);
+	pthread_mutex_unlock(&bc->mut);
+	return size;
+}
+
+struct scar_io_preader *scar_block_cache_create(
+	struct scar_io_preader *inner, size_t block_size, size_t nblocks
+) {
+	if (block_size == 0) {
+		block_size = SCAR_BLOCK_CACHE_DEFAULT_BLOCK_SIZE;
+	}
+	if (nblocks == 0) {
+		nblocks = SCAR_BLOCK_CACHE_DEFAULT_BLOCKS;
+	}
+
+	struct block_cache *bc = malloc(sizeof(*bc));
+	if (!bc) {
+		SCAR_ERETURN(NULL);
+	}
+
+	bc->pr.read_at = block_cache_read_at;
+	bc->pr.size = block_cache_size;
+	bc->inner = inner;
+	bc->block_size = block_size;
+	bc->size = -1;
+	bc->nblocks = nblocks;
+	bc->lru_head = NULL;
+	bc->lru_tail = NULL;
+	bc->ra_next = UINT64_MAX;
+	bc->ra_blocks = 1;
+	memset(&bc->stats, 0, sizeof(bc->stats));
+
+	bc->nbuckets = 1;
+	while (bc->nbuckets < nblocks) {
+		bc->nbuckets *= 2;
+	}
+
+	bc->blocks = calloc(nblocks, sizeof(*bc->blocks));
+	bc->buckets = calloc(bc->nbuckets, sizeof(*bc->buckets));
+	if (!bc->blocks || !bc->buckets) {
+		free(bc->blocks);
+		free(bc->buckets);
+		free(bc);
+		SCAR_ERETURN(NULL);
+	}
+
+	if (pthread_mutex_init(&bc->mut, NULL) != 0) {
+		free(bc->blocks);
+		free(bc->buckets);
+		free(bc);
+		SCAR_ERETURN(NULL);
+	}
+
+	// Block data is only allocated once a slot is first used
+	for (size_t i = 0; i < nblocks; ++i) {
+		lru_push_front(bc, &bc->blocks[i]);
+	}
+
+	return &bc->pr;
+}
+
+void scar_block_cache_get_stats(
+	struct scar_io_preader *pr, struct scar_block_cache_stats *stats
+) {
+	struct block_cache *bc = SCAR_BASE(struct block_cache, pr);
+	pthread_mutex_lock(&bc->mut);
+	*stats = bc->stats;
+	pthread_mutex_unlock(&bc->mut);
+}
+
+void scar_block_cache_free(struct scar_io_preader *pr)
+{
+	struct block_cache *bc = SCAR_BASE(struct block_cache, pr);
+	for (size_t i = 0; i < bc->nblocks; ++i) {
+		free(bc->blocks[i].data);
+	}
+
+	pthread_mutex_destroy(&bc->mut);
+	free(bc->blocks);
+	free(bc->buckets);
+	free(bc);
+}
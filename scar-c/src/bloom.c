@@ -0,0 +1,33 @@
+#include "bloom.h"
+
+#include <string.h>
+
+uint64_t scar_bloom_hash(const char *path)
+{
+	size_t len = strlen(path);
+	while (len > 0 && path[len - 1] == '/') {
+		len -= 1;
+	}
+
+	// 64-bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)path[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	// FNV-1a's high bits are poorly mixed for short inputs,
+	// and both halves of the hash are used, so finish with a mixer
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+uint64_t scar_bloom_bit(uint64_t hash, unsigned int i, uint64_t nbits)
+{
+	// Double hashing: derive all the hash functions from two halves
+	uint64_t h1 = hash & 0xffffffffu;
+	uint64_t h2 = (hash >> 32) | 1;
+	return (h1 + i * h2) % nbits;
+}
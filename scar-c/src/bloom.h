@@ -0,0 +1,20 @@
+#ifndef SCAR_BLOOM_H
+#define SCAR_BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The SCAR-BLOOM section is a Bloom filter over every path in the index.
+// With 10 bits per path and 7 hash functions,
+// the false positive rate is just under 1%.
+#define SCAR_BLOOM_BITS_PER_PATH 10
+#define SCAR_BLOOM_HASHES 7
+
+// Hash a path for the Bloom filter.
+// Trailing slashes are ignored, so that "dir" and "dir/" hash the same.
+uint64_t scar_bloom_hash(const char *path);
+
+// Get the index of the bit which hash function number 'i' sets for 'hash'.
+uint64_t scar_bloom_bit(uint64_t hash, unsigned int i, uint64_t nbits);
+
+#endif
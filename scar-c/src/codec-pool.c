@@ -0,0 +1,263 @@
+#include "codec-pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "internal-util.h"
+#include "parallel-inflate.h"
+#include "scar-reader.h"
+
+struct scar_codec_pool {
+	pthread_mutex_t mut;
+	const struct scar_compression *comp;
+	int clevel;
+
+	struct scar_compressor *compressors[SCAR_CODEC_POOL_MAX_IDLE];
+	size_t ncompressors;
+	struct scar_decompressor *decompressors[SCAR_CODEC_POOL_MAX_IDLE];
+	size_t ndecompressors;
+
+	// The parallel inflater which is lent out for big segments,
+	// created the first time it's needed
+	unsigned int inflate_threads;
+	size_t inflate_chunk;
+	struct scar_decompressor *pinflate;
+	bool pinflate_busy;
+
+	// Set when the number of threads changes while 'pinflate' is lent out,
+	// so that it's destroyed when it's put back
+	bool pinflate_stale;
+};
+
+struct scar_codec_pool *scar_codec_pool_create(
+	const struct scar_compression *comp, int clevel
+) {
+	struct scar_codec_pool *pool = malloc(sizeof(*pool));
+	if (!pool) {
+		SCAR_ERETURN(NULL);
+	}
+
+	if (pthread_mutex_init(&pool->mut, NULL) != 0) {
+		free(pool);
+		SCAR_ERETURN(NULL);
+	}
+
+	pool->comp = comp;
+	pool->clevel = clevel;
+	pool->ncompressors = 0;
+	pool->ndecompressors = 0;
+	pool->inflate_threads = 0;
+	pool->inflate_chunk = 0;
+	pool->pinflate = NULL;
+	pool->pinflate_busy = false;
+	pool->pinflate_stale = false;
+	return pool;
+}
+
+void scar_codec_pool_set_parallel_inflate(
+	struct scar_codec_pool *pool, unsigned int nthreads, size_t chunk_size
+) {
+	if (chunk_size == 0) {
+		chunk_size = SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK;
+	}
+
+	// The inflater which is there has the old number of threads
+	struct scar_decompressor *old = NULL;
+	pthread_mutex_lock(&pool->mut);
+	if (pool->pinflate_busy) {
+		pool->pinflate_stale = true;
+	} else {
+		old = pool->pinflate;
+		pool->pinflate = NULL;
+	}
+
+	pool->inflate_threads = nthreads;
+	pool->inflate_chunk = chunk_size;
+	pthread_mutex_unlock(&pool->mut);
+	scar_parallel_inflate_free(old);
+}
+
+struct scar_decompressor *scar_codec_pool_get_decompressor(
+	struct scar_codec_pool *pool, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink
+) {
+	struct scar_decompressor *d = NULL;
+	pthread_mutex_lock(&pool->mut);
+	if (pool->ndecompressors > 0) {
+		pool->ndecompressors -= 1;
+		d = pool->decompressors[pool->ndecompressors];
+	}
+	pthread_mutex_unlock(&pool->mut);
+
+	if (d) {
+		if (pool->comp->reset_decompressor(d, r, ap, sink) < 0) {
+			pool->comp->destroy_decompressor(d);
+			SCAR_ERETURN(NULL);
+		}
+
+		return d;
+	}
+
+	if (ap || sink) {
+		d = pool->comp->create_decompressor_at(r, ap, sink);
+	} else {
+		d = pool->comp->create_decompressor(r);
+	}
+
+	if (!d) {
+		SCAR_ERETURN(NULL);
+	}
+
+	return d;
+}
+
+struct scar_decompressor *scar_codec_pool_get_segment_decompressor(
+	struct scar_codec_pool *pool, struct scar_io_reader *r, scar_offset len,
+	struct scar_access_point_sink *sink
+) {
+	struct scar_decompressor *d = NULL;
+	bool parallel = false;
+	pthread_mutex_lock(&pool->mut);
+	if (
+		pool->inflate_threads > 1 && !pool->pinflate_busy &&
+		len >= 2 * (scar_offset)pool->inflate_chunk
+	) {
+		pool->pinflate_busy = true;
+		d = pool->pinflate;
+		parallel = true;
+	}
+	pthread_mutex_unlock(&pool->mut);
+
+	if (!parallel) {
+		return scar_codec_pool_get_decompressor(pool, r, NULL, sink);
+	}
+
+	// The threads are started outside of the lock,
+	// since nobody else can use the inflater in the meantime anyway
+	if (d) {
+		scar_parallel_inflate_reset(d, r, sink);
+		return d;
+	}
+
+	d = scar_parallel_inflate_create(
+		r, pool->inflate_threads, pool->inflate_chunk, sink);
+	pthread_mutex_lock(&pool->mut);
+	pool->pinflate = d;
+	pool->pinflate_busy = d != NULL;
+	pthread_mutex_unlock(&pool->mut);
+	if (!d) {
+		SCAR_ERETURN(NULL);
+	}
+
+	return d;
+}
+
+void scar_codec_pool_put_decompressor(
+	struct scar_codec_pool *pool, struct scar_decompressor *d
+) {
+	if (!d) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mut);
+	bool parallel = d == pool->pinflate;
+	bool stale = parallel && pool->pinflate_stale;
+	if (parallel) {
+		pool->pinflate_busy = false;
+	}
+
+	if (stale) {
+		pool->pinflate = NULL;
+		pool->pinflate_stale = false;
+	}
+	pthread_mutex_unlock(&pool->mut);
+
+	if (parallel) {
+		if (stale) {
+			scar_parallel_inflate_free(d);
+		}
+
+		return;
+	}
+
+	if (pool->comp->reset_decompressor) {
+		pthread_mutex_lock(&pool->mut);
+		if (pool->ndecompressors < SCAR_CODEC_POOL_MAX_IDLE) {
+			pool->decompressors[pool->ndecompressors] = d;
+			pool->ndecompressors += 1;
+			d = NULL;
+		}
+		pthread_mutex_unlock(&pool->mut);
+	}
+
+	if (d) {
+		pool->comp->destroy_decompressor(d);
+	}
+}
+
+struct scar_compressor *scar_codec_pool_get_compressor(
+	struct scar_codec_pool *pool, struct scar_io_writer *w
+) {
+	struct scar_compressor *c = NULL;
+	pthread_mutex_lock(&pool->mut);
+	if (pool->ncompressors > 0) {
+		pool->ncompressors -= 1;
+		c = pool->compressors[pool->ncompressors];
+	}
+	pthread_mutex_unlock(&pool->mut);
+
+	if (c) {
+		if (pool->comp->reset_compressor(c, w) < 0) {
+			pool->comp->destroy_compressor(c);
+			SCAR_ERETURN(NULL);
+		}
+
+		return c;
+	}
+
+	c = pool->comp->create_compressor(w, pool->clevel);
+	if (!c) {
+		SCAR_ERETURN(NULL);
+	}
+
+	return c;
+}
+
+void scar_codec_pool_put_compressor(
+	struct scar_codec_pool *pool, struct scar_compressor *c
+) {
+	if (!c) {
+		return;
+	}
+
+	if (pool->comp->reset_compressor) {
+		pthread_mutex_lock(&pool->mut);
+		if (pool->ncompressors < SCAR_CODEC_POOL_MAX_IDLE) {
+			pool->compressors[pool->ncompressors] = c;
+			pool->ncompressors += 1;
+			c = NULL;
+		}
+		pthread_mutex_unlock(&pool->mut);
+	}
+
+	if (c) {
+		pool->comp->destroy_compressor(c);
+	}
+}
+
+void scar_codec_pool_free(struct scar_codec_pool *pool)
+{
+	for (size_t i = 0; i < pool->ncompressors; ++i) {
+		pool->comp->destroy_compressor(pool->compressors[i]);
+	}
+
+	for (size_t i = 0; i < pool->ndecompressors; ++i) {
+		pool->comp->destroy_decompressor(pool->decompressors[i]);
+	}
+
+	scar_parallel_inflate_free(pool->pinflate);
+
+	pthread_mutex_destroy(&pool->mut);
+	free(pool);
+}
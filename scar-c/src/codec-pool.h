@@ -0,0 +1,68 @@
+#ifndef SCAR_CODEC_POOL_H
+#define SCAR_CODEC_POOL_H
+
+#include <stddef.h>
+
+#include "compression.h"
+#include "io.h"
+
+// The most compressors and decompressors a codec pool keeps around
+// while nobody is using them. More than that are destroyed when
+// they're put back.
+#define SCAR_CODEC_POOL_MAX_IDLE 8
+
+// A codec pool keeps compressors and decompressors which are done
+// with one stream, so that they can be reset for the next one,
+// instead of being destroyed and created again.
+// Compressions which can't reset them just get new ones every time.
+// The pool can be used from several threads at once.
+struct scar_codec_pool;
+
+// Create a pool for 'comp', whose compressors use level 'clevel'.
+// 'comp' must outlive the pool. It may be switched to another gzip engine
+// in the meantime, since their decompressors can be reset for each other.
+struct scar_codec_pool *scar_codec_pool_create(
+	const struct scar_compression *comp, int clevel);
+
+// Get a decompressor, like 'create_decompressor_at' would create it,
+// or like 'create_decompressor' if 'ap' and 'sink' are both NULL.
+// Returns NULL on error.
+struct scar_decompressor *scar_codec_pool_get_decompressor(
+	struct scar_codec_pool *pool, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink);
+
+// Let the pool lend out a parallel inflater with 'nthreads' threads
+// and chunks of 'chunk_size' for big segments, see
+// 'scar_parallel_inflate_create'. The pool's compression must be gzip.
+// An 'nthreads' of 1 or less turns it off. If the inflater is lent out
+// at the time, it's replaced once it's put back.
+void scar_codec_pool_set_parallel_inflate(
+	struct scar_codec_pool *pool, unsigned int nthreads, size_t chunk_size);
+
+// Get a decompressor for a segment of 'len' compressed bytes, which is read
+// from its start. That's the pool's parallel inflater if the segment is
+// at least two chunks long and nobody else is using it, so that there's
+// only ever one set of inflate threads, and a decompressor from
+// 'scar_codec_pool_get_decompressor' otherwise. Either one reports access
+// points to 'sink', if it isn't NULL. Returns NULL on error.
+struct scar_decompressor *scar_codec_pool_get_segment_decompressor(
+	struct scar_codec_pool *pool, struct scar_io_reader *r, scar_offset len,
+	struct scar_access_point_sink *sink);
+
+// Give a decompressor back to the pool. 'd' may be NULL.
+void scar_codec_pool_put_decompressor(
+	struct scar_codec_pool *pool, struct scar_decompressor *d);
+
+// Get a compressor which writes to 'w'. Returns NULL on error.
+struct scar_compressor *scar_codec_pool_get_compressor(
+	struct scar_codec_pool *pool, struct scar_io_writer *w);
+
+// Give a compressor back to the pool. 'c' may be NULL.
+void scar_codec_pool_put_compressor(
+	struct scar_codec_pool *pool, struct scar_compressor *c);
+
+// Destroy every compressor and decompressor in the pool, and free it.
+// All of them must have been put back.
+void scar_codec_pool_free(struct scar_codec_pool *pool);
+
+#endif
@@ -5,6 +5,10 @@
 #include <zlib.h>
 #include <assert.h>
 
+#ifdef SCAR_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
 #include "../internal-util.h"
 
 static const unsigned char MAGIC[] = {0x1f, 0x8b};
@@ -14,18 +18,40 @@ static const unsigned char EOF_MARKER[] = {
 	0xf3, 0x55, 0x01, 0x09, 0x00, 0x00, 0x00,
 };
 
+// How much data goes in and out of zlib at a time
+#define CHUNK_SIZE (32 * 1024)
+
+// The biggest gzip member libdeflate compresses or decompresses in one go.
+// Checkpoint segments are about 10 MiB, which leaves room for segments
+// which end in a big entry. Bigger members are streamed through zlib.
+#define ONESHOT_MAX (64 * 1024 * 1024)
+
 struct gzip_compressor {
 	struct scar_compressor c;
 	int level;
 	struct scar_io_writer *w;
 	z_stream stream;
 	gz_header header;
+
+#ifdef SCAR_HAVE_LIBDEFLATE
+	// With libdeflate, 'ld' is set, and the current member is collected
+	// in 'member' and compressed into 'out' when it ends. If it grows
+	// past ONESHOT_MAX, zlib takes over the rest of it,
+	// and 'streaming' is set.
+	struct libdeflate_compressor *ld;
+	unsigned char *member;
+	size_t member_len;
+	size_t member_cap;
+	unsigned char *out;
+	size_t out_cap;
+	bool streaming;
+#endif
 };
 
 static scar_ssize write_deflate(
 	struct gzip_compressor *c, const void *buf, size_t len, int flush
 ) {
-	unsigned char chunk[4 * 1024];
+	unsigned char chunk[CHUNK_SIZE];
 
 	assert((size_t)(uInt)len == len);
 	c->stream.avail_in = (uInt)len;
@@ -51,28 +77,124 @@ static scar_ssize write_deflate(
 	return (scar_ssize)len;
 }
 
+#ifdef SCAR_HAVE_LIBDEFLATE
+// libdeflate's levels go up to 12, and it has no default level
+static int libdeflate_level(int level)
+{
+	if (level < 0) {
+		return 6;
+	} else if (level > 12) {
+		return 12;
+	}
+
+	return level;
+}
+
+// Add data to the member which libdeflate is going to compress
+static scar_ssize gzip_compressor_collect(
+	struct gzip_compressor *c, const void *buf, size_t len
+) {
+	if (len > ONESHOT_MAX - c->member_len) {
+		c->streaming = true;
+		if (write_deflate(c, c->member, c->member_len, Z_NO_FLUSH) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		c->member_len = 0;
+		return write_deflate(c, buf, len, Z_NO_FLUSH);
+	}
+
+	if (c->member_len + len > c->member_cap) {
+		size_t cap = c->member_cap > 0 ? c->member_cap * 2 : CHUNK_SIZE;
+		while (cap < c->member_len + len) {
+			cap *= 2;
+		}
+
+		if (cap > ONESHOT_MAX) {
+			cap = ONESHOT_MAX;
+		}
+
+		unsigned char *member = realloc(c->member, cap);
+		if (!member) {
+			SCAR_ERETURN(-1);
+		}
+
+		c->member = member;
+		c->member_cap = cap;
+	}
+
+	memcpy(&c->member[c->member_len], buf, len);
+	c->member_len += len;
+	return (scar_ssize)len;
+}
+
+// Compress the collected member and write it out
+static int gzip_compressor_oneshot(struct gzip_compressor *c)
+{
+	size_t bound = libdeflate_gzip_compress_bound(c->ld, c->member_len);
+	if (bound > c->out_cap) {
+		free(c->out);
+		c->out = malloc(bound);
+		c->out_cap = c->out ? bound : 0;
+		if (!c->out) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	size_t n = libdeflate_gzip_compress(
+		c->ld, c->member, c->member_len, c->out, bound);
+	if (n == 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	c->member_len = 0;
+	if (c->w->write(c->w, c->out, n) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+#endif
+
 static scar_ssize gzip_compressor_write(
 	struct scar_io_writer *ptr, const void *buf, size_t len
 ) {
-	return write_deflate((struct gzip_compressor *)ptr, buf, len, Z_NO_FLUSH);
+	struct gzip_compressor *c = (struct gzip_compressor *)ptr;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	if (c->ld && !c->streaming) {
+		return gzip_compressor_collect(c, buf, len);
+	}
+#endif
+
+	return write_deflate(c, buf, len, Z_NO_FLUSH);
 }
 
-static int gzip_compressor_flush(struct scar_compressor *ptr)
+// Write out the end of the current member
+static int gzip_compressor_end_member(struct gzip_compressor *c)
 {
-	struct gzip_compressor *c = (struct gzip_compressor *)ptr;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	if (c->ld && !c->streaming) {
+		return gzip_compressor_oneshot(c);
+	}
+#endif
+
 	if (write_deflate(c, NULL, 0, Z_FINISH) < 0) {
-		return -1;
+		SCAR_ERETURN(-1);
 	}
 
-	deflateEnd(&c->stream);
+	return 0;
+}
 
-	c->stream.zalloc = Z_NULL;
-	c->stream.zfree = Z_NULL;
-	c->stream.opaque = Z_NULL;
-	if (deflateInit2(
-		&c->stream, c->level, Z_DEFLATED,
-		15 | 16, 8, Z_DEFAULT_STRATEGY) != Z_OK
-	) {
+// Start a new gzip member. The stream's state is kept,
+// so that nothing has to be allocated again.
+static int gzip_compressor_restart(struct gzip_compressor *c)
+{
+#ifdef SCAR_HAVE_LIBDEFLATE
+	c->member_len = 0;
+	c->streaming = false;
+#endif
+
+	if (deflateReset(&c->stream) != Z_OK) {
 		SCAR_ERETURN(-1);
 	}
 
@@ -85,9 +207,19 @@ static int gzip_compressor_flush(struct scar_compressor *ptr)
 	return 0;
 }
 
+static int gzip_compressor_flush(struct scar_compressor *ptr)
+{
+	struct gzip_compressor *c = (struct gzip_compressor *)ptr;
+	if (gzip_compressor_end_member(c) < 0) {
+		return -1;
+	}
+
+	return gzip_compressor_restart(c);
+}
+
 static int gzip_compressor_finish(struct scar_compressor *ptr)
 {
-	return (int)write_deflate((struct gzip_compressor *)ptr, NULL, 0, Z_FINISH);
+	return gzip_compressor_end_member((struct gzip_compressor *)ptr);
 }
 
 static struct scar_compressor *create_gzip_compressor(
@@ -121,46 +253,258 @@ static struct scar_compressor *create_gzip_compressor(
 	c->c.w.write = gzip_compressor_write;
 	c->c.flush = gzip_compressor_flush;
 	c->c.finish = gzip_compressor_finish;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	c->ld = NULL;
+	c->member = NULL;
+	c->member_len = 0;
+	c->member_cap = 0;
+	c->out = NULL;
+	c->out_cap = 0;
+	c->streaming = false;
+#endif
 	return &c->c;
 }
 
+static int reset_gzip_compressor(
+	struct scar_compressor *ptr, struct scar_io_writer *w
+) {
+	struct gzip_compressor *c = (struct gzip_compressor *)ptr;
+	c->w = w;
+	return gzip_compressor_restart(c);
+}
+
 static void destroy_gzip_compressor(struct scar_compressor *ptr)
 {
 	struct gzip_compressor *c = (struct gzip_compressor *)ptr;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	if (c->ld) {
+		libdeflate_free_compressor(c->ld);
+	}
+	free(c->member);
+	free(c->out);
+#endif
 	deflateEnd(&c->stream);
 	free(c);
 }
 
+#ifdef SCAR_HAVE_LIBDEFLATE
+static struct scar_compressor *create_libdeflate_compressor(
+	struct scar_io_writer *w, int level
+) {
+	struct scar_compressor *ptr = create_gzip_compressor(w, level);
+	if (!ptr) {
+		SCAR_ERETURN(NULL);
+	}
+
+	// zlib is still there for members which are too big
+	struct gzip_compressor *c = (struct gzip_compressor *)ptr;
+	c->ld = libdeflate_alloc_compressor(libdeflate_level(level));
+	if (!c->ld) {
+		destroy_gzip_compressor(ptr);
+		SCAR_ERETURN(NULL);
+	}
+
+	return ptr;
+}
+#endif
+
+// The most data deflate can refer back to
+#define WINDOW_SIZE (32 * 1024)
+
+// How much output fill_buf decompresses at a time
+#define BUFFER_SIZE (32 * 1024)
+
 struct gzip_decompressor {
 	struct scar_decompressor d;
 	struct scar_io_reader *r;
 	z_stream stream;
-	unsigned char chunk[4 * 1024];
+
+	// Compressed input is borrowed from 'r' if it can lend out its buffer,
+	// and read into 'chunk' otherwise
+	unsigned char chunk[CHUNK_SIZE];
+
+	// Output which fill_buf decompressed, and which hasn't been consumed yet.
+	// Reads take from here first, then decompress straight into
+	// the caller's buffer. 'pending' is 'buf', or the whole member
+	// if libdeflate decompressed it in one go.
+	unsigned char buf[BUFFER_SIZE];
+	unsigned char *pending;
+	size_t buf_pos;
+	size_t buf_len;
+
+	// With 'oneshot', the first read tries to decompress the whole member
+	// with libdeflate. If that works, 'finished' is set,
+	// and zlib never gets to see the member.
+	bool oneshot;
+	bool finished;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	struct libdeflate_decompressor *ld;
+	unsigned char *whole;
+	size_t whole_cap;
+#endif
+
+	// With a sink, inflate stops at every deflate block boundary,
+	// and every 'sink->span' bytes of output one of them is reported
+	// as an access point. 'in' and 'out' count the compressed bytes read
+	// and the uncompressed bytes produced, and 'window' holds
+	// the window of an access point while it's being reported.
+	struct scar_access_point_sink *sink;
+	scar_offset in;
+	scar_offset out;
+	scar_offset last_point;
+	unsigned char *window;
 };
 
-static scar_ssize gzip_decompressor_read(
-	struct scar_io_reader *ptr, void *buf, size_t len
+static void gzip_decompressor_add_point(struct gzip_decompressor *d)
+{
+	uInt window_len = WINDOW_SIZE;
+	if (inflateGetDictionary(&d->stream, d->window, &window_len) != Z_OK) {
+		return;
+	}
+
+	struct scar_access_point ap;
+	ap.in = d->in - d->stream.avail_in;
+	ap.out = d->out;
+	ap.bits = d->stream.data_type & 7;
+	ap.window = d->window;
+	ap.window_len = window_len;
+	d->sink->add(d->sink, &ap);
+	d->last_point = d->out;
+}
+
+// Try to decompress the whole member in one go, before anything else
+// has been read. This only works if 'r' lends out the whole member;
+// otherwise zlib streams it like usual.
+// Returns -1 on error, and 0 otherwise.
+static int gzip_decompressor_oneshot(struct gzip_decompressor *d)
+{
+	d->oneshot = false;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	struct scar_io_reader *r = d->r;
+	if (!r->fill_buf) {
+		return 0;
+	}
+
+	const void *in;
+	scar_ssize n = r->fill_buf(r, &in);
+	if (n < 0) {
+		SCAR_ERETURN(-1);
+	} else if (n < 18) {
+		return 0;
+	}
+
+	// If the reader has just the one member, its trailer says how big
+	// it is uncompressed. Deflate can't do better than about 1032:1,
+	// so anything more than that means the guess is wrong.
+	const unsigned char *isize = (const unsigned char *)in + n - 4;
+	size_t cap =
+		(size_t)isize[0] | (size_t)isize[1] << 8 |
+		(size_t)isize[2] << 16 | (size_t)isize[3] << 24;
+	if (cap == 0 || cap > ONESHOT_MAX || cap / 1032 > (size_t)n) {
+		cap = (size_t)n * 4;
+		if (cap < BUFFER_SIZE) {
+			cap = BUFFER_SIZE;
+		} else if (cap > ONESHOT_MAX) {
+			cap = ONESHOT_MAX;
+		}
+	}
+
+	while (1) {
+		if (cap > d->whole_cap) {
+			free(d->whole);
+			d->whole = malloc(cap);
+			d->whole_cap = d->whole ? cap : 0;
+			if (!d->whole) {
+				SCAR_ERETURN(-1);
+			}
+		}
+
+		size_t in_len, out_len;
+		enum libdeflate_result res = libdeflate_gzip_decompress_ex(
+			d->ld, in, (size_t)n, d->whole, cap, &in_len, &out_len);
+		if (res == LIBDEFLATE_SUCCESS) {
+			r->consume(r, in_len);
+			d->in += (scar_offset)in_len;
+			d->out += (scar_offset)out_len;
+			d->pending = d->whole;
+			d->buf_pos = 0;
+			d->buf_len = out_len;
+			d->finished = true;
+			return 0;
+		}
+
+		// Bad or cut off data is left for zlib to report
+		if (res != LIBDEFLATE_INSUFFICIENT_SPACE || cap >= ONESHOT_MAX) {
+			return 0;
+		}
+
+		cap = cap > ONESHOT_MAX / 2 ? ONESHOT_MAX : cap * 2;
+	}
+#else
+	return 0;
+#endif
+}
+
+// Give inflate more input. Returns the number of bytes,
+// 0 at the end of the input, or -1 on error.
+static scar_ssize gzip_decompressor_fill_input(struct gzip_decompressor *d)
+{
+	struct scar_io_reader *r = d->r;
+	scar_ssize n;
+	if (r->fill_buf) {
+		// Nothing else reads from 'r', so the borrowed data stays
+		// valid until inflate is done with it
+		const void *in;
+		n = r->fill_buf(r, &in);
+		if (n > (scar_ssize)(1u << 30)) {
+			n = (scar_ssize)(1u << 30);
+		}
+
+		if (n > 0) {
+			r->consume(r, (size_t)n);
+			d->stream.next_in = (Bytef *)in;
+		}
+	} else {
+		n = r->read(r, d->chunk, sizeof(d->chunk));
+		d->stream.next_in = d->chunk;
+	}
+
+	if (n < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	d->stream.avail_in = (uInt)n;
+	d->in += n;
+	return n;
+}
+
+// Decompress into 'buf' until it's full or the stream ends.
+// Returns the number of bytes decompressed, or -1 on error.
+static scar_ssize gzip_decompressor_inflate(
+	struct gzip_decompressor *d, unsigned char *buf, size_t len
 ) {
-	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+	if (d->finished) {
+		return 0;
+	}
 
 	assert((size_t)(uInt)len == len);
 	d->stream.avail_out = (uInt)len;
 	d->stream.next_out = (Bytef *)buf;
+	int flush = d->sink ? Z_BLOCK : Z_NO_FLUSH;
 
 	do {
 		if (d->stream.avail_in == 0) {
-			d->stream.next_in = d->chunk;
-			scar_ssize n = d->r->read(d->r, d->chunk, sizeof(d->chunk));
+			scar_ssize n = gzip_decompressor_fill_input(d);
 			if (n < 0) {
 				SCAR_ERETURN(-1);
 			} else if (n == 0) {
 				return (scar_ssize)(len - d->stream.avail_out);
 			}
-
-			d->stream.avail_in = (uInt)n;
 		}
 
-		int ret = inflate(&d->stream, Z_NO_FLUSH);
+		uInt avail_out = d->stream.avail_out;
+		int ret = inflate(&d->stream, flush);
+		d->out += avail_out - d->stream.avail_out;
 		switch (ret) {
 		case Z_STREAM_ERROR:
 		case Z_NEED_DICT:
@@ -170,49 +514,315 @@ static scar_ssize gzip_decompressor_read(
 		case Z_STREAM_END:
 			return (scar_ssize)(len - d->stream.avail_out);
 		}
+
+		// Bit 7 of data_type means inflate stopped at the end of a block,
+		// bit 6 means it was the last block
+		if (
+			d->sink && (d->stream.data_type & 128) &&
+			!(d->stream.data_type & 64) &&
+			d->out - d->last_point >= d->sink->span
+		) {
+			gzip_decompressor_add_point(d);
+		}
 	} while (d->stream.avail_out > 0);
 
 	return (scar_ssize)len;
 }
 
-static struct scar_decompressor *create_gzip_decompressor(
-	struct scar_io_reader *r
+static scar_ssize gzip_decompressor_read(
+	struct scar_io_reader *ptr, void *buf, size_t len
+) {
+	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+	if (d->oneshot && gzip_decompressor_oneshot(d) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	size_t done = 0;
+	if (d->buf_pos < d->buf_len) {
+		done = d->buf_len - d->buf_pos;
+		if (done > len) {
+			done = len;
+		}
+
+		memcpy(buf, &d->pending[d->buf_pos], done);
+		d->buf_pos += done;
+		if (done == len) {
+			return (scar_ssize)len;
+		}
+	}
+
+	scar_ssize n = gzip_decompressor_inflate(
+		d, (unsigned char *)buf + done, len - done);
+	if (n < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return (scar_ssize)done + n;
+}
+
+static scar_ssize gzip_decompressor_fill_buf(
+	struct scar_io_reader *ptr, const void **buf
+) {
+	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+	if (d->oneshot && gzip_decompressor_oneshot(d) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (d->buf_pos == d->buf_len) {
+		scar_ssize n = gzip_decompressor_inflate(d, d->buf, sizeof(d->buf));
+		if (n < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		d->pending = d->buf;
+		d->buf_pos = 0;
+		d->buf_len = (size_t)n;
+	}
+
+	*buf = &d->pending[d->buf_pos];
+	return (scar_ssize)(d->buf_len - d->buf_pos);
+}
+
+static void gzip_decompressor_consume(struct scar_io_reader *ptr, size_t len)
+{
+	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+	assert(len <= d->buf_len - d->buf_pos);
+	d->buf_pos += len;
+}
+
+// Point a decompressor whose stream has just been initialized or reset
+// at 'r', and start it at 'ap' if it's not NULL. With 'libdeflate',
+// a decompressor without 'ap' and 'sink' tries libdeflate first.
+static int gzip_decompressor_start(
+	struct gzip_decompressor *d, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink,
+	bool libdeflate
+) {
+	if (sink && !d->window) {
+		d->window = malloc(WINDOW_SIZE);
+		if (!d->window) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	d->oneshot = false;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	if (libdeflate && !ap && !sink) {
+		if (!d->ld) {
+			d->ld = libdeflate_alloc_decompressor();
+			if (!d->ld) {
+				SCAR_ERETURN(-1);
+			}
+		}
+
+		d->oneshot = true;
+	}
+#else
+	(void)libdeflate;
+#endif
+
+	d->r = r;
+	d->stream.next_in = NULL;
+	d->stream.avail_in = 0;
+	d->pending = d->buf;
+	d->buf_pos = 0;
+	d->buf_len = 0;
+	d->finished = false;
+	d->sink = sink;
+	d->in = 0;
+	d->out = 0;
+	d->last_point = 0;
+	if (!ap) {
+		return 0;
+	}
+
+	if (ap->bits > 0) {
+		unsigned char byte;
+		if (r->read(r, &byte, 1) != 1) {
+			SCAR_ERETURN(-1);
+		}
+
+		d->in = 1;
+		inflatePrime(&d->stream, ap->bits, byte >> (8 - ap->bits));
+	}
+
+	if (inflateSetDictionary(
+		&d->stream, ap->window, (uInt)ap->window_len) != Z_OK
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+static void destroy_gzip_decompressor(struct scar_decompressor *ptr)
+{
+	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	if (d->ld) {
+		libdeflate_free_decompressor(d->ld);
+	}
+	free(d->whole);
+#endif
+	inflateEnd(&d->stream);
+	free(d->window);
+	free(d);
+}
+
+static struct scar_decompressor *gzip_decompressor_create(
+	struct scar_io_reader *r, const struct scar_access_point *ap,
+	struct scar_access_point_sink *sink, bool libdeflate
 ) {
 	struct gzip_decompressor *d = malloc(sizeof(*d));
 	if (!d) {
 		SCAR_ERETURN(NULL);
 	}
 
+	// From an access point, the data is raw deflate
+	// in the middle of a gzip member
 	d->stream.next_in = NULL;
 	d->stream.avail_in = 0;
 	d->stream.zalloc = Z_NULL;
 	d->stream.zfree = Z_NULL;
 	d->stream.opaque = Z_NULL;
-	if (inflateInit2(&d->stream, 15 | 16) != Z_OK) {
+	if (inflateInit2(&d->stream, ap ? -15 : 15 | 16) != Z_OK) {
 		free(d);
 		SCAR_ERETURN(NULL);
 	}
 
-	d->r = r;
 	d->d.r.read = gzip_decompressor_read;
+	d->d.r.fill_buf = gzip_decompressor_fill_buf;
+	d->d.r.consume = gzip_decompressor_consume;
+	d->window = NULL;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	d->ld = NULL;
+	d->whole = NULL;
+	d->whole_cap = 0;
+#endif
+	if (gzip_decompressor_start(d, r, ap, sink, libdeflate) < 0) {
+		destroy_gzip_decompressor(&d->d);
+		SCAR_ERETURN(NULL);
+	}
+
 	return &d->d;
 }
 
-static void destroy_gzip_decompressor(struct scar_decompressor *ptr)
-{
+// The window, the inflate state and libdeflate's state are kept,
+// so that a cursor which seeks around doesn't allocate them over and over
+static int gzip_decompressor_reset(
+	struct scar_decompressor *ptr, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink,
+	bool libdeflate
+) {
 	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
-	inflateEnd(&d->stream);
-	free(d);
+	if (inflateReset2(&d->stream, ap ? -15 : 15 | 16) != Z_OK) {
+		SCAR_ERETURN(-1);
+	}
+
+	return gzip_decompressor_start(d, r, ap, sink, libdeflate);
+}
+
+static struct scar_decompressor *create_gzip_decompressor_at(
+	struct scar_io_reader *r, const struct scar_access_point *ap,
+	struct scar_access_point_sink *sink
+) {
+	return gzip_decompressor_create(r, ap, sink, false);
 }
 
+static struct scar_decompressor *create_gzip_decompressor(
+	struct scar_io_reader *r
+) {
+	return gzip_decompressor_create(r, NULL, NULL, false);
+}
+
+static int reset_gzip_decompressor(
+	struct scar_decompressor *ptr, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink
+) {
+	return gzip_decompressor_reset(ptr, r, ap, sink, false);
+}
+
+#ifdef SCAR_HAVE_LIBDEFLATE
+static struct scar_decompressor *create_libdeflate_decompressor_at(
+	struct scar_io_reader *r, const struct scar_access_point *ap,
+	struct scar_access_point_sink *sink
+) {
+	return gzip_decompressor_create(r, ap, sink, true);
+}
+
+static struct scar_decompressor *create_libdeflate_decompressor(
+	struct scar_io_reader *r
+) {
+	return gzip_decompressor_create(r, NULL, NULL, true);
+}
+
+static int reset_libdeflate_decompressor(
+	struct scar_decompressor *ptr, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink
+) {
+	return gzip_decompressor_reset(ptr, r, ap, sink, true);
+}
+#endif
+
 void scar_compression_init_gzip(struct scar_compression *c)
 {
-	c->create_compressor = create_gzip_compressor;
+	scar_compression_init_gzip_engine(c, SCAR_GZIP_ZLIB);
+}
+
+// Every engine's compressors and decompressors are gzip_compressors
+// and gzip_decompressors, so they share 'destroy' and 'reset_compressor',
+// and a pool can reset one engine's decompressor for another.
+bool scar_compression_init_gzip_engine(
+	struct scar_compression *c, enum scar_gzip_engine engine
+) {
+	switch (engine) {
+	case SCAR_GZIP_ZLIB:
+		c->create_compressor = create_gzip_compressor;
+		c->create_decompressor = create_gzip_decompressor;
+		c->create_decompressor_at = create_gzip_decompressor_at;
+		c->reset_decompressor = reset_gzip_decompressor;
+		break;
+#ifdef SCAR_HAVE_LIBDEFLATE
+	case SCAR_GZIP_LIBDEFLATE:
+		c->create_compressor = create_libdeflate_compressor;
+		c->create_decompressor = create_libdeflate_decompressor;
+		c->create_decompressor_at = create_libdeflate_decompressor_at;
+		c->reset_decompressor = reset_libdeflate_decompressor;
+		break;
+#endif
+	default:
+		return false;
+	}
+
 	c->destroy_compressor = destroy_gzip_compressor;
-	c->create_decompressor = create_gzip_decompressor;
 	c->destroy_decompressor = destroy_gzip_decompressor;
+	c->reset_compressor = reset_gzip_compressor;
 	c->magic = MAGIC;
 	c->magic_len = sizeof(MAGIC);
 	c->eof_marker = EOF_MARKER;
 	c->eof_marker_len = sizeof(EOF_MARKER);
+	return true;
+}
+
+bool scar_gzip_engine_from_name(
+	const char *name, enum scar_gzip_engine *engine
+) {
+	if (strcmp(name, "zlib") == 0) {
+		*engine = SCAR_GZIP_ZLIB;
+		return true;
+	}
+
+#ifdef SCAR_HAVE_LIBDEFLATE
+	if (strcmp(name, "libdeflate") == 0) {
+		*engine = SCAR_GZIP_LIBDEFLATE;
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+bool scar_compression_is_gzip(const struct scar_compression *comp)
+{
+	return comp->destroy_decompressor == destroy_gzip_decompressor;
 }
@@ -53,6 +53,14 @@ static struct scar_compressor *create_plain_compressor(
 	return &c->c;
 }
 
+static int reset_plain_compressor(
+	struct scar_compressor *ptr, struct scar_io_writer *w
+) {
+	struct plain_compressor *c = (struct plain_compressor *)ptr;
+	c->w = w;
+	return 0;
+}
+
 static void destroy_plain_compressor(struct scar_compressor *ptr)
 {
 	struct plain_compressor *c = (struct plain_compressor *)ptr;
@@ -71,6 +79,30 @@ static scar_ssize plain_decompressor_read(
 	return d->r->read(d->r, buf, len);
 }
 
+// The data is passed through as it is, so if the reader can lend out
+// its buffer, so can the decompressor
+static scar_ssize plain_decompressor_fill_buf(
+	struct scar_io_reader *ptr, const void **buf
+) {
+	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+	return d->r->fill_buf(d->r, buf);
+}
+
+static void plain_decompressor_consume(struct scar_io_reader *ptr, size_t len)
+{
+	struct gzip_decompressor *d = (struct gzip_decompressor *)ptr;
+	d->r->consume(d->r, len);
+}
+
+static void plain_decompressor_start(
+	struct gzip_decompressor *d, struct scar_io_reader *r
+) {
+	d->r = r;
+	d->d.r.read = plain_decompressor_read;
+	d->d.r.fill_buf = r->fill_buf ? plain_decompressor_fill_buf : NULL;
+	d->d.r.consume = r->fill_buf ? plain_decompressor_consume : NULL;
+}
+
 static struct scar_decompressor *create_plain_decompressor(
 	struct scar_io_reader *r
 ) {
@@ -79,11 +111,25 @@ static struct scar_decompressor *create_plain_decompressor(
 		SCAR_ERETURN(NULL);
 	}
 
-	d->r = r;
-	d->d.r.read = plain_decompressor_read;
+	plain_decompressor_start(d, r);
 	return &d->d;
 }
 
+static int reset_plain_decompressor(
+	struct scar_decompressor *ptr, struct scar_io_reader *r,
+	const struct scar_access_point *ap, struct scar_access_point_sink *sink
+) {
+	(void)sink;
+
+	// There are no access points in plain archives
+	if (ap) {
+		SCAR_ERETURN(-1);
+	}
+
+	plain_decompressor_start((struct gzip_decompressor *)ptr, r);
+	return 0;
+}
+
 static void destroy_plain_decompressor(struct scar_decompressor *ptr)
 {
 	struct plain_decompressor *d = (struct plain_decompressor *)ptr;
@@ -96,8 +142,16 @@ void scar_compression_init_plain(struct scar_compression *c)
 	c->destroy_compressor = destroy_plain_compressor;
 	c->create_decompressor = create_plain_decompressor;
 	c->destroy_decompressor = destroy_plain_decompressor;
+	c->create_decompressor_at = NULL;
+	c->reset_compressor = reset_plain_compressor;
+	c->reset_decompressor = reset_plain_decompressor;
 	c->magic = MAGIC;
 	c->magic_len = sizeof(MAGIC);
 	c->eof_marker = EOF_MARKER;
 	c->eof_marker_len = sizeof(EOF_MARKER);
 }
+
+bool scar_compression_is_plain(const struct scar_compression *comp)
+{
+	return comp->create_compressor == create_plain_compressor;
+}
@@ -0,0 +1,463 @@
+// For pread, mmap and syscall
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#endif
+
+#include "fetch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal-util.h"
+#include "ioutil.h"
+#include "util.h"
+
+#ifdef SCAR_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Old libc headers may not know about the io_uring syscalls yet
+#if !defined(__NR_io_uring_setup) || !defined(__NR_io_uring_enter)
+#undef SCAR_HAVE_IO_URING
+#endif
+#endif
+
+// The kernel refuses rings bigger than this
+#define FETCH_MAX_DEPTH 4096
+
+// A single read request's length is 32 bit;
+// longer reads are split up like short reads are.
+#define FETCH_MAX_READ (1u << 30)
+
+struct fetch_req {
+	scar_offset offset;
+	unsigned char *buf;
+	size_t len;
+	size_t done;
+	void *tag;
+	bool busy;
+	int status;
+};
+
+#ifdef SCAR_HAVE_IO_URING
+struct fetch_uring {
+	int fd;
+	int file_fd;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	// The number of SQEs which have been queued, but not yet
+	// handed to the kernel with io_uring_enter
+	unsigned int to_submit;
+};
+#endif
+
+struct scar_fetcher {
+	struct scar_io_preader *pr;
+	unsigned int depth;
+	unsigned int pending;
+	struct fetch_req *reqs;
+
+	// Synchronous reads complete in the order they're submitted;
+	// this is a ring buffer of their request indexes
+	unsigned int *done;
+	unsigned int done_head;
+	unsigned int done_len;
+
+	bool async;
+#ifdef SCAR_HAVE_IO_URING
+	struct fetch_uring ring;
+#endif
+};
+
+#ifdef SCAR_HAVE_IO_URING
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(
+	int fd, unsigned int to_submit, unsigned int min_complete,
+	unsigned int flags
+) {
+	return (int)syscall(
+		__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_destroy(struct fetch_uring *ring)
+{
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+}
+
+static int uring_init(
+	struct fetch_uring *ring, int file_fd, unsigned int entries
+) {
+	ring->fd = -1;
+	ring->file_fd = file_fd;
+	ring->sq_ring = NULL;
+	ring->cq_ring = NULL;
+	ring->sqes = NULL;
+	ring->to_submit = 0;
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	ring->fd = uring_setup(entries, &p);
+	if (ring->fd < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	// IORING_OP_READ came in the same kernel release as this feature flag,
+	// and older kernels would fail every read
+	if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+		uring_destroy(ring);
+		SCAR_ERETURN(-1);
+	}
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ring->cq_ring_size =
+		p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) {
+		ring->sq_ring_size = ring->cq_ring_size;
+	}
+
+	void *ptr = mmap(
+		NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED) {
+		uring_destroy(ring);
+		SCAR_ERETURN(-1);
+	}
+	ring->sq_ring = ptr;
+
+	if (single_mmap) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ptr = mmap(
+			NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ptr == MAP_FAILED) {
+			uring_destroy(ring);
+			SCAR_ERETURN(-1);
+		}
+		ring->cq_ring = ptr;
+	}
+
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ptr = mmap(
+		NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ptr == MAP_FAILED) {
+		uring_destroy(ring);
+		SCAR_ERETURN(-1);
+	}
+	ring->sqes = ptr;
+
+	unsigned char *sq = ring->sq_ring;
+	ring->sq_head = (unsigned int *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+
+	unsigned char *cq = ring->cq_ring;
+	ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	return 0;
+}
+
+// Queue a read of the rest of request 'idx'.
+// There's always room in the SQ, since it's at least as big
+// as the number of requests.
+static void uring_queue_read(
+	struct scar_fetcher *f, unsigned int idx
+) {
+	struct fetch_uring *ring = &f->ring;
+	struct fetch_req *req = &f->reqs[idx];
+
+	size_t len = req->len - req->done;
+	if (len > FETCH_MAX_READ) {
+		len = FETCH_MAX_READ;
+	}
+
+	unsigned int tail = *ring->sq_tail;
+	unsigned int slot = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[slot];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = ring->file_fd;
+	sqe->off = (uint64_t)req->offset + req->done;
+	sqe->addr = (uint64_t)(uintptr_t)(req->buf + req->done);
+	sqe->len = (uint32_t)len;
+	sqe->user_data = idx;
+	ring->sq_array[slot] = slot;
+
+	// The kernel must see the SQE before it sees the new tail
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->to_submit += 1;
+}
+
+// Hand queued reads to the kernel, and if 'wait' is set,
+// block until at least one read has completed.
+static int uring_flush(struct fetch_uring *ring, bool wait)
+{
+	while (ring->to_submit > 0 || wait) {
+		unsigned int flags = wait ? IORING_ENTER_GETEVENTS : 0;
+		int n = uring_enter(ring->fd, ring->to_submit, wait ? 1 : 0, flags);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		} else if (n < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		ring->to_submit -= (unsigned int)n;
+		if (ring->to_submit == 0) {
+			break;
+		}
+	}
+
+	return 0;
+}
+
+// Wait for the next read to be done with completely,
+// re-queueing the rest of any short reads.
+// Returns the request index, or -1 if the ring itself failed.
+static long uring_wait(struct scar_fetcher *f)
+{
+	struct fetch_uring *ring = &f->ring;
+
+	// Get any newly queued reads going before looking for completions
+	if (uring_flush(ring, false) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	while (1) {
+		unsigned int head = *ring->cq_head;
+		if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+			if (uring_flush(ring, true) < 0) {
+				SCAR_ERETURN(-1);
+			}
+			continue;
+		}
+
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		unsigned int idx = (unsigned int)cqe->user_data;
+		int res = cqe->res;
+		__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+		struct fetch_req *req = &f->reqs[idx];
+		if (res == -EINTR || res == -EAGAIN) {
+			uring_queue_read(f, idx);
+			continue;
+		} else if (res <= 0) {
+			// Either an I/O error, or the file ended early
+			req->status = -1;
+			return idx;
+		}
+
+		req->done += (size_t)res;
+		if (req->done < req->len) {
+			uring_queue_read(f, idx);
+			continue;
+		}
+
+		req->status = 0;
+		return idx;
+	}
+}
+
+#endif
+
+struct scar_fetcher *scar_fetcher_create(
+	struct scar_io_preader *pr, unsigned int depth
+) {
+	if (depth == 0) {
+		depth = SCAR_FETCH_DEFAULT_DEPTH;
+	} else if (depth > FETCH_MAX_DEPTH) {
+		depth = FETCH_MAX_DEPTH;
+	}
+
+	struct scar_fetcher *f = malloc(sizeof(*f));
+	if (!f) {
+		SCAR_ERETURN(NULL);
+	}
+
+	f->pr = pr;
+	f->depth = depth;
+	f->pending = 0;
+	f->done_head = 0;
+	f->done_len = 0;
+	f->async = false;
+	f->reqs = calloc(depth, sizeof(*f->reqs));
+	f->done = malloc(depth * sizeof(*f->done));
+	if (!f->reqs || !f->done) {
+		free(f->reqs);
+		free(f->done);
+		free(f);
+		SCAR_ERETURN(NULL);
+	}
+
+#ifdef SCAR_HAVE_IO_URING
+	// Only file descriptors can be read through the ring;
+	// anything else (or a kernel without io_uring) uses read_at
+	if (pr->read_at == scar_fd_preader_read_at) {
+		struct scar_fd_preader *fp = SCAR_BASE(struct scar_fd_preader, pr);
+		if (uring_init(&f->ring, fp->fd, depth) >= 0) {
+			f->async = true;
+		}
+	}
+#endif
+
+	return f;
+}
+
+unsigned int scar_fetcher_depth(struct scar_fetcher *f)
+{
+	return f->depth;
+}
+
+bool scar_fetcher_is_async(struct scar_fetcher *f)
+{
+	return f->async;
+}
+
+unsigned int scar_fetcher_pending(struct scar_fetcher *f)
+{
+	return f->pending;
+}
+
+int scar_fetcher_submit(
+	struct scar_fetcher *f, scar_offset offset, void *buf, size_t len,
+	void *tag
+) {
+	if (f->pending >= f->depth || offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned int idx = 0;
+	while (f->reqs[idx].busy) {
+		idx += 1;
+	}
+
+	struct fetch_req *req = &f->reqs[idx];
+	req->offset = offset;
+	req->buf = buf;
+	req->len = len;
+	req->done = 0;
+	req->tag = tag;
+	req->busy = true;
+	req->status = 0;
+	f->pending += 1;
+
+#ifdef SCAR_HAVE_IO_URING
+	if (f->async) {
+		if (len == 0) {
+			// Nothing to read, but it still has to come out of wait
+			f->done[(f->done_head + f->done_len) % f->depth] = idx;
+			f->done_len += 1;
+		} else {
+			uring_queue_read(f, idx);
+		}
+		return 0;
+	}
+#endif
+
+	scar_ssize n = f->pr->read_at(f->pr, offset, buf, len);
+	if (n < 0 || (size_t)n < len) {
+		req->status = -1;
+	}
+
+	f->done[(f->done_head + f->done_len) % f->depth] = idx;
+	f->done_len += 1;
+	return 0;
+}
+
+int scar_fetcher_wait(struct scar_fetcher *f, void **tag)
+{
+	*tag = NULL;
+	if (f->pending == 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned int idx;
+	if (f->done_len > 0) {
+		idx = f->done[f->done_head];
+		f->done_head = (f->done_head + 1) % f->depth;
+		f->done_len -= 1;
+	} else {
+#ifdef SCAR_HAVE_IO_URING
+		long r = uring_wait(f);
+		if (r < 0) {
+			SCAR_ERETURN(-1);
+		}
+		idx = (unsigned int)r;
+#else
+		SCAR_ERETURN(-1);
+#endif
+	}
+
+	struct fetch_req *req = &f->reqs[idx];
+	req->busy = false;
+	f->pending -= 1;
+	*tag = req->tag;
+	if (req->status < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+void scar_fetcher_free(struct scar_fetcher *f)
+{
+#ifdef SCAR_HAVE_IO_URING
+	if (f->async) {
+		// The kernel may still be writing into the callers' buffers,
+		// so all reads have to be done before they're freed
+		while (f->pending > 0) {
+			void *tag;
+			if (scar_fetcher_wait(f, &tag) < 0 && !tag) {
+				break;
+			}
+		}
+
+		uring_destroy(&f->ring);
+	}
+#endif
+
+	free(f->reqs);
+	free(f->done);
+	free(f);
+}
@@ -0,0 +1,74 @@
+#include "footer.h"
+
+#include "ioutil.h"
+#include "internal-util.h"
+
+int scar_footer_write_section(
+	struct scar_io_writer *w, struct scar_compression *comp, int clevel,
+	const void *buf, size_t len
+) {
+	struct scar_compressor *compressor = comp->create_compressor(w, clevel);
+	if (compressor == NULL) {
+		SCAR_ERETURN(-1);
+	}
+
+	scar_ssize ret = compressor->w.write(&compressor->w, buf, len);
+	if (ret < (scar_ssize)len) {
+		comp->destroy_compressor(compressor);
+		SCAR_ERETURN(-1);
+	}
+
+	if (compressor->finish(compressor) < 0) {
+		comp->destroy_compressor(compressor);
+		SCAR_ERETURN(-1);
+	}
+
+	comp->destroy_compressor(compressor);
+	return 0;
+}
+
+int scar_footer_write_tail(
+	struct scar_io_writer *w, struct scar_compression *comp, int clevel,
+	scar_offset index_offset, scar_offset checkpoints_offset,
+	const struct scar_footer_section *sections, size_t nsections
+) {
+	struct scar_compressor *tail_compressor =
+		comp->create_compressor(w, clevel);
+	if (tail_compressor == NULL) {
+		SCAR_ERETURN(-1);
+	}
+
+	scar_ssize ret = scar_io_printf(
+		&tail_compressor->w, "SCAR-TAIL\n%lld\n%lld\n",
+		index_offset, checkpoints_offset);
+	if (ret < 0) {
+		comp->destroy_compressor(tail_compressor);
+		SCAR_ERETURN(-1);
+	}
+
+	// Readers which don't know about extension sections
+	// stop reading after the checkpoints offset
+	for (size_t i = 0; i < nsections; ++i) {
+		ret = scar_io_printf(
+			&tail_compressor->w, "%s %lld\n",
+			sections[i].name, sections[i].offset);
+		if (ret < 0) {
+			comp->destroy_compressor(tail_compressor);
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	if (tail_compressor->finish(tail_compressor) < 0) {
+		comp->destroy_compressor(tail_compressor);
+		SCAR_ERETURN(-1);
+	}
+
+	comp->destroy_compressor(tail_compressor);
+
+	ret = w->write(w, comp->eof_marker, comp->eof_marker_len);
+	if (ret < (scar_ssize)comp->eof_marker_len) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef SCAR_FOOTER_H
+#define SCAR_FOOTER_H
+
+#include "compression.h"
+#include "io.h"
+
+// The most extension sections a tail can list.
+#define SCAR_FOOTER_MAX_SECTIONS 16
+
+// An extension section, listed in the tail as "<name> <offset>".
+struct scar_footer_section {
+	const char *name;
+	scar_offset offset;
+};
+
+// Compress 'len' bytes from 'buf' as a section of its own.
+int scar_footer_write_section(
+	struct scar_io_writer *w, struct scar_compression *comp, int clevel,
+	const void *buf, size_t len);
+
+// Write the SCAR-TAIL section with its own compressor,
+// followed by the compression's EOF marker.
+int scar_footer_write_tail(
+	struct scar_io_writer *w, struct scar_compression *comp, int clevel,
+	scar_offset index_offset, scar_offset checkpoints_offset,
+	const struct scar_footer_section *sections, size_t nsections);
+
+#endif
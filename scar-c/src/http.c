@@ -0,0 +1,258 @@
+#include "http.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal-util.h"
+#include "util.h"
+
+#ifdef SCAR_HAVE_CURL
+#include <curl/curl.h>
+#include <pthread.h>
+#include <stdio.h>
+#endif
+
+bool scar_http_is_url(const char *str)
+{
+	return
+		strncmp(str, "http://", 7) == 0 ||
+		strncmp(str, "https://", 8) == 0;
+}
+
+#ifdef SCAR_HAVE_CURL
+
+struct http_preader {
+	struct scar_io_preader pr;
+
+	// Only one request can use the curl handle at a time
+	pthread_mutex_t mut;
+	CURL *curl;
+
+	// The size of the file, or -1 until it's known
+	scar_offset size;
+	size_t requests;
+};
+
+// The state of one ranged GET.
+struct http_transfer {
+	CURL *curl;
+	scar_offset offset;
+	unsigned char *buf;
+	size_t len;
+	size_t got;
+
+	// The number of bytes to throw away before 'offset' is reached,
+	// which is only non-zero if the server ignored the range,
+	// or -1 until the response code is known
+	scar_offset skip;
+};
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+static CURLcode curl_init_result;
+
+static void http_global_init(void)
+{
+	curl_init_result = curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+static size_t http_write(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	struct http_transfer *t = userdata;
+	size_t n = size * nmemb;
+
+	if (t->skip < 0) {
+		long code = 0;
+		curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &code);
+		t->skip = code == 200 ? t->offset : 0;
+	}
+
+	size_t pos = 0;
+	if (t->skip > 0) {
+		pos = (scar_offset)n < t->skip ? n : (size_t)t->skip;
+		t->skip -= (scar_offset)pos;
+	}
+
+	size_t avail = n - pos;
+	size_t want = t->len - t->got;
+	size_t copy = avail < want ? avail : want;
+	memcpy(&t->buf[t->got], &ptr[pos], copy);
+	t->got += copy;
+
+	// If the server sent more than we asked for, stop the transfer
+	// instead of downloading the rest of the file
+	if (avail > want) {
+		return 0;
+	}
+
+	return n;
+}
+
+static scar_ssize http_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	struct http_preader *hp = SCAR_BASE(struct http_preader, pr);
+	if (offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (len == 0) {
+		return 0;
+	}
+
+	char range[64];
+	snprintf(
+		range, sizeof(range), "%lld-%lld",
+		(long long)offset, (long long)offset + (long long)len - 1);
+
+	struct http_transfer t;
+	t.curl = hp->curl;
+	t.offset = offset;
+	t.buf = buf;
+	t.len = len;
+	t.got = 0;
+	t.skip = -1;
+
+	pthread_mutex_lock(&hp->mut);
+	curl_easy_setopt(hp->curl, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(hp->curl, CURLOPT_RANGE, range);
+	curl_easy_setopt(hp->curl, CURLOPT_WRITEFUNCTION, http_write);
+	curl_easy_setopt(hp->curl, CURLOPT_WRITEDATA, &t);
+
+	CURLcode res = curl_easy_perform(hp->curl);
+	hp->requests += 1;
+
+	long code = 0;
+	curl_easy_getinfo(hp->curl, CURLINFO_RESPONSE_CODE, &code);
+	curl_easy_setopt(hp->curl, CURLOPT_RANGE, NULL);
+	pthread_mutex_unlock(&hp->mut);
+
+	// A write error means http_write cut the transfer short on purpose
+	if (res == CURLE_WRITE_ERROR && t.got == t.len) {
+		res = CURLE_OK;
+	}
+
+	// Asking for a range which starts past the end of the file
+	if (code == 416) {
+		return 0;
+	}
+
+	// Non-HTTP URLs (like file://) don't have a response code
+	if (res != CURLE_OK || (code != 0 && code != 200 && code != 206)) {
+		SCAR_ERETURN(-1);
+	}
+
+	return (scar_ssize)t.got;
+}
+
+static scar_offset http_size(struct scar_io_preader *pr)
+{
+	struct http_preader *hp = SCAR_BASE(struct http_preader, pr);
+
+	pthread_mutex_lock(&hp->mut);
+	if (hp->size >= 0) {
+		scar_offset size = hp->size;
+		pthread_mutex_unlock(&hp->mut);
+		return size;
+	}
+
+	curl_easy_setopt(hp->curl, CURLOPT_NOBODY, 1L);
+	CURLcode res = curl_easy_perform(hp->curl);
+	hp->requests += 1;
+
+	long code = 0;
+	curl_off_t length = -1;
+	curl_easy_getinfo(hp->curl, CURLINFO_RESPONSE_CODE, &code);
+	curl_easy_getinfo(hp->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+	curl_easy_setopt(hp->curl, CURLOPT_NOBODY, 0L);
+
+	if (res == CURLE_OK && (code == 0 || code == 200) && length >= 0) {
+		hp->size = (scar_offset)length;
+	}
+
+	scar_offset size = hp->size;
+	pthread_mutex_unlock(&hp->mut);
+	if (size < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return size;
+}
+
+struct scar_io_preader *scar_http_preader_create(const char *url)
+{
+	pthread_once(&curl_once, http_global_init);
+	if (curl_init_result != CURLE_OK) {
+		SCAR_ERETURN(NULL);
+	}
+
+	struct http_preader *hp = malloc(sizeof(*hp));
+	if (!hp) {
+		SCAR_ERETURN(NULL);
+	}
+
+	hp->curl = curl_easy_init();
+	if (!hp->curl) {
+		free(hp);
+		SCAR_ERETURN(NULL);
+	}
+
+	if (pthread_mutex_init(&hp->mut, NULL) != 0) {
+		curl_easy_cleanup(hp->curl);
+		free(hp);
+		SCAR_ERETURN(NULL);
+	}
+
+	// Curl makes its own copy of the URL
+	if (curl_easy_setopt(hp->curl, CURLOPT_URL, url) != CURLE_OK) {
+		scar_http_preader_free(&hp->pr);
+		SCAR_ERETURN(NULL);
+	}
+
+	curl_easy_setopt(hp->curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(hp->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(hp->curl, CURLOPT_USERAGENT, "scar");
+
+	hp->pr.read_at = http_read_at;
+	hp->pr.size = http_size;
+	hp->size = -1;
+	hp->requests = 0;
+	return &hp->pr;
+}
+
+size_t scar_http_preader_request_count(struct scar_io_preader *pr)
+{
+	struct http_preader *hp = SCAR_BASE(struct http_preader, pr);
+	pthread_mutex_lock(&hp->mut);
+	size_t requests = hp->requests;
+	pthread_mutex_unlock(&hp->mut);
+	return requests;
+}
+
+void scar_http_preader_free(struct scar_io_preader *pr)
+{
+	struct http_preader *hp = SCAR_BASE(struct http_preader, pr);
+	curl_easy_cleanup(hp->curl);
+	pthread_mutex_destroy(&hp->mut);
+	free(hp);
+}
+
+#else
+
+struct scar_io_preader *scar_http_preader_create(const char *url)
+{
+	(void)url;
+	SCAR_ERETURN(NULL);
+}
+
+size_t scar_http_preader_request_count(struct scar_io_preader *pr)
+{
+	(void)pr;
+	return 0;
+}
+
+void scar_http_preader_free(struct scar_io_preader *pr)
+{
+	(void)pr;
+}
+
+#endif
@@ -1,13 +1,30 @@
-// For fseeko/ftello
+// For fseeko/ftello, pread and mmap
 #ifndef __WIN32
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+// For copy_file_range
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
 #endif
 
 #include "ioutil.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "crc32c.h"
 #include "util.h"
 #include "internal-util.h"
 
@@ -25,6 +42,15 @@
 // Utility functions
 //
 
+void scar_io_reader_init(
+	struct scar_io_reader *r,
+	scar_ssize (*read)(struct scar_io_reader *r, void *buf, size_t len)
+) {
+	r->read = read;
+	r->fill_buf = NULL;
+	r->consume = NULL;
+}
+
 scar_ssize scar_io_printf(struct scar_io_writer *w, const char *fmt, ...)
 {
 	va_list ap;
@@ -37,16 +63,29 @@ scar_ssize scar_io_printf(struct scar_io_writer *w, const char *fmt, ...)
 scar_ssize scar_io_vprintf(
 	struct scar_io_writer *w, const char *fmt, va_list ap
 ) {
+	// The first vsnprintf consumes 'ap',
+	// so keep a copy around in case we need a second pass
+	va_list ap2;
+	va_copy(ap2, ap);
+
 	char buf[128];
 	int n = vsnprintf(buf, sizeof(buf), fmt, ap);
 	if (n < 0) {
+		va_end(ap2);
 		SCAR_ERETURN(-1);
 	} else if ((size_t)n <= sizeof(buf) - 1) {
+		va_end(ap2);
 		return w->write(w, buf, (size_t)n);
 	}
 
 	void *mbuf = malloc((size_t)n + 1);
-	n = vsnprintf(mbuf, (size_t)n + 1, fmt, ap);
+	if (!mbuf) {
+		va_end(ap2);
+		SCAR_ERETURN(-1);
+	}
+
+	n = vsnprintf(mbuf, (size_t)n + 1, fmt, ap2);
+	va_end(ap2);
 	scar_ssize ret = w->write(w, mbuf, (size_t)n);
 	free(mbuf);
 	return ret;
@@ -57,27 +96,92 @@ scar_ssize scar_io_puts(struct scar_io_writer *w, const char *str)
 	return w->write(w, str, strlen(str));
 }
 
+// Write the digits of 'num' in base 'base' to 'buf'.
+// The digits are produced backwards into a local buffer,
+// so that they can be copied out in one go.
+static size_t format_base(char *buf, uint64_t num, unsigned int base)
+{
+	char digits[SCAR_FORMAT_MAX];
+	char *ptr = &digits[sizeof(digits)];
+	do {
+		*(--ptr) = (char)('0' + num % base);
+		num /= base;
+	} while (num > 0);
+
+	size_t len = (size_t)(&digits[sizeof(digits)] - ptr);
+	memcpy(buf, ptr, len);
+	return len;
+}
+
+size_t scar_format_u64(char *buf, uint64_t num)
+{
+	return format_base(buf, num, 10);
+}
+
+size_t scar_format_i64(char *buf, int64_t num)
+{
+	if (num >= 0) {
+		return format_base(buf, (uint64_t)num, 10);
+	}
+
+	// Negate in unsigned arithmetic, so that INT64_MIN works
+	buf[0] = '-';
+	return 1 + format_base(&buf[1], -(uint64_t)num, 10);
+}
+
+size_t scar_format_octal(char *buf, uint64_t num)
+{
+	return format_base(buf, num, 8);
+}
+
+scar_ssize scar_io_read_full(struct scar_io_reader *r, void *buf, size_t len)
+{
+	size_t done = 0;
+	while (done < len) {
+		scar_ssize n = r->read(r, (char *)buf + done, len - done);
+		if (n < 0) {
+			return n;
+		} else if (n == 0) {
+			break;
+		}
+
+		done += (size_t)n;
+	}
+
+	return (scar_ssize)done;
+}
+
 scar_ssize scar_io_copy(struct scar_io_reader *r, struct scar_io_writer *w)
 {
+	char *buf = malloc(SCAR_IO_CHUNK_SIZE);
+	if (!buf) {
+		SCAR_ERETURN(-1);
+	}
+
 	scar_ssize count = 0;
-	char buf[512];
 	while (1) {
-		scar_ssize nr = r->read(r, buf, sizeof(buf));
+		scar_ssize nr = r->read(r, buf, SCAR_IO_CHUNK_SIZE);
 		if (nr < 0) {
-			return nr;
+			count = nr;
+			break;
 		} else if (nr == 0) {
-			return count;
+			break;
 		}
 
-		scar_ssize nw = w->write(w, buf, nr);
+		scar_ssize nw = w->write(w, buf, (size_t)nr);
 		if (nw < 0) {
-			return nw;
+			count = nw;
+			break;
 		} else if (nw < nr) {
-			return -1;
+			count = -1;
+			break;
 		}
 
 		count += nw;
 	}
+
+	free(buf);
+	return count;
 }
 
 //
@@ -86,7 +190,7 @@ scar_ssize scar_io_copy(struct scar_io_reader *r, struct scar_io_writer *w)
 
 void scar_file_handle_init(struct scar_file_handle *r, FILE *f)
 {
-	r->r.read = scar_file_handle_read;
+	scar_io_reader_init(&r->r, scar_file_handle_read);
 	r->w.write = scar_file_handle_write;
 	r->s.seek = scar_file_handle_seek;
 	r->s.tell = scar_file_handle_tell;
@@ -135,6 +239,109 @@ scar_offset scar_file_handle_tell(struct scar_io_seeker *s)
 	return SCAR_FTELL(sf->f);
 }
 
+#ifdef __linux__
+// Copy with copy_file_range, which works between regular files,
+// or failing that, with sendfile, which also writes to pipes and sockets.
+// Returns 1 if it was copied, 0 if neither works for these files,
+// -1 on error.
+static int copy_fd_to_fd(int in_fd, loff_t offset, uint64_t len, int out_fd)
+{
+	loff_t pos = offset;
+	bool use_sendfile = false;
+	while ((uint64_t)(pos - offset) < len) {
+		uint64_t remaining = len - (uint64_t)(pos - offset);
+		size_t chunk = remaining < (1u << 30) ? (size_t)remaining : (1u << 30);
+
+		ssize_t n;
+		if (use_sendfile) {
+			off_t off = (off_t)pos;
+			n = sendfile(out_fd, in_fd, &off, chunk);
+			if (n > 0) {
+				pos = (loff_t)off;
+			}
+		} else {
+			n = copy_file_range(in_fd, &pos, out_fd, NULL, chunk, 0);
+		}
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0 && pos == offset && !use_sendfile) {
+			use_sendfile = true;
+			continue;
+		} else if (n <= 0 && pos == offset) {
+			return 0;
+		} else if (n <= 0) {
+			// Either an error, or the file ended early
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	return 1;
+}
+#endif
+
+int scar_io_copy_fd(
+	int fd, scar_offset offset, uint64_t len, struct scar_io_writer *w
+) {
+#ifdef __linux__
+	if (w->write != scar_file_handle_write) {
+		return 0;
+	}
+
+	FILE *out = SCAR_BASE(struct scar_file_handle, w)->f;
+	if (fflush(out) != 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	int ret = copy_fd_to_fd(fd, (loff_t)offset, len, fileno(out));
+	if (ret <= 0) {
+		return ret;
+	}
+
+	// Bring the FILE's idea of its position up to date,
+	// which there's no need for if it's a pipe
+	if (SCAR_FSEEK(out, 0, SEEK_CUR) < 0 && errno != ESPIPE) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 1;
+#else
+	(void)fd;
+	(void)offset;
+	(void)len;
+	(void)w;
+	return 0;
+#endif
+}
+
+int scar_file_handle_copy_to(
+	struct scar_io_reader *r, struct scar_io_writer *w, uint64_t len
+) {
+	if (r->read != scar_file_handle_read) {
+		return 0;
+	}
+
+	// The FILE may have read ahead, so the file descriptor's position
+	// isn't the reader's. A file without a position, like a pipe,
+	// has to be read the normal way.
+	FILE *in = SCAR_BASE(struct scar_file_handle, r)->f;
+	scar_offset offset = SCAR_FTELL(in);
+	if (offset < 0) {
+		return 0;
+	}
+
+	int ret = scar_io_copy_fd(fileno(in), offset, len, w);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	if (SCAR_FSEEK(in, offset + (scar_offset)len, SEEK_SET) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 1;
+}
+
 //
 // scar_mem_reader
 //
@@ -143,6 +350,8 @@ void scar_mem_reader_init(
 	struct scar_mem_reader *mr, const void *buf, size_t len
 ) {
 	mr->r.read = scar_mem_reader_read;
+	mr->r.fill_buf = scar_mem_reader_fill_buf;
+	mr->r.consume = scar_mem_reader_consume;
 	mr->s.seek = scar_mem_reader_seek;
 	mr->s.tell = scar_mem_reader_tell;
 	mr->buf = buf;
@@ -171,6 +380,24 @@ scar_ssize scar_mem_reader_read(
 	return (scar_ssize)n;
 }
 
+scar_ssize scar_mem_reader_fill_buf(
+	struct scar_io_reader *r, const void **buf
+) {
+	struct scar_mem_reader *mr = SCAR_BASE(struct scar_mem_reader, r);
+	if (mr->pos >= mr->len) {
+		return 0;
+	}
+
+	*buf = (const unsigned char *)mr->buf + mr->pos;
+	return (scar_ssize)(mr->len - mr->pos);
+}
+
+void scar_mem_reader_consume(struct scar_io_reader *r, size_t len)
+{
+	struct scar_mem_reader *mr = SCAR_BASE(struct scar_mem_reader, r);
+	mr->pos += len;
+}
+
 int scar_mem_reader_seek(
 	struct scar_io_seeker *s, scar_offset offset, enum scar_io_whence whence
 ) {
@@ -202,6 +429,243 @@ scar_offset scar_mem_reader_tell(struct scar_io_seeker *s)
 	return (scar_offset)mr->pos;
 }
 
+//
+// scar_mem_preader
+//
+
+void scar_mem_preader_init(
+	struct scar_mem_preader *mp, const void *buf, size_t len
+) {
+	mp->pr.read_at = scar_mem_preader_read_at;
+	mp->pr.size = scar_mem_preader_size;
+	mp->buf = buf;
+	mp->len = len;
+}
+
+scar_ssize scar_mem_preader_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	struct scar_mem_preader *mp = SCAR_BASE(struct scar_mem_preader, pr);
+	if (offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if ((size_t)offset >= mp->len) {
+		return 0;
+	}
+
+	size_t left = mp->len - (size_t)offset;
+	size_t n = left < len ? left : len;
+	memcpy(buf, (const unsigned char *)mp->buf + offset, n);
+	return (scar_ssize)n;
+}
+
+scar_offset scar_mem_preader_size(struct scar_io_preader *pr)
+{
+	struct scar_mem_preader *mp = SCAR_BASE(struct scar_mem_preader, pr);
+	return (scar_offset)mp->len;
+}
+
+//
+// scar_fd_preader
+//
+
+#ifdef _WIN32
+
+int scar_fd_preader_init(struct scar_fd_preader *fp, int fd)
+{
+	(void)fp;
+	(void)fd;
+	SCAR_ERETURN(-1);
+}
+
+scar_ssize scar_fd_preader_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	(void)pr;
+	(void)offset;
+	(void)buf;
+	(void)len;
+	SCAR_ERETURN(-1);
+}
+
+scar_offset scar_fd_preader_size(struct scar_io_preader *pr)
+{
+	(void)pr;
+	SCAR_ERETURN(-1);
+}
+
+#else
+
+int scar_fd_preader_init(struct scar_fd_preader *fp, int fd)
+{
+	if (fd < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	fp->pr.read_at = scar_fd_preader_read_at;
+	fp->pr.size = scar_fd_preader_size;
+	fp->fd = fd;
+	return 0;
+}
+
+scar_ssize scar_fd_preader_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	struct scar_fd_preader *fp = SCAR_BASE(struct scar_fd_preader, pr);
+	if (offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	// Like fread, keep going until we have everything or hit the end
+	size_t total = 0;
+	while (total < len) {
+		ssize_t n = pread(
+			fp->fd, (unsigned char *)buf + total, len - total,
+			(off_t)offset + (off_t)total);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0) {
+			SCAR_ERETURN(-1);
+		} else if (n == 0) {
+			break;
+		}
+
+		total += (size_t)n;
+	}
+
+	return (scar_ssize)total;
+}
+
+scar_offset scar_fd_preader_size(struct scar_io_preader *pr)
+{
+	struct scar_fd_preader *fp = SCAR_BASE(struct scar_fd_preader, pr);
+	struct stat st;
+	if (fstat(fp->fd, &st) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return (scar_offset)st.st_size;
+}
+
+#endif
+
+//
+// scar_mmap_preader
+//
+
+#ifdef _WIN32
+
+int scar_mmap_preader_init(struct scar_mmap_preader *mm, int fd)
+{
+	(void)mm;
+	(void)fd;
+	SCAR_ERETURN(-1);
+}
+
+void scar_mmap_preader_destroy(struct scar_mmap_preader *mm)
+{
+	(void)mm;
+}
+
+#else
+
+int scar_mmap_preader_init(struct scar_mmap_preader *mm, int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	// mmap doesn't accept zero-length mappings
+	if (st.st_size == 0) {
+		scar_mem_preader_init(&mm->mp, NULL, 0);
+		return 0;
+	}
+
+	size_t len = (size_t)st.st_size;
+	void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		SCAR_ERETURN(-1);
+	}
+
+	scar_mem_preader_init(&mm->mp, data, len);
+	return 0;
+}
+
+void scar_mmap_preader_destroy(struct scar_mmap_preader *mm)
+{
+	if (mm->mp.len > 0) {
+		munmap((void *)mm->mp.buf, mm->mp.len);
+	}
+}
+
+#endif
+
+//
+// scar_preader_stream
+//
+
+void scar_preader_stream_init(
+	struct scar_preader_stream *ps, struct scar_io_preader *pr
+) {
+	scar_io_reader_init(&ps->r, scar_preader_stream_read);
+	ps->s.seek = scar_preader_stream_seek;
+	ps->s.tell = scar_preader_stream_tell;
+	ps->pr = pr;
+	ps->pos = 0;
+}
+
+scar_ssize scar_preader_stream_read(
+	struct scar_io_reader *r, void *buf, size_t len
+) {
+	struct scar_preader_stream *ps = SCAR_BASE(struct scar_preader_stream, r);
+	scar_ssize n = ps->pr->read_at(ps->pr, ps->pos, buf, len);
+	if (n < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	ps->pos += n;
+	return n;
+}
+
+int scar_preader_stream_seek(
+	struct scar_io_seeker *s, scar_offset offset, enum scar_io_whence whence
+) {
+	struct scar_preader_stream *ps = SCAR_BASE(struct scar_preader_stream, s);
+	scar_offset newpos = 0;
+	switch (whence) {
+	case SCAR_SEEK_START:
+		newpos = offset;
+		break;
+	case SCAR_SEEK_CURRENT:
+		newpos = ps->pos + offset;
+		break;
+	case SCAR_SEEK_END: {
+		scar_offset size = ps->pr->size(ps->pr);
+		if (size < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		newpos = size + offset;
+		break;
+	}
+	}
+
+	if (newpos < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	ps->pos = newpos;
+	return 0;
+}
+
+scar_offset scar_preader_stream_tell(struct scar_io_seeker *s)
+{
+	struct scar_preader_stream *ps = SCAR_BASE(struct scar_preader_stream, s);
+	return ps->pos;
+}
+
 //
 // scar_mem_writer
 //
@@ -271,6 +735,163 @@ void *scar_mem_writer_get_buffer(struct scar_mem_writer *mw, size_t len)
 	return buf;
 }
 
+//
+// scar_spill_writer
+//
+
+void scar_spill_writer_init(struct scar_spill_writer *sw, size_t threshold)
+{
+	sw->w.write = scar_spill_writer_write;
+	scar_mem_writer_init(&sw->mem);
+	sw->f = NULL;
+	sw->threshold = threshold;
+	sw->len = 0;
+}
+
+scar_ssize scar_spill_writer_write(
+	struct scar_io_writer *w, const void *buf, size_t len
+) {
+	struct scar_spill_writer *sw = SCAR_BASE(struct scar_spill_writer, w);
+	if (
+		!sw->f && sw->threshold > 0 &&
+		sw->mem.len + len > sw->threshold
+	) {
+		// tmpfile() files are already unlinked where the platform allows it
+		sw->f = tmpfile();
+		if (!sw->f) {
+			SCAR_ERETURN(-1);
+		}
+
+		if (
+			sw->mem.len > 0 &&
+			fwrite(sw->mem.buf, 1, sw->mem.len, sw->f) < sw->mem.len
+		) {
+			SCAR_ERETURN(-1);
+		}
+
+		free(sw->mem.buf);
+		scar_mem_writer_init(&sw->mem);
+	}
+
+	if (sw->f) {
+		if (fwrite(buf, 1, len, sw->f) < len) {
+			SCAR_ERETURN(-1);
+		}
+	} else if (scar_mem_writer_write(&sw->mem.w, buf, len) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	sw->len += (scar_offset)len;
+	return (scar_ssize)len;
+}
+
+#ifdef __linux__
+// Copy the spilled data with copy_file_range, if 'w' writes to a file.
+// Returns 1 if it was copied, 0 if it has to be copied some other way,
+// -1 on error.
+static int spill_writer_copy_file_range(
+	struct scar_spill_writer *sw, struct scar_io_writer *w
+) {
+	if (w->write != scar_file_handle_write) {
+		return 0;
+	}
+
+	FILE *out = SCAR_BASE(struct scar_file_handle, w)->f;
+	if (fflush(out) != 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	int in_fd = fileno(sw->f);
+	int out_fd = fileno(out);
+	loff_t in_off = 0;
+	scar_offset remaining = sw->len;
+	while (remaining > 0) {
+		ssize_t n = copy_file_range(
+			in_fd, &in_off, out_fd, NULL, (size_t)remaining, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0 && in_off == 0) {
+			// Not supported for these files, like when 'out' is a pipe
+			return 0;
+		} else if (n <= 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		remaining -= n;
+	}
+
+	// Bring the FILE's idea of its position up to date
+	if (SCAR_FSEEK(out, 0, SEEK_CUR) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 1;
+}
+#endif
+
+int scar_spill_writer_copy_to(
+	struct scar_spill_writer *sw, struct scar_io_writer *w
+) {
+	if (!sw->f) {
+		if (w->write(w, sw->mem.buf, sw->mem.len) < (scar_ssize)sw->mem.len) {
+			SCAR_ERETURN(-1);
+		}
+		return 0;
+	}
+
+	if (fflush(sw->f) != 0) {
+		SCAR_ERETURN(-1);
+	}
+
+#ifdef __linux__
+	int ret = spill_writer_copy_file_range(sw, w);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	} else if (ret > 0) {
+		return 0;
+	}
+#endif
+
+	if (SCAR_FSEEK(sw->f, 0, SEEK_SET) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned char buf[64 * 1024];
+	scar_offset remaining = sw->len;
+	while (remaining > 0) {
+		size_t chunk = sizeof(buf);
+		if ((scar_offset)chunk > remaining) {
+			chunk = (size_t)remaining;
+		}
+
+		if (fread(buf, 1, chunk, sw->f) < chunk) {
+			SCAR_ERETURN(-1);
+		}
+
+		if (w->write(w, buf, chunk) < (scar_ssize)chunk) {
+			SCAR_ERETURN(-1);
+		}
+
+		remaining -= (scar_offset)chunk;
+	}
+
+	if (SCAR_FSEEK(sw->f, 0, SEEK_END) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+void scar_spill_writer_destroy(struct scar_spill_writer *sw)
+{
+	free(sw->mem.buf);
+	sw->mem.buf = NULL;
+	if (sw->f) {
+		fclose(sw->f);
+		sw->f = NULL;
+	}
+}
+
 //
 // scar_counting_writer
 //
@@ -296,6 +917,31 @@ scar_ssize scar_counting_writer_write(
 	return count;
 }
 
+//
+// scar_crc32c_writer
+//
+
+void scar_crc32c_writer_init(
+	struct scar_crc32c_writer *cw, struct scar_io_writer *w
+) {
+	cw->w.write = scar_crc32c_writer_write;
+	cw->backing_w = w;
+	cw->crc = 0;
+}
+
+scar_ssize scar_crc32c_writer_write(
+	struct scar_io_writer *w, const void *buf, size_t len
+) {
+	struct scar_crc32c_writer *cw =
+		SCAR_BASE(struct scar_crc32c_writer, w);
+	scar_ssize count = cw->backing_w->write(cw->backing_w, buf, len);
+	if (count > 0) {
+		cw->crc = scar_crc32c(cw->crc, buf, (size_t)count);
+	}
+
+	return count;
+}
+
 //
 // scar_counting_reader
 //
@@ -304,6 +950,8 @@ void scar_counting_reader_init(
 	struct scar_counting_reader *cr, struct scar_io_reader *r
 ) {
 	cr->r.read = scar_counting_reader_read;
+	cr->r.fill_buf = r->fill_buf ? scar_counting_reader_fill_buf : NULL;
+	cr->r.consume = r->fill_buf ? scar_counting_reader_consume : NULL;
 	cr->backing_r = r;
 	cr->count = 0;
 }
@@ -321,6 +969,22 @@ scar_ssize scar_counting_reader_read(
 	return count;
 }
 
+scar_ssize scar_counting_reader_fill_buf(
+	struct scar_io_reader *r, const void **buf
+) {
+	struct scar_counting_reader *cr =
+		SCAR_BASE(struct scar_counting_reader, r);
+	return cr->backing_r->fill_buf(cr->backing_r, buf);
+}
+
+void scar_counting_reader_consume(struct scar_io_reader *r, size_t len)
+{
+	struct scar_counting_reader *cr =
+		SCAR_BASE(struct scar_counting_reader, r);
+	cr->backing_r->consume(cr->backing_r, len);
+	cr->count += (scar_offset)len;
+}
+
 //
 // scar_limited_reader
 //
@@ -329,6 +993,8 @@ void scar_limited_reader_init(
 	struct scar_limited_reader *cr, struct scar_io_reader *r, scar_offset limit
 ) {
 	cr->r.read = scar_limited_reader_read;
+	cr->r.fill_buf = r->fill_buf ? scar_limited_reader_fill_buf : NULL;
+	cr->r.consume = r->fill_buf ? scar_limited_reader_consume : NULL;
 	cr->backing_r = r;
 	cr->limit = limit;
 }
@@ -353,63 +1019,116 @@ scar_ssize scar_limited_reader_read(
 	return count;
 }
 
+scar_ssize scar_limited_reader_fill_buf(
+	struct scar_io_reader *r, const void **buf
+) {
+	struct scar_limited_reader *lr = SCAR_BASE(struct scar_limited_reader, r);
+	if (lr->limit <= 0) {
+		return 0;
+	}
+
+	scar_ssize n = lr->backing_r->fill_buf(lr->backing_r, buf);
+	if (n > lr->limit) {
+		n = (scar_ssize)lr->limit;
+	}
+
+	return n;
+}
+
+void scar_limited_reader_consume(struct scar_io_reader *r, size_t len)
+{
+	struct scar_limited_reader *lr = SCAR_BASE(struct scar_limited_reader, r);
+	lr->backing_r->consume(lr->backing_r, len);
+	lr->limit -= (scar_offset)len;
+}
+
 //
 // scar_block_reader
 //
 
-void scar_block_reader_init(
-	struct scar_block_reader *br, struct scar_io_reader *r
-) {
-	br->r.read = scar_block_reader_read;
-	br->backing_r = r;
-	br->index = 0;
-	br->bufcap = 0;
+// Refill 'buf' with the data after what has been consumed.
+// If the backing reader can lend out its buffer, the block reader
+// takes all of it at once, and it stays valid until the backing reader
+// is read from again, which only the block reader does.
+static void block_reader_fill(struct scar_block_reader *br)
+{
+	struct scar_io_reader *r = br->backing_r;
+	scar_ssize n;
+	if (r->fill_buf) {
+		const void *buf;
+		n = r->fill_buf(r, &buf);
+		if (n > 0) {
+			r->consume(r, (size_t)n);
+			br->buf = buf;
+		}
+	} else {
+		n = r->read(r, br->block, sizeof(br->block));
+		br->buf = br->block;
+	}
 
-	scar_ssize n = r->read(r, br->block, sizeof(br->block));
 	if (n < 1) {
 		br->next = EOF;
 		br->error = (int)n;
-	} else {
-		br->bufcap = (int)n;
-		br->next = br->block[br->index++];
-		br->error = 0;
+		br->index = 0;
+		br->len = 0;
+		return;
 	}
+
+	br->len = (size_t)n;
+	br->index = 1;
+	br->next = br->buf[0];
 }
 
-void scar_block_reader_consume(struct scar_block_reader *br)
+// The number of bytes left in 'buf', including 'next'
+static size_t block_reader_avail(struct scar_block_reader *br)
 {
-	if (br->next == EOF) {
+	return br->len - br->index + 1;
+}
+
+// Consume 'count' bytes, which are all in 'buf'
+static void block_reader_advance(struct scar_block_reader *br, size_t count)
+{
+	if (count == block_reader_avail(br)) {
+		block_reader_fill(br);
 		return;
 	}
 
-	if (br->index >= br->bufcap) {
-		scar_ssize n = br->backing_r->read(
-			br->backing_r, br->block, sizeof(br->block));
-		if (n < 1) {
-			br->next = EOF;
-			br->error = (int)n;
-		} else {
-			br->index = 0;
-			br->next = br->block[br->index++];
-			br->bufcap = (int)n;
-		}
+	br->index += count;
+	br->next = br->buf[br->index - 1];
+}
 
+void scar_block_reader_init(
+	struct scar_block_reader *br, struct scar_io_reader *r
+) {
+	scar_io_reader_init(&br->r, scar_block_reader_read);
+	br->backing_r = r;
+	br->error = 0;
+	block_reader_fill(br);
+}
+
+void scar_block_reader_consume(struct scar_block_reader *br)
+{
+	if (br->next == EOF) {
 		return;
 	}
 
-	br->next = br->block[br->index++];
+	block_reader_advance(br, 1);
 }
 
 int scar_block_reader_skip(struct scar_block_reader *br, size_t n)
 {
-	// This could be faster...
 	while (n > 0) {
 		if (br->next == EOF) {
 			SCAR_ERETURN(-1);
 		}
 
-		scar_block_reader_consume(br);
-		n -= 1;
+		size_t count = block_reader_avail(br);
+		if (count > n) {
+			count = n;
+		}
+
+		block_reader_advance(br, count);
+		n -= count;
 	}
 
 	return 0;
@@ -419,50 +1138,57 @@ scar_ssize scar_block_reader_read(struct scar_io_reader *r, void *buf, size_t n)
 {
 	struct scar_block_reader *br = SCAR_BASE(struct scar_block_reader, r);
 
-	scar_ssize ret = 0;
-
-	// This could also be faster...
-	unsigned char *cbuf = (unsigned char *)buf;
-	while (ret < (scar_ssize)n) {
-		if (br->next == EOF) {
-			return ret;
+	unsigned char *dest = buf;
+	size_t done = 0;
+	while (done < n && br->next != EOF) {
+		size_t count = block_reader_avail(br);
+		if (count > n - done) {
+			count = n - done;
 		}
 
-		*cbuf = (unsigned char)br->next;
-		cbuf += 1;
-
-		scar_block_reader_consume(br);
-		ret += 1;
+		memcpy(&dest[done], &br->buf[br->index - 1], count);
+		block_reader_advance(br, count);
+		done += count;
 	}
 
-	return ret;
+	return (scar_ssize)done;
 }
 
 scar_ssize scar_block_reader_read_line(
 	struct scar_block_reader *br, void *buf, size_t n
 ) {
-	scar_ssize ret = 0;
+	if (n == 0) {
+		return 0;
+	}
 
-	unsigned char *cbuf = (unsigned char *)buf;
-	while (ret - 1 < (scar_ssize)n) {
-		if (br->next == EOF) {
-			*cbuf = '\0';
-			return ret;
-		} else if (br->next == '\n' || br->next == '\r') {
-			*cbuf = '\0';
-			break;
+	// Copy as much of the line as 'buf' has room for,
+	// a run of buffered bytes at a time
+	unsigned char *dest = buf;
+	size_t done = 0;
+	while (
+		br->next != EOF && br->next != '\n' && br->next != '\r' &&
+		done + 1 < n
+	) {
+		const unsigned char *src = &br->buf[br->index - 1];
+		size_t avail = block_reader_avail(br);
+		if (avail > n - 1 - done) {
+			avail = n - 1 - done;
 		}
 
-		*cbuf = (unsigned char)br->next;
-		cbuf += 1;
-		ret += 1;
+		size_t count = 0;
+		while (count < avail && src[count] != '\n' && src[count] != '\r') {
+			count += 1;
+		}
 
-		scar_block_reader_consume(br);
+		memcpy(&dest[done], src, count);
+		block_reader_advance(br, count);
+		done += count;
 	}
 
+	dest[done] = '\0';
 	while (br->next == '\n' || br->next == '\r') {
 		scar_block_reader_consume(br);
 	}
 
-	return ret;
+	return (scar_ssize)done;
 }
@@ -0,0 +1,332 @@
+#include "meta-arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meta.h"
+#include "internal-util.h"
+
+// Chunks start small, so that an arena for a single entry stays cheap,
+// and double up to a limit. Strings bigger than a chunk get their own.
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_MAX_CHUNK (1024 * 1024)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t cap;
+	size_t len;
+	char data[];
+};
+
+struct intern_slot {
+	uint64_t hash;
+	char *str;
+	size_t len;
+};
+
+struct scar_meta_arena {
+	// Every chunk, in the order they're used in.
+	// After a reset, allocations start over from 'first'.
+	struct arena_chunk *first;
+	struct arena_chunk *current;
+
+	// The most recent allocation, which scar_meta_arena_intern
+	// can give back
+	char *last;
+	size_t last_size;
+
+	// An open addressing hash table of interned strings,
+	// never more than half full
+	struct intern_slot *slots;
+	size_t slots_cap;
+	size_t slots_len;
+
+	// Global metadata which strings in the arena may point into
+	struct scar_meta_global **held;
+	size_t held_cap;
+	size_t held_len;
+};
+
+static uint64_t hash_string(const char *str, size_t len)
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)str[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+struct scar_meta_arena *scar_meta_arena_create(void)
+{
+	struct scar_meta_arena *arena = malloc(sizeof(*arena));
+	if (!arena) {
+		SCAR_ERETURN(NULL);
+	}
+
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->last = NULL;
+	arena->last_size = 0;
+	arena->slots = NULL;
+	arena->slots_cap = 0;
+	arena->slots_len = 0;
+	arena->held = NULL;
+	arena->held_cap = 0;
+	arena->held_len = 0;
+	return arena;
+}
+
+// Make 'current' a chunk with room for 'size' more bytes.
+// A chunk which is kept from before a reset is re-used if it's big enough,
+// otherwise a new one is put in front of it.
+static int arena_next_chunk(struct scar_meta_arena *arena, size_t size)
+{
+	struct arena_chunk *next = arena->current ?
+		arena->current->next : arena->first;
+	if (next && next->cap >= size) {
+		next->len = 0;
+		arena->current = next;
+		return 0;
+	}
+
+	size_t cap = arena->current ? arena->current->cap * 2 : ARENA_MIN_CHUNK;
+	if (cap > ARENA_MAX_CHUNK) {
+		cap = ARENA_MAX_CHUNK;
+	}
+	if (cap < size) {
+		cap = size;
+	}
+
+	struct arena_chunk *chunk = malloc(sizeof(*chunk) + cap);
+	if (!chunk) {
+		SCAR_ERETURN(-1);
+	}
+
+	chunk->next = next;
+	chunk->cap = cap;
+	chunk->len = 0;
+	if (arena->current) {
+		arena->current->next = chunk;
+	} else {
+		arena->first = chunk;
+	}
+
+	arena->current = chunk;
+	return 0;
+}
+
+char *scar_meta_arena_alloc(struct scar_meta_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk = arena->current;
+	if (!chunk || chunk->cap - chunk->len < size) {
+		if (arena_next_chunk(arena, size) < 0) {
+			SCAR_ERETURN(NULL);
+		}
+
+		chunk = arena->current;
+	}
+
+	char *ptr = &chunk->data[chunk->len];
+	chunk->len += size;
+	arena->last = ptr;
+	arena->last_size = size;
+	return ptr;
+}
+
+char *scar_meta_arena_strndup(
+	struct scar_meta_arena *arena, const char *str, size_t len
+) {
+	char *dest = scar_meta_arena_alloc(arena, len + 1);
+	if (!dest) {
+		SCAR_ERETURN(NULL);
+	}
+
+	memcpy(dest, str, len);
+	dest[len] = '\0';
+	return dest;
+}
+
+static int intern_grow(struct scar_meta_arena *arena)
+{
+	size_t cap = arena->slots_cap ? arena->slots_cap * 2 : 16;
+	struct intern_slot *slots = calloc(cap, sizeof(*slots));
+	if (!slots) {
+		SCAR_ERETURN(-1);
+	}
+
+	for (size_t i = 0; i < arena->slots_cap; ++i) {
+		struct intern_slot *slot = &arena->slots[i];
+		if (!slot->str) {
+			continue;
+		}
+
+		size_t idx = (size_t)slot->hash & (cap - 1);
+		while (slots[idx].str) {
+			idx = (idx + 1) & (cap - 1);
+		}
+		slots[idx] = *slot;
+	}
+
+	free(arena->slots);
+	arena->slots = slots;
+	arena->slots_cap = cap;
+	return 0;
+}
+
+char *scar_meta_arena_intern(
+	struct scar_meta_arena *arena, const char *str, size_t len
+) {
+	if ((arena->slots_len + 1) * 2 > arena->slots_cap) {
+		if (intern_grow(arena) < 0) {
+			SCAR_ERETURN(NULL);
+		}
+	}
+
+	uint64_t hash = hash_string(str, len);
+	size_t idx = (size_t)hash & (arena->slots_cap - 1);
+	while (arena->slots[idx].str) {
+		struct intern_slot *slot = &arena->slots[idx];
+		if (
+			slot->hash == hash && slot->len == len &&
+			memcmp(slot->str, str, len) == 0
+		) {
+			if (str == arena->last) {
+				arena->current->len -= arena->last_size;
+				arena->last = NULL;
+			}
+
+			return slot->str;
+		}
+
+		idx = (idx + 1) & (arena->slots_cap - 1);
+	}
+
+	// The string has to be NUL-terminated in the arena,
+	// so only adopt the last allocation if it is
+	char *interned = arena->last;
+	if (str != arena->last || arena->last_size != len + 1 || str[len]) {
+		interned = scar_meta_arena_strndup(arena, str, len);
+		if (!interned) {
+			SCAR_ERETURN(NULL);
+		}
+	}
+
+	// Never give back an interned string
+	arena->last = NULL;
+
+	arena->slots[idx].hash = hash;
+	arena->slots[idx].str = interned;
+	arena->slots[idx].len = len;
+	arena->slots_len += 1;
+	return interned;
+}
+
+static int copy_string(
+	struct scar_meta_arena *arena, char **dest, const char *src, int intern
+) {
+	if (!src) {
+		*dest = NULL;
+		return 0;
+	}
+
+	size_t len = strlen(src);
+	if (intern) {
+		*dest = scar_meta_arena_intern(arena, src, len);
+	} else {
+		*dest = scar_meta_arena_strndup(arena, src, len);
+	}
+
+	return *dest ? 0 : -1;
+}
+
+int scar_meta_copy_arena(
+	struct scar_meta *dest, const struct scar_meta *src,
+	struct scar_meta_arena *arena
+) {
+	memcpy(dest, src, sizeof(*dest));
+	if (
+		copy_string(arena, &dest->charset, src->charset, 1) < 0 ||
+		copy_string(arena, &dest->comment, src->comment, 0) < 0 ||
+		copy_string(arena, &dest->gname, src->gname, 1) < 0 ||
+		copy_string(arena, &dest->hdrcharset, src->hdrcharset, 1) < 0 ||
+		copy_string(arena, &dest->linkpath, src->linkpath, 0) < 0 ||
+		copy_string(arena, &dest->path, src->path, 0) < 0 ||
+		copy_string(arena, &dest->uname, src->uname, 1) < 0
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (src->records) {
+		dest->records = scar_meta_arena_alloc(arena, src->records_len);
+		if (!dest->records) {
+			SCAR_ERETURN(-1);
+		}
+
+		memcpy(dest->records, src->records, src->records_len);
+	}
+
+	return 0;
+}
+
+int scar_meta_arena_hold(
+	struct scar_meta_arena *arena, struct scar_meta_global *global
+) {
+	// Entries in a row tend to share the same global metadata
+	if (arena->held_len > 0 && arena->held[arena->held_len - 1] == global) {
+		return 0;
+	}
+
+	if (arena->held_len == arena->held_cap) {
+		size_t cap = arena->held_cap ? arena->held_cap * 2 : 4;
+		struct scar_meta_global **held = realloc(
+			arena->held, cap * sizeof(*held));
+		if (!held) {
+			SCAR_ERETURN(-1);
+		}
+
+		arena->held = held;
+		arena->held_cap = cap;
+	}
+
+	arena->held[arena->held_len++] = scar_meta_global_ref(global);
+	return 0;
+}
+
+static void arena_release(struct scar_meta_arena *arena)
+{
+	for (size_t i = 0; i < arena->held_len; ++i) {
+		scar_meta_global_unref(arena->held[i]);
+	}
+
+	arena->held_len = 0;
+}
+
+void scar_meta_arena_reset(struct scar_meta_arena *arena)
+{
+	arena_release(arena);
+	arena->current = NULL;
+	arena->last = NULL;
+	if (arena->slots_len > 0) {
+		memset(arena->slots, 0, arena->slots_cap * sizeof(*arena->slots));
+		arena->slots_len = 0;
+	}
+}
+
+void scar_meta_arena_free(struct scar_meta_arena *arena)
+{
+	struct arena_chunk *chunk = arena->first;
+	while (chunk) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	arena_release(arena);
+	free(arena->held);
+	free(arena->slots);
+	free(arena);
+}
@@ -1,11 +1,13 @@
 #include "meta.h"
 
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <inttypes.h>
 
 #include "ioutil.h"
+#include "internal-util.h"
 
 static const struct scar_meta empty_meta = {
 	.type = SCAR_FT_UNKNOWN,
@@ -24,6 +26,8 @@ static const struct scar_meta empty_meta = {
 	.size = ~(uint64_t)0,
 	.uid = ~(uint64_t)0,
 	.uname = NULL,
+	.records = NULL,
+	.records_len = 0,
 };
 
 static char *dupstr(const char *src)
@@ -162,6 +166,10 @@ void scar_meta_copy(struct scar_meta *dest, struct scar_meta *src)
 	dest->linkpath = dupstr(src->linkpath);
 	dest->path = dupstr(src->path);
 	dest->uname = dupstr(src->uname);
+	if (src->records) {
+		dest->records = malloc(src->records_len);
+		memcpy(dest->records, src->records, src->records_len);
+	}
 }
 
 void scar_meta_print(struct scar_meta *meta, struct scar_io_writer *w)
@@ -229,6 +237,10 @@ void scar_meta_print(struct scar_meta *meta, struct scar_io_writer *w)
 		scar_io_printf(w, "\tuname: %s\n", meta->uname);
 	}
 
+	if (meta->records) {
+		scar_io_printf(w, "\trecords: %zu bytes\n", meta->records_len);
+	}
+
 	scar_io_printf(w, "}\n");
 }
 
@@ -241,5 +253,57 @@ void scar_meta_destroy(struct scar_meta *meta)
 	free(meta->linkpath);
 	free(meta->path);
 	free(meta->uname);
+	free(meta->records);
+	scar_meta_init_empty(meta);
+}
+
+struct scar_meta_global *scar_meta_global_create(struct scar_meta *meta)
+{
+	struct scar_meta_global *global = malloc(sizeof(*global));
+	if (!global) {
+		SCAR_ERETURN(NULL);
+	}
+
+	memcpy(&global->meta, meta, sizeof(*meta));
+	global->refs = 1;
 	scar_meta_init_empty(meta);
+	return global;
+}
+
+#ifndef __GNUC__
+// Compilers without atomic builtins share one lock for every
+// reference count, which is slow, but keeps them thread safe
+static pthread_mutex_t global_refs_mut = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+struct scar_meta_global *scar_meta_global_ref(
+	struct scar_meta_global *global
+) {
+#ifdef __GNUC__
+	__atomic_add_fetch(&global->refs, 1, __ATOMIC_RELAXED);
+#else
+	pthread_mutex_lock(&global_refs_mut);
+	global->refs += 1;
+	pthread_mutex_unlock(&global_refs_mut);
+#endif
+	return global;
+}
+
+void scar_meta_global_unref(struct scar_meta_global *global)
+{
+	if (!global) {
+		return;
+	}
+
+#ifdef __GNUC__
+	unsigned long refs = __atomic_sub_fetch(&global->refs, 1, __ATOMIC_ACQ_REL);
+#else
+	pthread_mutex_lock(&global_refs_mut);
+	unsigned long refs = --global->refs;
+	pthread_mutex_unlock(&global_refs_mut);
+#endif
+	if (refs == 0) {
+		scar_meta_destroy(&global->meta);
+		free(global);
+	}
 }
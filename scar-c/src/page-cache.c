@@ -0,0 +1,218 @@
+#include "page-cache.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal-util.h"
+
+struct cache_page {
+	scar_offset segment;
+	uint64_t idx;
+	unsigned char *data;
+	size_t len;
+
+	// The next page in the same hash bucket
+	struct cache_page *hnext;
+
+	// The LRU list, most recently used first
+	struct cache_page *prev;
+	struct cache_page *next;
+};
+
+struct scar_page_cache {
+	pthread_mutex_t mut;
+	size_t max_bytes;
+
+	struct cache_page **buckets;
+	size_t nbuckets;
+	struct cache_page *lru_head;
+	struct cache_page *lru_tail;
+
+	struct scar_page_cache_stats stats;
+};
+
+static size_t bucket_of(
+	struct scar_page_cache *pc, scar_offset segment, uint64_t idx
+) {
+	uint64_t h = ((uint64_t)segment * 0x9e3779b97f4a7c15ull) ^ idx;
+	h *= 0xff51afd7ed558ccdull;
+	return (size_t)(h ^ (h >> 32)) & (pc->nbuckets - 1);
+}
+
+static void lru_unlink(struct scar_page_cache *pc, struct cache_page *p)
+{
+	if (p->prev) {
+		p->prev->next = p->next;
+	} else {
+		pc->lru_head = p->next;
+	}
+
+	if (p->next) {
+		p->next->prev = p->prev;
+	} else {
+		pc->lru_tail = p->prev;
+	}
+
+	p->prev = NULL;
+	p->next = NULL;
+}
+
+static void lru_push_front(struct scar_page_cache *pc, struct cache_page *p)
+{
+	p->prev = NULL;
+	p->next = pc->lru_head;
+	if (pc->lru_head) {
+		pc->lru_head->prev = p;
+	} else {
+		pc->lru_tail = p;
+	}
+	pc->lru_head = p;
+}
+
+static struct cache_page *cache_find(
+	struct scar_page_cache *pc, scar_offset segment, uint64_t idx
+) {
+	struct cache_page *p = pc->buckets[bucket_of(pc, segment, idx)];
+	while (p && (p->segment != segment || p->idx != idx)) {
+		p = p->hnext;
+	}
+
+	return p;
+}
+
+static void cache_evict(struct scar_page_cache *pc, struct cache_page *p)
+{
+	struct cache_page **link = &pc->buckets[bucket_of(pc, p->segment, p->idx)];
+	while (*link != p) {
+		link = &(*link)->hnext;
+	}
+
+	*link = p->hnext;
+	lru_unlink(pc, p);
+	pc->stats.bytes -= p->len;
+	free(p->data);
+	free(p);
+}
+
+struct scar_page_cache *scar_page_cache_create(size_t max_bytes)
+{
+	struct scar_page_cache *pc = malloc(sizeof(*pc));
+	if (!pc) {
+		SCAR_ERETURN(NULL);
+	}
+
+	pc->max_bytes = max_bytes;
+	pc->lru_head = NULL;
+	pc->lru_tail = NULL;
+	memset(&pc->stats, 0, sizeof(pc->stats));
+
+	size_t npages = max_bytes / SCAR_PAGE_SIZE;
+	pc->nbuckets = 16;
+	while (pc->nbuckets < npages) {
+		pc->nbuckets *= 2;
+	}
+
+	pc->buckets = calloc(pc->nbuckets, sizeof(*pc->buckets));
+	if (!pc->buckets) {
+		free(pc);
+		SCAR_ERETURN(NULL);
+	}
+
+	if (pthread_mutex_init(&pc->mut, NULL) != 0) {
+		free(pc->buckets);
+		free(pc);
+		SCAR_ERETURN(NULL);
+	}
+
+	return pc;
+}
+
+scar_ssize scar_page_cache_read(
+	struct scar_page_cache *pc, scar_offset segment, uint64_t page,
+	size_t offset, void *buf, size_t len
+) {
+	pthread_mutex_lock(&pc->mut);
+	struct cache_page *p = cache_find(pc, segment, page);
+	if (!p) {
+		pc->stats.misses += 1;
+		pthread_mutex_unlock(&pc->mut);
+		return -1;
+	}
+
+	pc->stats.hits += 1;
+	lru_unlink(pc, p);
+	lru_push_front(pc, p);
+
+	size_t n = 0;
+	if (offset < p->len) {
+		n = p->len - offset < len ? p->len - offset : len;
+		memcpy(buf, &p->data[offset], n);
+	}
+
+	pthread_mutex_unlock(&pc->mut);
+	return (scar_ssize)n;
+}
+
+void scar_page_cache_insert(
+	struct scar_page_cache *pc, scar_offset segment, uint64_t page,
+	unsigned char *data, size_t len
+) {
+	if (len > pc->max_bytes) {
+		free(data);
+		return;
+	}
+
+	struct cache_page *p = malloc(sizeof(*p));
+	if (!p) {
+		// The cache is only an optimization
+		free(data);
+		return;
+	}
+
+	pthread_mutex_lock(&pc->mut);
+
+	// Another cursor might have decompressed the same page in the meantime
+	if (cache_find(pc, segment, page)) {
+		pthread_mutex_unlock(&pc->mut);
+		free(data);
+		free(p);
+		return;
+	}
+
+	while (pc->stats.bytes + len > pc->max_bytes) {
+		cache_evict(pc, pc->lru_tail);
+	}
+
+	p->segment = segment;
+	p->idx = page;
+	p->data = data;
+	p->len = len;
+
+	size_t bucket = bucket_of(pc, segment, page);
+	p->hnext = pc->buckets[bucket];
+	pc->buckets[bucket] = p;
+	lru_push_front(pc, p);
+	pc->stats.bytes += len;
+
+	pthread_mutex_unlock(&pc->mut);
+}
+
+void scar_page_cache_get_stats(
+	struct scar_page_cache *pc, struct scar_page_cache_stats *stats
+) {
+	pthread_mutex_lock(&pc->mut);
+	*stats = pc->stats;
+	pthread_mutex_unlock(&pc->mut);
+}
+
+void scar_page_cache_free(struct scar_page_cache *pc)
+{
+	while (pc->lru_head) {
+		cache_evict(pc, pc->lru_head);
+	}
+
+	pthread_mutex_destroy(&pc->mut);
+	free(pc->buckets);
+	free(pc);
+}
@@ -0,0 +1,41 @@
+#ifndef SCAR_PAGE_CACHE_H
+#define SCAR_PAGE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scar-reader.h"
+#include "types.h"
+
+// The page cache holds decompressed tar body in pages of SCAR_PAGE_SIZE
+// bytes. A page is identified by the compressed offset of the checkpoint
+// it was decompressed from, and its index within that segment.
+// Only the last page of a segment can be shorter than SCAR_PAGE_SIZE.
+#define SCAR_PAGE_SIZE (64 * 1024)
+
+struct scar_page_cache;
+
+// Create a page cache which holds at most 'max_bytes' of page data,
+// evicting the least recently used pages to stay below that.
+// The cache can be used from several threads at once.
+struct scar_page_cache *scar_page_cache_create(size_t max_bytes);
+
+// Copy up to 'len' bytes of a page, starting 'offset' bytes into it.
+// Returns the number of bytes copied, which is short if the page is,
+// or -1 if the page isn't in the cache.
+scar_ssize scar_page_cache_read(
+	struct scar_page_cache *pc, scar_offset segment, uint64_t page,
+	size_t offset, void *buf, size_t len);
+
+// Store a page. The cache takes ownership of 'data',
+// which must have been allocated with malloc.
+void scar_page_cache_insert(
+	struct scar_page_cache *pc, scar_offset segment, uint64_t page,
+	unsigned char *data, size_t len);
+
+void scar_page_cache_get_stats(
+	struct scar_page_cache *pc, struct scar_page_cache_stats *stats);
+
+void scar_page_cache_free(struct scar_page_cache *pc);
+
+#endif
@@ -0,0 +1,1109 @@
+#include "parallel-inflate.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "internal-util.h"
+#include "pool.h"
+#include "scar-reader.h"
+
+// How far back deflate's back-references reach
+#define WINDOW_SIZE (32 * 1024)
+
+// What the chunks of a round may decompress to, all together, counting
+// the two bytes each byte takes in 'wide'. Each chunk gets an equal share.
+// A chunk which decompresses to more than its share isn't worth guessing
+// about. The first chunk of a round, which zlib decompresses, stops at
+// the first block boundary after it instead.
+#define ROUND_OUT_MAX (256 * 1024 * 1024)
+
+// The free space zlib gets in a chunk's output buffer
+#define NARROW_ROOM (256 * 1024)
+
+// The first three bits of a block which isn't the last one
+// and has its own Huffman codes
+#define HEADER_DYNAMIC 4
+
+// Results of decompressing a chunk
+#define CHUNK_OK 0
+#define CHUNK_BAD -1
+#define CHUNK_SHORT -2
+
+static const unsigned char CODE_LENGTH_ORDER[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+static const uint16_t LENGTH_BASE[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+
+static const unsigned char LENGTH_EXTRA[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+static const uint16_t DIST_BASE[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+	16385, 24577,
+};
+
+static const unsigned char DIST_EXTRA[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+struct scar_parallel_inflate;
+
+// One thread's share of a round.
+//
+// A chunk which doesn't know the data before it decompresses into 'wide',
+// where bytes are stored as values below 256, and a byte which
+// is copied from the unknown window is stored as 256 plus its position
+// in the window. Once a window's worth of output has no such markers,
+// nothing after it can refer to the unknown data, and zlib decompresses
+// the rest of the chunk into 'narrow'. When the chunk is used, 'wide'
+// is turned into bytes in place.
+struct chunk {
+	struct scar_parallel_inflate *pi;
+
+	// Whether the chunk starts at 'search_start', right after the
+	// window of the parallel inflater. Otherwise it starts at the first
+	// block boundary it can find before 'search_end'.
+	// Either way, it ends at the first block boundary at or after
+	// 'end_min' which is followed by a non-final block with its own codes,
+	// since that's what the next chunk looks for, or at the end of the
+	// last block.
+	bool known;
+	uint64_t search_start;
+	uint64_t search_end;
+	uint64_t end_min;
+
+	// The outcome: 'start' and 'end' are bit offsets into the
+	// parallel inflater's input
+	int status;
+	bool final;
+	uint64_t start;
+	uint64_t end;
+	uint32_t narrow_crc;
+
+	uint16_t *wide;
+	size_t wide_len;
+	size_t wide_cap;
+	unsigned char *narrow;
+	size_t narrow_len;
+	size_t narrow_cap;
+
+	// The speculative decoder: the next bit to read, how many bits
+	// there are, where the last marker in 'wide' ends, and the
+	// lookup tables for the current block's Huffman codes
+	uint64_t pos;
+	uint64_t limit;
+	size_t last_marker;
+	uint16_t lit[1 << 15];
+	unsigned int lit_bits;
+	uint16_t dist[1 << 15];
+	unsigned int dist_bits;
+
+	unsigned char window[WINDOW_SIZE];
+	z_stream zs;
+	bool zs_init;
+};
+
+struct scar_parallel_inflate {
+	struct scar_decompressor d;
+	struct scar_io_reader *r;
+	struct scar_pool *pool;
+	unsigned int nthreads;
+	size_t chunk_size;
+	size_t chunk_out_max;
+	struct chunk *chunks;
+
+	// Compressed data which hasn't been decompressed yet starts at bit
+	// 'pos' of 'in'. 'in_offset' is how much of the member came before 'in'.
+	unsigned char *in;
+	size_t in_len;
+	size_t in_cap;
+	scar_offset in_offset;
+	bool in_eof;
+	uint64_t pos;
+	bool header_done;
+	bool done;
+	bool error;
+
+	// The last WINDOW_SIZE bytes of output, the CRC of all of it,
+	// and how much there is
+	unsigned char window[WINDOW_SIZE];
+	size_t window_len;
+	uint32_t crc;
+	scar_offset out;
+
+	// The chunks of the last round which were used,
+	// and how far the reader is through them
+	size_t nready;
+	size_t serve_chunk;
+	bool serve_narrow;
+	size_t serve_pos;
+
+	struct scar_access_point_sink *sink;
+	scar_offset last_point;
+};
+
+// Peek at 'n' (at most 25) bits at bit 'pos'.
+// Bits past the end of the input read as 0.
+static uint32_t peek_bits(
+	const unsigned char *in, size_t len, uint64_t pos, unsigned int n
+) {
+	size_t i = (size_t)(pos >> 3);
+	uint32_t v = 0;
+	if (i + 4 <= len) {
+		v = (uint32_t)in[i] | (uint32_t)in[i + 1] << 8 |
+			(uint32_t)in[i + 2] << 16 | (uint32_t)in[i + 3] << 24;
+	} else {
+		for (size_t k = 0; k < 4 && i + k < len; ++k) {
+			v |= (uint32_t)in[i + k] << (8 * k);
+		}
+	}
+
+	return (v >> (pos & 7)) & ((UINT32_C(1) << n) - 1);
+}
+
+static uint32_t chunk_bits(struct chunk *c, unsigned int n)
+{
+	uint32_t v = peek_bits(c->pi->in, c->pi->in_len, c->pos, n);
+	c->pos += n;
+	return v;
+}
+
+// Build a lookup table for the canonical Huffman code with code lengths
+// 'lens'. Each entry holds a symbol shifted left by 4 and its code length,
+// or 0 for bit patterns which don't start with a code.
+// An incomplete code is only allowed if 'incomplete' is set, and then
+// only if it's a single code of length 1, like zlib does.
+// Returns the number of bits the table is indexed with, or 0 if the
+// lengths aren't a valid code.
+static unsigned int build_table(
+	uint16_t *table, const unsigned char *lens, unsigned int n,
+	bool incomplete
+) {
+	unsigned int count[16] = {0};
+	for (unsigned int i = 0; i < n; ++i) {
+		count[lens[i]] += 1;
+	}
+	count[0] = 0;
+
+	unsigned int max = 15;
+	while (max > 0 && count[max] == 0) {
+		max -= 1;
+	}
+
+	if (max == 0) {
+		if (!incomplete) {
+			return 0;
+		}
+
+		table[0] = table[1] = 0;
+		return 1;
+	}
+
+	int left = 1;
+	for (unsigned int len = 1; len <= 15; ++len) {
+		left = left * 2 - (int)count[len];
+		if (left < 0) {
+			return 0;
+		}
+	}
+
+	if (left > 0 && (!incomplete || max != 1)) {
+		return 0;
+	}
+
+	unsigned int next[16];
+	unsigned int code = 0;
+	for (unsigned int len = 1; len <= 15; ++len) {
+		code = (code + count[len - 1]) << 1;
+		next[len] = code;
+	}
+
+	size_t size = (size_t)1 << max;
+	memset(table, 0, size * sizeof(*table));
+	for (unsigned int sym = 0; sym < n; ++sym) {
+		unsigned int len = lens[sym];
+		if (len == 0) {
+			continue;
+		}
+
+		// Deflate packs codes starting with their most significant bit
+		code = next[len]++;
+		unsigned int rev = 0;
+		for (unsigned int i = 0; i < len; ++i) {
+			rev = (rev << 1) | ((code >> i) & 1);
+		}
+
+		for (size_t i = rev; i < size; i += (size_t)1 << len) {
+			table[i] = (uint16_t)(sym << 4 | len);
+		}
+	}
+
+	return max;
+}
+
+static int chunk_symbol(
+	struct chunk *c, const uint16_t *table, unsigned int bits
+) {
+	uint16_t e = table[peek_bits(c->pi->in, c->pi->in_len, c->pos, bits)];
+	if ((e & 15) == 0) {
+		return -1;
+	}
+
+	c->pos += e & 15;
+	return e >> 4;
+}
+
+static void chunk_fixed_codes(struct chunk *c)
+{
+	unsigned char lens[288];
+	memset(&lens[0], 8, 144);
+	memset(&lens[144], 9, 112);
+	memset(&lens[256], 7, 24);
+	memset(&lens[280], 8, 8);
+	c->lit_bits = build_table(c->lit, lens, 288, false);
+
+	memset(lens, 5, 32);
+	c->dist_bits = build_table(c->dist, lens, 32, false);
+}
+
+static int chunk_dynamic_codes(struct chunk *c)
+{
+	unsigned int nlit = chunk_bits(c, 5) + 257;
+	unsigned int ndist = chunk_bits(c, 5) + 1;
+	unsigned int nclen = chunk_bits(c, 4) + 4;
+	if (nlit > 286 || ndist > 30) {
+		return -1;
+	}
+
+	unsigned char clens[19] = {0};
+	for (unsigned int i = 0; i < nclen; ++i) {
+		clens[CODE_LENGTH_ORDER[i]] = (unsigned char)chunk_bits(c, 3);
+	}
+
+	uint16_t ctable[1 << 7];
+	unsigned int cbits = build_table(ctable, clens, 19, false);
+	if (cbits == 0) {
+		return -1;
+	}
+
+	unsigned char lens[286 + 30];
+	unsigned int n = 0;
+	while (n < nlit + ndist) {
+		int sym = chunk_symbol(c, ctable, cbits);
+		if (sym < 0) {
+			return -1;
+		} else if (sym < 16) {
+			lens[n++] = (unsigned char)sym;
+			continue;
+		}
+
+		unsigned char len = 0;
+		unsigned int repeat;
+		if (sym == 16) {
+			if (n == 0) {
+				return -1;
+			}
+
+			len = lens[n - 1];
+			repeat = 3 + chunk_bits(c, 2);
+		} else if (sym == 17) {
+			repeat = 3 + chunk_bits(c, 3);
+		} else {
+			repeat = 11 + chunk_bits(c, 7);
+		}
+
+		if (n + repeat > nlit + ndist) {
+			return -1;
+		}
+
+		memset(&lens[n], len, repeat);
+		n += repeat;
+	}
+
+	// Every block needs an end-of-block code
+	if (lens[256] == 0) {
+		return -1;
+	}
+
+	c->lit_bits = build_table(c->lit, lens, nlit, true);
+	c->dist_bits = build_table(c->dist, &lens[nlit], ndist, true);
+	if (c->lit_bits == 0 || c->dist_bits == 0 || c->pos > c->limit) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int chunk_wide_reserve(struct chunk *c, size_t n)
+{
+	if ((c->wide_len + n) * sizeof(*c->wide) > c->pi->chunk_out_max) {
+		return -1;
+	} else if (c->wide_cap - c->wide_len >= n) {
+		return 0;
+	}
+
+	size_t cap = c->wide_cap ? c->wide_cap * 2 : 256 * 1024;
+	while (cap - c->wide_len < n) {
+		cap *= 2;
+	}
+
+	uint16_t *wide = realloc(c->wide, cap * sizeof(*wide));
+	if (!wide) {
+		return -1;
+	}
+
+	c->wide = wide;
+	c->wide_cap = cap;
+	return 0;
+}
+
+// Decompress the symbols of a block with Huffman codes into 'wide'
+static int chunk_huffman_block(struct chunk *c)
+{
+	for (;;) {
+		if (c->pos > c->limit || chunk_wide_reserve(c, 258) < 0) {
+			return -1;
+		}
+
+		int sym = chunk_symbol(c, c->lit, c->lit_bits);
+		if (sym < 0) {
+			return -1;
+		} else if (sym < 256) {
+			c->wide[c->wide_len++] = (uint16_t)sym;
+			continue;
+		} else if (sym == 256) {
+			return 0;
+		} else if (sym > 285) {
+			return -1;
+		}
+
+		sym -= 257;
+		size_t len = LENGTH_BASE[sym] + chunk_bits(c, LENGTH_EXTRA[sym]);
+		int dsym = chunk_symbol(c, c->dist, c->dist_bits);
+		if (dsym < 0 || dsym >= 30) {
+			return -1;
+		}
+
+		size_t dist = DIST_BASE[dsym] + chunk_bits(c, DIST_EXTRA[dsym]);
+		if (dist > c->wide_len + WINDOW_SIZE) {
+			return -1;
+		}
+
+		for (size_t i = 0; i < len; ++i) {
+			size_t n = c->wide_len;
+			uint16_t v;
+			if (n >= dist) {
+				v = c->wide[n - dist];
+			} else {
+				v = (uint16_t)(256 + WINDOW_SIZE - (dist - n));
+			}
+
+			if (v >= 256) {
+				c->last_marker = n + 1;
+			}
+
+			c->wide[c->wide_len++] = v;
+		}
+	}
+}
+
+static int chunk_stored_block(struct chunk *c)
+{
+	c->pos = (c->pos + 7) & ~(uint64_t)7;
+	uint32_t len = chunk_bits(c, 16);
+	uint32_t nlen = chunk_bits(c, 16);
+	size_t at = (size_t)(c->pos / 8);
+	if (
+		(len ^ 0xffff) != nlen || c->pos > c->limit ||
+		c->pi->in_len - at < len || chunk_wide_reserve(c, len) < 0
+	) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		c->wide[c->wide_len++] = c->pi->in[at + i];
+	}
+
+	c->pos += (uint64_t)len * 8;
+	return 0;
+}
+
+// Decompress the block starting at bit 'c->pos' into 'wide'
+static int chunk_block(struct chunk *c, bool *final)
+{
+	uint32_t header = chunk_bits(c, 3);
+	*final = header & 1;
+	switch (header >> 1) {
+	case 0:
+		return chunk_stored_block(c);
+	case 1:
+		chunk_fixed_codes(c);
+		return chunk_huffman_block(c);
+	case 2:
+		if (chunk_dynamic_codes(c) < 0) {
+			return -1;
+		}
+		return chunk_huffman_block(c);
+	default:
+		return -1;
+	}
+}
+
+static int chunk_narrow_reserve(struct chunk *c)
+{
+	if (c->narrow_cap - c->narrow_len >= NARROW_ROOM) {
+		return 0;
+	}
+
+	size_t cap = c->narrow_cap ? c->narrow_cap * 2 : 4 * NARROW_ROOM;
+	unsigned char *narrow = realloc(c->narrow, cap);
+	if (!narrow) {
+		return -1;
+	}
+
+	c->narrow = narrow;
+	c->narrow_cap = cap;
+	return 0;
+}
+
+static bool chunk_ends_at(struct chunk *c, uint64_t pos)
+{
+	return pos >= c->end_min &&
+		peek_bits(c->pi->in, c->pi->in_len, pos, 3) == HEADER_DYNAMIC;
+}
+
+// Decompress with zlib into 'narrow' from bit 'start',
+// which is at a block boundary, and which 'window' leads up to.
+static int chunk_inflate(
+	struct chunk *c, uint64_t start,
+	const unsigned char *window, size_t window_len
+) {
+	struct scar_parallel_inflate *pi = c->pi;
+	z_stream *zs = &c->zs;
+	if (!c->zs_init) {
+		memset(zs, 0, sizeof(*zs));
+		if (inflateInit2(zs, -15) != Z_OK) {
+			return CHUNK_BAD;
+		}
+
+		c->zs_init = true;
+	} else if (inflateReset(zs) != Z_OK) {
+		return CHUNK_BAD;
+	}
+
+	size_t at = (size_t)(start / 8);
+	int bits = (int)(start % 8);
+	if (at >= pi->in_len) {
+		return CHUNK_SHORT;
+	}
+
+	assert(pi->in_len - at <= UINT_MAX);
+	zs->next_in = &pi->in[at];
+	zs->avail_in = (uInt)(pi->in_len - at);
+	if (bits) {
+		if (inflatePrime(zs, 8 - bits, pi->in[at] >> bits) != Z_OK) {
+			return CHUNK_BAD;
+		}
+
+		zs->next_in += 1;
+		zs->avail_in -= 1;
+	}
+
+	if (
+		window_len > 0 &&
+		inflateSetDictionary(zs, window, (uInt)window_len) != Z_OK
+	) {
+		return CHUNK_BAD;
+	}
+
+	uint64_t boundary = start;
+	size_t boundary_len = c->narrow_len;
+	for (;;) {
+		if (chunk_narrow_reserve(c) < 0) {
+			return CHUNK_BAD;
+		}
+
+		size_t room = c->narrow_cap - c->narrow_len;
+		if (room > UINT_MAX) {
+			room = UINT_MAX;
+		}
+
+		zs->next_out = &c->narrow[c->narrow_len];
+		zs->avail_out = (uInt)room;
+		int ret = inflate(zs, Z_BLOCK);
+		c->narrow_len += room - zs->avail_out;
+
+		uint64_t pos =
+			(uint64_t)(zs->next_in - pi->in) * 8 - (zs->data_type & 7);
+		// With Z_BLOCK, zlib stops right after the last block
+		// before it gets to say so, and whatever follows it
+		// might look like the start of another block
+		bool last = (zs->data_type & 128) && (zs->data_type & 64);
+		if (ret == Z_STREAM_END || (ret == Z_OK && last)) {
+			c->final = true;
+			c->end = pos;
+			return CHUNK_OK;
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			return CHUNK_BAD;
+		}
+
+		if ((zs->data_type & 128) && pos != boundary) {
+			boundary = pos;
+			boundary_len = c->narrow_len;
+			if (chunk_ends_at(c, pos)) {
+				c->end = pos;
+				return CHUNK_OK;
+			}
+
+			size_t out = c->wide_len * sizeof(*c->wide) + c->narrow_len;
+			if (out > pi->chunk_out_max) {
+				if (!c->known) {
+					return CHUNK_BAD;
+				}
+
+				c->end = pos;
+				return CHUNK_OK;
+			}
+		}
+
+		// Without enough input to reach the end it's after,
+		// the first chunk stops at the last block boundary it passed
+		if (zs->avail_in == 0) {
+			if (!c->known || boundary == start) {
+				return CHUNK_SHORT;
+			}
+
+			c->narrow_len = boundary_len;
+			c->end = boundary;
+			return CHUNK_OK;
+		}
+	}
+}
+
+// Carry on after the first block of a chunk which doesn't know its window
+static int chunk_continue(struct chunk *c)
+{
+	bool final = false;
+	for (;;) {
+		if (final) {
+			c->final = true;
+			c->end = c->pos;
+			return CHUNK_OK;
+		} else if (chunk_ends_at(c, c->pos)) {
+			c->end = c->pos;
+			return CHUNK_OK;
+		}
+
+		if (c->wide_len - c->last_marker >= WINDOW_SIZE) {
+			const uint16_t *src = &c->wide[c->wide_len - WINDOW_SIZE];
+			for (size_t i = 0; i < WINDOW_SIZE; ++i) {
+				c->window[i] = (unsigned char)src[i];
+			}
+
+			return chunk_inflate(c, c->pos, c->window, WINDOW_SIZE);
+		}
+
+		if (chunk_block(c, &final) < 0) {
+			return CHUNK_BAD;
+		}
+	}
+}
+
+// Check whether a block with its own codes, which isn't the last one,
+// starts at bit 'start', by decompressing it
+static bool chunk_try(struct chunk *c, uint64_t start)
+{
+	// The header, and the number of literal/length and distance codes
+	uint32_t v = peek_bits(c->pi->in, c->pi->in_len, start, 13);
+	if ((v & 7) != HEADER_DYNAMIC || (v >> 3 & 31) > 29 || (v >> 8) > 29) {
+		return false;
+	}
+
+	c->pos = start + 3;
+	c->wide_len = 0;
+	c->last_marker = 0;
+	if (chunk_dynamic_codes(c) < 0 || chunk_huffman_block(c) < 0) {
+		return false;
+	}
+
+	// Whatever follows must at least be a valid block type
+	return c->pos <= c->limit &&
+		peek_bits(c->pi->in, c->pi->in_len, c->pos, 3) >> 1 != 3;
+}
+
+static void chunk_run(void *arg)
+{
+	struct chunk *c = arg;
+	struct scar_parallel_inflate *pi = c->pi;
+	c->final = false;
+	c->wide_len = 0;
+	c->narrow_len = 0;
+	c->last_marker = 0;
+	c->limit = (uint64_t)pi->in_len * 8;
+
+	if (c->known) {
+		c->start = c->search_start;
+		c->status = chunk_inflate(c, c->start, pi->window, pi->window_len);
+	} else {
+		c->status = CHUNK_BAD;
+		uint64_t end = c->search_end < c->limit ? c->search_end : c->limit;
+		for (uint64_t b = c->search_start; b < end; ++b) {
+			if (chunk_try(c, b)) {
+				c->start = b;
+				c->status = chunk_continue(c);
+				break;
+			}
+		}
+	}
+
+	if (c->status == CHUNK_OK) {
+		assert(c->narrow_len <= UINT_MAX);
+		c->narrow_crc = crc32(0, c->narrow, (uInt)c->narrow_len);
+	}
+}
+
+// Turn the markers in a chunk's 'wide' into the bytes they stand for,
+// now that the window before the chunk is known
+static int chunk_resolve(struct scar_parallel_inflate *pi, struct chunk *c)
+{
+	unsigned char *bytes = (unsigned char *)c->wide;
+	size_t missing = WINDOW_SIZE - pi->window_len;
+	for (size_t i = 0; i < c->wide_len; ++i) {
+		uint16_t v = c->wide[i];
+		if (v < 256) {
+			bytes[i] = (unsigned char)v;
+		} else if ((size_t)(v - 256) >= missing) {
+			bytes[i] = pi->window[v - 256 - missing];
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void pi_window_append(
+	struct scar_parallel_inflate *pi, const unsigned char *buf, size_t len
+) {
+	if (len == 0) {
+		return;
+	} else if (len >= WINDOW_SIZE) {
+		memcpy(pi->window, &buf[len - WINDOW_SIZE], WINDOW_SIZE);
+		pi->window_len = WINDOW_SIZE;
+		return;
+	}
+
+	size_t keep = WINDOW_SIZE - len;
+	if (keep > pi->window_len) {
+		keep = pi->window_len;
+	}
+
+	memmove(pi->window, &pi->window[pi->window_len - keep], keep);
+	memcpy(&pi->window[keep], buf, len);
+	pi->window_len = keep + len;
+}
+
+// Add a chunk whose bytes are all known to the output
+static void pi_accept(struct scar_parallel_inflate *pi, struct chunk *c)
+{
+	if (
+		pi->sink && pi->out > 0 &&
+		pi->out - pi->last_point >= pi->sink->span
+	) {
+		uint64_t bit = (uint64_t)pi->in_offset * 8 + c->start;
+		struct scar_access_point ap;
+		ap.in = (scar_offset)((bit + 7) / 8);
+		ap.out = pi->out;
+		ap.bits = (int)((8 - bit % 8) % 8);
+		ap.window = pi->window;
+		ap.window_len = pi->window_len;
+		pi->sink->add(pi->sink, &ap);
+		pi->last_point = pi->out;
+	}
+
+	const unsigned char *bytes = (const unsigned char *)c->wide;
+	assert(c->wide_len <= UINT_MAX);
+	uint32_t crc = crc32(0, bytes, (uInt)c->wide_len);
+	crc = crc32_combine(crc, c->narrow_crc, (z_off_t)c->narrow_len);
+	size_t len = c->wide_len + c->narrow_len;
+	pi->crc = crc32_combine(pi->crc, crc, (z_off_t)len);
+	pi->out += (scar_offset)len;
+
+	pi_window_append(pi, bytes, c->wide_len);
+	pi_window_append(pi, c->narrow, c->narrow_len);
+}
+
+// Make sure there are at least 'want' bytes of input from bit 'pos' on,
+// unless the stream ends first. Input before 'pos' is dropped.
+static int pi_fill(struct scar_parallel_inflate *pi, size_t want)
+{
+	size_t drop = (size_t)(pi->pos / 8);
+	if (drop > 0) {
+		memmove(pi->in, &pi->in[drop], pi->in_len - drop);
+		pi->in_len -= drop;
+		pi->in_offset += (scar_offset)drop;
+		pi->pos -= (uint64_t)drop * 8;
+	}
+
+	if (pi->in_cap < want) {
+		unsigned char *in = realloc(pi->in, want);
+		if (!in) {
+			SCAR_ERETURN(-1);
+		}
+
+		pi->in = in;
+		pi->in_cap = want;
+	}
+
+	while (pi->in_len < want && !pi->in_eof) {
+		scar_ssize n = pi->r->read(
+			pi->r, &pi->in[pi->in_len], want - pi->in_len);
+		if (n < 0) {
+			SCAR_ERETURN(-1);
+		} else if (n == 0) {
+			pi->in_eof = true;
+		}
+
+		pi->in_len += (size_t)n;
+	}
+
+	return 0;
+}
+
+// Parse the gzip header at the start of 'in'. Returns its length,
+// 0 if it doesn't fit in 'len' bytes, or -1 if it isn't a valid header.
+static scar_ssize parse_header(const unsigned char *in, size_t len)
+{
+	if (len < 10) {
+		return 0;
+	} else if (
+		in[0] != 0x1f || in[1] != 0x8b || in[2] != 8 || (in[3] & 0xe0)
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned char flags = in[3];
+	size_t pos = 10;
+	if (flags & 4) {
+		if (len - pos < 2) {
+			return 0;
+		}
+
+		size_t xlen = (size_t)in[pos] | (size_t)in[pos + 1] << 8;
+		pos += 2;
+		if (len - pos < xlen) {
+			return 0;
+		}
+
+		pos += xlen;
+	}
+
+	// The file name and the comment
+	for (unsigned char flag = 8; flag <= 16; flag <<= 1) {
+		if (!(flags & flag)) {
+			continue;
+		}
+
+		while (pos < len && in[pos] != 0) {
+			pos += 1;
+		}
+
+		if (pos == len) {
+			return 0;
+		}
+
+		pos += 1;
+	}
+
+	if (flags & 2) {
+		if (len - pos < 2) {
+			return 0;
+		}
+
+		pos += 2;
+	}
+
+	return (scar_ssize)pos;
+}
+
+static uint32_t read_le32(const unsigned char *buf)
+{
+	return (uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+		(uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+// Decompress the next 'nthreads' chunks, and use as many of them
+// as line up with each other
+static int pi_round(struct scar_parallel_inflate *pi)
+{
+	pi->nready = 0;
+	pi->serve_chunk = 0;
+	pi->serve_narrow = false;
+	pi->serve_pos = 0;
+
+	uint64_t csize = pi->chunk_size;
+	size_t want = (pi->nthreads + 1) * pi->chunk_size;
+	size_t n;
+	for (;;) {
+		if (pi_fill(pi, want) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		if (!pi->header_done) {
+			scar_ssize len = parse_header(pi->in, pi->in_len);
+			if (len == 0 && !pi->in_eof) {
+				want *= 2;
+				continue;
+			} else if (len <= 0) {
+				SCAR_ERETURN(-1);
+			}
+
+			pi->pos = (uint64_t)len * 8;
+			pi->header_done = true;
+		}
+
+		n = (pi->in_len - (size_t)(pi->pos / 8)) / pi->chunk_size;
+		if (n > pi->nthreads) {
+			n = pi->nthreads;
+		} else if (n == 0) {
+			n = 1;
+		}
+
+		for (size_t i = 0; i < n; ++i) {
+			struct chunk *c = &pi->chunks[i];
+			c->known = i == 0;
+			c->search_start = pi->pos + i * csize * 8;
+			c->search_end = c->search_start + csize * 8;
+			c->end_min = c->search_end;
+			if (scar_pool_submit(pi->pool, chunk_run, c) < 0) {
+				chunk_run(c);
+			}
+		}
+
+		scar_pool_wait(pi->pool);
+
+		// A block which doesn't fit needs more input
+		if (pi->chunks[0].status == CHUNK_SHORT && !pi->in_eof) {
+			want *= 2;
+			continue;
+		} else if (pi->chunks[0].status != CHUNK_OK) {
+			SCAR_ERETURN(-1);
+		}
+
+		break;
+	}
+
+	struct chunk *last = NULL;
+	for (size_t i = 0; i < n; ++i) {
+		struct chunk *c = &pi->chunks[i];
+		if (last && (
+			last->final || c->status != CHUNK_OK || c->start != last->end ||
+			chunk_resolve(pi, c) < 0
+		)) {
+			break;
+		}
+
+		pi_accept(pi, c);
+		pi->nready += 1;
+		last = c;
+	}
+
+	pi->pos = last->end;
+	if (!last->final) {
+		return 0;
+	}
+
+	// The trailer has the CRC32 and the length of the data, mod 2^32
+	pi->pos = (pi->pos + 7) & ~(uint64_t)7;
+	if (pi_fill(pi, 8) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	size_t at = (size_t)(pi->pos / 8);
+	if (
+		pi->in_len - at < 8 ||
+		read_le32(&pi->in[at]) != pi->crc ||
+		read_le32(&pi->in[at + 4]) != (uint32_t)pi->out
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	pi->done = true;
+	return 0;
+}
+
+static scar_ssize pi_fill_buf(struct scar_io_reader *ptr, const void **buf)
+{
+	struct scar_parallel_inflate *pi = (struct scar_parallel_inflate *)ptr;
+
+	for (;;) {
+		if (pi->error) {
+			SCAR_ERETURN(-1);
+		}
+
+		while (pi->serve_chunk < pi->nready) {
+			struct chunk *c = &pi->chunks[pi->serve_chunk];
+			const unsigned char *data = (const unsigned char *)c->wide;
+			size_t len = c->wide_len;
+			if (pi->serve_narrow) {
+				data = c->narrow;
+				len = c->narrow_len;
+			}
+
+			if (pi->serve_pos < len) {
+				*buf = &data[pi->serve_pos];
+				return (scar_ssize)(len - pi->serve_pos);
+			}
+
+			pi->serve_pos = 0;
+			pi->serve_narrow = !pi->serve_narrow;
+			if (!pi->serve_narrow) {
+				pi->serve_chunk += 1;
+			}
+		}
+
+		if (pi->done) {
+			*buf = pi->window;
+			return 0;
+		}
+
+		if (pi_round(pi) < 0) {
+			pi->error = true;
+			SCAR_ERETURN(-1);
+		}
+	}
+}
+
+static void pi_consume(struct scar_io_reader *ptr, size_t len)
+{
+	struct scar_parallel_inflate *pi = (struct scar_parallel_inflate *)ptr;
+	pi->serve_pos += len;
+}
+
+static scar_ssize pi_read(struct scar_io_reader *r, void *buf, size_t len)
+{
+	unsigned char *out = buf;
+	size_t done = 0;
+	while (done < len) {
+		const void *data;
+		scar_ssize n = pi_fill_buf(r, &data);
+		if (n < 0) {
+			SCAR_ERETURN(-1);
+		} else if (n == 0) {
+			break;
+		}
+
+		size_t take = (size_t)n < len - done ? (size_t)n : len - done;
+		memcpy(&out[done], data, take);
+		pi_consume(r, take);
+		done += take;
+	}
+
+	return (scar_ssize)done;
+}
+
+struct scar_decompressor *scar_parallel_inflate_create(
+	struct scar_io_reader *r, unsigned int nthreads, size_t chunk_size,
+	struct scar_access_point_sink *sink
+) {
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+
+	if (chunk_size == 0) {
+		chunk_size = SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK;
+	}
+
+	struct scar_parallel_inflate *pi = malloc(sizeof(*pi));
+	if (!pi) {
+		SCAR_ERETURN(NULL);
+	}
+
+	pi->chunks = calloc(nthreads, sizeof(*pi->chunks));
+	if (!pi->chunks) {
+		free(pi);
+		SCAR_ERETURN(NULL);
+	}
+
+	pi->pool = scar_pool_create((int)nthreads);
+	if (!pi->pool) {
+		free(pi->chunks);
+		free(pi);
+		SCAR_ERETURN(NULL);
+	}
+
+	for (unsigned int i = 0; i < nthreads; ++i) {
+		pi->chunks[i].pi = pi;
+	}
+
+	pi->d.r.read = pi_read;
+	pi->d.r.fill_buf = pi_fill_buf;
+	pi->d.r.consume = pi_consume;
+	pi->nthreads = nthreads;
+	pi->chunk_size = chunk_size;
+	pi->chunk_out_max = ROUND_OUT_MAX / nthreads;
+	pi->in = NULL;
+	pi->in_cap = 0;
+	scar_parallel_inflate_reset(&pi->d, r, sink);
+	return &pi->d;
+}
+
+void scar_parallel_inflate_reset(
+	struct scar_decompressor *d, struct scar_io_reader *r,
+	struct scar_access_point_sink *sink
+) {
+	struct scar_parallel_inflate *pi = (struct scar_parallel_inflate *)d;
+	pi->r = r;
+	pi->in_len = 0;
+	pi->in_offset = 0;
+	pi->in_eof = false;
+	pi->pos = 0;
+	pi->header_done = false;
+	pi->done = false;
+	pi->error = false;
+	pi->window_len = 0;
+	pi->crc = 0;
+	pi->out = 0;
+	pi->nready = 0;
+	pi->serve_chunk = 0;
+	pi->serve_narrow = false;
+	pi->serve_pos = 0;
+	pi->sink = sink;
+	pi->last_point = 0;
+}
+
+void scar_parallel_inflate_free(struct scar_decompressor *d)
+{
+	if (!d) {
+		return;
+	}
+
+	struct scar_parallel_inflate *pi = (struct scar_parallel_inflate *)d;
+	scar_pool_free(pi->pool);
+	for (unsigned int i = 0; i < pi->nthreads; ++i) {
+		struct chunk *c = &pi->chunks[i];
+		if (c->zs_init) {
+			inflateEnd(&c->zs);
+		}
+
+		free(c->wide);
+		free(c->narrow);
+	}
+
+	free(pi->chunks);
+	free(pi->in);
+	free(pi);
+}
@@ -0,0 +1,34 @@
+#ifndef SCAR_PARALLEL_INFLATE_H
+#define SCAR_PARALLEL_INFLATE_H
+
+#include <stddef.h>
+
+#include "compression.h"
+#include "io.h"
+
+// A parallel inflater decompresses one big gzip member with several
+// threads, the way pugz does: the compressed data is cut into chunks,
+// and each thread starts on its chunk at the first place which looks
+// like the start of a deflate block. A chunk is only used if it starts
+// exactly where the chunk before it ends, so a wrong guess costs time,
+// never correctness. It reads ahead of what it has returned by a few
+// chunks, so 'r' must not be shared with anything else while it's used.
+
+// Create a parallel inflater which reads a gzip member from 'r',
+// cut into chunks of about 'chunk_size' compressed bytes
+// (0 means SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK), 'nthreads' of which
+// are decompressed at a time. If 'sink' isn't NULL, the start of every
+// chunk is reported to it as an access point, subject to its span.
+// Returns NULL on error.
+struct scar_decompressor *scar_parallel_inflate_create(
+	struct scar_io_reader *r, unsigned int nthreads, size_t chunk_size,
+	struct scar_access_point_sink *sink);
+
+// Start over with a new member from 'r', keeping the threads and buffers.
+void scar_parallel_inflate_reset(
+	struct scar_decompressor *d, struct scar_io_reader *r,
+	struct scar_access_point_sink *sink);
+
+void scar_parallel_inflate_free(struct scar_decompressor *d);
+
+#endif
@@ -1,208 +1,393 @@
 #include "pax-syntax.h"
 
-#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "internal-util.h"
 #include "ioutil.h"
 #include "meta.h"
-
-static int parse_time(struct scar_block_reader *br, size_t size, double *num)
+#include "meta-arena.h"
+
+// A pax extended header is a series of records, each of which is
+// "<length> <keyword>=<value>\n", where the length covers the whole record.
+// The header is read into one buffer, and the records are parsed
+// straight out of it.
+
+// Headers up to this size are parsed from the stack, when there's no arena
+#define STACK_HEADER_SIZE 4096
+
+enum keyword_type {
+	KW_TIME,
+	KW_U64,
+	KW_STRING,
+	KW_INTERNED_STRING,
+};
+
+struct keyword {
+	const char *name;
+	enum keyword_type type;
+	size_t offset;
+};
+
+#define KEYWORD(name, type) {#name, type, offsetof(struct scar_meta, name)}
+
+enum {
+	KW_ATIME,
+	KW_CHARSET,
+	KW_COMMENT,
+	KW_GID,
+	KW_GNAME,
+	KW_HDRCHARSET,
+	KW_LINKPATH,
+	KW_MTIME,
+	KW_PATH,
+	KW_SIZE,
+	KW_UID,
+	KW_UNAME,
+};
+
+// Strings which repeat in almost every header are interned
+static const struct keyword keywords[] = {
+	[KW_ATIME] = KEYWORD(atime, KW_TIME),
+	[KW_CHARSET] = KEYWORD(charset, KW_INTERNED_STRING),
+	[KW_COMMENT] = KEYWORD(comment, KW_STRING),
+	[KW_GID] = KEYWORD(gid, KW_U64),
+	[KW_GNAME] = KEYWORD(gname, KW_INTERNED_STRING),
+	[KW_HDRCHARSET] = KEYWORD(hdrcharset, KW_INTERNED_STRING),
+	[KW_LINKPATH] = KEYWORD(linkpath, KW_STRING),
+	[KW_MTIME] = KEYWORD(mtime, KW_TIME),
+	[KW_PATH] = KEYWORD(path, KW_STRING),
+	[KW_SIZE] = KEYWORD(size, KW_U64),
+	[KW_UID] = KEYWORD(uid, KW_U64),
+	[KW_UNAME] = KEYWORD(uname, KW_INTERNED_STRING),
+};
+
+// Every keyword we know is told apart by its length and one of its bytes,
+// so that a keyword only ever has to be compared with one candidate
+static const struct keyword *find_keyword(const char *key, size_t len)
 {
-	// This float parser probably isn't correct,
-	// I'm guessing numbers don't really round-trip correctly.
+	int idx = -1;
+	switch (len) {
+	case 3:
+		idx = key[0] == 'g' ? KW_GID : key[0] == 'u' ? KW_UID : -1;
+		break;
+	case 4:
+		idx = key[0] == 'p' ? KW_PATH : key[0] == 's' ? KW_SIZE : -1;
+		break;
+	case 5:
+		switch (key[0]) {
+		case 'a': idx = KW_ATIME; break;
+		case 'g': idx = KW_GNAME; break;
+		case 'm': idx = KW_MTIME; break;
+		case 'u': idx = KW_UNAME; break;
+		}
+		break;
+	case 7:
+		idx = key[1] == 'h' ? KW_CHARSET : key[1] == 'o' ? KW_COMMENT : -1;
+		break;
+	case 8:
+		idx = KW_LINKPATH;
+		break;
+	case 10:
+		idx = KW_HDRCHARSET;
+		break;
+	}
 
-	double sign = 1;
-	if (br->next == '-') {
-		sign = -1;
-		size -= 1;
-		scar_block_reader_consume(br);
-	}  else if (br->next == '+') {
-		size -= 1;
-		scar_block_reader_consume(br);
+	if (idx < 0 || memcmp(keywords[idx].name, key, len) != 0) {
+		return NULL;
 	}
 
-	uint64_t intpart = 0;
-	while (br->next != '.' && size > 0) {
-		if (br->next < '0' && br->next > '9') {
+	return &keywords[idx];
+}
+
+// Vendor records which we have no field for, but which are worth
+// carrying over to the archives we write
+static int is_kept_keyword(const char *key, size_t len)
+{
+	return
+		(len > 13 && memcmp(key, "SCHILY.xattr.", 13) == 0) ||
+		(len > 11 && memcmp(key, "LIBARCHIVE.", 11) == 0);
+}
+
+static int parse_u64(const char *str, size_t len, uint64_t *num)
+{
+	uint64_t n = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (str[i] < '0' || str[i] > '9') {
 			SCAR_ERETURN(-1);
 		}
 
-		intpart *= 10;
-		intpart += (uint64_t)(br->next - '0');
-		size -= 1;
-		scar_block_reader_consume(br);
+		n *= 10;
+		n += (uint64_t)(str[i] - '0');
 	}
 
-	if (size == 0) {
-		*num = (double)intpart;
-		return 0;
+	*num = n;
+	return 0;
+}
+
+static int parse_time(const char *str, size_t len, double *num)
+{
+	// This float parser probably isn't correct,
+	// I'm guessing numbers don't really round-trip correctly.
+
+	double sign = 1;
+	size_t i = 0;
+	if (len > 0 && str[0] == '-') {
+		sign = -1;
+		i += 1;
+	} else if (len > 0 && str[0] == '+') {
+		i += 1;
 	}
 
-	if (br->next != '.') {
+	const char *dot = memchr(&str[i], '.', len - i);
+	size_t intlen = dot ? (size_t)(dot - &str[i]) : len - i;
+	uint64_t intpart;
+	if (parse_u64(&str[i], intlen, &intpart) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	size -= 1;
-	scar_block_reader_consume(br); // '.'
+	if (!dot) {
+		*num = (double)intpart * sign;
+		return 0;
+	}
 
+	// Digits past what fits in a uint64_t don't change the double
 	uint64_t fracpart = 0;
 	uint64_t fracpow = 1;
-	while (size > 0) {
-		if (br->next < '0' || br->next > '9') {
+	for (i = (size_t)(dot - str) + 1; i < len; ++i) {
+		if (str[i] < '0' || str[i] > '9') {
 			SCAR_ERETURN(-1);
 		}
 
-		fracpart *= 10;
-		fracpart += (uint64_t)(br->next - '0');
-		fracpow *= 10;
-		size -= 1;
-		scar_block_reader_consume(br);
+		if (fracpow < 1000000000000000000ull) {
+			fracpart *= 10;
+			fracpart += (uint64_t)(str[i] - '0');
+			fracpow *= 10;
+		}
 	}
 
 	*num = ((double)intpart + ((double)fracpart / (double)fracpow)) * sign;
 	return 0;
 }
 
-static int scar_parse_string(
-	struct scar_block_reader *br, size_t size, char **str
+// Set a string field to 'len' bytes of 'val'.
+// With an arena, the header is in the arena too, so the value is
+// NUL-terminated where it is (over the record's newline) and used as is,
+// and the old string is left in the arena.
+static int set_string(
+	char **str, char *val, size_t len, struct scar_meta_arena *arena,
+	int intern
 ) {
-	char *buf = malloc(size + 1);
-	if (buf == NULL) {
-		SCAR_ERETURN(-1);
+	if (arena) {
+		val[len] = '\0';
+		if (intern) {
+			val = scar_meta_arena_intern(arena, val, len);
+			if (val == NULL) {
+				SCAR_ERETURN(-1);
+			}
+		}
+
+		*str = val;
+		return 0;
 	}
 
-	if (scar_block_reader_read(&br->r, buf, size) < 0) {
-		free(buf);
+	char *buf = malloc(len + 1);
+	if (buf == NULL) {
 		SCAR_ERETURN(-1);
 	}
 
-	buf[size] = '\0';
+	memcpy(buf, val, len);
+	buf[len] = '\0';
 	free(*str);
 	*str = buf;
 	return 0;
 }
 
-static int parse_u64(struct scar_block_reader *br, size_t size, uint64_t *num)
-{
-	uint64_t n = 0;
-	while (size > 0) {
-		if (br->next < '0' || br->next > '9') {
-			SCAR_ERETURN(-1);
+// Add a whole record to the meta's kept records.
+// With an arena, records which follow each other in the header
+// stay where they are, as one slice of it.
+static int keep_record(
+	struct scar_meta *meta, char *rec, size_t len,
+	struct scar_meta_arena *arena
+) {
+	if (arena && !meta->records) {
+		meta->records = rec;
+		meta->records_len = len;
+		return 0;
+	}
+
+	if (arena && &meta->records[meta->records_len] == rec) {
+		meta->records_len += len;
+		return 0;
+	}
+
+	char *records;
+	if (arena) {
+		records = scar_meta_arena_alloc(arena, meta->records_len + len);
+		if (records) {
+			memcpy(records, meta->records, meta->records_len);
 		}
+	} else {
+		records = realloc(meta->records, meta->records_len + len);
+	}
 
-		n *= 10;
-		n += (uint64_t)(br->next - '0');
-		scar_block_reader_consume(br);
-		size -= 1;
+	if (records == NULL) {
+		SCAR_ERETURN(-1);
 	}
 
-	*num = n;
+	memcpy(&records[meta->records_len], rec, len);
+	meta->records = records;
+	meta->records_len += len;
 	return 0;
 }
 
-static int parse_one(struct scar_meta *meta, struct scar_block_reader *br) {
-	size_t fieldsize = 0;
-	size_t fieldsize_len = 0;
-	while (br->next != ' ') {
-		if (br->next < '0' || br->next > '9') {
-			SCAR_ERETURN(-1);
-		}
+static int parse_record(
+	struct scar_meta *meta, char *rec, size_t avail,
+	struct scar_meta_arena *arena, size_t *reclen
+) {
+	// The length is at most 20 digits
+	const char *space = memchr(rec, ' ', avail < 21 ? avail : 21);
+	if (space == NULL || space == rec) {
+		SCAR_ERETURN(-1);
+	}
 
-		fieldsize *= 10;
-		fieldsize += (uint64_t)(br->next - '0');
-		fieldsize_len += 1;
-		scar_block_reader_consume(br);
+	size_t digits = (size_t)(space - rec);
+	uint64_t len;
+	if (parse_u64(rec, digits, &len) < 0) {
+		SCAR_ERETURN(-1);
 	}
 
-	scar_block_reader_consume(br); // ' '
+	// There has to be room for the space, the '=' and the newline
+	if (len > avail || len < digits + 3 || rec[len - 1] != '\n') {
+		SCAR_ERETURN(-1);
+	}
 
-	// Ignore the length of the field size number itself, the space separator,
-	// the equals sign, and the trailing newline
-	fieldsize -= fieldsize_len + 3;
+	char *key = &rec[digits + 1];
+	char *end = &rec[len - 1];
+	char *eq = memchr(key, '=', (size_t)(end - key));
+	if (eq == NULL) {
+		SCAR_ERETURN(-1);
+	}
 
-	char fieldname[64];
-	size_t fieldname_len = 0;
-	while (br->next != '=') {
-		if (br->next == EOF) {
-			SCAR_ERETURN(-1);
-		}
+	size_t keylen = (size_t)(eq - key);
+	char *val = eq + 1;
+	size_t vallen = (size_t)(end - val);
+	*reclen = (size_t)len;
 
-		fieldname[fieldname_len++] = (char)br->next;
-		if (fieldname_len >= sizeof(fieldname) - 1) {
-			SCAR_ERETURN(-1);
+	const struct keyword *kw = find_keyword(key, keylen);
+	if (kw == NULL) {
+		if (is_kept_keyword(key, keylen)) {
+			return keep_record(meta, rec, (size_t)len, arena);
 		}
 
-		fieldsize -= 1;
-		if (fieldsize == 0) {
+		return 0;
+	}
+
+	void *field = (char *)meta + kw->offset;
+	switch (kw->type) {
+	case KW_TIME:
+		return parse_time(val, vallen, field);
+	case KW_U64:
+		return parse_u64(val, vallen, field);
+	case KW_STRING:
+		return set_string(field, val, vallen, arena, 0);
+	case KW_INTERNED_STRING:
+		return set_string(field, val, vallen, arena, 1);
+	}
+
+	SCAR_ERETURN(-1);
+}
+
+int scar_pax_parse(
+	struct scar_meta *meta, struct scar_io_reader *r, uint64_t size
+) {
+	return scar_pax_parse_arena(meta, r, size, NULL);
+}
+
+int scar_pax_parse_arena(
+	struct scar_meta *meta, struct scar_io_reader *r, uint64_t size,
+	struct scar_meta_arena *arena
+) {
+	if (size > SIZE_MAX) {
+		SCAR_ERETURN(-1);
+	}
+
+	// Without an arena, every value is copied out of the header,
+	// so if the whole header is in the reader's buffer,
+	// it's parsed from there, and never written to
+	const void *borrowed = NULL;
+	if (!arena && r->fill_buf && size > 0) {
+		scar_ssize n = r->fill_buf(r, &borrowed);
+		if (n < 0) {
 			SCAR_ERETURN(-1);
+		} else if ((uint64_t)n < size) {
+			borrowed = NULL;
 		}
+	}
 
-		scar_block_reader_consume(br);
-	}
-	fieldname[fieldname_len] = '\0';
-
-	scar_block_reader_consume(br); // '='
-
-	int ret;
-	if (strcmp(fieldname, "atime") == 0) {
-		ret = parse_time(br, fieldsize, &meta->atime);
-	} else if (strcmp(fieldname, "charset") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->charset);
-	} else if (strcmp(fieldname, "comment") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->comment);
-	} else if (strcmp(fieldname, "gid") == 0) {
-		ret = parse_u64(br, fieldsize, &meta->gid);
-	} else if (strcmp(fieldname, "gname") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->gname);
-	} else if (strcmp(fieldname, "hdrcharset") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->hdrcharset);
-	} else if (strcmp(fieldname, "linkpath") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->linkpath);
-	} else if (strcmp(fieldname, "mtime") == 0) {
-		ret = parse_time(br, fieldsize, &meta->mtime);
-	} else if (strcmp(fieldname, "path") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->path);
-	} else if (strcmp(fieldname, "size") == 0) {
-		ret = parse_u64(br, fieldsize, &meta->size);
-	} else if (strcmp(fieldname, "uid") == 0) {
-		ret = parse_u64(br, fieldsize, &meta->uid);
-	} else if (strcmp(fieldname, "uname") == 0) {
-		ret = scar_parse_string(br, fieldsize, &meta->uname);
-	} else {
-		ret = scar_block_reader_skip(br, fieldsize);
+	char stack_buf[STACK_HEADER_SIZE];
+	char *buf = stack_buf;
+	if (borrowed) {
+		buf = (char *)borrowed;
+		r->consume(r, (size_t)size);
+	} else if (arena) {
+		buf = scar_meta_arena_alloc(arena, (size_t)size);
+	} else if (size > sizeof(stack_buf)) {
+		buf = malloc((size_t)size);
 	}
 
-	if (ret < 0) {
-		SCAR_ERETURN(ret);
+	if (buf == NULL) {
+		SCAR_ERETURN(-1);
+	}
+
+	int ret = 0;
+	if (
+		!borrowed &&
+		scar_io_read_full(r, buf, (size_t)size) < (scar_ssize)size
+	) {
+		ret = -1;
+	}
+
+	size_t pos = 0;
+	while (ret >= 0 && pos < size) {
+		size_t reclen;
+		ret = parse_record(meta, &buf[pos], (size_t)size - pos, arena, &reclen);
+		if (ret >= 0) {
+			pos += reclen;
+		}
+	}
+
+	if (!arena && !borrowed && buf != stack_buf) {
+		free(buf);
 	}
 
-	if (br->next != '\n') {
+	if (ret < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	scar_block_reader_consume(br); // '\n'
 	return 0;
 }
 
-int scar_pax_parse(
-	struct scar_meta *meta, struct scar_io_reader *r, uint64_t size
+int scar_pax_parse_global(
+	struct scar_meta_global **global, struct scar_io_reader *r,
+	uint64_t size
 ) {
-	struct scar_limited_reader lr;
-	scar_limited_reader_init(&lr, r, size);
-	struct scar_block_reader br;
-	scar_block_reader_init(&br, &lr.r);
-
-	while (br.next != EOF) {
-		if (parse_one(meta, &br) < 0) {
-			SCAR_ERETURN(-1);
-		}
+	struct scar_meta meta;
+	scar_meta_copy(&meta, &(*global)->meta);
+	if (scar_pax_parse(&meta, r, size) < 0) {
+		scar_meta_destroy(&meta);
+		SCAR_ERETURN(-1);
 	}
 
-	if (br.error) {
+	struct scar_meta_global *next = scar_meta_global_create(&meta);
+	if (!next) {
+		scar_meta_destroy(&meta);
 		SCAR_ERETURN(-1);
-	} else {
-		return 0;
 	}
+
+	scar_meta_global_unref(*global);
+	*global = next;
+	return 0;
 }
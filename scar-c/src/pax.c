@@ -6,16 +6,12 @@
 #include <math.h>
 
 #include "meta.h"
+#include "meta-arena.h"
 #include "ioutil.h"
 #include "pax-syntax.h"
 #include "ustar.h"
 #include "internal-util.h"
 
-// Format truncation isn't a bug in this code.
-#if defined(__GNUC__) && !defined(__clang__)
-#pragma GCC diagnostic ignored "-Wformat-truncation"
-#endif
-
 static int read_bytes_block_aligned(
 	void *buf, size_t size, struct scar_io_reader *r
 ) {
@@ -46,14 +42,15 @@ static int read_bytes_block_aligned(
 }
 
 static int read_pax_block_aligned(
-	struct scar_meta *meta, size_t size, struct scar_io_reader *r
+	struct scar_meta *meta, size_t size, struct scar_io_reader *r,
+	struct scar_meta_arena *arena
 ) {
 	unsigned char block[512];
 
 	int leftover = 512 - (size % 512);
 	if (leftover == 512) leftover = 0;
 
-	if (scar_pax_parse(meta, r, size) < 0) {
+	if (scar_pax_parse_arena(meta, r, size, arena) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
@@ -72,76 +69,54 @@ static size_t block_field_strlen(
 	return len;
 }
 
-static uint64_t block_read_u64(
-	const unsigned char *block, struct scar_ustar_field field
-) {
-	const unsigned char *text = &block[field.start];
-	uint64_t num = 0;
-	for (size_t i = 0; i < field.length; ++i) {
-		unsigned char ch = text[i];
-		if (ch < '0' || ch > '7') {
-			return num;
-		}
-
-		num *= 8;
-		num += ch - '0';
-	}
-
-	return num;
-}
-
 static uint32_t block_read_u32(
 	const unsigned char *block, struct scar_ustar_field field
 ) {
-	return (uint32_t)block_read_u64(block, field);
+	return (uint32_t)scar_ustar_read_octal(block, field);
 }
 
-static uint64_t block_read_size(
-	const unsigned char *block, struct scar_ustar_field field
-) {
-	const unsigned char *text = &block[field.start];
-	if (text[0] < 128) {
-		return block_read_u64(block, field);
-	}
-
-	uint64_t num = text[0] & 0x7f;
-	for (size_t i = 1; i < field.length; ++i) {
-		num *= 256;
-		num += text[i];
+// Allocate a string of 'len' bytes plus a NUL terminator,
+// from the arena if there is one
+static char *alloc_string(struct scar_meta_arena *arena, size_t len)
+{
+	if (arena) {
+		return scar_meta_arena_alloc(arena, len + 1);
 	}
 
-	return num;
+	return malloc(len + 1);
 }
 
 static char *block_read_string(
-	const unsigned char *block, struct scar_ustar_field field
+	const unsigned char *block, struct scar_ustar_field field,
+	struct scar_meta_arena *arena
 ) {
 	size_t len = block_field_strlen(block, field);
-	char *path = malloc(len + 1);
-	memcpy(path, &block[field.start], len);
-	path[len] = '\0';
-	return path;
-}
+	char *str = alloc_string(arena, len);
+	if (str == NULL) {
+		return NULL;
+	}
 
-static int block_is_zero(const unsigned char *block)
-{
-	for (size_t i = 0; i < 512; ++i) {
-		if (block[i]) {
-			return 0;
-		}
+	memcpy(str, &block[field.start], len);
+	str[len] = '\0';
+
+	// The string fields of a ustar header are user and group names,
+	// which repeat in almost every header
+	if (arena) {
+		return scar_meta_arena_intern(arena, str, len);
 	}
 
-	return 1;
+	return str;
 }
 
 static char *block_read_path(
-	const unsigned char *block, struct scar_ustar_field field
+	const unsigned char *block, struct scar_ustar_field field,
+	struct scar_meta_arena *arena
 ) {
 	size_t pfx_len = block_field_strlen(block, SCAR_UST_PREFIX);
 	size_t field_len = block_field_strlen(block, field);
 
 	if (pfx_len == 0) {
-		char *path = malloc(field_len + 1);
+		char *path = alloc_string(arena, field_len);
 		if (path == NULL) {
 			return NULL;
 		}
@@ -151,7 +126,7 @@ static char *block_read_path(
 		return path;
 	}
 
-	char *path = malloc(pfx_len + 1 + pfx_len + 1);
+	char *path = alloc_string(arena, pfx_len + 1 + field_len);
 	if (path == NULL) {
 		return NULL;
 	}
@@ -163,29 +138,175 @@ static char *block_read_path(
 	return path;
 }
 
+// Read a GNU 'L' or 'K' block's contents into '*str'.
+static int read_gnu_string(
+	struct scar_io_reader *r, uint64_t size, char **str,
+	struct scar_meta_arena *arena
+) {
+	if (size > SIZE_MAX - 1) {
+		SCAR_ERETURN(-1);
+	}
+
+	char *buf = alloc_string(arena, (size_t)size);
+	if (buf == NULL) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (!arena) {
+		free(*str);
+	}
+	*str = buf;
+
+	if (read_bytes_block_aligned(buf, (size_t)size, r) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	buf[size] = '\0';
+	return 0;
+}
+
+// Where an entry's global metadata comes from: either a scar_meta
+// which is copied into every entry, or shared global metadata
+// whose strings the entry borrows
+struct global_source {
+	struct scar_meta *meta;
+	struct scar_meta_global **shared;
+};
+
+// Fill 'meta' with the global metadata, before the entry's own
+// metadata is read into it
+static int apply_global(
+	struct scar_meta *meta, struct global_source *src,
+	struct scar_meta_arena *arena
+) {
+	if (src->shared) {
+		memcpy(meta, &(*src->shared)->meta, sizeof(*meta));
+		return scar_meta_arena_hold(arena, *src->shared);
+	}
+
+	if (arena) {
+		return scar_meta_copy_arena(meta, src->meta, arena);
+	}
+
+	scar_meta_copy(meta, src->meta);
+	return 0;
+}
+
+// Read a 'g' block into the global metadata.
+// The global metadata outlives this entry, so it never goes in the arena.
+static int read_global(
+	struct global_source *src, size_t size, struct scar_io_reader *r
+) {
+	if (!src->shared) {
+		return read_pax_block_aligned(src->meta, size, r, NULL);
+	}
+
+	unsigned char block[512];
+
+	int leftover = 512 - (size % 512);
+	if (leftover == 512) leftover = 0;
+
+	if (scar_pax_parse_global(src->shared, r, size) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (r->read(r, block, (size_t)leftover) < leftover) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+static int read_meta(
+	struct scar_io_reader *r, struct global_source *src,
+	struct scar_meta *meta, struct scar_meta_arena *arena, int opts);
+
 int scar_pax_read_meta(
 	struct scar_io_reader *r,
 	struct scar_meta *global, struct scar_meta *meta
 ) {
-	unsigned char block[512];
+	return scar_pax_read_meta_arena(r, global, meta, NULL);
+}
+
+int scar_pax_read_meta_arena(
+	struct scar_io_reader *r,
+	struct scar_meta *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena
+) {
+	struct global_source src = {global, NULL};
+	return read_meta(r, &src, meta, arena, 0);
+}
+
+int scar_pax_read_meta_shared(
+	struct scar_io_reader *r,
+	struct scar_meta_global **global, struct scar_meta *meta,
+	struct scar_meta_arena *arena
+) {
+	return scar_pax_read_meta_shared_opts(r, global, meta, arena, 0);
+}
+
+int scar_pax_read_meta_shared_opts(
+	struct scar_io_reader *r,
+	struct scar_meta_global **global, struct scar_meta *meta,
+	struct scar_meta_arena *arena, int opts
+) {
+	struct global_source src = {NULL, global};
+	return read_meta(r, &src, meta, arena, opts);
+}
+
+// Read the next header block. If 'r' can lend out its buffer,
+// and there's a whole block in it, the block is used from there,
+// otherwise it's read into 'buf'. Either way, it stays valid until
+// the next read from 'r'.
+static const unsigned char *read_header_block(
+	struct scar_io_reader *r, unsigned char *buf
+) {
+	if (r->fill_buf) {
+		const void *data;
+		scar_ssize n = r->fill_buf(r, &data);
+		if (n < 0) {
+			SCAR_ERETURN(NULL);
+		} else if (n >= 512) {
+			r->consume(r, 512);
+			return data;
+		}
+	}
+
+	if (r->read(r, buf, 512) < 512) {
+		SCAR_ERETURN(NULL);
+	}
+
+	return buf;
+}
+
+static int read_meta(
+	struct scar_io_reader *r, struct global_source *src,
+	struct scar_meta *meta, struct scar_meta_arena *arena, int opts
+) {
+	unsigned char buf[512];
+	const unsigned char *block;
 	char ftype;
 	uint64_t size;
 
-	scar_meta_copy(meta, global);
+	if (apply_global(meta, src, arena) < 0) {
+		SCAR_ERETURN(-1);
+	}
 
-	if (r->read(r, block, 512) < 512) {
+	block = read_header_block(r, buf);
+	if (!block) {
 		SCAR_ERETURN(-1);
 	}
 
 	// End of archive is indicated by two all-zero blocks.
 	// If we get just one all-zero block, that's an error, since no valid
 	// archive entry starts with an all-zero block header.
-	if (block_is_zero(block)) {
-		if (r->read(r, block, 512) < 512) {
+	if (scar_ustar_block_is_zero(block)) {
+		block = read_header_block(r, buf);
+		if (!block) {
 			SCAR_ERETURN(-1);
 		}
 
-		if (block_is_zero(block)) {
+		if (scar_ustar_block_is_zero(block)) {
 			return 0;
 		} else {
 			SCAR_ERETURN(-1);
@@ -196,53 +317,50 @@ int scar_pax_read_meta(
 	// Once this loop finishes, we'll have 'meta' and 'global' filled,
 	// and we'll be ready to read the next non-metadata entry's header block.
 	while (1) {
-		size = block_read_size(block, SCAR_UST_SIZE);
+		if (
+			!(opts & SCAR_PAX_IGNORE_CHECKSUM) &&
+			!scar_pax_block_checksum_ok(block)
+		) {
+			SCAR_ERETURN(-1);
+		}
+
+		size = scar_ustar_read_size(block, SCAR_UST_SIZE);
 		ftype = (char)block[SCAR_UST_TYPEFLAG.start];
 
 		// GNU extension: path block.
 		if (ftype == 'L') {
-			free(meta->path);
-			meta->path = malloc(size + 1);
-			if (meta->path == NULL) {
+			if (read_gnu_string(r, size, &meta->path, arena) < 0) {
 				SCAR_ERETURN(-1);
 			}
-
-			if (read_bytes_block_aligned(meta->path, size, r) < 0) {
-				SCAR_ERETURN(-1);
-			}
-
-			meta->path[size] = '\0';
 		}
 
 		// GNU extension: linkpath block.
 		else if (ftype == 'K') {
-			free(meta->linkpath);
-			meta->linkpath = malloc(size + 1);
-			if (meta->linkpath == NULL) {
-				SCAR_ERETURN(-1);
-			}
-
-			if (read_bytes_block_aligned(meta->linkpath, size, r) < 0) {
+			if (read_gnu_string(r, size, &meta->linkpath, arena) < 0) {
 				SCAR_ERETURN(-1);
 			}
-
-			meta->linkpath[size] = '\0';
 		}
 
 		// Pax extension: metadata block.
 		else if (ftype == 'x') {
-			if (read_pax_block_aligned(meta, size, r) < 0) {
+			if (read_pax_block_aligned(meta, size, r, arena) < 0) {
 				SCAR_ERETURN(-1);
 			}
 		}
 
 		// Pax extension: global metadata block.
 		else if (ftype == 'g') {
-			if (read_pax_block_aligned(global, size, r) < 0) {
+			if (read_global(src, size, r) < 0) {
 				SCAR_ERETURN(-1);
 			}
 
-			scar_meta_copy(meta, global);
+			if (!arena) {
+				scar_meta_destroy(meta);
+			}
+
+			if (apply_global(meta, src, arena) < 0) {
+				SCAR_ERETURN(-1);
+			}
 		}
 
 		// Anything else should be a valid scar_pax_filetype.
@@ -252,7 +370,8 @@ int scar_pax_read_meta(
 			break;
 		}
 
-		if (r->read(r, block, 512) < 512) {
+		block = read_header_block(r, buf);
+		if (!block) {
 			SCAR_ERETURN(-1);
 		}
 	}
@@ -265,44 +384,112 @@ int scar_pax_read_meta(
 	if (!~meta->mode) meta->mode = block_read_u32(block, SCAR_UST_MODE);
 	if (!~meta->devmajor) meta->devmajor = block_read_u32(block, SCAR_UST_DEVMAJOR);
 	if (!~meta->devminor) meta->devminor = block_read_u32(block, SCAR_UST_DEVMINOR);
-	if (!~meta->gid) meta->gid = block_read_u64(block, SCAR_UST_GID);
-	if (!meta->gname) meta->gname = block_read_string(block, SCAR_UST_GNAME);
-	if (!meta->linkpath) meta->linkpath = block_read_path(block, SCAR_UST_LINKNAME);
-	if (isnan(meta->mtime)) meta->mtime = (double)block_read_u64(block, SCAR_UST_MTIME);
-	if (!meta->path) meta->path = block_read_path(block, SCAR_UST_NAME);
-	if (!~meta->size) meta->size = block_read_size(block, SCAR_UST_SIZE);
-	if (!~meta->uid) meta->uid = block_read_u64(block, SCAR_UST_UID);
-	if (!meta->uname) meta->uname = block_read_string(block, SCAR_UST_UNAME);
+	if (!~meta->gid) meta->gid = scar_ustar_read_octal(block, SCAR_UST_GID);
+	if (!meta->gname) meta->gname = block_read_string(block, SCAR_UST_GNAME, arena);
+	if (!meta->linkpath) meta->linkpath = block_read_path(block, SCAR_UST_LINKNAME, arena);
+	if (isnan(meta->mtime)) meta->mtime = (double)scar_ustar_read_octal(block, SCAR_UST_MTIME);
+	if (!meta->path) meta->path = block_read_path(block, SCAR_UST_NAME, arena);
+	if (!~meta->size) meta->size = scar_ustar_read_size(block, SCAR_UST_SIZE);
+	if (!~meta->uid) meta->uid = scar_ustar_read_octal(block, SCAR_UST_UID);
+	if (!meta->uname) meta->uname = block_read_string(block, SCAR_UST_UNAME, arena);
 
 	return 1;
 }
 
+int scar_pax_block_checksum_ok(const unsigned char *block)
+{
+	// Historic implementations summed signed chars,
+	// so accept either interpretation
+	uint64_t usum;
+	int64_t ssum;
+	scar_ustar_block_sums(block, &usum, &ssum);
+
+	// Some implementations pad the checksum with leading spaces
+	const unsigned char *text = &block[SCAR_UST_CHKSUM.start];
+	size_t i = 0;
+	while (i < SCAR_UST_CHKSUM.length && text[i] == ' ') {
+		i += 1;
+	}
+
+	uint64_t expected = 0;
+	size_t ndigits = 0;
+	for (; i < SCAR_UST_CHKSUM.length; ++i) {
+		if (text[i] < '0' || text[i] > '7') {
+			break;
+		}
+
+		expected *= 8;
+		expected += text[i] - '0';
+		ndigits += 1;
+	}
+
+	if (ndigits == 0) {
+		return 0;
+	}
+
+	return expected == usum || (int64_t)expected == ssum;
+}
+
+// Entries which fit in this much stack space are copied without
+// a heap buffer, which is most of them in a typical archive
+#define SMALL_CONTENT_SIZE 8192
+
+// Get a buffer for copying 'padded' bytes of entry content:
+// 'stack' if that's big enough, otherwise a heap buffer of up to
+// SCAR_IO_CHUNK_SIZE bytes. Either way, its size is a multiple of 512.
+static unsigned char *content_buffer(
+	uint64_t padded, unsigned char *stack, size_t *size
+) {
+	if (padded <= SMALL_CONTENT_SIZE) {
+		*size = SMALL_CONTENT_SIZE;
+		return stack;
+	}
+
+	*size = padded < SCAR_IO_CHUNK_SIZE ?
+		(size_t)padded : SCAR_IO_CHUNK_SIZE;
+	return malloc(*size);
+}
+
 int scar_pax_read_content(
 	struct scar_io_reader *r, struct scar_io_writer *w, uint64_t size
 ) {
-	unsigned char block[512];
+	if (size > UINT64_MAX - 511) {
+		SCAR_ERETURN(-1);
+	}
 
-	while (size > 512) {
-		if (r->read(r, block, 512) < 512) {
-			SCAR_ERETURN(-1);
-		}
+	uint64_t padded = (size + 511) / 512 * 512;
+	unsigned char stack[SMALL_CONTENT_SIZE];
+	size_t bufsize;
+	unsigned char *buf = content_buffer(padded, stack, &bufsize);
+	if (!buf) {
+		SCAR_ERETURN(-1);
+	}
 
-		if (w->write(w, block, 512) < 512) {
-			SCAR_ERETURN(-1);
+	// Read whole blocks, but only write the content,
+	// not the padding at the end
+	int ret = 0;
+	while (padded > 0) {
+		size_t n = padded < bufsize ? (size_t)padded : bufsize;
+		if (scar_io_read_full(r, buf, n) < (scar_ssize)n) {
+			ret = -1;
+			break;
 		}
 
-		size -= 512;
-	}
+		size_t content = size < n ? (size_t)size : n;
+		if (w->write(w, buf, content) < (scar_ssize)content) {
+			ret = -1;
+			break;
+		}
 
-	if (size == 0) {
-		return 0;
+		padded -= n;
+		size -= content;
 	}
 
-	if (r->read(r, block, 512) < 512) {
-		SCAR_ERETURN(-1);
+	if (buf != stack) {
+		free(buf);
 	}
 
-	if (w->write(w, block, size) < (scar_ssize)size) {
+	if (ret < 0) {
 		SCAR_ERETURN(-1);
 	}
 
@@ -316,9 +503,7 @@ static void block_write_u64(
 		num = 0;
 	}
 
-	snprintf(
-		(char *)&block[field.start], field.length, "%0*" PRIo64,
-		(int)field.length - 1, num);
+	scar_ustar_write_octal(block, field, num);
 }
 
 static void block_write_u32(
@@ -328,9 +513,7 @@ static void block_write_u32(
 		num = 0;
 	}
 
-	snprintf(
-		(char *)&block[field.start], field.length, "%0*" PRIo32,
-		(int)field.length - 1, num);
+	scar_ustar_write_octal(block, field, num);
 }
 
 static void block_write_string(
@@ -340,18 +523,16 @@ static void block_write_string(
 		str = "";
 	}
 
-	snprintf((char *)&block[field.start], field.length, "%s", str);
-}
-
-static void block_write_chksum(unsigned char *block)
-{
-	memset(&block[SCAR_UST_CHKSUM.start], ' ', SCAR_UST_CHKSUM.length);
-	uint64_t sum = 0;
-	for (size_t i = 0; i < 512; ++i) {
-		sum += block[i];
+	// Strings which are too long are truncated,
+	// but the field is always NUL-terminated
+	char *dest = (char *)&block[field.start];
+	size_t len = strlen(str);
+	if (len > field.length - 1) {
+		len = field.length - 1;
 	}
 
-	block_write_u64(block, SCAR_UST_CHKSUM, sum);
+	memcpy(dest, str, len);
+	dest[len] = '\0';
 }
 
 static int pax_write_field(
@@ -370,7 +551,7 @@ static int pax_write_field(
 		SCAR_ERETURN(-1);
 	}
 
-	destbuf += snprintf(destbuf, fieldsize, "%zu", fieldsize);
+	destbuf += scar_format_u64(destbuf, fieldsize);
 	*(destbuf++) = ' ';
 	memcpy(destbuf, name, namelen);
 	destbuf += namelen;
@@ -384,8 +565,20 @@ static int pax_write_field(
 
 static int pax_write_time(struct scar_mem_writer *mw, char *name, double time)
 {
+	// Let most of this function not care about negatives,
+	// just make the numbers positive but keep track of the sign.
+	int sign = 1;
+	if (time < 0) {
+		sign = -1;
+		time = -time;
+	}
+
 	int64_t seconds = (int64_t)floor(time);
 	int64_t nanos = (int64_t)round((time - (double)seconds) * 1000000000.0);
+	if (nanos >= 1000000000) {
+		seconds += 1;
+		nanos -= 1000000000;
+	}
 
 	// We'll be writing the number in reverse into buf.
 	// Due to the 64-bit integer part and the nanosecond precision
@@ -402,15 +595,6 @@ static int pax_write_time(struct scar_mem_writer *mw, char *name, double time)
 	// in our number.
 	char *bufptr = &buf[sizeof(buf)];
 
-	// Let most of this function not care about negatives,
-	// just make the numbers positive but keep track of the sign.
-	int sign = 1;
-	if (nanos < 0) {
-		sign = -1;
-		seconds = -seconds;
-		nanos = -nanos;
-	}
-
 	// Start with the reverse fraction
 	int found_first_nonzero = 0;
 	do {
@@ -452,56 +636,56 @@ static int pax_write_string(struct scar_mem_writer *mw, char *name, char *str)
 
 static int pax_write_uint(struct scar_mem_writer *mw, char *name, uint64_t num)
 {
-	char buf[32];
-	int n = snprintf(buf, sizeof(buf), "%" PRIu64, num);
-	return pax_write_field(mw, name, buf, (size_t)n);
+	char buf[SCAR_FORMAT_MAX];
+	size_t len = scar_format_u64(buf, num);
+	return pax_write_field(mw, name, buf, len);
 }
 
-int scar_pax_write_meta(
-	const struct scar_meta *meta, struct scar_io_writer *w)
+int scar_pax_write_meta_scratch(
+	const struct scar_meta *meta, struct scar_io_writer *w,
+	struct scar_mem_writer *scratch)
 {
 	unsigned char block[512] = {0};
 
-	struct scar_mem_writer paxhdr;
-	scar_mem_writer_init(&paxhdr);
+	scratch->len = 0;
 
 	if (SCAR_META_HAS_ATIME(meta)) {
-		if (pax_write_time(&paxhdr, "atime", meta->atime) < 0) {
+		if (pax_write_time(scratch, "atime", meta->atime) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	if (SCAR_META_HAS_CHARSET(meta)) {
-		if (pax_write_string(&paxhdr, "charset", meta->charset) < 0) {
+		if (pax_write_string(scratch, "charset", meta->charset) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	if (SCAR_META_HAS_COMMENT(meta)) {
-		if (pax_write_string(&paxhdr, "comment", meta->comment) < 0) {
+		if (pax_write_string(scratch, "comment", meta->comment) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	if (SCAR_META_HAS_GID(meta) && meta->gid > 07777777ll) {
-		if (pax_write_uint(&paxhdr, "gid", meta->gid) < 0)
+		if (pax_write_uint(scratch, "gid", meta->gid) < 0)
 			SCAR_ERETURN(-1);
 	}
 
-	if (SCAR_META_HAS_GNAME(meta) && strlen(meta->gname) > 32) {
-		if (pax_write_string(&paxhdr, "gname", meta->gname) < 0) {
+	if (SCAR_META_HAS_GNAME(meta) && strlen(meta->gname) >= 32) {
+		if (pax_write_string(scratch, "gname", meta->gname) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	if (SCAR_META_HAS_HDRCHARSET(meta)) {
-		if (pax_write_string(&paxhdr, "hdrcharset", meta->hdrcharset) < 0) {
+		if (pax_write_string(scratch, "hdrcharset", meta->hdrcharset) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
-	if (SCAR_META_HAS_LINKPATH(meta) && strlen(meta->linkpath) > 100) {
-		if (pax_write_string(&paxhdr, "linkpath", meta->linkpath) < 0) {
+	if (SCAR_META_HAS_LINKPATH(meta) && strlen(meta->linkpath) >= 100) {
+		if (pax_write_string(scratch, "linkpath", meta->linkpath) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
@@ -511,47 +695,56 @@ int scar_pax_write_meta(
 		meta->mtime > 0777777777777ll ||
 		meta->mtime != floor(meta->mtime))
 	) {
-		if (pax_write_time(&paxhdr, "mtime", meta->mtime) < 0) {
+		if (pax_write_time(scratch, "mtime", meta->mtime) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
-	if (SCAR_META_HAS_PATH(meta) && strlen(meta->path) > 100) {
-		if (pax_write_string(&paxhdr, "path", meta->path) < 0) {
+	if (SCAR_META_HAS_PATH(meta) && strlen(meta->path) >= 100) {
+		if (pax_write_string(scratch, "path", meta->path) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	if (SCAR_META_HAS_SIZE(meta) && meta->size > 077777777777ll) {
-		if (pax_write_uint(&paxhdr, "size", meta->size) < 0) {
+		if (pax_write_uint(scratch, "size", meta->size) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	if (SCAR_META_HAS_UID(meta) && meta->uid > 07777777ll) {
-		if (pax_write_uint(&paxhdr, "uid", meta->uid) < 0) {
+		if (pax_write_uint(scratch, "uid", meta->uid) < 0) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	if (SCAR_META_HAS_UNAME(meta) && strlen(meta->uname) >= 32) {
+		if (pax_write_string(scratch, "uname", meta->uname) < 0) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
-	if (SCAR_META_HAS_UNAME(meta) && strlen(meta->uname) > 32) {
-		if (pax_write_string(&paxhdr, "uname", meta->uname) < 0) {
+	if (meta->records) {
+		if (scar_mem_writer_write(
+			&scratch->w, meta->records, meta->records_len) < 0
+		) {
 			SCAR_ERETURN(-1);
 		}
 	}
 
 	// Write a pax extended metadata entry if necessary
-	if (paxhdr.len > 0) {
+	if (scratch->len > 0) {
 		memcpy(&block[SCAR_UST_MAGIC.start], "ustar", 6);
 		memcpy(&block[SCAR_UST_VERSION.start], "00", 2);
 		block[SCAR_UST_TYPEFLAG.start] = 'x';
-		block_write_u64(block, SCAR_UST_SIZE, (uint64_t)paxhdr.len);
-		block_write_chksum(block);
+		block_write_u64(block, SCAR_UST_SIZE, (uint64_t)scratch->len);
+		scar_ustar_write_checksum(block);
 		if (w->write(w, block, 512) < 512) {
 			SCAR_ERETURN(-1);
 		}
 
-		if (w->write(w, paxhdr.buf, paxhdr.len) < (scar_ssize)paxhdr.len) {
+		scar_ssize n = w->write(w, scratch->buf, scratch->len);
+		if (n < (scar_ssize)scratch->len) {
 			SCAR_ERETURN(-1);
 		}
 
@@ -559,7 +752,7 @@ int scar_pax_write_meta(
 		// for the next entry, and to use it for padding
 		memset(block, 0, 512);
 
-		size_t padding = 512 - (paxhdr.len % 512);
+		size_t padding = 512 - (scratch->len % 512);
 		if (padding < 512) {
 			if (w->write(w, block, padding) < 0) {
 				SCAR_ERETURN(-1);
@@ -584,7 +777,7 @@ int scar_pax_write_meta(
 	block_write_string(block, SCAR_UST_GNAME, meta->gname);
 	block_write_u32(block, SCAR_UST_DEVMAJOR, meta->devmajor);
 	block_write_u32(block, SCAR_UST_DEVMINOR, meta->devminor);
-	block_write_chksum(block);
+	scar_ustar_write_checksum(block);
 
 	if (w->write(w, block, 512) < 512) {
 		SCAR_ERETURN(-1);
@@ -593,34 +786,58 @@ int scar_pax_write_meta(
 	return 0;
 }
 
+int scar_pax_write_meta(
+	const struct scar_meta *meta, struct scar_io_writer *w)
+{
+	struct scar_mem_writer paxhdr;
+	scar_mem_writer_init(&paxhdr);
+	int ret = scar_pax_write_meta_scratch(meta, w, &paxhdr);
+	free(paxhdr.buf);
+	return ret;
+}
+
 int scar_pax_write_content(
 	struct scar_io_reader *r, struct scar_io_writer *w, uint64_t size
 ) {
-	unsigned char block[512];
+	if (size > UINT64_MAX - 511) {
+		SCAR_ERETURN(-1);
+	}
 
-	while (size >= 512) {
-		if (r->read(r, block, 512) < 512) {
-			SCAR_ERETURN(-1);
-		}
+	uint64_t padded = (size + 511) / 512 * 512;
+	unsigned char stack[SMALL_CONTENT_SIZE];
+	size_t bufsize;
+	unsigned char *buf = content_buffer(padded, stack, &bufsize);
+	if (!buf) {
+		SCAR_ERETURN(-1);
+	}
 
-		if (w->write(w, block, 512) < 512) {
-			SCAR_ERETURN(-1);
+	// Like the blocks are written, they're read whole,
+	// so that a reader which is a tar stream itself is left
+	// at the next header. Other readers just run out of data early.
+	int ret = 0;
+	while (padded > 0) {
+		size_t n = padded < bufsize ? (size_t)padded : bufsize;
+		size_t content = size < n ? (size_t)size : n;
+		if (scar_io_read_full(r, buf, n) < (scar_ssize)content) {
+			ret = -1;
+			break;
 		}
 
-		size -= 512;
-	}
+		memset(&buf[content], 0, n - content);
+		if (w->write(w, buf, n) < (scar_ssize)n) {
+			ret = -1;
+			break;
+		}
 
-	if (size == 0) {
-		return 0;
+		padded -= n;
+		size -= content;
 	}
 
-	if (r->read(r, block, 512) < (scar_ssize)size) {
-		SCAR_ERETURN(-1);
+	if (buf != stack) {
+		free(buf);
 	}
 
-	memset(&block[size], 0, 512 - size);
-
-	if (w->write(w, block, 512) < 512) {
+	if (ret < 0) {
 		SCAR_ERETURN(-1);
 	}
 
@@ -643,6 +860,22 @@ int scar_pax_write_entry(
 	return scar_pax_write_content(r, w, meta->size);
 }
 
+int scar_pax_write_entry_scratch(
+	struct scar_meta *meta, struct scar_io_reader *r,
+	struct scar_io_writer *w, struct scar_mem_writer *scratch)
+{
+	int ret = scar_pax_write_meta_scratch(meta, w, scratch);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (!~meta->size) {
+		return 0;
+	}
+
+	return scar_pax_write_content(r, w, meta->size);
+}
+
 int scar_pax_write_end(struct scar_io_writer *w)
 {
 	char block[512] = {0};
@@ -0,0 +1,193 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "internal-util.h"
+
+struct pool_job {
+	scar_pool_fn fn;
+	void *arg;
+};
+
+struct scar_pool {
+	pthread_mutex_t mut;
+
+	// Signalled when a job is added, or when the pool is stopped
+	pthread_cond_t job_cond;
+
+	// Signalled when the last outstanding job finishes
+	pthread_cond_t idle_cond;
+
+	pthread_t *threads;
+	int nthreads;
+
+	// The queue is a ring buffer of 'cap' jobs
+	struct pool_job *queue;
+	size_t cap;
+	size_t head;
+	size_t len;
+
+	// The number of jobs which are queued or running
+	size_t outstanding;
+	bool stop;
+};
+
+static void *pool_worker(void *ptr)
+{
+	struct scar_pool *pool = ptr;
+
+	pthread_mutex_lock(&pool->mut);
+	while (1) {
+		while (pool->len == 0 && !pool->stop) {
+			pthread_cond_wait(&pool->job_cond, &pool->mut);
+		}
+
+		if (pool->len == 0 && pool->stop) {
+			break;
+		}
+
+		struct pool_job job = pool->queue[pool->head];
+		pool->head = (pool->head + 1) % pool->cap;
+		pool->len -= 1;
+
+		pthread_mutex_unlock(&pool->mut);
+		job.fn(job.arg);
+		pthread_mutex_lock(&pool->mut);
+
+		pool->outstanding -= 1;
+		if (pool->outstanding == 0) {
+			pthread_cond_broadcast(&pool->idle_cond);
+		}
+	}
+	pthread_mutex_unlock(&pool->mut);
+
+	return NULL;
+}
+
+static int pool_grow(struct scar_pool *pool)
+{
+	size_t newcap = pool->cap == 0 ? 16 : pool->cap * 2;
+	struct pool_job *newqueue = malloc(newcap * sizeof(*newqueue));
+	if (!newqueue) {
+		SCAR_ERETURN(-1);
+	}
+
+	// Unwrap the ring buffer while copying it over
+	for (size_t i = 0; i < pool->len; ++i) {
+		newqueue[i] = pool->queue[(pool->head + i) % pool->cap];
+	}
+
+	free(pool->queue);
+	pool->queue = newqueue;
+	pool->cap = newcap;
+	pool->head = 0;
+	return 0;
+}
+
+struct scar_pool *scar_pool_create(int nthreads)
+{
+	struct scar_pool *pool = malloc(sizeof(*pool));
+	if (!pool) {
+		SCAR_ERETURN(NULL);
+	}
+
+	pool->threads = NULL;
+	pool->nthreads = 0;
+	pool->queue = NULL;
+	pool->cap = 0;
+	pool->head = 0;
+	pool->len = 0;
+	pool->outstanding = 0;
+	pool->stop = false;
+
+	if (nthreads <= 1) {
+		return pool;
+	}
+
+	pthread_mutex_init(&pool->mut, NULL);
+	pthread_cond_init(&pool->job_cond, NULL);
+	pthread_cond_init(&pool->idle_cond, NULL);
+
+	pool->threads = malloc((size_t)nthreads * sizeof(*pool->threads));
+	if (!pool->threads) {
+		scar_pool_free(pool);
+		SCAR_ERETURN(NULL);
+	}
+
+	for (int i = 0; i < nthreads; ++i) {
+		if (pthread_create(&pool->threads[i], NULL, pool_worker, pool) != 0) {
+			scar_pool_free(pool);
+			SCAR_ERETURN(NULL);
+		}
+
+		pool->nthreads += 1;
+	}
+
+	return pool;
+}
+
+int scar_pool_size(struct scar_pool *pool)
+{
+	return pool->nthreads > 0 ? pool->nthreads : 1;
+}
+
+int scar_pool_submit(struct scar_pool *pool, scar_pool_fn fn, void *arg)
+{
+	if (pool->nthreads == 0) {
+		fn(arg);
+		return 0;
+	}
+
+	pthread_mutex_lock(&pool->mut);
+	if (pool->len == pool->cap && pool_grow(pool) < 0) {
+		pthread_mutex_unlock(&pool->mut);
+		SCAR_ERETURN(-1);
+	}
+
+	struct pool_job *job = &pool->queue[(pool->head + pool->len) % pool->cap];
+	job->fn = fn;
+	job->arg = arg;
+	pool->len += 1;
+	pool->outstanding += 1;
+
+	pthread_cond_signal(&pool->job_cond);
+	pthread_mutex_unlock(&pool->mut);
+	return 0;
+}
+
+void scar_pool_wait(struct scar_pool *pool)
+{
+	if (pool->nthreads == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mut);
+	while (pool->outstanding > 0) {
+		pthread_cond_wait(&pool->idle_cond, &pool->mut);
+	}
+	pthread_mutex_unlock(&pool->mut);
+}
+
+void scar_pool_free(struct scar_pool *pool)
+{
+	if (pool->threads) {
+		pthread_mutex_lock(&pool->mut);
+		pool->stop = true;
+		pthread_cond_broadcast(&pool->job_cond);
+		pthread_mutex_unlock(&pool->mut);
+
+		for (int i = 0; i < pool->nthreads; ++i) {
+			pthread_join(pool->threads[i], NULL);
+		}
+
+		free(pool->threads);
+		pthread_mutex_destroy(&pool->mut);
+		pthread_cond_destroy(&pool->job_cond);
+		pthread_cond_destroy(&pool->idle_cond);
+	}
+
+	free(pool->queue);
+	free(pool);
+}
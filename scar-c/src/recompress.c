@@ -0,0 +1,334 @@
+#include "recompress.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "codec-pool.h"
+#include "footer.h"
+#include "internal-util.h"
+#include "ioutil.h"
+#include "pool.h"
+#include "scar-reader.h"
+#include "segment-batch.h"
+#include "util.h"
+
+struct recompress_job {
+	struct scar_segment_job sj;
+
+	// Shared by all the jobs, so that the workers reuse
+	// their compressors and decompressors
+	struct scar_codec_pool *src_codecs;
+	struct scar_codec_pool *dest_codecs;
+
+	// The recompressed segment, which moves to a temporary file
+	// once it's bigger than the job's share of the batch
+	struct scar_spill_writer out;
+	int ret;
+};
+
+struct recompress {
+	struct scar_reader *sr;
+	struct recompress_job *jobs;
+
+	// The output is counted so that we know the new offsets
+	// of each segment as they're written
+	struct scar_counting_writer cw;
+	struct scar_mem_writer checkpoints_buf;
+
+	struct scar_footer_section sections[SCAR_FOOTER_MAX_SECTIONS];
+	size_t nsections;
+	scar_offset index_offset;
+};
+
+static void recompress_job_run(void *ptr)
+{
+	struct scar_segment_job *sj = ptr;
+	struct recompress_job *job = SCAR_BASE(struct recompress_job, sj);
+	struct scar_decompressor *decomp = NULL;
+	struct scar_compressor *comp = NULL;
+	job->ret = -1;
+
+	scar_offset len = sj->seg.compressed_end - sj->seg.compressed_start;
+	decomp = scar_codec_pool_get_segment_decompressor(
+		job->src_codecs, scar_segment_job_reader(sj), len, NULL);
+	if (!decomp) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	comp = scar_codec_pool_get_compressor(job->dest_codecs, &job->out.w);
+	if (!comp) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	scar_ssize n = scar_io_copy(&decomp->r, &comp->w);
+	if (n < 0) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	// If we know how big the segment is supposed to be,
+	// make sure we didn't get a truncated stream
+	if (
+		sj->seg.uncompressed_start >= 0 && sj->seg.uncompressed_end >= 0 &&
+		n != sj->seg.uncompressed_end - sj->seg.uncompressed_start
+	) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	if (comp->finish(comp) < 0) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	job->ret = 0;
+
+exit:
+	scar_codec_pool_put_compressor(job->dest_codecs, comp);
+	scar_codec_pool_put_decompressor(job->src_codecs, decomp);
+}
+
+// Copy a recompressed job to the output, and get it ready for the next one.
+static int recompress_job_finish(
+	struct recompress *rc, struct recompress_job *job
+) {
+	if (job->ret < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (scar_spill_writer_copy_to(&job->out, &rc->cw.w) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	size_t spill = job->out.threshold;
+	scar_spill_writer_destroy(&job->out);
+	scar_spill_writer_init(&job->out, spill);
+	return 0;
+}
+
+static struct scar_segment_job *recompress_prepare_segment(
+	void *ptr, size_t slot, size_t idx
+) {
+	struct recompress *rc = ptr;
+	struct recompress_job *job = &rc->jobs[slot];
+	if (scar_reader_get_segment(rc->sr, idx, &job->sj.seg) < 0) {
+		SCAR_ERETURN(NULL);
+	}
+
+	return &job->sj;
+}
+
+static int recompress_finish_segment(
+	void *ptr, struct scar_segment_job *sj, size_t idx
+) {
+	struct recompress *rc = ptr;
+
+	// The first segment starts at the implicit checkpoint at 0
+	if (idx > 0) {
+		scar_ssize r = scar_io_printf(
+			&rc->checkpoints_buf.w, "%lld %lld\n",
+			rc->cw.count, sj->seg.uncompressed_start);
+		if (r < 0) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	if (recompress_job_finish(
+		rc, SCAR_BASE(struct recompress_job, sj)) < 0
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+// The extension sections come first, then the index.
+static struct scar_segment_job *recompress_prepare_section(
+	void *ptr, size_t slot, size_t idx
+) {
+	struct recompress *rc = ptr;
+	struct recompress_job *job = &rc->jobs[slot];
+	if (idx < rc->nsections) {
+		if (scar_reader_get_extension(
+			rc->sr, idx, &rc->sections[idx].name, &job->sj.seg) < 0
+		) {
+			SCAR_ERETURN(NULL);
+		}
+	} else if (
+		scar_reader_find_section(rc->sr, "SCAR-INDEX", &job->sj.seg) != 1
+	) {
+		SCAR_ERETURN(NULL);
+	}
+
+	return &job->sj;
+}
+
+static int recompress_finish_section(
+	void *ptr, struct scar_segment_job *sj, size_t idx
+) {
+	struct recompress *rc = ptr;
+	if (idx < rc->nsections) {
+		rc->sections[idx].offset = rc->cw.count;
+	} else {
+		rc->index_offset = rc->cw.count;
+	}
+
+	if (recompress_job_finish(
+		rc, SCAR_BASE(struct recompress_job, sj)) < 0
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+static const struct scar_segment_batch_ops recompress_segment_ops = {
+	.prepare = recompress_prepare_segment,
+	.run = recompress_job_run,
+	.finish = recompress_finish_segment,
+};
+
+static const struct scar_segment_batch_ops recompress_section_ops = {
+	.prepare = recompress_prepare_section,
+	.run = recompress_job_run,
+	.finish = recompress_finish_section,
+};
+
+int scar_recompress(
+	struct scar_reader *sr, struct scar_io_writer *w,
+	struct scar_compression *comp, int clevel, struct scar_pool *pool
+) {
+	int ret = -1;
+	struct scar_segment_batch batch;
+	bool have_batch = false;
+	size_t njobs = 0;
+	struct scar_codec_pool *dest_codecs = NULL;
+
+	struct recompress rc;
+	rc.sr = sr;
+	rc.jobs = NULL;
+	scar_counting_writer_init(&rc.cw, w);
+	scar_mem_writer_init(&rc.checkpoints_buf);
+	rc.nsections = 0;
+	rc.index_offset = 0;
+
+	scar_ssize segcount = scar_reader_segment_count(sr);
+	if (segcount < 0) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	if (scar_segment_batch_init(&batch, sr, pool) < 0) {
+		SCAR_ELOG();
+		goto exit;
+	}
+	have_batch = true;
+
+	dest_codecs = scar_codec_pool_create(comp, clevel);
+	if (!dest_codecs) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	// Recompressing rarely makes a segment much bigger, so the output
+	// of a batch stays within about the batch's compressed bytes too
+	size_t spill = batch.bytes / batch.size;
+	if (spill == 0) {
+		spill = 1;
+	}
+
+	rc.jobs = malloc(batch.size * sizeof(*rc.jobs));
+	if (!rc.jobs) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	for (; njobs < batch.size; ++njobs) {
+		struct recompress_job *job = &rc.jobs[njobs];
+		job->src_codecs = batch.codecs;
+		job->dest_codecs = dest_codecs;
+		job->ret = 0;
+		scar_spill_writer_init(&job->out, spill);
+	}
+
+	if (scar_io_puts(&rc.checkpoints_buf.w, "SCAR-CHECKPOINTS\n") < 0) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	if (scar_segment_batch_run(
+		&batch, (size_t)segcount, &recompress_segment_ops, &rc) < 0
+	) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	// The extension sections and the index only refer to
+	// uncompressed offsets, so they can be transcoded as-is
+	rc.nsections = scar_reader_extension_count(sr);
+	if (rc.nsections > SCAR_FOOTER_MAX_SECTIONS) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	if (scar_segment_batch_run(
+		&batch, rc.nsections + 1, &recompress_section_ops, &rc) < 0
+	) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	// The checkpoints section has to be regenerated,
+	// since it records compressed offsets
+	scar_offset checkpoints_offset = rc.cw.count;
+	struct scar_compressor *checkpoints_compressor =
+		comp->create_compressor(&rc.cw.w, clevel);
+	if (!checkpoints_compressor) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	scar_ssize r = checkpoints_compressor->w.write(
+		&checkpoints_compressor->w, rc.checkpoints_buf.buf,
+		rc.checkpoints_buf.len);
+	if (r < (scar_ssize)rc.checkpoints_buf.len) {
+		comp->destroy_compressor(checkpoints_compressor);
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	if (checkpoints_compressor->finish(checkpoints_compressor) < 0) {
+		comp->destroy_compressor(checkpoints_compressor);
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	comp->destroy_compressor(checkpoints_compressor);
+
+	if (scar_footer_write_tail(
+		w, comp, clevel, rc.index_offset, checkpoints_offset,
+		rc.sections, rc.nsections) < 0
+	) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	ret = 0;
+
+exit:
+	// The batch runner never leaves reads or workers using the jobs
+	if (have_batch) {
+		scar_segment_batch_destroy(&batch);
+	}
+	for (size_t i = 0; i < njobs; ++i) {
+		scar_spill_writer_destroy(&rc.jobs[i].out);
+	}
+	free(rc.jobs);
+	if (dest_codecs) {
+		scar_codec_pool_free(dest_codecs);
+	}
+	free(rc.checkpoints_buf.buf);
+	return ret;
+}
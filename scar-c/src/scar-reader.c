@@ -1,62 +1,221 @@
 #include "scar-reader.h"
 
 #include <assert.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "internal-util.h"
 #include "compression.h"
+#include "bloom.h"
+#include "codec-pool.h"
+#include "footer.h"
 #include "io.h"
 #include "ioutil.h"
+#include "page-cache.h"
 #include "pax.h"
 #include "types.h"
 #include "pax-syntax.h"
+#include "sidecar-format.h"
+#include "util.h"
 
 struct checkpoint {
 	scar_offset compressed;
 	scar_offset uncompressed;
 };
 
+struct section {
+	char name[32];
+	scar_offset offset;
+};
+
+struct segment_checksum {
+	scar_offset uncompressed;
+	uint32_t crc;
+};
+
+struct access_point {
+	scar_offset compressed;
+	scar_offset uncompressed;
+	int bits;
+	unsigned char *window;
+	size_t window_len;
+};
+
+// A preader which serves reads of the end of the archive from memory,
+// and passes everything before 'start' on to 'inner'.
+struct footer_preader {
+	struct scar_io_preader pr;
+	struct scar_io_preader *inner;
+	unsigned char *buf;
+	scar_offset start;
+	size_t len;
+};
+
+struct scar_cursor {
+	struct scar_reader *sr;
+	struct scar_io_reader *r;
+	struct scar_io_seeker *s;
+	struct scar_decompressor *decomp;
+
+	// What scar_cursor_read_meta and scar_cursor_read_content read
+	// the tar body from: either 'decomp', or 'pages' with a page cache
+	struct scar_io_reader *body;
+
+	// With a page cache, 'pages' reads from cached pages of the segment
+	// starting at 'chk', and only decompresses pages which are missing.
+	// 'pos' is the uncompressed offset of the next read, and 'decomp_pos'
+	// is where 'decomp' is in the same segment, or -1 if it has to be
+	// created anew.
+	struct scar_io_reader pages;
+	struct checkpoint chk;
+	scar_offset pos;
+	scar_offset decomp_pos;
+
+	// Receives the access points 'decomp' passes, which it reports
+	// relative to the offsets it was started at
+	struct scar_access_point_sink sink;
+	scar_offset sink_in;
+	scar_offset sink_out;
+
+	// A copy of the window of the access point 'decomp' was started at,
+	// since the reader's copy may be freed by another thread
+	unsigned char *ap_window;
+	size_t ap_window_cap;
+
+	// The stream 'r' and 's' point to,
+	// if the cursor reads through the reader's preader
+	struct scar_preader_stream ps;
+};
+
+// Everything in the scar_reader is read-only once it has been created,
+// except for its own cursor, and the sections which are loaded on demand,
+// which are guarded by 'lazy_mut'.
+// That way, any number of other cursors can read from it concurrently.
 struct scar_reader {
-	struct scar_io_reader *raw_r;
-	struct scar_io_seeker *raw_s;
+	// The cursor used by the scar_reader_* functions,
+	// reading from the streams which the reader was created with
+	struct scar_cursor cursor;
 	struct scar_compression comp;
 
-	struct scar_decompressor *current_decomp;
+	// Decompressors which cursors and iterators are done with,
+	// so that seeking doesn't set up a new one every time.
+	// It does its own locking.
+	struct scar_codec_pool *codecs;
+
+	// The preader the reader was created with, if any
+	struct scar_io_preader *pr;
+
+	// With a footer window, the end of the archive, which was read in one go
+	// when the reader was created. The reader and its cursors read through
+	// 'footer.pr' instead of 'pr' then, so that the tail, the index and
+	// the other footer sections are all parsed from memory.
+	struct footer_preader footer;
+
+	// How many segment reads to keep in flight, for the fetchers
+	// scar_verify and scar_recompress create on top of 'pr'
+	unsigned int queue_depth;
+
+	// How much compressed data scar_recompress reads into memory at once
+	size_t batch_bytes;
+
+	// How many threads decompress a big gzip segment,
+	// and how much compressed data each one starts on
+	unsigned int inflate_threads;
+	size_t inflate_chunk;
+
+	// Decompressed pages of the tar body, or NULL
+	struct scar_page_cache *page_cache;
+
+	// Access points found while decompressing the tar body,
+	// sorted by uncompressed offset, and the span between them,
+	// or 0 if they aren't recorded. Guarded by 'ap_mut'.
+	pthread_mutex_t ap_mut;
+	scar_offset ap_span;
+	struct access_point *aps;
+	size_t apcount;
+	size_t apcap;
 
-	bool has_checkpoints;
 	struct checkpoint *checkpoints;
 	size_t checkpointcount;
 
+	// The uncompressed offset of the end of the tar body,
+	// or -1 if the checkpoints section doesn't tell us
+	scar_offset body_end_uncompressed;
+
+	// Extension sections listed in the tail
+	struct section sections[SCAR_FOOTER_MAX_SECTIONS];
+	size_t sectioncount;
+
+	pthread_mutex_t lazy_mut;
+
+	bool has_checksums;
+	struct segment_checksum *checksums;
+	size_t checksumcount;
+
+	bool has_bloom;
+	unsigned int bloom_hashes;
+	uint64_t bloom_nbits;
+	unsigned char *bloom_bits;
+
+	// The sidecar index the reader was created with, if it's fresh,
+	// and its global metadata, copied out of the sidecar
+	bool has_sidecar;
+	struct scar_sidecar sidecar;
+	struct scar_meta_global **sidecar_globals;
+
+	// Where scar_reader_find_entry keeps what the entry it found points to
+	struct scar_mem_writer found_name;
+	struct scar_meta_global *found_global;
+
+	// The compressed offset of the end of the tar body,
+	// which is where the first footer section starts
+	scar_offset body_end_offset;
 	scar_offset index_offset;
 	scar_offset checkpoints_offset;
+	scar_offset tail_offset;
 };
 
 struct scar_index_iterator {
-	struct scar_compression *comp;
+	struct scar_codec_pool *codecs;
 	struct scar_decompressor *decompressor;
 
 	struct scar_mem_writer buf;
 	struct scar_block_reader br;
 	scar_offset next_offset;
 	struct scar_io_seeker *seeker;
-	struct scar_meta global;
+
+	// The global metadata from the 'g' lines so far,
+	// which every entry until the next one shares
+	struct scar_meta_global *global;
+
+	// The SCAR-META section is read in lockstep with the index,
+	// if the archive has one
+	struct scar_decompressor *meta_decompressor;
+	struct scar_limited_reader meta_lr;
+	struct scar_block_reader meta_br;
+	scar_offset meta_next_offset;
+
+	// With a sidecar, the entries come from there instead,
+	// and 'sidecar_next' is the number of the next one
+	struct scar_reader *sidecar_sr;
+	uint64_t sidecar_next;
 };
 
-static int reader_ensure_checkpoint_section(struct scar_reader *sr)
+// Load the checkpoints section. This is done when the reader is created,
+// so that the checkpoints never change after that.
+static int reader_load_checkpoints(struct scar_reader *sr)
 {
-	if (sr->has_checkpoints) {
-		return 0;
-	}
-
-	if (sr->raw_s->seek(
-		sr->raw_s, sr->checkpoints_offset, SCAR_SEEK_START) < 0
-	) {
+	struct scar_cursor *c = &sr->cursor;
+	if (c->s->seek(c->s, sr->checkpoints_offset, SCAR_SEEK_START) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	struct scar_decompressor *decomp = sr->comp.create_decompressor(sr->raw_r);
+	struct scar_decompressor *decomp = scar_codec_pool_get_decompressor(
+		sr->codecs, c->r, NULL, NULL);
 	if (!decomp) {
 		SCAR_ERETURN(-1);
 	}
@@ -68,12 +227,12 @@ static int reader_ensure_checkpoint_section(struct scar_reader *sr)
 	char line[64];
 	scar_ssize len = scar_block_reader_read_line(&br, line, sizeof(line));
 	if (len == 0) {
-		sr->comp.destroy_decompressor(decomp);
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
 		SCAR_ERETURN(-1);
 	}
 
 	if (strcmp(line, "SCAR-CHECKPOINTS") != 0) {
-		sr->comp.destroy_decompressor(decomp);
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
 		SCAR_ERETURN(-1);
 	}
 
@@ -86,7 +245,6 @@ static int reader_ensure_checkpoint_section(struct scar_reader *sr)
 		}
 
 		if (len == 0 || strcmp(line, "SCAR-TAIL") == 0) {
-			sr->has_checkpoints = true;
 			break;
 		}
 
@@ -128,24 +286,111 @@ static int reader_ensure_checkpoint_section(struct scar_reader *sr)
 		sr->checkpoints[sr->checkpointcount - 1].uncompressed = uncompressed;
 	}
 
+	// Some writers also list the checkpoints in front of the footer
+	// sections. Those aren't part of the tar body, but the first one
+	// tells us where the tar body ends.
+	while (ret == 0 && sr->checkpointcount > 0) {
+		struct checkpoint *last = &sr->checkpoints[sr->checkpointcount - 1];
+		if (last->compressed < sr->body_end_offset) {
+			break;
+		}
+
+		if (last->compressed == sr->body_end_offset) {
+			sr->body_end_uncompressed = last->uncompressed;
+		}
+
+		sr->checkpointcount -= 1;
+	}
+
 	if (ret != 0) {
 		free(sr->checkpoints);
 		sr->checkpoints = NULL;
 		sr->checkpointcount = 0;
 	}
 
-	sr->comp.destroy_decompressor(decomp);
+	scar_codec_pool_put_decompressor(sr->codecs, decomp);
 	return ret;
 }
 
-static int reader_find_checkpoint(
-	struct scar_reader *sr, scar_offset offset_uc,
-	struct checkpoint *chkpoint
+static void free_globals(struct scar_meta_global **globals, uint64_t count)
+{
+	for (uint64_t i = 0; i < count; ++i) {
+		scar_meta_global_unref(globals[i]);
+	}
+
+	free(globals);
+}
+
+// Copy global metadata number 'idx' out of a sidecar,
+// so that it can be shared like global metadata from the index
+static struct scar_meta_global *sidecar_global(
+	const struct scar_sidecar *sc, uint64_t idx
 ) {
-	if (reader_ensure_checkpoint_section(sr) < 0) {
-		SCAR_ERETURN(-1);
+	struct scar_meta borrowed, meta;
+	if (scar_sidecar_get_global(sc, idx, &borrowed) < 0) {
+		SCAR_ERETURN(NULL);
+	}
+
+	scar_meta_copy(&meta, &borrowed);
+	struct scar_meta_global *global = scar_meta_global_create(&meta);
+	if (!global) {
+		scar_meta_destroy(&meta);
+		SCAR_ERETURN(NULL);
+	}
+
+	return global;
+}
+
+// Take the checkpoints and global metadata from a sidecar,
+// instead of parsing them out of the archive.
+static int reader_load_sidecar(
+	struct scar_reader *sr, const struct scar_sidecar *sc
+) {
+	if (sc->checkpoint_count > 0) {
+		sr->checkpoints = malloc(sc->checkpoint_count * sizeof(*sr->checkpoints));
+		if (!sr->checkpoints) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	for (uint64_t i = 0; i < sc->checkpoint_count; ++i) {
+		scar_sidecar_get_checkpoint(
+			sc, i, &sr->checkpoints[i].compressed,
+			&sr->checkpoints[i].uncompressed);
+	}
+	sr->checkpointcount = (size_t)sc->checkpoint_count;
+	sr->body_end_uncompressed = sc->body_end_uncompressed;
+
+	if (sc->global_count > 0) {
+		sr->sidecar_globals = malloc(
+			sc->global_count * sizeof(*sr->sidecar_globals));
+		if (!sr->sidecar_globals) {
+			free(sr->checkpoints);
+			sr->checkpoints = NULL;
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	for (uint64_t i = 0; i < sc->global_count; ++i) {
+		sr->sidecar_globals[i] = sidecar_global(sc, i);
+		if (!sr->sidecar_globals[i]) {
+			free(sr->checkpoints);
+			free_globals(sr->sidecar_globals, i);
+			sr->checkpoints = NULL;
+			sr->sidecar_globals = NULL;
+			SCAR_ERETURN(-1);
+		}
 	}
 
+	sr->sidecar = *sc;
+	sr->has_sidecar = true;
+	return 0;
+}
+
+static void reader_find_checkpoint(
+	struct scar_reader *sr, scar_offset offset_uc,
+	struct checkpoint *chkpoint
+) {
 	chkpoint->compressed = 0;
 	chkpoint->uncompressed = 0;
 
@@ -158,40 +403,224 @@ static int reader_find_checkpoint(
 			break;
 		}
 	}
+}
 
-	return 0;
+// Find the first access point at or after 'offset_uc'.
+// Must be called with 'ap_mut' held.
+static size_t reader_access_point_search(
+	struct scar_reader *sr, scar_offset offset_uc
+) {
+	size_t lo = 0;
+	size_t hi = sr->apcount;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (sr->aps[mid].uncompressed < offset_uc) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static void reader_add_access_point(
+	struct scar_reader *sr, scar_offset compressed, scar_offset uncompressed,
+	const struct scar_access_point *ap
+) {
+	pthread_mutex_lock(&sr->ap_mut);
+
+	// Decompressors which started at different places find different
+	// access points in the same stretch of data, so only keep points
+	// which aren't close to one we already have
+	size_t idx = reader_access_point_search(sr, uncompressed);
+	scar_offset gap = sr->ap_span / 2;
+	if (
+		sr->ap_span == 0 ||
+		(idx > 0 && uncompressed - sr->aps[idx - 1].uncompressed < gap) ||
+		(idx < sr->apcount && sr->aps[idx].uncompressed - uncompressed < gap)
+	) {
+		pthread_mutex_unlock(&sr->ap_mut);
+		return;
+	}
+
+	if (sr->apcount == sr->apcap) {
+		size_t cap = sr->apcap ? sr->apcap * 2 : 16;
+		struct access_point *aps = realloc(sr->aps, cap * sizeof(*aps));
+		if (!aps) {
+			pthread_mutex_unlock(&sr->ap_mut);
+			return;
+		}
+
+		sr->aps = aps;
+		sr->apcap = cap;
+	}
+
+	unsigned char *window = malloc(ap->window_len ? ap->window_len : 1);
+	if (!window) {
+		pthread_mutex_unlock(&sr->ap_mut);
+		return;
+	}
+
+	memcpy(window, ap->window, ap->window_len);
+	memmove(
+		&sr->aps[idx + 1], &sr->aps[idx],
+		(sr->apcount - idx) * sizeof(*sr->aps));
+	sr->aps[idx].compressed = compressed;
+	sr->aps[idx].uncompressed = uncompressed;
+	sr->aps[idx].bits = ap->bits;
+	sr->aps[idx].window = window;
+	sr->aps[idx].window_len = ap->window_len;
+	sr->apcount += 1;
+
+	pthread_mutex_unlock(&sr->ap_mut);
+}
+
+// Find the last access point inside the segment starting at 'chkpoint'
+// which is at or before 'offset_uc'. Its window is copied into the
+// cursor's 'ap_window' before the lock is released, since the reader's
+// access points can be dropped as soon as it is.
+static bool cursor_find_access_point(
+	struct scar_cursor *c, struct checkpoint *chkpoint,
+	scar_offset offset_uc, struct access_point *ap
+) {
+	struct scar_reader *sr = c->sr;
+	pthread_mutex_lock(&sr->ap_mut);
+	size_t idx = reader_access_point_search(sr, offset_uc + 1);
+	bool found =
+		idx > 0 && sr->aps[idx - 1].uncompressed > chkpoint->uncompressed;
+	if (found && sr->aps[idx - 1].window_len > c->ap_window_cap) {
+		// Without memory for the window, start at the checkpoint instead
+		size_t cap = sr->aps[idx - 1].window_len;
+		unsigned char *window = realloc(c->ap_window, cap);
+		if (window) {
+			c->ap_window = window;
+			c->ap_window_cap = cap;
+		} else {
+			found = false;
+		}
+	}
+
+	if (found) {
+		*ap = sr->aps[idx - 1];
+		memcpy(c->ap_window, ap->window, ap->window_len);
+		ap->window = c->ap_window;
+	}
+
+	pthread_mutex_unlock(&sr->ap_mut);
+	return found;
+}
+
+static void cursor_sink_add(
+	struct scar_access_point_sink *sink, const struct scar_access_point *ap
+) {
+	struct scar_cursor *c = SCAR_BASE(struct scar_cursor, sink);
+	reader_add_access_point(
+		c->sr, c->sink_in + ap->in, c->sink_out + ap->out, ap);
+}
+
+// Get the compressed length of the segment starting at 'chkpoint'
+static scar_offset reader_segment_length(
+	struct scar_reader *sr, struct checkpoint *chkpoint
+) {
+	scar_offset end = sr->body_end_offset;
+	for (size_t i = 0; i < sr->checkpointcount; ++i) {
+		if (sr->checkpoints[i].compressed > chkpoint->compressed) {
+			end = sr->checkpoints[i].compressed;
+			break;
+		}
+	}
+
+	return end - chkpoint->compressed;
 }
 
-static int reader_seek_to(struct scar_reader *sr, scar_offset offset_uc)
+// Give the cursor's decompressor back
+static void cursor_put_decompressor(struct scar_cursor *c)
 {
-	struct checkpoint chkpoint;
-	if (reader_find_checkpoint(sr, offset_uc, &chkpoint) < 0) {
-		SCAR_ERETURN(-1);
+	scar_codec_pool_put_decompressor(c->sr->codecs, c->decomp);
+	c->decomp = NULL;
+}
+
+// Start a new decompressor in the segment starting at 'chkpoint',
+// as close to 'offset_uc' as possible: at the checkpoint,
+// or at an access point after it.
+// Returns the uncompressed offset the decompressor starts at,
+// or -1 on error.
+static scar_offset cursor_restart(
+	struct scar_cursor *c, struct checkpoint *chkpoint, scar_offset offset_uc
+) {
+	struct scar_reader *sr = c->sr;
+	cursor_put_decompressor(c);
+	c->decomp_pos = -1;
+
+	struct access_point ap;
+	bool at_ap = false;
+	if (sr->ap_span > 0 && sr->comp.create_decompressor_at) {
+		at_ap = cursor_find_access_point(c, chkpoint, offset_uc, &ap);
 	}
 
-	if (sr->current_decomp) {
-		sr->comp.destroy_decompressor(sr->current_decomp);
+	scar_offset start_in = chkpoint->compressed;
+	scar_offset start_out = chkpoint->uncompressed;
+	if (at_ap) {
+		start_in = ap.compressed - (ap.bits ? 1 : 0);
+		start_out = ap.uncompressed;
 	}
 
-	if (sr->raw_s->seek(sr->raw_s, chkpoint.compressed, SCAR_SEEK_START) < 0) {
+	if (c->s->seek(c->s, start_in, SCAR_SEEK_START) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	sr->current_decomp = sr->comp.create_decompressor(sr->raw_r);
-	if (!sr->current_decomp) {
+	struct scar_access_point_sink *sink = NULL;
+	if (sr->ap_span > 0 && sr->comp.create_decompressor_at) {
+		c->sink.span = sr->ap_span;
+		c->sink_in = start_in;
+		c->sink_out = start_out;
+		sink = &c->sink;
+	}
+
+	// The parallel inflater decompresses a whole round of chunks before
+	// it returns anything, which only pays off when the cursor has to get
+	// through at least a chunk's worth of the segment to reach 'offset_uc'
+	bool parallel =
+		!at_ap && sr->inflate_threads > 1 &&
+		scar_compression_is_gzip(&sr->comp) &&
+		offset_uc - start_out >= (scar_offset)sr->inflate_chunk;
+
+	if (parallel) {
+		c->decomp = scar_codec_pool_get_segment_decompressor(
+			sr->codecs, c->r, reader_segment_length(sr, chkpoint), sink);
+	} else if (at_ap) {
+		struct scar_access_point start;
+		start.in = ap.compressed;
+		start.out = ap.uncompressed;
+		start.bits = ap.bits;
+		start.window = ap.window;
+		start.window_len = ap.window_len;
+		c->decomp = scar_codec_pool_get_decompressor(
+			sr->codecs, c->r, &start, sink);
+	} else {
+		c->decomp = scar_codec_pool_get_decompressor(
+			sr->codecs, c->r, NULL, sink);
+	}
+
+	if (!c->decomp) {
 		SCAR_ERETURN(-1);
 	}
 
+	return start_out;
+}
+
+// Read and throw away 'skip' bytes from the cursor's decompressor.
+static int cursor_skip(struct scar_cursor *c, scar_offset skip)
+{
 	char buf[512];
-	scar_offset skip = offset_uc - chkpoint.uncompressed;
 	while (skip > 0) {
 		size_t n = skip;
 		if (n > sizeof(buf)) {
 			n = sizeof(buf);
 		}
 
-		scar_ssize ret = sr->current_decomp->r.read(
-			&sr->current_decomp->r, buf, n);
+		scar_ssize ret = c->decomp->r.read(&c->decomp->r, buf, n);
 		if (ret < (scar_ssize)n) {
 			SCAR_ERETURN(-1);
 		}
@@ -202,6 +631,210 @@ static int reader_seek_to(struct scar_reader *sr, scar_offset offset_uc)
 	return 0;
 }
 
+// Decompress pages of the cursor's segment up to and including 'page',
+// and put them in the page cache. The part of 'page' which the read
+// wants is copied into 'buf' first, since the cache might not keep it.
+// Returns the number of bytes copied, or -1 on error.
+static scar_ssize cursor_load_page(
+	struct scar_cursor *c, uint64_t page, size_t offset,
+	unsigned char *buf, size_t len
+) {
+	struct scar_reader *sr = c->sr;
+	scar_offset start =
+		c->chk.uncompressed + (scar_offset)(page * SCAR_PAGE_SIZE);
+
+	// A decompressor which is already partway through the segment
+	// can carry on from where it is
+	if (!c->decomp || c->decomp_pos < 0 || c->decomp_pos > start) {
+		scar_offset pos = cursor_restart(c, &c->chk, start);
+		if (pos < 0 || cursor_skip(c, start - pos) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		c->decomp_pos = start;
+	}
+
+	while (c->decomp_pos <= start) {
+		unsigned char *data = malloc(SCAR_PAGE_SIZE);
+		if (!data) {
+			SCAR_ERETURN(-1);
+		}
+
+		size_t datalen = 0;
+		while (datalen < SCAR_PAGE_SIZE) {
+			scar_ssize n = c->decomp->r.read(
+				&c->decomp->r, &data[datalen], SCAR_PAGE_SIZE - datalen);
+			if (n < 0) {
+				free(data);
+				c->decomp_pos = -1;
+				SCAR_ERETURN(-1);
+			} else if (n == 0) {
+				break;
+			}
+
+			datalen += (size_t)n;
+		}
+
+		uint64_t idx =
+			(uint64_t)(c->decomp_pos - c->chk.uncompressed) / SCAR_PAGE_SIZE;
+		size_t copied = 0;
+		if (idx == page && offset < datalen) {
+			copied = datalen - offset < len ? datalen - offset : len;
+			memcpy(buf, &data[offset], copied);
+		}
+
+		scar_page_cache_insert(
+			sr->page_cache, c->chk.compressed, idx, data, datalen);
+
+		// A short page is the end of the segment
+		if (datalen < SCAR_PAGE_SIZE) {
+			c->decomp_pos = -1;
+			return (scar_ssize)copied;
+		}
+
+		c->decomp_pos += SCAR_PAGE_SIZE;
+		if (idx == page) {
+			return (scar_ssize)copied;
+		}
+	}
+
+	return 0;
+}
+
+static scar_ssize cursor_pages_read(
+	struct scar_io_reader *pages, void *buf, size_t len
+) {
+	struct scar_cursor *c = SCAR_BASE(struct scar_cursor, pages);
+	unsigned char *out = buf;
+	size_t done = 0;
+
+	while (done < len) {
+		uint64_t rel = (uint64_t)(c->pos - c->chk.uncompressed);
+		uint64_t page = rel / SCAR_PAGE_SIZE;
+		size_t offset = (size_t)(rel % SCAR_PAGE_SIZE);
+		size_t want = SCAR_PAGE_SIZE - offset;
+		if (want > len - done) {
+			want = len - done;
+		}
+
+		scar_ssize n = scar_page_cache_read(
+			c->sr->page_cache, c->chk.compressed, page, offset,
+			&out[done], want);
+		if (n < 0) {
+			n = cursor_load_page(c, page, offset, &out[done], want);
+			if (n < 0) {
+				SCAR_ERETURN(-1);
+			}
+		}
+
+		done += (size_t)n;
+		c->pos += n;
+		if ((size_t)n < want) {
+			break;
+		}
+	}
+
+	return (scar_ssize)done;
+}
+
+static void cursor_init(
+	struct scar_cursor *c, struct scar_reader *sr,
+	struct scar_io_reader *r, struct scar_io_seeker *s
+) {
+	c->sr = sr;
+	c->r = r;
+	c->s = s;
+	c->decomp = NULL;
+	c->ap_window = NULL;
+	c->ap_window_cap = 0;
+	c->body = NULL;
+	scar_io_reader_init(&c->pages, cursor_pages_read);
+	c->chk.compressed = -1;
+	c->chk.uncompressed = -1;
+	c->pos = -1;
+	c->decomp_pos = -1;
+	c->sink.span = 0;
+	c->sink.add = cursor_sink_add;
+	c->sink_in = 0;
+	c->sink_out = 0;
+}
+
+static int cursor_seek_to(struct scar_cursor *c, scar_offset offset_uc)
+{
+	struct scar_reader *sr = c->sr;
+	struct checkpoint chkpoint;
+	reader_find_checkpoint(sr, offset_uc, &chkpoint);
+
+	// With a page cache, nothing is decompressed until a read misses
+	if (sr->page_cache) {
+		if (chkpoint.compressed != c->chk.compressed) {
+			c->decomp_pos = -1;
+		}
+
+		c->chk = chkpoint;
+		c->pos = offset_uc;
+		c->body = &c->pages;
+		return 0;
+	}
+
+	c->body = NULL;
+	scar_offset pos = cursor_restart(c, &chkpoint, offset_uc);
+	if (pos < 0 || cursor_skip(c, offset_uc - pos) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	c->body = &c->decomp->r;
+	return 0;
+}
+
+// Parse an extension section line ("<name> <offset>\n") from the tail.
+// Returns 1 if a line was parsed, 0 if not.
+static int parse_tail_section(
+	struct scar_reader *sr, char **text, scar_ssize *textlen
+) {
+	char *ptr = *text;
+	scar_ssize len = *textlen;
+	struct section *sec = &sr->sections[sr->sectioncount];
+
+	size_t namelen = 0;
+	while (len > 0 && *ptr != ' ') {
+		if (*ptr == '\n' || namelen + 1 >= sizeof(sec->name)) {
+			return 0;
+		}
+
+		sec->name[namelen++] = *ptr;
+		ptr += 1;
+		len -= 1;
+	}
+
+	if (len == 0 || namelen == 0) {
+		return 0;
+	}
+
+	sec->name[namelen] = '\0';
+	ptr += 1;
+	len -= 1;
+
+	size_t ndigits = 0;
+	sec->offset = 0;
+	while (len > 0 && *ptr >= '0' && *ptr <= '9') {
+		sec->offset *= 10;
+		sec->offset += *ptr - '0';
+		ptr += 1;
+		len -= 1;
+		ndigits += 1;
+	}
+
+	if (len == 0 || ndigits == 0 || *ptr != '\n') {
+		return 0;
+	}
+
+	*text = ptr + 1;
+	*textlen = len - 1;
+	sr->sectioncount += 1;
+	return 1;
+}
+
 // Returns 1 if the tail was successfully parsed, 0 if not,
 // and -1 if it failed.
 static int parse_tail(struct scar_reader *sr, unsigned char *tail, size_t len)
@@ -265,13 +898,24 @@ static int parse_tail(struct scar_reader *sr, unsigned char *tail, size_t len)
 		sr->comp.destroy_decompressor(d);
 		return 0;
 	}
+	plain += 1;
+	plainlen -= 1;
+
+	// Any lines after the standard ones list extension sections
+	sr->sectioncount = 0;
+	while (
+		sr->sectioncount < SCAR_FOOTER_MAX_SECTIONS &&
+		parse_tail_section(sr, &plain, &plainlen)
+	);
 
 	sr->comp.destroy_decompressor(d);
 	return 1;
 }
 
-static int find_tail(struct scar_reader *sr, unsigned char *end, size_t len)
-{
+// Returns the position of the tail within 'end', or -1 if it wasn't found.
+static scar_ssize find_tail(
+	struct scar_reader *sr, unsigned char *end, size_t len
+) {
 	unsigned char *ptr = end + len - sr->comp.magic_len;
 	while (ptr >= end) {
 		if (memcmp(ptr, sr->comp.magic, sr->comp.magic_len) == 0) {
@@ -279,8 +923,8 @@ static int find_tail(struct scar_reader *sr, unsigned char *end, size_t len)
 			if (ret < 0) {
 				SCAR_ERETURN(-1);
 			} else if (ret) {
-				return 0;
-				}
+				return (scar_ssize)(ptr - end);
+			}
 		}
 
 		ptr -= 1;
@@ -289,83 +933,490 @@ static int find_tail(struct scar_reader *sr, unsigned char *end, size_t len)
 	SCAR_ERETURN(-1);
 }
 
-struct scar_reader *scar_reader_create(
-	struct scar_io_reader *r, struct scar_io_seeker *s)
-{
-	unsigned char end_block[512];
+static scar_ssize footer_preader_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	struct footer_preader *fp = SCAR_BASE(struct footer_preader, pr);
+	unsigned char *dest = buf;
+	size_t done = 0;
+
+	// Reads which run into the window get the part before it from 'inner',
+	// and the rest from the window. Returning early at the window's start
+	// would look like a short read to readers that need all of it.
+	while (offset < fp->start && done < len) {
+		size_t n = len - done;
+		if ((scar_offset)n > fp->start - offset) {
+			n = (size_t)(fp->start - offset);
+		}
 
-	if (s->seek(s, 0, SCAR_SEEK_END) < 0) {
-		SCAR_ERETURN(NULL);
-	}
+		scar_ssize ret = fp->inner->read_at(fp->inner, offset, &dest[done], n);
+		if (ret < 0) {
+			SCAR_ERETURN(-1);
+		} else if (ret == 0) {
+			return (scar_ssize)done;
+		}
 
-	scar_offset file_len = s->tell(s);
-	if (file_len < 0) {
-		SCAR_ERETURN(NULL);
+		offset += ret;
+		done += (size_t)ret;
 	}
 
-	scar_offset end_block_len = sizeof(end_block);
-	if (end_block_len > file_len) {
-		end_block_len = file_len;
+	scar_offset end = fp->start + (scar_offset)fp->len;
+	if (done == len || offset >= end) {
+		return (scar_ssize)done;
 	}
 
-	if (s->seek(s, -end_block_len, SCAR_SEEK_CURRENT) < 0) {
-		SCAR_ERETURN(NULL);
+	size_t n = len - done;
+	if ((scar_offset)n > end - offset) {
+		n = (size_t)(end - offset);
 	}
+	memcpy(&dest[done], &fp->buf[offset - fp->start], n);
+	return (scar_ssize)(done + n);
+}
 
-	if (r->read(r, end_block, (size_t)end_block_len) < end_block_len) {
-		SCAR_ERETURN(NULL);
+static scar_offset footer_preader_size(struct scar_io_preader *pr)
+{
+	struct footer_preader *fp = SCAR_BASE(struct footer_preader, pr);
+	return fp->start + (scar_offset)fp->len;
+}
+
+// Read all of 'len' bytes at 'offset' from 'pr'.
+static int preader_read_full(
+	struct scar_io_preader *pr, scar_offset offset, unsigned char *buf,
+	size_t len
+) {
+	while (len > 0) {
+		scar_ssize n = pr->read_at(pr, offset, buf, len);
+		if (n <= 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		offset += n;
+		buf += n;
+		len -= (size_t)n;
 	}
 
-	struct scar_reader *sr = malloc(sizeof(*sr));
-	if (!sr) {
-		SCAR_ERETURN(NULL);
+	return 0;
+}
+
+// Read the last 'window' bytes of 'pr' into the footer.
+static int footer_preader_init(
+	struct footer_preader *fp, struct scar_io_preader *pr, size_t window
+) {
+	fp->pr.read_at = footer_preader_read_at;
+	fp->pr.size = footer_preader_size;
+	fp->inner = pr;
+
+	scar_offset size = pr->size(pr);
+	if (size < 0) {
+		SCAR_ERETURN(-1);
 	}
 
-	// Find the correct compression, based on a suffix match of
-	// the scar-end section
-	if (!scar_compression_init_from_tail(
-		&sr->comp, end_block, (size_t)end_block_len)
-	) {
-		free(sr);
-		SCAR_ERETURN(NULL);
+	if ((scar_offset)window > size) {
+		window = (size_t)size;
 	}
 
-	// Now, find the tail, and populate the offsets to
-	// the index and the checkpoints
-	if (find_tail(sr, end_block, (size_t)end_block_len - sr->comp.eof_marker_len) < 0) {
-		free(sr);
-		SCAR_ERETURN(NULL);
+	fp->start = size - (scar_offset)window;
+	fp->len = window;
+	fp->buf = malloc(window > 0 ? window : 1);
+	if (!fp->buf) {
+		SCAR_ERETURN(-1);
 	}
 
-	sr->current_decomp = NULL;
-	sr->has_checkpoints = false;
-	sr->checkpoints = NULL;
-	sr->checkpointcount = 0;
-	sr->raw_r = r;
-	sr->raw_s = s;
+	if (preader_read_full(pr, fp->start, fp->buf, window) < 0) {
+		free(fp->buf);
+		fp->buf = NULL;
+		SCAR_ERETURN(-1);
+	}
 
-	return sr;
+	return 0;
 }
 
-struct scar_index_iterator *scar_reader_iterate(struct scar_reader *sr)
+// Grow the footer to start at 'start', with one more read.
+static int footer_preader_grow(struct footer_preader *fp, scar_offset start)
 {
-	struct scar_index_iterator *it = NULL;
+	size_t extra = (size_t)(fp->start - start);
+	unsigned char *buf = malloc(extra + fp->len);
+	if (!buf) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (preader_read_full(fp->inner, start, buf, extra) < 0) {
+		free(buf);
+		SCAR_ERETURN(-1);
+	}
+
+	memcpy(&buf[extra], fp->buf, fp->len);
+	free(fp->buf);
+	fp->buf = buf;
+	fp->start = start;
+	fp->len += extra;
+	return 0;
+}
+
+static struct scar_reader *reader_create(
+	struct scar_io_reader *r, struct scar_io_seeker *s,
+	struct scar_io_preader *pr, const struct scar_sidecar *sc, size_t window
+) {
+	unsigned char end_block[512];
+
+	struct scar_reader *sr = malloc(sizeof(*sr));
+	if (!sr) {
+		SCAR_ERETURN(NULL);
+	}
+
+	sr->checkpoints = NULL;
+	sr->has_sidecar = false;
+	sr->sidecar_globals = NULL;
+	sr->footer.buf = NULL;
+	sr->codecs = NULL;
+
+	// A reader created from a preader gets a stream of its own on top of it,
+	// which goes through the footer if there is one
+	sr->pr = pr;
+	sr->queue_depth = 0;
+	sr->batch_bytes = SCAR_DEFAULT_BATCH_BYTES;
+	sr->inflate_threads = 0;
+	sr->inflate_chunk = SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK;
+	if (pr && window > 0) {
+		if (footer_preader_init(&sr->footer, pr, window) < 0) {
+			goto err;
+		}
+		pr = &sr->footer.pr;
+	}
+
+	if (pr) {
+		scar_preader_stream_init(&sr->cursor.ps, pr);
+		r = &sr->cursor.ps.r;
+		s = &sr->cursor.ps.s;
+	}
+
+	if (s->seek(s, 0, SCAR_SEEK_END) < 0) {
+		goto err;
+	}
+
+	scar_offset file_len = s->tell(s);
+	if (file_len < 0) {
+		goto err;
+	}
+
+	scar_offset end_block_len = sizeof(end_block);
+	if (end_block_len > file_len) {
+		end_block_len = file_len;
+	}
+
+	if (s->seek(s, -end_block_len, SCAR_SEEK_CURRENT) < 0) {
+		goto err;
+	}
+
+	if (r->read(r, end_block, (size_t)end_block_len) < end_block_len) {
+		goto err;
+	}
+
+	// Find the correct compression, based on a suffix match of
+	// the scar-end section
+	if (!scar_compression_init_from_tail(
+		&sr->comp, end_block, (size_t)end_block_len)
+	) {
+		goto err;
+	}
+
+	// Now, find the tail, and populate the offsets to
+	// the index and the checkpoints
+	scar_ssize tail_pos = find_tail(
+		sr, end_block, (size_t)end_block_len - sr->comp.eof_marker_len);
+	if (tail_pos < 0) {
+		goto err;
+	}
+
+	sr->tail_offset = file_len - end_block_len + tail_pos;
+	sr->body_end_offset = sr->index_offset;
+	for (size_t i = 0; i < sr->sectioncount; ++i) {
+		if (sr->sections[i].offset < sr->body_end_offset) {
+			sr->body_end_offset = sr->sections[i].offset;
+		}
+	}
+
+	// If the footer sections didn't fit in the window, grow it once
+	// to cover all of them, unless they're too big to keep in memory
+	if (
+		sr->footer.buf && sr->body_end_offset < sr->footer.start &&
+		file_len - sr->body_end_offset <= SCAR_FOOTER_MAX_WINDOW
+	) {
+		if (footer_preader_grow(&sr->footer, sr->body_end_offset) < 0) {
+			goto err;
+		}
+	}
+
+	sr->codecs = scar_codec_pool_create(&sr->comp, 0);
+	if (!sr->codecs) {
+		goto err;
+	}
+
+	sr->body_end_uncompressed = -1;
+	sr->has_checksums = false;
+	sr->checksums = NULL;
+	sr->checksumcount = 0;
+	sr->has_bloom = false;
+	sr->bloom_hashes = 0;
+	sr->bloom_nbits = 0;
+	sr->bloom_bits = NULL;
+	sr->checkpointcount = 0;
+	sr->page_cache = NULL;
+	sr->ap_span = 0;
+	sr->aps = NULL;
+	sr->apcount = 0;
+	sr->apcap = 0;
+	scar_mem_writer_init(&sr->found_name);
+	sr->found_global = NULL;
+	cursor_init(&sr->cursor, sr, r, s);
+
+	// A sidecar which was made for a different archive,
+	// or which doesn't match this one's footer, is ignored
+	bool use_sidecar =
+		sc && sc->archive_size == (uint64_t)file_len &&
+		sc->index_offset == sr->index_offset &&
+		sc->checkpoints_offset == sr->checkpoints_offset;
+	if (use_sidecar) {
+		if (reader_load_sidecar(sr, sc) < 0) {
+			goto err;
+		}
+	} else if (reader_load_checkpoints(sr) < 0) {
+		goto err;
+	}
+
+	if (pthread_mutex_init(&sr->lazy_mut, NULL) != 0) {
+		goto err;
+	}
+
+	if (pthread_mutex_init(&sr->ap_mut, NULL) != 0) {
+		pthread_mutex_destroy(&sr->lazy_mut);
+		goto err;
+	}
+
+	return sr;
+
+err:
+	if (sr->codecs) {
+		scar_codec_pool_free(sr->codecs);
+	}
+	free(sr->checkpoints);
+	if (sr->has_sidecar) {
+		free_globals(sr->sidecar_globals, sr->sidecar.global_count);
+	}
+	free(sr->footer.buf);
+	free(sr);
+	SCAR_ERETURN(NULL);
+}
+
+struct scar_reader *scar_reader_create(
+	struct scar_io_reader *r, struct scar_io_seeker *s)
+{
+	return reader_create(r, s, NULL, NULL, 0);
+}
+
+struct scar_reader *scar_reader_create_p(struct scar_io_preader *pr)
+{
+	return reader_create(NULL, NULL, pr, NULL, 0);
+}
+
+struct scar_reader *scar_reader_create_p_window(
+	struct scar_io_preader *pr, size_t window
+) {
+	return reader_create(NULL, NULL, pr, NULL, window);
+}
+
+struct scar_reader *scar_reader_create_p_sidecar(
+	struct scar_io_preader *pr, const void *sidecar, size_t len,
+	const struct scar_sidecar_stamp *stamp
+) {
+	struct scar_sidecar sc;
+	if (
+		scar_sidecar_parse(&sc, sidecar, len) < 0 ||
+		sc.stamp.size != stamp->size ||
+		sc.stamp.mtime_sec != stamp->mtime_sec ||
+		sc.stamp.mtime_nsec != stamp->mtime_nsec
+	) {
+		return reader_create(NULL, NULL, pr, NULL, 0);
+	}
+
+	return reader_create(NULL, NULL, pr, &sc, 0);
+}
+
+bool scar_reader_has_sidecar(struct scar_reader *sr)
+{
+	return sr->has_sidecar;
+}
+
+// Open the SCAR-META section, if the archive has one.
+static int iterator_open_meta(
+	struct scar_index_iterator *it, struct scar_cursor *c
+) {
+	struct scar_segment seg;
+	if (!scar_reader_find_section(c->sr, "SCAR-META", &seg)) {
+		return 0;
+	}
+
+	if (it->seeker->seek(it->seeker, seg.compressed_start, SCAR_SEEK_START) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	scar_limited_reader_init(
+		&it->meta_lr, c->r, seg.compressed_end - seg.compressed_start);
+	it->meta_decompressor = scar_codec_pool_get_decompressor(
+		it->codecs, &it->meta_lr.r, NULL, NULL);
+	if (!it->meta_decompressor) {
+		SCAR_ERETURN(-1);
+	}
+
+	scar_block_reader_init(&it->meta_br, &it->meta_decompressor->r);
+
+	char line[32];
+	scar_block_reader_read_line(&it->meta_br, line, sizeof(line));
+	if (strcmp(line, "SCAR-META") != 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	it->meta_next_offset = it->seeker->tell(it->seeker);
+	if (it->meta_next_offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+// Parse one space-terminated field of a SCAR-META line.
+// A '-' means the value is missing, in which case 'str' is left alone.
+static char *parse_meta_field(char *text, char **str)
+{
+	char *end = strchr(text, ' ');
+	if (end) {
+		*end = '\0';
+		end += 1;
+	}
+
+	if (strcmp(text, "-") == 0) {
+		*str = NULL;
+	} else {
+		*str = text;
+	}
+
+	return end;
+}
+
+// Read the SCAR-META line which belongs to 'entry',
+// and fill in its metadata fields.
+static int iterator_read_meta(
+	struct scar_index_iterator *it, struct scar_index_entry *entry
+) {
+	entry->mode = ~(uint32_t)0;
+	entry->size = ~(uint64_t)0;
+	entry->mtime = NAN;
+
+	if (!it->meta_decompressor) {
+		return 0;
+	}
+
+	if (it->seeker->seek(it->seeker, it->meta_next_offset, SCAR_SEEK_START) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	char line[128];
+	scar_block_reader_read_line(&it->meta_br, line, sizeof(line));
+	if (it->meta_br.error) {
+		SCAR_ERETURN(-1);
+	}
+
+	it->meta_next_offset = it->seeker->tell(it->seeker);
+	if (it->meta_next_offset < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	// "<offset> <mode> <size> <mtime>"
+	char *offset, *mode, *size, *mtime;
+	char *next = parse_meta_field(line, &offset);
+	if (!next) {
+		return 0;
+	}
+	next = parse_meta_field(next, &mode);
+	if (!next) {
+		return 0;
+	}
+	next = parse_meta_field(next, &size);
+	if (!next) {
+		return 0;
+	}
+	parse_meta_field(next, &mtime);
+
+	// The lines should match up with the index entries.
+	// If they don't, pretend there's no metadata.
+	if (!offset || strtoll(offset, NULL, 10) != entry->offset) {
+		return 0;
+	}
+
+	if (mode) {
+		entry->mode = (uint32_t)strtoul(mode, NULL, 8);
+	}
+
+	if (size) {
+		entry->size = (uint64_t)strtoull(size, NULL, 10);
+	}
+
+	if (mtime) {
+		entry->mtime = strtod(mtime, NULL);
+	}
+
+	return 0;
+}
+
+struct scar_index_iterator *scar_reader_iterate(struct scar_reader *sr)
+{
+	return scar_cursor_iterate(&sr->cursor);
+}
+
+struct scar_index_iterator *scar_cursor_iterate(struct scar_cursor *c)
+{
+	struct scar_reader *sr = c->sr;
+	struct scar_index_iterator *it = NULL;
 
 	it = malloc(sizeof(*it));
 	if (!it) {
 		return NULL;
 	}
 
-	scar_meta_init_empty(&it->global);
+	it->global = NULL;
+	it->decompressor = NULL;
+	it->meta_decompressor = NULL;
+	it->buf.buf = NULL;
+	it->codecs = sr->codecs;
+	it->sidecar_sr = NULL;
+
+	if (sr->has_sidecar) {
+		scar_mem_writer_init(&it->buf);
+		it->sidecar_sr = sr;
+		it->sidecar_next = 0;
+		return it;
+	}
+
+	struct scar_meta empty;
+	scar_meta_init_empty(&empty);
+	it->global = scar_meta_global_create(&empty);
+	if (!it->global) {
+		scar_index_iterator_free(it);
+		SCAR_ERETURN(NULL);
+	}
 
-	it->seeker = sr->raw_s;
+	it->seeker = c->s;
 	if (it->seeker->seek(it->seeker, sr->index_offset, SCAR_SEEK_START) < 0) {
 		scar_index_iterator_free(it);
 		SCAR_ERETURN(NULL);
 	}
 
-	it->comp = &sr->comp;
-	it->decompressor = it->comp->create_decompressor(sr->raw_r);
+	it->decompressor = scar_codec_pool_get_decompressor(
+		it->codecs, c->r, NULL, NULL);
+	if (!it->decompressor) {
+		scar_index_iterator_free(it);
+		SCAR_ERETURN(NULL);
+	}
 
 	scar_block_reader_init(&it->br, &it->decompressor->r);
 	scar_mem_writer_init(&it->buf);
@@ -393,20 +1444,66 @@ struct scar_index_iterator *scar_reader_iterate(struct scar_reader *sr)
 		SCAR_ERETURN(NULL);
 	}
 
-	it->seeker = sr->raw_s;
 	it->next_offset = it->seeker->tell(it->seeker);
 	if (it->next_offset < 0) {
 		scar_index_iterator_free(it);
 		SCAR_ERETURN(NULL);
 	}
 
+	if (iterator_open_meta(it, c) < 0) {
+		scar_index_iterator_free(it);
+		SCAR_ERETURN(NULL);
+	}
+
 	return it;
 }
 
+// Copy what an entry from the sidecar points to into 'buf',
+// and fill in 'entry'.
+static int reader_sidecar_entry(
+	struct scar_reader *sr, uint64_t idx, struct scar_mem_writer *buf,
+	struct scar_index_entry *entry
+) {
+	struct scar_sidecar_entry e;
+	if (scar_sidecar_get_entry(&sr->sidecar, idx, &e) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	buf->len = 0;
+	if (scar_mem_writer_write(&buf->w, e.name, strlen(e.name) + 1) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	entry->ft = e.ft;
+	entry->name = buf->buf;
+	entry->offset = e.offset;
+	entry->global = &sr->sidecar_globals[e.global]->meta;
+	entry->shared_global = sr->sidecar_globals[e.global];
+	entry->mode = e.mode;
+	entry->size = e.size;
+	entry->mtime = e.mtime;
+	return 0;
+}
+
 int scar_index_iterator_next(
 	struct scar_index_iterator *it,
 	struct scar_index_entry *entry
 ) {
+	if (it->sidecar_sr) {
+		if (it->sidecar_next >= it->sidecar_sr->sidecar.entry_count) {
+			return 0;
+		}
+
+		if (reader_sidecar_entry(
+			it->sidecar_sr, it->sidecar_next, &it->buf, entry) < 0
+		) {
+			SCAR_ERETURN(-1);
+		}
+
+		it->sidecar_next += 1;
+		return 1;
+	}
+
 start:
 	if (it->br.next < '0' || it->br.next > '9') {
 		return 0;
@@ -485,7 +1582,8 @@ start:
 	}
 
 	if (ft == 'g') {
-		if (scar_pax_parse(&it->global, &it->br.r, remaining) < 0) {
+		// Entries we've already returned keep the old global metadata
+		if (scar_pax_parse_global(&it->global, &it->br.r, remaining) < 0) {
 			SCAR_ERETURN(-1);
 		}
 
@@ -523,27 +1621,140 @@ start:
 	}
 
 	entry->name = it->buf.buf;
-	entry->global = &it->global;
+	entry->global = &it->global->meta;
+	entry->shared_global = it->global;
 	it->next_offset = it->seeker->tell(it->seeker);
 	if (it->next_offset < 0) {
 		SCAR_ERETURN(-1);
 	}
 
+	if (iterator_read_meta(it, entry) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
 	return 1;
 }
 
 void scar_index_iterator_free(struct scar_index_iterator *it)
 {
-	it->comp->destroy_decompressor(it->decompressor);
+	scar_codec_pool_put_decompressor(it->codecs, it->decompressor);
+	scar_codec_pool_put_decompressor(it->codecs, it->meta_decompressor);
+
+	scar_meta_global_unref(it->global);
 	free(it->buf.buf);
 	free(it);
 }
 
+// Find an entry with a binary search of the sidecar's sorted entries.
+static int reader_find_entry_sidecar(
+	struct scar_reader *sr, const char *path, struct scar_index_entry *entry
+) {
+	// Find the first entry which sorts after 'path',
+	// so that the one before it is the last one with that path
+	uint64_t lo = 0;
+	uint64_t hi = sr->sidecar.entry_count;
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		uint64_t idx = scar_sidecar_get_sorted(&sr->sidecar, mid);
+		struct scar_sidecar_entry e;
+		if (
+			idx >= sr->sidecar.entry_count ||
+			scar_sidecar_get_entry(&sr->sidecar, idx, &e) < 0
+		) {
+			SCAR_ERETURN(-1);
+		}
+
+		if (strcmp(e.name, path) <= 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == 0) {
+		return 0;
+	}
+
+	uint64_t idx = scar_sidecar_get_sorted(&sr->sidecar, lo - 1);
+	if (reader_sidecar_entry(sr, idx, &sr->found_name, entry) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return strcmp(entry->name, path) == 0;
+}
+
+int scar_reader_find_entry(
+	struct scar_reader *sr, const char *path, struct scar_index_entry *entry
+) {
+	if (sr->has_sidecar) {
+		return reader_find_entry_sidecar(sr, path, entry);
+	}
+
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	if (!it) {
+		SCAR_ERETURN(-1);
+	}
+
+	int found = 0;
+	int ret;
+	struct scar_index_entry e;
+	while ((ret = scar_index_iterator_next(it, &e)) > 0) {
+		if (strcmp(e.name, path) != 0) {
+			continue;
+		}
+
+		sr->found_name.len = 0;
+		if (scar_mem_writer_write(
+			&sr->found_name.w, e.name, strlen(e.name) + 1) < 0
+		) {
+			ret = -1;
+			break;
+		}
+
+		scar_meta_global_unref(sr->found_global);
+		sr->found_global = scar_meta_global_ref(e.shared_global);
+		*entry = e;
+		entry->name = sr->found_name.buf;
+		found = 1;
+	}
+
+	scar_index_iterator_free(it);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return found;
+}
+
 int scar_reader_read_meta(
 	struct scar_reader *sr, scar_offset offset,
 	const struct scar_meta *global, struct scar_meta *meta
 ) {
-	if (reader_seek_to(sr, offset) < 0) {
+	return scar_cursor_read_meta(&sr->cursor, offset, global, meta);
+}
+
+int scar_reader_read_meta_arena(
+	struct scar_reader *sr, scar_offset offset,
+	const struct scar_meta *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena
+) {
+	return scar_cursor_read_meta_arena(
+		&sr->cursor, offset, global, meta, arena);
+}
+
+int scar_cursor_read_meta(
+	struct scar_cursor *c, scar_offset offset,
+	const struct scar_meta *global, struct scar_meta *meta
+) {
+	return scar_cursor_read_meta_arena(c, offset, global, meta, NULL);
+}
+
+int scar_cursor_read_meta_arena(
+	struct scar_cursor *c, scar_offset offset,
+	const struct scar_meta *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena
+) {
+	if (cursor_seek_to(c, offset) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
@@ -553,36 +1764,695 @@ int scar_reader_read_meta(
 	memcpy(&global2, global, sizeof(global2));
 
 	struct scar_counting_reader cr;
-	scar_counting_reader_init(&cr, &sr->current_decomp->r);
+	scar_counting_reader_init(&cr, c->body);
 
-	if (scar_pax_read_meta(&sr->current_decomp->r, &global2, meta) < 0) {
+	if (scar_pax_read_meta_arena(c->body, &global2, meta, arena) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
 	return 0;
 }
 
-int scar_reader_read_content(
-	struct scar_reader *sr, struct scar_io_writer *w, uint64_t size
+int scar_reader_read_meta_shared(
+	struct scar_reader *sr, scar_offset offset,
+	struct scar_meta_global *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena
 ) {
-	assert(sr->current_decomp);
+	return scar_cursor_read_meta_shared(
+		&sr->cursor, offset, global, meta, arena);
+}
 
-	struct scar_counting_reader cr;
-	scar_counting_reader_init(&cr, &sr->current_decomp->r);
+int scar_cursor_read_meta_shared(
+	struct scar_cursor *c, scar_offset offset,
+	struct scar_meta_global *global, struct scar_meta *meta,
+	struct scar_meta_arena *arena
+) {
+	if (cursor_seek_to(c, offset) < 0) {
+		SCAR_ERETURN(-1);
+	}
 
-	if (scar_pax_read_content(&cr.r, w, size) < 0) {
+	// A 'g' header replaces our reference with new global metadata,
+	// and leaves the caller's alone
+	struct scar_meta_global *g = scar_meta_global_ref(global);
+	int ret = scar_pax_read_meta_shared(c->body, &g, meta, arena);
+	scar_meta_global_unref(g);
+	if (ret < 0) {
 		SCAR_ERETURN(-1);
 	}
 
 	return 0;
 }
 
-void scar_reader_free(struct scar_reader *sr)
-{
-	if (sr->current_decomp) {
-		sr->comp.destroy_decompressor(sr->current_decomp);
+int scar_reader_read_content(
+	struct scar_reader *sr, struct scar_io_writer *w, uint64_t size
+) {
+	return scar_cursor_read_content(&sr->cursor, w, size);
+}
+
+// With plain compression, the tar body is stored as it is, so when
+// the cursor reads straight from a file, an entry's content can go
+// from the archive to 'w' in the kernel.
+// Returns 1 if the content was copied, 0 if it has to be read
+// the normal way, -1 on error.
+static int cursor_read_content_direct(
+	struct scar_cursor *c, struct scar_io_writer *w, uint64_t size
+) {
+	struct scar_reader *sr = c->sr;
+	if (
+		size == 0 || !scar_compression_is_plain(&sr->comp) ||
+		!sr->pr || sr->pr->read_at != scar_fd_preader_read_at ||
+		c->r != &c->ps.r || !c->decomp || c->body != &c->decomp->r
+	) {
+		return 0;
 	}
 
+	// The plain decompressor reads straight from the stream,
+	// so the stream's position is where the content starts
+	struct scar_io_preader *pr = sr->pr;
+	int fd = SCAR_BASE(struct scar_fd_preader, pr)->fd;
+	int ret = scar_io_copy_fd(fd, c->ps.pos, size, w);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	c->ps.pos += (scar_offset)((size + 511) / 512 * 512);
+	return 1;
+}
+
+int scar_cursor_read_content(
+	struct scar_cursor *c, struct scar_io_writer *w, uint64_t size
+) {
+	assert(c->body);
+
+	int ret = cursor_read_content_direct(c, w, size);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	} else if (ret > 0) {
+		return 0;
+	}
+
+	struct scar_counting_reader cr;
+	scar_counting_reader_init(&cr, c->body);
+
+	if (scar_pax_read_content(&cr.r, w, size) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+struct scar_compression *scar_reader_compression(struct scar_reader *sr)
+{
+	return &sr->comp;
+}
+
+struct scar_io_preader *scar_reader_preader(struct scar_reader *sr)
+{
+	return sr->pr;
+}
+
+void scar_reader_set_queue_depth(struct scar_reader *sr, unsigned int depth)
+{
+	sr->queue_depth = depth;
+}
+
+unsigned int scar_reader_queue_depth(struct scar_reader *sr)
+{
+	return sr->queue_depth;
+}
+
+void scar_reader_set_batch_bytes(struct scar_reader *sr, size_t bytes)
+{
+	sr->batch_bytes = bytes ? bytes : SCAR_DEFAULT_BATCH_BYTES;
+}
+
+size_t scar_reader_batch_bytes(struct scar_reader *sr)
+{
+	return sr->batch_bytes;
+}
+
+void scar_reader_set_parallel_inflate(
+	struct scar_reader *sr, unsigned int nthreads, size_t chunk_size
+) {
+	sr->inflate_threads = nthreads;
+	sr->inflate_chunk =
+		chunk_size ? chunk_size : SCAR_PARALLEL_INFLATE_DEFAULT_CHUNK;
+
+	// Cursors borrow the parallel inflater from the codec pool,
+	// so that there's only one set of threads however many there are
+	if (scar_compression_is_gzip(&sr->comp)) {
+		scar_codec_pool_set_parallel_inflate(
+			sr->codecs, nthreads, sr->inflate_chunk);
+	}
+}
+
+unsigned int scar_reader_parallel_inflate(
+	struct scar_reader *sr, size_t *chunk_size
+) {
+	if (chunk_size) {
+		*chunk_size = sr->inflate_chunk;
+	}
+
+	return sr->inflate_threads;
+}
+
+int scar_reader_set_page_cache(struct scar_reader *sr, size_t max_bytes)
+{
+	struct scar_page_cache *pc = NULL;
+	if (max_bytes > 0) {
+		pc = scar_page_cache_create(max_bytes);
+		if (!pc) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	if (sr->page_cache) {
+		scar_page_cache_free(sr->page_cache);
+	}
+
+	sr->page_cache = pc;
+	sr->cursor.body = NULL;
+	sr->cursor.decomp_pos = -1;
+	return 0;
+}
+
+void scar_reader_set_access_points(struct scar_reader *sr, scar_offset span)
+{
+	if (span <= 0) {
+		for (size_t i = 0; i < sr->apcount; ++i) {
+			free(sr->aps[i].window);
+		}
+
+		free(sr->aps);
+		sr->aps = NULL;
+		sr->apcount = 0;
+		sr->apcap = 0;
+		span = 0;
+	}
+
+	sr->ap_span = span;
+}
+
+size_t scar_reader_access_point_count(struct scar_reader *sr)
+{
+	pthread_mutex_lock(&sr->ap_mut);
+	size_t count = sr->apcount;
+	pthread_mutex_unlock(&sr->ap_mut);
+	return count;
+}
+
+int scar_reader_set_gzip_engine(
+	struct scar_reader *sr, enum scar_gzip_engine engine
+) {
+	if (!scar_compression_is_gzip(&sr->comp)) {
+		return 0;
+	}
+
+	// Decompressors which are already out keep their engine
+	// until they're reset
+	if (!scar_compression_init_gzip_engine(&sr->comp, engine)) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+void scar_reader_page_cache_stats(
+	struct scar_reader *sr, struct scar_page_cache_stats *stats
+) {
+	if (!sr->page_cache) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	scar_page_cache_get_stats(sr->page_cache, stats);
+}
+
+scar_ssize scar_reader_segment_count(struct scar_reader *sr)
+{
+	return (scar_ssize)sr->checkpointcount + 1;
+}
+
+int scar_reader_get_segment(
+	struct scar_reader *sr, size_t idx, struct scar_segment *seg
+) {
+	if (idx > sr->checkpointcount) {
+		SCAR_ERETURN(-1);
+	}
+
+	// Segment 0 starts at the implicit checkpoint at the start of the file,
+	// segment N starts at checkpoint N - 1 in the checkpoints section
+	if (idx == 0) {
+		seg->compressed_start = 0;
+		seg->uncompressed_start = 0;
+	} else {
+		seg->compressed_start = sr->checkpoints[idx - 1].compressed;
+		seg->uncompressed_start = sr->checkpoints[idx - 1].uncompressed;
+	}
+
+	if (idx < sr->checkpointcount) {
+		seg->compressed_end = sr->checkpoints[idx].compressed;
+		seg->uncompressed_end = sr->checkpoints[idx].uncompressed;
+	} else {
+		seg->compressed_end = sr->body_end_offset;
+		seg->uncompressed_end = sr->body_end_uncompressed;
+	}
+
+	return 0;
+}
+
+// Find where the footer section which starts at 'start' ends,
+// which is wherever the next section starts.
+static scar_offset reader_section_end(
+	struct scar_reader *sr, scar_offset start
+) {
+	scar_offset end = sr->tail_offset;
+	if (sr->index_offset > start && sr->index_offset < end) {
+		end = sr->index_offset;
+	}
+
+	if (sr->checkpoints_offset > start && sr->checkpoints_offset < end) {
+		end = sr->checkpoints_offset;
+	}
+
+	for (size_t i = 0; i < sr->sectioncount; ++i) {
+		scar_offset offset = sr->sections[i].offset;
+		if (offset > start && offset < end) {
+			end = offset;
+		}
+	}
+
+	return end;
+}
+
+int scar_reader_find_section(
+	struct scar_reader *sr, const char *name, struct scar_segment *seg
+) {
+	seg->uncompressed_start = -1;
+	seg->uncompressed_end = -1;
+
+	if (strcmp(name, "SCAR-INDEX") == 0) {
+		seg->compressed_start = sr->index_offset;
+	} else if (strcmp(name, "SCAR-CHECKPOINTS") == 0) {
+		seg->compressed_start = sr->checkpoints_offset;
+	} else {
+		size_t i;
+		for (i = 0; i < sr->sectioncount; ++i) {
+			if (strcmp(name, sr->sections[i].name) == 0) {
+				break;
+			}
+		}
+
+		if (i == sr->sectioncount) {
+			return 0;
+		}
+
+		seg->compressed_start = sr->sections[i].offset;
+	}
+
+	seg->compressed_end = reader_section_end(sr, seg->compressed_start);
+	return 1;
+}
+
+size_t scar_reader_extension_count(struct scar_reader *sr)
+{
+	return sr->sectioncount;
+}
+
+int scar_reader_get_extension(
+	struct scar_reader *sr, size_t idx,
+	const char **name, struct scar_segment *seg
+) {
+	if (idx >= sr->sectioncount) {
+		SCAR_ERETURN(-1);
+	}
+
+	*name = sr->sections[idx].name;
+	seg->compressed_start = sr->sections[idx].offset;
+	seg->compressed_end = reader_section_end(sr, seg->compressed_start);
+	seg->uncompressed_start = -1;
+	seg->uncompressed_end = -1;
+	return 0;
+}
+
+// Parse a line from the SCAR-CHECKSUMS section ("<offset> <crc>").
+static int parse_checksum_line(char *line, struct segment_checksum *sum)
+{
+	char *sep = strchr(line, ' ');
+	if (!sep) {
+		SCAR_ERETURN(-1);
+	}
+
+	*sep = '\0';
+	char *endptr = NULL;
+	sum->uncompressed = strtoll(line, &endptr, 10);
+	if (*endptr != '\0' || endptr == line) {
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned long crc = strtoul(sep + 1, &endptr, 16);
+	if (*endptr != '\0' || endptr == sep + 1) {
+		SCAR_ERETURN(-1);
+	}
+
+	sum->crc = (uint32_t)crc;
+	return 0;
+}
+
+// Returns 1 if the checksums were loaded, 0 if the archive
+// doesn't have any (that we understand), -1 on error.
+// Must be called with 'lazy_mut' held.
+static int reader_load_checksums(struct scar_cursor *c)
+{
+	struct scar_reader *sr = c->sr;
+	if (sr->has_checksums) {
+		return 1;
+	}
+
+	struct scar_segment seg;
+	if (!scar_reader_find_section(sr, "SCAR-CHECKSUMS", &seg)) {
+		return 0;
+	}
+
+	if (c->s->seek(c->s, seg.compressed_start, SCAR_SEEK_START) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	// The decompressor mustn't read past the end of the section,
+	// since that's not necessarily where the compressed stream ends
+	struct scar_limited_reader lr;
+	scar_limited_reader_init(
+		&lr, c->r, seg.compressed_end - seg.compressed_start);
+
+	struct scar_decompressor *decomp = scar_codec_pool_get_decompressor(
+		sr->codecs, &lr.r, NULL, NULL);
+	if (!decomp) {
+		SCAR_ERETURN(-1);
+	}
+
+	int ret = 1;
+	struct scar_block_reader br;
+	scar_block_reader_init(&br, &decomp->r);
+
+	char line[64];
+	scar_block_reader_read_line(&br, line, sizeof(line));
+	if (strcmp(line, "SCAR-CHECKSUMS") != 0) {
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		SCAR_ERETURN(-1);
+	}
+
+	// Unknown checksum algorithms are treated as if there are no checksums
+	scar_block_reader_read_line(&br, line, sizeof(line));
+	if (strcmp(line, "crc32c") != 0) {
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		return 0;
+	}
+
+	while (true) {
+		scar_ssize len = scar_block_reader_read_line(&br, line, sizeof(line));
+		if (br.error) {
+			SCAR_ELOG();
+			ret = -1;
+			break;
+		}
+
+		if (len == 0) {
+			break;
+		}
+
+		struct segment_checksum sum;
+		if (parse_checksum_line(line, &sum) < 0) {
+			SCAR_ELOG();
+			ret = -1;
+			break;
+		}
+
+		void *new_alloc = realloc(
+			sr->checksums, (sr->checksumcount + 1) * sizeof(*sr->checksums));
+		if (!new_alloc) {
+			SCAR_ELOG();
+			ret = -1;
+			break;
+		}
+
+		sr->checksums = new_alloc;
+		sr->checksums[sr->checksumcount++] = sum;
+	}
+
+	if (ret < 0) {
+		free(sr->checksums);
+		sr->checksums = NULL;
+		sr->checksumcount = 0;
+	} else {
+		sr->has_checksums = true;
+	}
+
+	scar_codec_pool_put_decompressor(sr->codecs, decomp);
+	return ret;
+}
+
+static int cursor_ensure_checksums(struct scar_cursor *c)
+{
+	pthread_mutex_lock(&c->sr->lazy_mut);
+	int ret = reader_load_checksums(c);
+	pthread_mutex_unlock(&c->sr->lazy_mut);
+	return ret;
+}
+
+int scar_reader_segment_checksum(
+	struct scar_reader *sr, size_t idx, uint32_t *crc
+) {
+	return scar_cursor_segment_checksum(&sr->cursor, idx, crc);
+}
+
+int scar_cursor_segment_checksum(
+	struct scar_cursor *c, size_t idx, uint32_t *crc
+) {
+	struct scar_reader *sr = c->sr;
+	int ret = cursor_ensure_checksums(c);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	struct scar_segment seg;
+	if (scar_reader_get_segment(sr, idx, &seg) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	// There's one checksum per segment, in order
+	if (
+		idx >= sr->checksumcount ||
+		sr->checksums[idx].uncompressed != seg.uncompressed_start
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	*crc = sr->checksums[idx].crc;
+	return 1;
+}
+
+// Returns 1 if the Bloom filter was loaded, 0 if the archive
+// doesn't have one, -1 on error.
+// Must be called with 'lazy_mut' held.
+static int reader_load_bloom(struct scar_cursor *c)
+{
+	struct scar_reader *sr = c->sr;
+	if (sr->has_bloom) {
+		return 1;
+	}
+
+	struct scar_segment seg;
+	if (!scar_reader_find_section(sr, "SCAR-BLOOM", &seg)) {
+		return 0;
+	}
+
+	if (c->s->seek(c->s, seg.compressed_start, SCAR_SEEK_START) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	struct scar_limited_reader lr;
+	scar_limited_reader_init(
+		&lr, c->r, seg.compressed_end - seg.compressed_start);
+
+	struct scar_decompressor *decomp = scar_codec_pool_get_decompressor(
+		sr->codecs, &lr.r, NULL, NULL);
+	if (!decomp) {
+		SCAR_ERETURN(-1);
+	}
+
+	struct scar_block_reader br;
+	scar_block_reader_init(&br, &decomp->r);
+
+	char line[64];
+	scar_block_reader_read_line(&br, line, sizeof(line));
+	if (strcmp(line, "SCAR-BLOOM") != 0) {
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		SCAR_ERETURN(-1);
+	}
+
+	// "<hashes> <nbits>"
+	scar_block_reader_read_line(&br, line, sizeof(line));
+	char *endptr = NULL;
+	unsigned long hashes = strtoul(line, &endptr, 10);
+	if (*endptr != ' ' || hashes == 0 || hashes > 64) {
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		SCAR_ERETURN(-1);
+	}
+
+	char *nbitsstr = endptr + 1;
+	unsigned long long nbits = strtoull(nbitsstr, &endptr, 10);
+	if (
+		*endptr != '\0' || endptr == nbitsstr ||
+		nbits == 0 || nbits % 8 != 0 || nbits / 8 > SIZE_MAX
+	) {
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		SCAR_ERETURN(-1);
+	}
+
+	size_t nbytes = (size_t)(nbits / 8);
+	unsigned char *bits = malloc(nbytes);
+	if (!bits) {
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		SCAR_ERETURN(-1);
+	}
+
+	if (scar_block_reader_read(&br.r, bits, nbytes) < (scar_ssize)nbytes) {
+		free(bits);
+		scar_codec_pool_put_decompressor(sr->codecs, decomp);
+		SCAR_ERETURN(-1);
+	}
+
+	scar_codec_pool_put_decompressor(sr->codecs, decomp);
+
+	sr->bloom_hashes = (unsigned int)hashes;
+	sr->bloom_nbits = (uint64_t)nbits;
+	sr->bloom_bits = bits;
+	sr->has_bloom = true;
+	return 1;
+}
+
+static int cursor_ensure_bloom(struct scar_cursor *c)
+{
+	pthread_mutex_lock(&c->sr->lazy_mut);
+	int ret = reader_load_bloom(c);
+	pthread_mutex_unlock(&c->sr->lazy_mut);
+	return ret;
+}
+
+int scar_reader_may_contain(struct scar_reader *sr, const char *path)
+{
+	return scar_cursor_may_contain(&sr->cursor, path);
+}
+
+int scar_cursor_may_contain(struct scar_cursor *c, const char *path)
+{
+	struct scar_reader *sr = c->sr;
+	int ret = cursor_ensure_bloom(c);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	} else if (ret == 0) {
+		// Without a filter, we can't rule anything out
+		return 1;
+	}
+
+	uint64_t hash = scar_bloom_hash(path);
+	for (unsigned int i = 0; i < sr->bloom_hashes; ++i) {
+		uint64_t bit = scar_bloom_bit(hash, i, sr->bloom_nbits);
+		if (!(sr->bloom_bits[bit / 8] & (1u << (bit % 8)))) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int scar_reader_read_compressed(
+	struct scar_reader *sr, const struct scar_segment *seg, void *buf
+) {
+	return scar_cursor_read_compressed(&sr->cursor, seg, buf);
+}
+
+int scar_cursor_read_compressed(
+	struct scar_cursor *c, const struct scar_segment *seg, void *buf
+) {
+	scar_offset len = seg->compressed_end - seg->compressed_start;
+	if (len < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (c->s->seek(c->s, seg->compressed_start, SCAR_SEEK_START) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (c->r->read(c->r, buf, (size_t)len) < len) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+struct scar_cursor *scar_cursor_create(
+	struct scar_reader *sr, struct scar_io_reader *r, struct scar_io_seeker *s
+) {
+	struct scar_cursor *c = malloc(sizeof(*c));
+	if (!c) {
+		SCAR_ERETURN(NULL);
+	}
+
+	cursor_init(c, sr, r, s);
+	return c;
+}
+
+struct scar_cursor *scar_cursor_create_p(struct scar_reader *sr)
+{
+	if (!sr->pr) {
+		SCAR_ERETURN(NULL);
+	}
+
+	struct scar_cursor *c = malloc(sizeof(*c));
+	if (!c) {
+		SCAR_ERETURN(NULL);
+	}
+
+	if (sr->footer.buf) {
+		scar_preader_stream_init(&c->ps, &sr->footer.pr);
+	} else {
+		scar_preader_stream_init(&c->ps, sr->pr);
+	}
+	cursor_init(c, sr, &c->ps.r, &c->ps.s);
+	return c;
+}
+
+void scar_cursor_free(struct scar_cursor *c)
+{
+	cursor_put_decompressor(c);
+	free(c->ap_window);
+
+	free(c);
+}
+
+void scar_reader_free(struct scar_reader *sr)
+{
+	cursor_put_decompressor(&sr->cursor);
+	free(sr->cursor.ap_window);
+	scar_codec_pool_free(sr->codecs);
+
+	if (sr->page_cache) {
+		scar_page_cache_free(sr->page_cache);
+	}
+
+	scar_reader_set_access_points(sr, 0);
+	pthread_mutex_destroy(&sr->ap_mut);
+	pthread_mutex_destroy(&sr->lazy_mut);
+
 	free(sr->checkpoints);
+	if (sr->has_sidecar) {
+		free_globals(sr->sidecar_globals, sr->sidecar.global_count);
+	}
+	free(sr->found_name.buf);
+	scar_meta_global_unref(sr->found_global);
+	free(sr->checksums);
+	free(sr->bloom_bits);
+	free(sr->footer.buf);
 	free(sr);
 }
@@ -1,29 +1,65 @@
 #include "scar-writer.h"
 
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "bloom.h"
+#include "footer.h"
 #include "ioutil.h"
 #include "internal-util.h"
 #include "pax.h"
 
 struct scar_writer {
 	int clevel;
+	int opts;
 	struct scar_compression *comp;
 	scar_offset last_checkpoint_uncompressed_offset;
 
 	struct scar_counting_writer compressed_writer;
 	struct scar_compressor *compressor;
+	struct scar_crc32c_writer checksum_writer;
 	struct scar_counting_writer uncompressed_writer;
 
-	struct scar_mem_writer index_buf;
+	// Uncompressed contents of the SCAR-CHECKSUMS section,
+	// only used with SCAR_WRITER_CHECKSUMS
+	struct scar_mem_writer checksums_buf;
+
+	// The compressed index, checkpoints and SCAR-META sections grow
+	// with the number of entries, so they spill to disk once they get big
+	struct scar_spill_writer index_buf;
 	struct scar_compressor *index_compressor;
 
-	struct scar_mem_writer checkpoints_buf;
+	// Compressed SCAR-META section, only used with SCAR_WRITER_META
+	struct scar_spill_writer meta_buf;
+	struct scar_compressor *meta_compressor;
+
+	// Hashes of every path, only used with SCAR_WRITER_BLOOM.
+	// The filter is sized once we know how many paths there are.
+	uint64_t *bloom_hashes;
+	size_t bloom_count;
+	size_t bloom_cap;
+
+	struct scar_spill_writer checkpoints_buf;
 	struct scar_compressor *checkpoints_compressor;
+
+	// Reused for every entry's index line and pax extended header,
+	// so that the per-entry write path doesn't allocate
+	// once it has grown to fit the longest path
+	struct scar_mem_writer scratch;
 };
 
 struct scar_writer *scar_writer_create(
 	struct scar_io_writer *w, struct scar_compression *comp, int clevel)
+{
+	return scar_writer_create_opts(w, comp, clevel, 0);
+}
+
+struct scar_writer *scar_writer_create_opts(
+	struct scar_io_writer *w, struct scar_compression *comp, int clevel,
+	int opts)
 {
 	struct scar_writer *sw = malloc(sizeof(*sw));
 	if (!sw) {
@@ -31,8 +67,10 @@ struct scar_writer *scar_writer_create(
 	}
 
 	sw->clevel = clevel;
+	sw->opts = opts;
 	sw->comp = comp;
 	sw->last_checkpoint_uncompressed_offset = 0;
+	scar_mem_writer_init(&sw->scratch);
 
 	scar_counting_writer_init(&sw->compressed_writer, w);
 	sw->compressor =
@@ -41,13 +79,32 @@ struct scar_writer *scar_writer_create(
 		free(sw);
 		SCAR_ERETURN(NULL);
 	}
-	scar_counting_writer_init(&sw->uncompressed_writer, &sw->compressor->w);
 
-	scar_mem_writer_init(&sw->index_buf);
+	// The checksum writer sits between the counting writer
+	// and the compressor, so that it sees all the uncompressed data
+	scar_mem_writer_init(&sw->checksums_buf);
+	if (opts & SCAR_WRITER_CHECKSUMS) {
+		scar_crc32c_writer_init(&sw->checksum_writer, &sw->compressor->w);
+		scar_counting_writer_init(
+			&sw->uncompressed_writer, &sw->checksum_writer.w);
+
+		if (scar_io_puts(&sw->checksums_buf.w, "SCAR-CHECKSUMS\ncrc32c\n") < 0) {
+			comp->destroy_compressor(sw->compressor);
+			free(sw->checksums_buf.buf);
+			free(sw);
+			SCAR_ERETURN(NULL);
+		}
+	} else {
+		scar_counting_writer_init(
+			&sw->uncompressed_writer, &sw->compressor->w);
+	}
+
+	scar_spill_writer_init(&sw->index_buf, 0);
 	sw->index_compressor =
 		sw->comp->create_compressor(&sw->index_buf.w, clevel);
 	if (!sw->index_compressor) {
 		comp->destroy_compressor(sw->compressor);
+		free(sw->checksums_buf.buf);
 		free(sw);
 		SCAR_ERETURN(NULL);
 	}
@@ -55,16 +112,18 @@ struct scar_writer *scar_writer_create(
 	if (scar_io_printf(&sw->index_compressor->w, "SCAR-INDEX\n") < 0) {
 		comp->destroy_compressor(sw->compressor);
 		comp->destroy_compressor(sw->index_compressor);
+		free(sw->checksums_buf.buf);
 		free(sw);
 		SCAR_ERETURN(NULL);
 	}
 
-	scar_mem_writer_init(&sw->checkpoints_buf);
+	scar_spill_writer_init(&sw->checkpoints_buf, 0);
 	sw->checkpoints_compressor = sw->comp->create_compressor(
 		&sw->checkpoints_buf.w, clevel);
 	if (!sw->checkpoints_compressor) {
 		comp->destroy_compressor(sw->compressor);
 		comp->destroy_compressor(sw->index_compressor);
+		free(sw->checksums_buf.buf);
 		free(sw);
 		SCAR_ERETURN(NULL);
 	}
@@ -75,15 +134,56 @@ struct scar_writer *scar_writer_create(
 		comp->destroy_compressor(sw->compressor);
 		comp->destroy_compressor(sw->index_compressor);
 		comp->destroy_compressor(sw->checkpoints_compressor);
+		free(sw->checksums_buf.buf);
 		free(sw);
 		SCAR_ERETURN(NULL);
 	}
 
+	sw->bloom_hashes = NULL;
+	sw->bloom_count = 0;
+	sw->bloom_cap = 0;
+
+	scar_spill_writer_init(&sw->meta_buf, 0);
+	sw->meta_compressor = NULL;
+	if (opts & SCAR_WRITER_META) {
+		sw->meta_compressor = sw->comp->create_compressor(
+			&sw->meta_buf.w, clevel);
+		if (
+			!sw->meta_compressor ||
+			scar_io_printf(&sw->meta_compressor->w, "SCAR-META\n") < 0
+		) {
+			scar_writer_free(sw);
+			SCAR_ERETURN(NULL);
+		}
+	}
+
 	return sw;
 }
 
+// Record the checksum of the segment which started at the last checkpoint.
+static int finish_segment_checksum(struct scar_writer *sw)
+{
+	if (!(sw->opts & SCAR_WRITER_CHECKSUMS)) {
+		return 0;
+	}
+
+	scar_ssize ret = scar_io_printf(
+		&sw->checksums_buf.w, "%lld %08" PRIx32 "\n",
+		sw->last_checkpoint_uncompressed_offset, sw->checksum_writer.crc);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	sw->checksum_writer.crc = 0;
+	return 0;
+}
+
 static int create_checkpoint(struct scar_writer *sw)
 {
+	if (finish_segment_checksum(sw) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
 	if (sw->compressor->flush(sw->compressor) < 0) {
 		SCAR_ERETURN(-1);
 	}
@@ -102,6 +202,207 @@ static int create_checkpoint(struct scar_writer *sw)
 	return 0;
 }
 
+// The most characters format_meta_time can write
+#define META_TIME_MAX 64
+
+// Format a meta value with 'format', or as '-' if it's missing.
+static size_t format_meta_uint(
+	char *buf, int present, uint64_t val,
+	size_t (*format)(char *buf, uint64_t num)
+) {
+	if (!present) {
+		buf[0] = '-';
+		return 1;
+	}
+
+	return format(buf, val);
+}
+
+static size_t format_meta_time(char *buf, double val)
+{
+	if (!SCAR_META_IS_FLOAT(val)) {
+		buf[0] = '-';
+		return 1;
+	}
+
+	// Whole, non-negative times are by far the most common,
+	// and don't need printf
+	if (
+		val == floor(val) && !signbit(val) &&
+		val < 9223372036854775808.0
+	) {
+		return scar_format_i64(buf, (int64_t)val);
+	}
+
+	// Otherwise, only keep the fractional part if there is one,
+	// and then without trailing zeroes
+	int n;
+	if (val == floor(val)) {
+		n = snprintf(buf, META_TIME_MAX, "%.0f", val);
+	} else {
+		n = snprintf(buf, META_TIME_MAX, "%.9f", val);
+	}
+
+	if (n < 0) {
+		n = 0;
+	} else if (n > META_TIME_MAX - 1) {
+		n = META_TIME_MAX - 1;
+	}
+
+	size_t len = (size_t)n;
+	if (val != floor(val)) {
+		while (len > 0 && buf[len - 1] == '0') {
+			len -= 1;
+		}
+	}
+
+	return len;
+}
+
+// Write the SCAR-META line for an entry:
+// "<offset> <mode> <size> <mtime>\n"
+static int write_meta_line(
+	struct scar_writer *sw, struct scar_meta *meta, scar_offset offset
+) {
+	if (!sw->meta_compressor) {
+		return 0;
+	}
+
+	char line[3 * (SCAR_FORMAT_MAX + 1) + META_TIME_MAX + 1];
+	char *ptr = line;
+	ptr += scar_format_i64(ptr, offset);
+	*(ptr++) = ' ';
+	ptr += format_meta_uint(
+		ptr, SCAR_META_HAS_MODE(meta), meta->mode, scar_format_octal);
+	*(ptr++) = ' ';
+	ptr += format_meta_uint(
+		ptr, SCAR_META_HAS_SIZE(meta), meta->size, scar_format_u64);
+	*(ptr++) = ' ';
+	ptr += format_meta_time(ptr, meta->mtime);
+	*(ptr++) = '\n';
+
+	struct scar_io_writer *w = &sw->meta_compressor->w;
+	size_t len = (size_t)(ptr - line);
+	if (w->write(w, line, len) < (scar_ssize)len) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+static int add_bloom_path(struct scar_writer *sw, const char *path)
+{
+	if (!(sw->opts & SCAR_WRITER_BLOOM)) {
+		return 0;
+	}
+
+	if (sw->bloom_count == sw->bloom_cap) {
+		size_t newcap = sw->bloom_cap == 0 ? 64 : sw->bloom_cap * 2;
+		uint64_t *newhashes = realloc(
+			sw->bloom_hashes, newcap * sizeof(*newhashes));
+		if (!newhashes) {
+			SCAR_ERETURN(-1);
+		}
+
+		sw->bloom_hashes = newhashes;
+		sw->bloom_cap = newcap;
+	}
+
+	sw->bloom_hashes[sw->bloom_count++] = scar_bloom_hash(path);
+	return 0;
+}
+
+// Build the SCAR-BLOOM section: "SCAR-BLOOM\n<k> <nbits>\n" followed by
+// the filter's bits, least significant bit first.
+static int write_bloom_section(struct scar_writer *sw)
+{
+	uint64_t nbits = (uint64_t)sw->bloom_count * SCAR_BLOOM_BITS_PER_PATH;
+	if (nbits < 64) {
+		nbits = 64;
+	}
+	nbits = (nbits + 7) & ~(uint64_t)7;
+
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	if (scar_io_printf(
+		&mw.w, "SCAR-BLOOM\n%d %" PRIu64 "\n", SCAR_BLOOM_HASHES, nbits) < 0
+	) {
+		free(mw.buf);
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned char *bits = scar_mem_writer_get_buffer(&mw, (size_t)(nbits / 8));
+	if (!bits) {
+		free(mw.buf);
+		SCAR_ERETURN(-1);
+	}
+	memset(bits, 0, (size_t)(nbits / 8));
+
+	for (size_t i = 0; i < sw->bloom_count; ++i) {
+		for (unsigned int k = 0; k < SCAR_BLOOM_HASHES; ++k) {
+			uint64_t bit = scar_bloom_bit(sw->bloom_hashes[i], k, nbits);
+			bits[bit / 8] |= (unsigned char)(1u << (bit % 8));
+		}
+	}
+
+	int ret = scar_footer_write_section(
+		&sw->compressed_writer.w, sw->comp, sw->clevel,
+		mw.buf, mw.len);
+	free(mw.buf);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+// With plain compression, the body is written as it is, so an entry's
+// content can go straight from a source file to the output file
+// in the kernel. That doesn't work with segment checksums,
+// which have to see the data.
+// Returns 1 if the content was written, 0 if it has to be written
+// the normal way, -1 on error.
+static int write_content_direct(
+	struct scar_writer *sw, struct scar_io_reader *r, uint64_t size
+) {
+	if (
+		size == 0 || !scar_compression_is_plain(sw->comp) ||
+		(sw->opts & SCAR_WRITER_CHECKSUMS)
+	) {
+		return 0;
+	}
+
+	int ret = scar_file_handle_copy_to(
+		r, sw->compressed_writer.backing_w, size);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	sw->compressed_writer.count += (scar_offset)size;
+	sw->uncompressed_writer.count += (scar_offset)size;
+
+	// The padding goes through the normal path. The reader's own padding
+	// is read too, as scar_pax_write_content would, in case it's
+	// a tar stream.
+	unsigned char block[512];
+	size_t pad = (512 - size % 512) % 512;
+	if (pad == 0) {
+		return 1;
+	}
+
+	if (scar_io_read_full(r, block, pad) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	memset(block, 0, pad);
+	struct scar_io_writer *w = &sw->uncompressed_writer.w;
+	if (w->write(w, block, pad) < (scar_ssize)pad) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 1;
+}
+
 int scar_writer_write_entry(
 	struct scar_writer *sw, struct scar_meta *meta,
 	struct scar_io_reader *r
@@ -119,53 +420,134 @@ int scar_writer_write_entry(
 		}
 	}
 
-	struct scar_mem_writer entry_buf;
-	scar_mem_writer_init(&entry_buf);
-
-	ret = scar_io_printf(
-		&entry_buf.w, "%c %lld %s\n", scar_meta_filetype_to_char(meta->type),
-		sw->uncompressed_writer.count, meta->path);
-	if (ret < 0) {
-		free(entry_buf.buf);
+	// Build "<type> <offset> <path>\n" in the scratch buffer
+	size_t pathlen = strlen(meta->path);
+	sw->scratch.len = 0;
+	char *line = scar_mem_writer_get_buffer(
+		&sw->scratch, SCAR_FORMAT_MAX + pathlen + 4);
+	if (!line) {
 		SCAR_ERETURN(-1);
 	}
 
-	size_t fieldsize = 1 + entry_buf.len;
+	char *ptr = line;
+	*(ptr++) = scar_meta_filetype_to_char(meta->type);
+	*(ptr++) = ' ';
+	ptr += scar_format_i64(ptr, sw->uncompressed_writer.count);
+	*(ptr++) = ' ';
+	memcpy(ptr, meta->path, pathlen);
+	ptr += pathlen;
+	*(ptr++) = '\n';
+	size_t linelen = (size_t)(ptr - line);
+
+	size_t fieldsize = 1 + linelen;
 	size_t fieldsizelen = log10_ceil(fieldsize);
 	if (log10_ceil(fieldsize + fieldsizelen) > fieldsizelen) {
 		fieldsizelen += 1;
 	}
 	fieldsize += fieldsizelen;
 
-	ret = scar_io_printf(&sw->index_compressor->w, "%zu ", fieldsize);
-	if (ret < 0) {
-		free(entry_buf.buf);
+	char prefix[SCAR_FORMAT_MAX + 1];
+	size_t prefixlen = scar_format_u64(prefix, fieldsize);
+	prefix[prefixlen++] = ' ';
+
+	struct scar_io_writer *iw = &sw->index_compressor->w;
+	if (
+		iw->write(iw, prefix, prefixlen) < (scar_ssize)prefixlen ||
+		iw->write(iw, line, linelen) < (scar_ssize)linelen
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (write_meta_line(sw, meta, sw->uncompressed_writer.count) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (add_bloom_path(sw, meta->path) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	ret = sw->index_compressor->w.write(
-		&sw->index_compressor->w, entry_buf.buf, entry_buf.len);
-	if (ret < (scar_ssize)entry_buf.len) {
-		free(entry_buf.buf);
+	struct scar_io_writer *w = &sw->uncompressed_writer.w;
+	if (scar_pax_write_meta_scratch(meta, w, &sw->scratch) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	free(entry_buf.buf);
+	if (!~meta->size) {
+		return 0;
+	}
+
+	ret = write_content_direct(sw, r, meta->size);
+	if (ret < 0) {
+		SCAR_ERETURN(-1);
+	} else if (ret > 0) {
+		return 0;
+	}
 
-	return scar_pax_write_entry(meta, r, &sw->uncompressed_writer.w);
+	return scar_pax_write_content(r, w, meta->size);
 }
 
 int scar_writer_finish(struct scar_writer *sw)
 {
-	scar_ssize ret;
 	if (scar_pax_write_end(&sw->uncompressed_writer.w) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
+	if (finish_segment_checksum(sw) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
 	if (sw->compressor->finish(sw->compressor) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
+	// Extension sections go between the tar body and the index,
+	// where readers which don't know about them will never look
+	struct scar_footer_section sections[SCAR_FOOTER_MAX_SECTIONS];
+	size_t nsections = 0;
+
+	if (sw->opts & SCAR_WRITER_CHECKSUMS) {
+		sections[nsections].name = "SCAR-CHECKSUMS";
+		sections[nsections].offset = sw->compressed_writer.count;
+		nsections += 1;
+
+		if (scar_footer_write_section(
+			&sw->compressed_writer.w, sw->comp, sw->clevel,
+			sw->checksums_buf.buf, sw->checksums_buf.len) < 0
+		) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	// The SCAR-META section has been compressed as we went,
+	// like the index
+	if (sw->meta_compressor) {
+		if (sw->meta_compressor->finish(sw->meta_compressor) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		sections[nsections].name = "SCAR-META";
+		sections[nsections].offset = sw->compressed_writer.count;
+		nsections += 1;
+
+		// Bypass the counting writer, so that the copy can go
+		// straight from file to file
+		if (scar_spill_writer_copy_to(
+			&sw->meta_buf, sw->compressed_writer.backing_w) < 0
+		) {
+			SCAR_ERETURN(-1);
+		}
+		sw->compressed_writer.count += sw->meta_buf.len;
+	}
+
+	if (sw->opts & SCAR_WRITER_BLOOM) {
+		sections[nsections].name = "SCAR-BLOOM";
+		sections[nsections].offset = sw->compressed_writer.count;
+		nsections += 1;
+
+		if (write_bloom_section(sw) < 0) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
 	if (sw->index_compressor->finish(sw->index_compressor) < 0) {
 		SCAR_ERETURN(-1);
 	}
@@ -176,58 +558,52 @@ int scar_writer_finish(struct scar_writer *sw)
 
 	scar_offset index_compressed_offset = sw->compressed_writer.count;
 	scar_offset checkpoints_compressed_offset =
-		index_compressed_offset + (scar_offset)sw->index_buf.len;
+		index_compressed_offset + sw->index_buf.len;
 
 	// We don't need to count anymore,
 	// so we'll just directly use the backing writer
 	// for the compressed stream from now on
 	struct scar_io_writer *w = sw->compressed_writer.backing_w;
 
-	ret = w->write(w, sw->index_buf.buf, sw->index_buf.len);
-	if (ret < (scar_offset)sw->index_buf.len) {
-		SCAR_ERETURN(-1);
-	}
-
-	ret = w->write(w, sw->checkpoints_buf.buf, sw->checkpoints_buf.len);
-	if (ret < (scar_offset)sw->checkpoints_buf.len) {
-		SCAR_ERETURN(-1);
-	}
-
-	// We need one final compressor to write the tail
-	struct scar_compressor *tail_compressor = sw->comp->create_compressor(w, sw->clevel);
-	if (tail_compressor == NULL) {
+	if (scar_spill_writer_copy_to(&sw->index_buf, w) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	ret = scar_io_printf(
-		&tail_compressor->w, "SCAR-TAIL\n%lld\n%lld\n",
-		index_compressed_offset, checkpoints_compressed_offset);
-	if (ret < 0) {
-		sw->comp->destroy_compressor(tail_compressor);
+	if (scar_spill_writer_copy_to(&sw->checkpoints_buf, w) < 0) {
 		SCAR_ERETURN(-1);
 	}
 
-	if (tail_compressor->finish(tail_compressor) < 0) {
-		sw->comp->destroy_compressor(tail_compressor);
-		SCAR_ERETURN(-1);
-	}
-
-	sw->comp->destroy_compressor(tail_compressor);
-
-	ret = w->write(w, sw->comp->eof_marker, sw->comp->eof_marker_len);
-	if (ret < (scar_offset)sw->comp->eof_marker_len) {
+	if (scar_footer_write_tail(
+		w, sw->comp, sw->clevel,
+		index_compressed_offset, checkpoints_compressed_offset,
+		sections, nsections) < 0
+	) {
 		SCAR_ERETURN(-1);
 	}
 
 	return 0;
 }
 
+void scar_writer_set_spill_threshold(struct scar_writer *sw, size_t threshold)
+{
+	sw->index_buf.threshold = threshold;
+	sw->checkpoints_buf.threshold = threshold;
+	sw->meta_buf.threshold = threshold;
+}
+
 void scar_writer_free(struct scar_writer *sw)
 {
 	sw->comp->destroy_compressor(sw->compressor);
 	sw->comp->destroy_compressor(sw->index_compressor);
 	sw->comp->destroy_compressor(sw->checkpoints_compressor);
-	free(sw->index_buf.buf);
-	free(sw->checkpoints_buf.buf);
+	if (sw->meta_compressor) {
+		sw->comp->destroy_compressor(sw->meta_compressor);
+	}
+	scar_spill_writer_destroy(&sw->index_buf);
+	scar_spill_writer_destroy(&sw->checkpoints_buf);
+	free(sw->checksums_buf.buf);
+	scar_spill_writer_destroy(&sw->meta_buf);
+	free(sw->bloom_hashes);
+	free(sw->scratch.buf);
 	free(sw);
 }
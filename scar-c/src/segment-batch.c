@@ -0,0 +1,253 @@
+#include "segment-batch.h"
+
+#include <stdlib.h>
+
+#include "internal-util.h"
+
+struct scar_io_reader *scar_segment_job_reader(struct scar_segment_job *job)
+{
+	if (!job->in) {
+		return &job->limited.r;
+	}
+
+	size_t len = (size_t)(job->seg.compressed_end - job->seg.compressed_start);
+	scar_mem_reader_init(&job->mem, job->in, len);
+	return &job->mem.r;
+}
+
+int scar_segment_batch_init(
+	struct scar_segment_batch *b, struct scar_reader *sr,
+	struct scar_pool *pool
+) {
+	b->sr = sr;
+	b->pool = pool;
+	b->fetcher = NULL;
+	b->codecs = NULL;
+	b->jobs = NULL;
+	b->read_failed = false;
+	b->failed = NULL;
+
+	// Keep a couple of batches worth of segments in flight per thread,
+	// so that workers don't run dry while we're reading the next batch.
+	// Batches are cut short once they hold 'bytes' of compressed data.
+	b->size = (size_t)scar_pool_size(pool) * 2;
+	b->bytes = scar_reader_batch_bytes(sr);
+
+	// With a preader, many segment reads can be in flight at once,
+	// and the batches have to be big enough to keep the queue full
+	struct scar_io_preader *pr = scar_reader_preader(sr);
+	if (pr) {
+		b->fetcher = scar_fetcher_create(pr, scar_reader_queue_depth(sr));
+		if (!b->fetcher) {
+			goto err;
+		}
+
+		if (b->size < scar_fetcher_depth(b->fetcher)) {
+			b->size = scar_fetcher_depth(b->fetcher);
+		}
+	}
+
+	b->codecs = scar_codec_pool_create(scar_reader_compression(sr), 0);
+	if (!b->codecs) {
+		goto err;
+	}
+
+	if (scar_compression_is_gzip(scar_reader_compression(sr))) {
+		size_t chunk_size;
+		unsigned int nthreads = scar_reader_parallel_inflate(sr, &chunk_size);
+		scar_codec_pool_set_parallel_inflate(b->codecs, nthreads, chunk_size);
+	}
+
+	b->jobs = malloc(b->size * sizeof(*b->jobs));
+	if (!b->jobs) {
+		goto err;
+	}
+
+	return 0;
+
+err:
+	scar_segment_batch_destroy(b);
+	SCAR_ERETURN(-1);
+}
+
+// Note that the archive couldn't be read, for 'job' if it isn't NULL.
+static void segment_batch_read_failed(
+	struct scar_segment_batch *b, struct scar_segment_job *job
+) {
+	if (!b->read_failed) {
+		b->read_failed = true;
+		b->failed = job;
+	}
+}
+
+// Wait for one of the fetcher's reads, and hand its job to the pool.
+static int segment_batch_complete(
+	struct scar_segment_batch *b, scar_pool_fn run
+) {
+	void *tag;
+	if (scar_fetcher_wait(b->fetcher, &tag) < 0) {
+		segment_batch_read_failed(b, tag);
+		SCAR_ERETURN(-1);
+	}
+
+	if (scar_pool_submit(b->pool, run, tag) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+// Hand every job which is still being read off to the pool.
+// After an error, the rest of the reads are only waited for,
+// so that none of them is still writing to its job.
+static int segment_batch_drain(
+	struct scar_segment_batch *b, scar_pool_fn run, int ret
+) {
+	while (b->fetcher && scar_fetcher_pending(b->fetcher) > 0) {
+		if (ret < 0) {
+			void *tag;
+			scar_fetcher_wait(b->fetcher, &tag);
+		} else if (segment_batch_complete(b, run) < 0) {
+			SCAR_ELOG();
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+// Read the job's compressed bytes, then hand it off to the pool.
+// With a fetcher, the read is only started, and the job is handed off
+// by 'segment_batch_complete' once it's done.
+static int segment_batch_submit(
+	struct scar_segment_batch *b, struct scar_segment_job *job,
+	scar_pool_fn run
+) {
+	scar_offset len = job->seg.compressed_end - job->seg.compressed_start;
+	struct scar_io_preader *pr = scar_reader_preader(b->sr);
+	if (pr && len > (scar_offset)b->bytes) {
+		scar_preader_stream_init(&job->stream, pr);
+		if (job->stream.s.seek(
+			&job->stream.s, job->seg.compressed_start, SCAR_SEEK_START) < 0
+		) {
+			segment_batch_read_failed(b, job);
+			SCAR_ERETURN(-1);
+		}
+
+		scar_limited_reader_init(&job->limited, &job->stream.r, len);
+		if (scar_pool_submit(b->pool, run, job) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		return 0;
+	}
+
+	job->in = malloc(len > 0 ? (size_t)len : 1);
+	if (!job->in) {
+		SCAR_ERETURN(-1);
+	}
+
+	if (b->fetcher) {
+		if (
+			scar_fetcher_pending(b->fetcher) >= scar_fetcher_depth(b->fetcher) &&
+			segment_batch_complete(b, run) < 0
+		) {
+			SCAR_ERETURN(-1);
+		}
+
+		if (scar_fetcher_submit(
+			b->fetcher, job->seg.compressed_start, job->in, (size_t)len, job) < 0
+		) {
+			segment_batch_read_failed(b, job);
+			SCAR_ERETURN(-1);
+		}
+
+		return 0;
+	}
+
+	if (scar_reader_read_compressed(b->sr, &job->seg, job->in) < 0) {
+		segment_batch_read_failed(b, job);
+		SCAR_ERETURN(-1);
+	}
+
+	if (scar_pool_submit(b->pool, run, job) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+int scar_segment_batch_run(
+	struct scar_segment_batch *b, size_t count,
+	const struct scar_segment_batch_ops *ops, void *ctx
+) {
+	b->read_failed = false;
+	b->failed = NULL;
+
+	size_t idx = 0;
+	while (idx < count) {
+		int ret = 0;
+		size_t n = 0;
+		scar_offset bytes = 0;
+		while (n < b->size && idx + n < count) {
+			struct scar_segment_job *job = ops->prepare(ctx, n, idx + n);
+			if (!job) {
+				SCAR_ELOG();
+				ret = -1;
+				break;
+			}
+
+			// The first segment of a batch is always taken, however big
+			bytes += job->seg.compressed_end - job->seg.compressed_start;
+			if (n > 0 && bytes > (scar_offset)b->bytes) {
+				break;
+			}
+
+			job->in = NULL;
+			b->jobs[n] = job;
+			n += 1;
+			if (segment_batch_submit(b, job, ops->run) < 0) {
+				SCAR_ELOG();
+				ret = -1;
+				break;
+			}
+		}
+
+		ret = segment_batch_drain(b, ops->run, ret);
+		scar_pool_wait(b->pool);
+
+		for (size_t i = 0; i < n; ++i) {
+			if (ret == 0 && ops->finish(ctx, b->jobs[i], idx + i) < 0) {
+				SCAR_ELOG();
+				ret = -1;
+			}
+
+			free(b->jobs[i]->in);
+			b->jobs[i]->in = NULL;
+		}
+
+		if (ret < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		idx += n;
+	}
+
+	return 0;
+}
+
+void scar_segment_batch_destroy(struct scar_segment_batch *b)
+{
+	if (b->fetcher) {
+		scar_fetcher_free(b->fetcher);
+		b->fetcher = NULL;
+	}
+
+	if (b->codecs) {
+		scar_codec_pool_free(b->codecs);
+		b->codecs = NULL;
+	}
+
+	free(b->jobs);
+	b->jobs = NULL;
+}
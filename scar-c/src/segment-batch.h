@@ -0,0 +1,89 @@
+#ifndef SCAR_SEGMENT_BATCH_H
+#define SCAR_SEGMENT_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "codec-pool.h"
+#include "fetch.h"
+#include "ioutil.h"
+#include "pool.h"
+#include "scar-reader.h"
+
+// The part of a job which the segment batch runner looks after:
+// getting the compressed bytes of one segment (or section) to a worker.
+// It's embedded in the caller's own job struct.
+struct scar_segment_job {
+	struct scar_segment seg;
+
+	// The compressed segment, or NULL if it's too big to keep in memory,
+	// in which case it's read from 'limited' as it's decompressed
+	void *in;
+	struct scar_preader_stream stream;
+	struct scar_limited_reader limited;
+	struct scar_mem_reader mem;
+};
+
+// Get a reader for the job's compressed segment, from its 'run' callback.
+struct scar_io_reader *scar_segment_job_reader(struct scar_segment_job *job);
+
+struct scar_segment_batch_ops {
+	// Get the job for item 'idx', which goes in slot 'slot' of the batch,
+	// with its 'seg' filled in. The same item may be asked for again
+	// in the next batch, if it didn't fit in this one.
+	// Returns NULL on error.
+	struct scar_segment_job *(*prepare)(void *ctx, size_t slot, size_t idx);
+
+	// Process a job on one of the pool's workers. It gets the job,
+	// and has to keep track of its own errors.
+	scar_pool_fn run;
+
+	// Take the result of item 'idx' once its batch is done.
+	// This is called for the jobs in order. Returns 0 on success,
+	// or -1 to stop.
+	int (*finish)(void *ctx, struct scar_segment_job *job, size_t idx);
+};
+
+// Reads the segments of an archive in batches, and hands them
+// to the workers of a pool. With a preader, the reads go through
+// a fetcher, and jobs go to the pool in the order their reads complete.
+// A segment which is bigger than the reader's batch size is read
+// by the worker as it goes instead, if there's a preader to read it from.
+struct scar_segment_batch {
+	struct scar_reader *sr;
+	struct scar_pool *pool;
+	struct scar_fetcher *fetcher;
+
+	// Shared by all the jobs, so that the workers reuse their decompressors,
+	// and there's one parallel inflater for all the big segments
+	struct scar_codec_pool *codecs;
+
+	// The most jobs in a batch, which is how many the caller needs,
+	// and how much compressed data a batch holds before it's cut short
+	size_t size;
+	size_t bytes;
+	struct scar_segment_job **jobs;
+
+	// When 'scar_segment_batch_run' fails because the archive couldn't
+	// be read, 'read_failed' is set, along with the job it was for,
+	// if that's known
+	bool read_failed;
+	struct scar_segment_job *failed;
+};
+
+// Set up to run jobs for the segments of 'sr' on 'pool'.
+// Returns 0 on success, -1 on error.
+int scar_segment_batch_init(
+	struct scar_segment_batch *b, struct scar_reader *sr,
+	struct scar_pool *pool);
+
+// Run items 0 to 'count' through 'ops', a batch at a time.
+// Nothing is being read into a job or run on it when this returns.
+// Returns 0 on success, -1 on error.
+int scar_segment_batch_run(
+	struct scar_segment_batch *b, size_t count,
+	const struct scar_segment_batch_ops *ops, void *ctx);
+
+void scar_segment_batch_destroy(struct scar_segment_batch *b);
+
+#endif
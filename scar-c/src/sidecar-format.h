@@ -0,0 +1,81 @@
+#ifndef SCAR_SIDECAR_FORMAT_H
+#define SCAR_SIDECAR_FORMAT_H
+
+#include <stdint.h>
+
+#include "meta.h"
+#include "sidecar.h"
+#include "types.h"
+
+// A sidecar starts with this magic and a format version,
+// which is bumped whenever the layout changes.
+#define SCAR_SIDECAR_MAGIC "SCAR-IDX"
+#define SCAR_SIDECAR_VERSION 1
+
+// A parsed view of a sidecar, pointing into the sidecar's data.
+// Every number in the sidecar is little endian, and every table
+// starts at a multiple of 8 bytes:
+//
+// - The header, with the stamp, the archive's size and footer offsets,
+//   and the count and offset of each table.
+// - The entries, in index order: offset, size, mtime (the bits of
+//   a double), path (an offset into the strings), mode, global
+//   (an index into the globals), and the type character.
+// - The entries sorted by path: one 64-bit entry number each.
+// - The checkpoints: the compressed and uncompressed offset of each.
+// - The globals: the global metadata which applies to a run of entries,
+//   with strings as offsets into the strings, or all ones if missing.
+// - The strings, each terminated by a 0 byte.
+struct scar_sidecar {
+	struct scar_sidecar_stamp stamp;
+	uint64_t archive_size;
+	scar_offset index_offset;
+	scar_offset checkpoints_offset;
+	scar_offset body_end_uncompressed;
+
+	uint64_t entry_count;
+	uint64_t checkpoint_count;
+	uint64_t global_count;
+	uint64_t strings_len;
+
+	const unsigned char *entries;
+	const unsigned char *sorted;
+	const unsigned char *checkpoints;
+	const unsigned char *globals;
+	const char *strings;
+};
+
+struct scar_sidecar_entry {
+	const char *name;
+	enum scar_meta_filetype ft;
+	scar_offset offset;
+	uint32_t mode;
+	uint64_t size;
+	double mtime;
+	uint64_t global;
+};
+
+// Parse the header of a sidecar, and check that all its tables fit.
+// Returns 0 on success, -1 if it isn't a sidecar this version can read.
+int scar_sidecar_parse(struct scar_sidecar *sc, const void *data, size_t len);
+
+// Get entry number 'idx', in index order.
+// Returns 0 on success, -1 if the entry is corrupt.
+int scar_sidecar_get_entry(
+	const struct scar_sidecar *sc, uint64_t idx, struct scar_sidecar_entry *e);
+
+// Get the number of the entry which comes at position 'idx'
+// when they're sorted by path.
+uint64_t scar_sidecar_get_sorted(const struct scar_sidecar *sc, uint64_t idx);
+
+void scar_sidecar_get_checkpoint(
+	const struct scar_sidecar *sc, uint64_t idx,
+	scar_offset *compressed, scar_offset *uncompressed);
+
+// Fill in 'meta' with global metadata number 'idx'.
+// Its strings point into the sidecar, so it must not be destroyed.
+// Returns 0 on success, -1 if it's corrupt.
+int scar_sidecar_get_global(
+	const struct scar_sidecar *sc, uint64_t idx, struct scar_meta *meta);
+
+#endif
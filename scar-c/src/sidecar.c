@@ -0,0 +1,608 @@
+#include "sidecar.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal-util.h"
+#include "ioutil.h"
+#include "scar-reader.h"
+#include "sidecar-format.h"
+
+// The layout of the header
+enum {
+	H_MAGIC = 0,
+	H_VERSION = 8,
+	H_HEADER_SIZE = 12,
+	H_ARCHIVE_SIZE = 16,
+	H_MTIME_SEC = 24,
+	H_MTIME_NSEC = 32,
+	H_INDEX_OFFSET = 40,
+	H_CHECKPOINTS_OFFSET = 48,
+	H_BODY_END = 56,
+	H_ENTRY_COUNT = 64,
+	H_CHECKPOINT_COUNT = 72,
+	H_GLOBAL_COUNT = 80,
+	H_ENTRIES = 88,
+	H_SORTED = 96,
+	H_CHECKPOINTS = 104,
+	H_GLOBALS = 112,
+	H_STRINGS = 120,
+	H_STRINGS_LEN = 128,
+	HEADER_SIZE = 136,
+};
+
+// The layout of an entry
+enum {
+	E_OFFSET = 0,
+	E_SIZE = 8,
+	E_MTIME = 16,
+	E_NAME = 24,
+	E_MODE = 32,
+	E_GLOBAL = 36,
+	E_TYPE = 40,
+	ENTRY_SIZE = 48,
+};
+
+// The layout of a global
+enum {
+	G_TYPE = 0,
+	G_MODE = 4,
+	G_DEVMAJOR = 8,
+	G_DEVMINOR = 12,
+	G_GID = 16,
+	G_UID = 24,
+	G_SIZE = 32,
+	G_ATIME = 40,
+	G_MTIME = 48,
+	G_STRINGS = 56,
+	GLOBAL_STRING_COUNT = 7,
+	GLOBAL_SIZE = G_STRINGS + GLOBAL_STRING_COUNT * 8,
+};
+
+#define CHECKPOINT_SIZE 16
+#define NO_STRING (~(uint64_t)0)
+
+static uint32_t get_u32(const unsigned char *p)
+{
+	return
+		(uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const unsigned char *p)
+{
+	return (uint64_t)get_u32(p) | (uint64_t)get_u32(&p[4]) << 32;
+}
+
+static double get_f64(const unsigned char *p)
+{
+	uint64_t bits = get_u64(p);
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return d;
+}
+
+static void put_u32(unsigned char *p, uint32_t num)
+{
+	p[0] = (unsigned char)num;
+	p[1] = (unsigned char)(num >> 8);
+	p[2] = (unsigned char)(num >> 16);
+	p[3] = (unsigned char)(num >> 24);
+}
+
+static void put_u64(unsigned char *p, uint64_t num)
+{
+	put_u32(p, (uint32_t)num);
+	put_u32(&p[4], (uint32_t)(num >> 32));
+}
+
+static void put_f64(unsigned char *p, double d)
+{
+	uint64_t bits;
+	memcpy(&bits, &d, sizeof(bits));
+	put_u64(p, bits);
+}
+
+// The string fields of scar_meta, in the order they're stored in a global
+static char **global_string(struct scar_meta *meta, int idx)
+{
+	switch (idx) {
+	case 0: return &meta->charset;
+	case 1: return &meta->comment;
+	case 2: return &meta->gname;
+	case 3: return &meta->hdrcharset;
+	case 4: return &meta->linkpath;
+	case 5: return &meta->path;
+	default: return &meta->uname;
+	}
+}
+
+//
+// Reading
+//
+
+// Check that a table of 'count' items of 'size' bytes at 'off' fits.
+static bool table_ok(uint64_t off, uint64_t count, uint64_t size, size_t len)
+{
+	return off % 8 == 0 && off <= len && count <= (len - off) / size;
+}
+
+int scar_sidecar_parse(struct scar_sidecar *sc, const void *data, size_t len)
+{
+	const unsigned char *buf = data;
+	if (
+		len < HEADER_SIZE ||
+		memcmp(&buf[H_MAGIC], SCAR_SIDECAR_MAGIC, 8) != 0 ||
+		get_u32(&buf[H_VERSION]) != SCAR_SIDECAR_VERSION ||
+		get_u32(&buf[H_HEADER_SIZE]) != HEADER_SIZE
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	sc->stamp.size = get_u64(&buf[H_ARCHIVE_SIZE]);
+	sc->stamp.mtime_sec = (int64_t)get_u64(&buf[H_MTIME_SEC]);
+	sc->stamp.mtime_nsec = (int64_t)get_u64(&buf[H_MTIME_NSEC]);
+	sc->archive_size = sc->stamp.size;
+	sc->index_offset = (scar_offset)get_u64(&buf[H_INDEX_OFFSET]);
+	sc->checkpoints_offset = (scar_offset)get_u64(&buf[H_CHECKPOINTS_OFFSET]);
+	sc->body_end_uncompressed = (scar_offset)get_u64(&buf[H_BODY_END]);
+	sc->entry_count = get_u64(&buf[H_ENTRY_COUNT]);
+	sc->checkpoint_count = get_u64(&buf[H_CHECKPOINT_COUNT]);
+	sc->global_count = get_u64(&buf[H_GLOBAL_COUNT]);
+	sc->strings_len = get_u64(&buf[H_STRINGS_LEN]);
+
+	uint64_t entries = get_u64(&buf[H_ENTRIES]);
+	uint64_t sorted = get_u64(&buf[H_SORTED]);
+	uint64_t checkpoints = get_u64(&buf[H_CHECKPOINTS]);
+	uint64_t globals = get_u64(&buf[H_GLOBALS]);
+	uint64_t strings = get_u64(&buf[H_STRINGS]);
+	if (
+		!table_ok(entries, sc->entry_count, ENTRY_SIZE, len) ||
+		!table_ok(sorted, sc->entry_count, 8, len) ||
+		!table_ok(checkpoints, sc->checkpoint_count, CHECKPOINT_SIZE, len) ||
+		!table_ok(globals, sc->global_count, GLOBAL_SIZE, len) ||
+		!table_ok(strings, sc->strings_len, 1, len)
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	sc->entries = &buf[entries];
+	sc->sorted = &buf[sorted];
+	sc->checkpoints = &buf[checkpoints];
+	sc->globals = &buf[globals];
+	sc->strings = (const char *)&buf[strings];
+
+	// With the last string terminated, no string can run off the end
+	if (sc->strings_len > 0 && sc->strings[sc->strings_len - 1] != '\0') {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+static int get_string(
+	const struct scar_sidecar *sc, uint64_t off, const char **str
+) {
+	if (off == NO_STRING) {
+		*str = NULL;
+		return 0;
+	}
+
+	if (off >= sc->strings_len) {
+		SCAR_ERETURN(-1);
+	}
+
+	*str = &sc->strings[off];
+	return 0;
+}
+
+int scar_sidecar_get_entry(
+	const struct scar_sidecar *sc, uint64_t idx, struct scar_sidecar_entry *e
+) {
+	const unsigned char *p = &sc->entries[idx * ENTRY_SIZE];
+	if (get_string(sc, get_u64(&p[E_NAME]), &e->name) < 0 || !e->name) {
+		SCAR_ERETURN(-1);
+	}
+
+	e->offset = (scar_offset)get_u64(&p[E_OFFSET]);
+	e->size = get_u64(&p[E_SIZE]);
+	e->mtime = get_f64(&p[E_MTIME]);
+	e->mode = get_u32(&p[E_MODE]);
+	e->global = get_u32(&p[E_GLOBAL]);
+	e->ft = scar_meta_filetype_from_char((char)p[E_TYPE]);
+	if (e->global >= sc->global_count) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+uint64_t scar_sidecar_get_sorted(const struct scar_sidecar *sc, uint64_t idx)
+{
+	return get_u64(&sc->sorted[idx * 8]);
+}
+
+void scar_sidecar_get_checkpoint(
+	const struct scar_sidecar *sc, uint64_t idx,
+	scar_offset *compressed, scar_offset *uncompressed
+) {
+	const unsigned char *p = &sc->checkpoints[idx * CHECKPOINT_SIZE];
+	*compressed = (scar_offset)get_u64(p);
+	*uncompressed = (scar_offset)get_u64(&p[8]);
+}
+
+int scar_sidecar_get_global(
+	const struct scar_sidecar *sc, uint64_t idx, struct scar_meta *meta
+) {
+	const unsigned char *p = &sc->globals[idx * GLOBAL_SIZE];
+	scar_meta_init_empty(meta);
+	meta->type = scar_meta_filetype_from_char((char)get_u32(&p[G_TYPE]));
+	meta->mode = get_u32(&p[G_MODE]);
+	meta->devmajor = get_u32(&p[G_DEVMAJOR]);
+	meta->devminor = get_u32(&p[G_DEVMINOR]);
+	meta->gid = get_u64(&p[G_GID]);
+	meta->uid = get_u64(&p[G_UID]);
+	meta->size = get_u64(&p[G_SIZE]);
+	meta->atime = get_f64(&p[G_ATIME]);
+	meta->mtime = get_f64(&p[G_MTIME]);
+
+	for (int i = 0; i < GLOBAL_STRING_COUNT; ++i) {
+		const char *str;
+		if (get_string(sc, get_u64(&p[G_STRINGS + i * 8]), &str) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		*global_string(meta, i) = (char *)str;
+	}
+
+	return 0;
+}
+
+//
+// Writing
+//
+
+struct sidecar_builder {
+	struct scar_mem_writer entries;
+	struct scar_mem_writer globals;
+	struct scar_mem_writer strings;
+	uint64_t entry_count;
+	uint64_t global_count;
+
+	// The last global which was written, or NULL before the first one
+	struct scar_meta_global *last_global;
+};
+
+struct sorted_name {
+	const char *name;
+	uint64_t idx;
+};
+
+static int compare_sorted_names(const void *aptr, const void *bptr)
+{
+	const struct sorted_name *a = aptr;
+	const struct sorted_name *b = bptr;
+	int cmp = strcmp(a->name, b->name);
+	if (cmp != 0) {
+		return cmp;
+	}
+
+	// Entries with the same path stay in index order
+	return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+static bool str_eq(const char *a, const char *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	return strcmp(a, b) == 0;
+}
+
+static bool time_eq(double a, double b)
+{
+	return (isnan(a) && isnan(b)) || a == b;
+}
+
+static bool global_eq(struct scar_meta *a, struct scar_meta *b)
+{
+	if (
+		a->type != b->type || a->mode != b->mode ||
+		a->devmajor != b->devmajor || a->devminor != b->devminor ||
+		a->gid != b->gid || a->uid != b->uid || a->size != b->size ||
+		!time_eq(a->atime, b->atime) || !time_eq(a->mtime, b->mtime)
+	) {
+		return false;
+	}
+
+	for (int i = 0; i < GLOBAL_STRING_COUNT; ++i) {
+		if (!str_eq(*global_string(a, i), *global_string(b, i))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static uint64_t builder_add_string(struct sidecar_builder *b, const char *str)
+{
+	if (!str) {
+		return NO_STRING;
+	}
+
+	uint64_t off = b->strings.len;
+	if (scar_mem_writer_write(&b->strings.w, str, strlen(str) + 1) < 0) {
+		SCAR_ERETURN(NO_STRING - 1);
+	}
+
+	return off;
+}
+
+static int builder_add_global(
+	struct sidecar_builder *b, struct scar_meta_global *shared
+) {
+	const struct scar_meta *global = &shared->meta;
+	unsigned char *p = scar_mem_writer_get_buffer(&b->globals, GLOBAL_SIZE);
+	if (!p) {
+		SCAR_ERETURN(-1);
+	}
+
+	memset(p, 0, GLOBAL_SIZE);
+	put_u32(&p[G_TYPE], (uint32_t)scar_meta_filetype_to_char(global->type));
+	put_u32(&p[G_MODE], global->mode);
+	put_u32(&p[G_DEVMAJOR], global->devmajor);
+	put_u32(&p[G_DEVMINOR], global->devminor);
+	put_u64(&p[G_GID], global->gid);
+	put_u64(&p[G_UID], global->uid);
+	put_u64(&p[G_SIZE], global->size);
+	put_f64(&p[G_ATIME], global->atime);
+	put_f64(&p[G_MTIME], global->mtime);
+
+	struct scar_meta copy = *global;
+	for (int i = 0; i < GLOBAL_STRING_COUNT; ++i) {
+		uint64_t str = builder_add_string(b, *global_string(&copy, i));
+		if (str == NO_STRING - 1) {
+			SCAR_ERETURN(-1);
+		}
+
+		put_u64(&p[G_STRINGS + i * 8], str);
+	}
+
+	b->global_count += 1;
+
+	scar_meta_global_unref(b->last_global);
+	b->last_global = scar_meta_global_ref(shared);
+	return 0;
+}
+
+static int builder_add_entry(
+	struct sidecar_builder *b, const struct scar_index_entry *entry
+) {
+	// Entries share their global metadata until it changes,
+	// so only compare the contents when it's a different one
+	struct scar_meta_global *global = entry->shared_global;
+	if (!b->last_global) {
+		if (builder_add_global(b, global) < 0) {
+			SCAR_ERETURN(-1);
+		}
+	} else if (global != b->last_global) {
+		if (global_eq(&global->meta, &b->last_global->meta)) {
+			scar_meta_global_unref(b->last_global);
+			b->last_global = scar_meta_global_ref(global);
+		} else if (builder_add_global(b, global) < 0) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	uint64_t name = builder_add_string(b, entry->name);
+	if (name == NO_STRING - 1) {
+		SCAR_ERETURN(-1);
+	}
+
+	unsigned char *p = scar_mem_writer_get_buffer(&b->entries, ENTRY_SIZE);
+	if (!p) {
+		SCAR_ERETURN(-1);
+	}
+
+	memset(p, 0, ENTRY_SIZE);
+	put_u64(&p[E_OFFSET], (uint64_t)entry->offset);
+	put_u64(&p[E_SIZE], entry->size);
+	put_f64(&p[E_MTIME], entry->mtime);
+	put_u64(&p[E_NAME], name);
+	put_u32(&p[E_MODE], entry->mode);
+	put_u32(&p[E_GLOBAL], (uint32_t)(b->global_count - 1));
+	p[E_TYPE] = (unsigned char)scar_meta_filetype_to_char(entry->ft);
+
+	b->entry_count += 1;
+	return 0;
+}
+
+static int builder_write_sorted(
+	struct sidecar_builder *b, struct scar_io_writer *w
+) {
+	if (b->entry_count == 0) {
+		return 0;
+	}
+
+	struct sorted_name *names = malloc(b->entry_count * sizeof(*names));
+	if (!names) {
+		SCAR_ERETURN(-1);
+	}
+
+	const unsigned char *entries = b->entries.buf;
+	const char *strings = b->strings.buf;
+	for (uint64_t i = 0; i < b->entry_count; ++i) {
+		names[i].name = &strings[get_u64(&entries[i * ENTRY_SIZE + E_NAME])];
+		names[i].idx = i;
+	}
+
+	qsort(names, b->entry_count, sizeof(*names), compare_sorted_names);
+
+	// Written in chunks, so that the sorted table doesn't need
+	// a second copy in memory
+	unsigned char chunk[8 * 512];
+	size_t chunklen = 0;
+	for (uint64_t i = 0; i < b->entry_count; ++i) {
+		put_u64(&chunk[chunklen], names[i].idx);
+		chunklen += 8;
+		if (chunklen == sizeof(chunk) || i + 1 == b->entry_count) {
+			if (w->write(w, chunk, chunklen) < (scar_ssize)chunklen) {
+				free(names);
+				SCAR_ERETURN(-1);
+			}
+			chunklen = 0;
+		}
+	}
+
+	free(names);
+	return 0;
+}
+
+static int write_all(struct scar_io_writer *w, const void *buf, size_t len)
+{
+	if (len > 0 && w->write(w, buf, len) < (scar_ssize)len) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+static int builder_write(
+	struct sidecar_builder *b, struct scar_reader *sr,
+	const struct scar_sidecar_stamp *stamp, struct scar_io_writer *w
+) {
+	// Segment N > 0 starts at checkpoint N - 1
+	scar_ssize segcount = scar_reader_segment_count(sr);
+	if (segcount < 1) {
+		SCAR_ERETURN(-1);
+	}
+
+	struct scar_segment last;
+	if (scar_reader_get_segment(sr, (size_t)segcount - 1, &last) < 0) {
+		SCAR_ERETURN(-1);
+	}
+
+	struct scar_segment index, checkpoints;
+	if (
+		scar_reader_find_section(sr, "SCAR-INDEX", &index) != 1 ||
+		scar_reader_find_section(sr, "SCAR-CHECKPOINTS", &checkpoints) != 1
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	uint64_t checkpoint_count = (uint64_t)segcount - 1;
+	uint64_t entries_off = HEADER_SIZE;
+	uint64_t sorted_off = entries_off + b->entry_count * ENTRY_SIZE;
+	uint64_t checkpoints_off = sorted_off + b->entry_count * 8;
+	uint64_t globals_off = checkpoints_off + checkpoint_count * CHECKPOINT_SIZE;
+	uint64_t strings_off = globals_off + b->global_count * GLOBAL_SIZE;
+
+	unsigned char header[HEADER_SIZE];
+	memset(header, 0, sizeof(header));
+	memcpy(&header[H_MAGIC], SCAR_SIDECAR_MAGIC, 8);
+	put_u32(&header[H_VERSION], SCAR_SIDECAR_VERSION);
+	put_u32(&header[H_HEADER_SIZE], HEADER_SIZE);
+	put_u64(&header[H_ARCHIVE_SIZE], stamp->size);
+	put_u64(&header[H_MTIME_SEC], (uint64_t)stamp->mtime_sec);
+	put_u64(&header[H_MTIME_NSEC], (uint64_t)stamp->mtime_nsec);
+	put_u64(&header[H_INDEX_OFFSET], (uint64_t)index.compressed_start);
+	put_u64(&header[H_CHECKPOINTS_OFFSET], (uint64_t)checkpoints.compressed_start);
+	put_u64(&header[H_BODY_END], (uint64_t)last.uncompressed_end);
+	put_u64(&header[H_ENTRY_COUNT], b->entry_count);
+	put_u64(&header[H_CHECKPOINT_COUNT], checkpoint_count);
+	put_u64(&header[H_GLOBAL_COUNT], b->global_count);
+	put_u64(&header[H_ENTRIES], entries_off);
+	put_u64(&header[H_SORTED], sorted_off);
+	put_u64(&header[H_CHECKPOINTS], checkpoints_off);
+	put_u64(&header[H_GLOBALS], globals_off);
+	put_u64(&header[H_STRINGS], strings_off);
+	put_u64(&header[H_STRINGS_LEN], b->strings.len);
+
+	if (
+		write_all(w, header, sizeof(header)) < 0 ||
+		write_all(w, b->entries.buf, b->entries.len) < 0 ||
+		builder_write_sorted(b, w) < 0
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	for (uint64_t i = 0; i < checkpoint_count; ++i) {
+		struct scar_segment seg;
+		if (scar_reader_get_segment(sr, (size_t)i + 1, &seg) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		unsigned char cp[CHECKPOINT_SIZE];
+		put_u64(cp, (uint64_t)seg.compressed_start);
+		put_u64(&cp[8], (uint64_t)seg.uncompressed_start);
+		if (write_all(w, cp, sizeof(cp)) < 0) {
+			SCAR_ERETURN(-1);
+		}
+	}
+
+	if (
+		write_all(w, b->globals.buf, b->globals.len) < 0 ||
+		write_all(w, b->strings.buf, b->strings.len) < 0
+	) {
+		SCAR_ERETURN(-1);
+	}
+
+	return 0;
+}
+
+int scar_sidecar_write(
+	struct scar_reader *sr, const struct scar_sidecar_stamp *stamp,
+	struct scar_io_writer *w
+) {
+	int ret = 0;
+	struct sidecar_builder b;
+	scar_mem_writer_init(&b.entries);
+	scar_mem_writer_init(&b.globals);
+	scar_mem_writer_init(&b.strings);
+	b.entry_count = 0;
+	b.global_count = 0;
+	b.last_global = NULL;
+
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	if (!it) {
+		SCAR_ELOG();
+		ret = -1;
+		goto exit;
+	}
+
+	struct scar_index_entry entry;
+	int next;
+	while ((next = scar_index_iterator_next(it, &entry)) > 0) {
+		if (builder_add_entry(&b, &entry) < 0) {
+			SCAR_ELOG();
+			ret = -1;
+			goto exit;
+		}
+	}
+
+	if (next < 0) {
+		SCAR_ELOG();
+		ret = -1;
+		goto exit;
+	}
+
+	if (builder_write(&b, sr, stamp, w) < 0) {
+		SCAR_ELOG();
+		ret = -1;
+		goto exit;
+	}
+
+exit:
+	if (it) {
+		scar_index_iterator_free(it);
+	}
+
+	scar_meta_global_unref(b.last_global);
+	free(b.entries.buf);
+	free(b.globals.buf);
+	free(b.strings.buf);
+	return ret;
+}
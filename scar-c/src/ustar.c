@@ -0,0 +1,326 @@
+#include "ustar.h"
+
+#include <string.h>
+
+#include "ioutil.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Octal fields are handled 8 digits at a time, with one digit in each
+// byte of a 64-bit word. The first character of a field goes in the
+// lowest byte, whatever the byte order of the machine.
+#define ONES 0x0101010101010101ull
+
+static uint64_t load_chars(const unsigned char *text, size_t len)
+{
+	uint64_t word = 0;
+	for (size_t i = 0; i < len; ++i) {
+		word |= (uint64_t)text[i] << (i * 8);
+	}
+
+	return word;
+}
+
+static void store_chars(unsigned char *dest, uint64_t word, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		dest[i] = (unsigned char)(word >> (i * 8));
+	}
+}
+
+static unsigned int count_trailing_zeros(uint64_t word)
+{
+#ifdef __GNUC__
+	return (unsigned int)__builtin_ctzll(word);
+#else
+	unsigned int n = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		n += 1;
+	}
+	return n;
+#endif
+}
+
+// Count the octal digits at the start of 'word'
+static size_t count_digits(uint64_t word)
+{
+	// Every byte from '0' to '7' is 0x30 once its low 3 bits are masked off.
+	// Set the top bit of every byte which isn't.
+	uint64_t bad = (word & (0xf8 * ONES)) ^ (0x30 * ONES);
+	bad = ((bad & (0x7f * ONES)) + 0x7f * ONES) | bad;
+	bad &= 0x80 * ONES;
+	if (!bad) {
+		return 8;
+	}
+
+	return count_trailing_zeros(bad) / 8;
+}
+
+// Combine the first 'ndigits' digits of 'word' into a number
+static uint64_t combine_digits(uint64_t word, size_t ndigits)
+{
+	if (ndigits == 0) {
+		return 0;
+	}
+
+	// Move the digits to the top of the word, so that the first one is
+	// in byte 8 - ndigits, and the last one in byte 7.
+	// The bytes in front of them become leading zeroes.
+	word &= 0x07 * ONES;
+	word <<= (8 - ndigits) * 8;
+
+	// Then merge neighbours: pairs of digits, then groups of 4, then all 8
+	word = ((word & 0x0007000700070007ull) << 3) |
+		((word >> 8) & 0x0007000700070007ull);
+	word = ((word & 0x0000003f0000003full) << 6) |
+		((word >> 16) & 0x0000003f0000003full);
+	word = ((word & 0xfff) << 12) | ((word >> 32) & 0xfff);
+	return word;
+}
+
+// The reverse of combine_digits: spread the low 24 bits of 'num'
+// out into 8 digit characters
+static uint64_t spread_digits(uint64_t num)
+{
+	uint64_t word = ((num >> 12) & 0xfff) | ((num & 0xfff) << 32);
+	word = ((word >> 6) & 0x0000003f0000003full) |
+		((word & 0x0000003f0000003full) << 16);
+	word = ((word >> 3) & 0x0007000700070007ull) |
+		((word & 0x0007000700070007ull) << 8);
+	return word | 0x30 * ONES;
+}
+
+uint64_t scar_ustar_read_octal(
+	const unsigned char *block, struct scar_ustar_field field
+) {
+	const unsigned char *text = &block[field.start];
+	uint64_t num = 0;
+	for (size_t i = 0; i < field.length; i += 8) {
+		size_t len = field.length - i < 8 ? field.length - i : 8;
+		uint64_t word = load_chars(&text[i], len);
+
+		// A short last chunk is padded with NULs, which aren't digits
+		size_t ndigits = count_digits(word);
+		num = (num << (ndigits * 3)) | combine_digits(word, ndigits);
+		if (ndigits < 8) {
+			break;
+		}
+	}
+
+	return num;
+}
+
+uint64_t scar_ustar_read_size(
+	const unsigned char *block, struct scar_ustar_field field
+) {
+	const unsigned char *text = &block[field.start];
+	if (text[0] < 128) {
+		return scar_ustar_read_octal(block, field);
+	}
+
+	uint64_t num = text[0] & 0x7f;
+	for (size_t i = 1; i < field.length; ++i) {
+		num *= 256;
+		num += text[i];
+	}
+
+	return num;
+}
+
+void scar_ustar_write_octal(
+	unsigned char *block, struct scar_ustar_field field, uint64_t num
+) {
+	size_t width = field.length - 1;
+	unsigned char *dest = &block[field.start];
+	dest[width] = '\0';
+
+	// Numbers of up to 16 digits which fit are written 8 digits at a time
+	if (width <= 16 && num >> (width * 3) == 0) {
+		if (width > 8) {
+			store_chars(
+				dest, spread_digits(num >> 24) >> ((16 - width) * 8),
+				width - 8);
+			store_chars(&dest[width - 8], spread_digits(num), 8);
+		} else {
+			store_chars(
+				dest, spread_digits(num) >> ((8 - width) * 8), width);
+		}
+		return;
+	}
+
+	char digits[SCAR_FORMAT_MAX];
+	size_t len = scar_format_octal(digits, num);
+	if (len < width) {
+		memset(dest, '0', width - len);
+		memcpy(&dest[width - len], digits, len);
+	} else {
+		memcpy(dest, digits, width);
+	}
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+__attribute__((target("avx2")))
+static int block_is_zero_avx2(const unsigned char *block)
+{
+	__m256i acc = _mm256_setzero_si256();
+	for (size_t i = 0; i < 512; i += 32) {
+		acc = _mm256_or_si256(
+			acc, _mm256_loadu_si256((const __m256i *)&block[i]));
+	}
+
+	return _mm256_testz_si256(acc, acc);
+}
+
+__attribute__((target("avx2")))
+static void block_sums_avx2(
+	const unsigned char *block, uint64_t *usum, uint64_t *flipped
+) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i flip = _mm256_set1_epi8((char)0x80);
+	__m256i uacc = zero;
+	__m256i facc = zero;
+	for (size_t i = 0; i < 512; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)&block[i]);
+		uacc = _mm256_add_epi64(uacc, _mm256_sad_epu8(v, zero));
+		facc = _mm256_add_epi64(
+			facc, _mm256_sad_epu8(_mm256_xor_si256(v, flip), zero));
+	}
+
+	uint64_t lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, uacc);
+	*usum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm256_storeu_si256((__m256i *)lanes, facc);
+	*flipped = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+#ifdef __SSE2__
+static int block_is_zero_sse2(const unsigned char *block)
+{
+	__m128i acc = _mm_setzero_si128();
+	for (size_t i = 0; i < 512; i += 16) {
+		acc = _mm_or_si128(acc, _mm_loadu_si128((const __m128i *)&block[i]));
+	}
+
+	acc = _mm_cmpeq_epi8(acc, _mm_setzero_si128());
+	return _mm_movemask_epi8(acc) == 0xffff;
+}
+
+static void block_sums_sse2(
+	const unsigned char *block, uint64_t *usum, uint64_t *flipped
+) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i flip = _mm_set1_epi8((char)0x80);
+	__m128i uacc = zero;
+	__m128i facc = zero;
+	for (size_t i = 0; i < 512; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&block[i]);
+		uacc = _mm_add_epi64(uacc, _mm_sad_epu8(v, zero));
+		facc = _mm_add_epi64(facc, _mm_sad_epu8(_mm_xor_si128(v, flip), zero));
+	}
+
+	uint64_t lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, uacc);
+	*usum = lanes[0] + lanes[1];
+	_mm_storeu_si128((__m128i *)lanes, facc);
+	*flipped = lanes[0] + lanes[1];
+}
+#else
+static int block_is_zero_sw(const unsigned char *block)
+{
+	uint64_t acc = 0;
+	for (size_t i = 0; i < 512; i += 8) {
+		uint64_t word;
+		memcpy(&word, &block[i], 8);
+		acc |= word;
+	}
+
+	return acc == 0;
+}
+
+static void block_sums_sw(
+	const unsigned char *block, uint64_t *usum, uint64_t *flipped
+) {
+	uint64_t u = 0;
+	uint64_t f = 0;
+	for (size_t i = 0; i < 512; ++i) {
+		u += block[i];
+		f += block[i] ^ 0x80;
+	}
+
+	*usum = u;
+	*flipped = f;
+}
+#endif
+
+int scar_ustar_block_is_zero(const unsigned char *block)
+{
+	// Header blocks almost always start with a path,
+	// so most blocks are rejected by their first bytes
+	uint64_t word;
+	memcpy(&word, block, 8);
+	if (word) {
+		return 0;
+	}
+
+#ifdef HAVE_AVX2_DISPATCH
+	if (__builtin_cpu_supports("avx2")) {
+		return block_is_zero_avx2(block);
+	}
+#endif
+
+#ifdef __SSE2__
+	return block_is_zero_sse2(block);
+#else
+	return block_is_zero_sw(block);
+#endif
+}
+
+void scar_ustar_block_sums(
+	const unsigned char *block, uint64_t *usum, int64_t *ssum
+) {
+	// 'flipped' is the sum of every byte with its top bit flipped.
+	// A byte's value as a signed char is its flipped value minus 128.
+	uint64_t u, flipped;
+#ifdef HAVE_AVX2_DISPATCH
+	if (__builtin_cpu_supports("avx2")) {
+		block_sums_avx2(block, &u, &flipped);
+	} else
+#endif
+	{
+#ifdef __SSE2__
+		block_sums_sse2(block, &u, &flipped);
+#else
+		block_sums_sw(block, &u, &flipped);
+#endif
+	}
+
+	int64_t s = (int64_t)flipped - 128 * 512;
+
+	// Count the checksum field as spaces
+	const unsigned char *field = &block[SCAR_UST_CHKSUM.start];
+	for (size_t i = 0; i < SCAR_UST_CHKSUM.length; ++i) {
+		u = u - field[i] + ' ';
+		s = s - (signed char)field[i] + ' ';
+	}
+
+	*usum = u;
+	*ssum = s;
+}
+
+void scar_ustar_write_checksum(unsigned char *block)
+{
+	memset(&block[SCAR_UST_CHKSUM.start], ' ', SCAR_UST_CHKSUM.length);
+	uint64_t usum;
+	int64_t ssum;
+	scar_ustar_block_sums(block, &usum, &ssum);
+	scar_ustar_write_octal(block, SCAR_UST_CHKSUM, usum);
+}
@@ -0,0 +1,798 @@
+#include "verify.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codec-pool.h"
+#include "compression.h"
+#include "crc32c.h"
+#include "internal-util.h"
+#include "ioutil.h"
+#include "meta.h"
+#include "meta-arena.h"
+#include "pax.h"
+#include "pool.h"
+#include "scar-reader.h"
+#include "segment-batch.h"
+#include "ustar.h"
+#include "util.h"
+
+// What we remember about each entry in the tar body,
+// so that the index can be checked against it afterwards.
+struct verify_entry {
+	scar_offset offset;
+	uint64_t path_hash;
+	enum scar_meta_filetype ft;
+
+	// True if the entry's metadata headers continue into the next segment,
+	// so that we never got to see its real header
+	bool partial;
+};
+
+struct verify_entries {
+	struct verify_entry *entries;
+	size_t len;
+	size_t cap;
+};
+
+struct verify_job {
+	struct scar_segment_job sj;
+	struct scar_codec_pool *codecs;
+	bool last;
+
+	// The segment's checksum from the SCAR-CHECKSUMS section, if any
+	bool has_crc;
+	uint32_t expected_crc;
+
+	// The decompressed segment is checked as it's read from 'r',
+	// through 'buf' if 'r' can't lend out its own buffer.
+	// 'pos' is how much of it has been read, and 'crc' its CRC-32C so far.
+	struct scar_io_reader *r;
+	unsigned char *buf;
+	size_t buf_pos;
+	size_t buf_len;
+	scar_offset pos;
+	uint32_t crc;
+	bool read_failed;
+
+	// The header blocks and extended headers of the entry being checked
+	struct scar_mem_writer chain;
+
+	struct verify_entries entries;
+	scar_offset uncompressed_len;
+
+	// Holds the strings of the entry being checked
+	struct scar_meta_arena *arena;
+	bool found_end;
+
+	scar_offset bad_offset;
+	char message[256];
+	int ret;
+};
+
+static uint64_t hash_path(const char *path)
+{
+	// 64-bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	while (*path) {
+		hash ^= (unsigned char)*(path++);
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+static int entries_push(
+	struct verify_entries *ents, const struct verify_entry *ent
+) {
+	if (ents->len >= ents->cap) {
+		size_t newcap = ents->cap == 0 ? 64 : ents->cap * 2;
+		void *newents = realloc(ents->entries, newcap * sizeof(*ents->entries));
+		if (!newents) {
+			SCAR_ERETURN(-1);
+		}
+
+		ents->entries = newents;
+		ents->cap = newcap;
+	}
+
+	ents->entries[ents->len++] = *ent;
+	return 0;
+}
+
+static const struct verify_entry *entries_find(
+	const struct verify_entries *ents, scar_offset offset
+) {
+	size_t lo = 0;
+	size_t hi = ents->len;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		scar_offset midoff = ents->entries[mid].offset;
+		if (midoff == offset) {
+			return &ents->entries[mid];
+		} else if (midoff < offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return NULL;
+}
+
+static void report(
+	char *message, size_t size, scar_offset *bad_offset,
+	scar_offset offset, const char *fmt, ...
+) __attribute__((format(printf, 5, 6)));
+
+static void report(
+	char *message, size_t size, scar_offset *bad_offset,
+	scar_offset offset, const char *fmt, ...
+) {
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(message, size, fmt, ap);
+	va_end(ap);
+	*bad_offset = offset;
+}
+
+#define JOB_FAIL(job, offset, ...) do { \
+	report( \
+		(job)->message, sizeof((job)->message), &(job)->bad_offset, \
+		(offset), __VA_ARGS__); \
+	return -1; \
+} while (0)
+
+static uint64_t round_up_block(uint64_t size)
+{
+	return (size + 511) / 512 * 512;
+}
+
+// Point '*data' at the next bytes of the decompressed segment.
+// Returns how many there are (0 at the end of the segment), or -1 on error.
+static scar_ssize job_fill(struct verify_job *job, const unsigned char **data)
+{
+	scar_ssize n;
+	if (job->r->fill_buf) {
+		n = job->r->fill_buf(job->r, (const void **)data);
+	} else {
+		if (job->buf_pos == job->buf_len) {
+			n = job->r->read(job->r, job->buf, SCAR_IO_CHUNK_SIZE);
+			job->buf_pos = 0;
+			job->buf_len = n > 0 ? (size_t)n : 0;
+		}
+
+		*data = &job->buf[job->buf_pos];
+		n = (scar_ssize)(job->buf_len - job->buf_pos);
+	}
+
+	if (n < 0) {
+		job->read_failed = true;
+		SCAR_ERETURN(-1);
+	}
+
+	return n;
+}
+
+// Mark the first 'len' bytes 'job_fill' returned as read.
+static void job_consume(
+	struct verify_job *job, const unsigned char *data, size_t len
+) {
+	if (job->has_crc) {
+		job->crc = scar_crc32c(job->crc, data, len);
+	}
+
+	job->pos += (scar_offset)len;
+	if (job->r->fill_buf) {
+		job->r->consume(job->r, len);
+	} else {
+		job->buf_pos += len;
+	}
+}
+
+// Read up to 'len' bytes of the decompressed segment into 'buf'.
+// Returns less than 'len' only at the end of the segment, or -1 on error.
+static scar_ssize job_read(struct verify_job *job, void *buf, size_t len)
+{
+	size_t done = 0;
+	while (done < len) {
+		const unsigned char *data;
+		scar_ssize n = job_fill(job, &data);
+		if (n < 0) {
+			SCAR_ERETURN(-1);
+		} else if (n == 0) {
+			break;
+		}
+
+		size_t take = (size_t)n < len - done ? (size_t)n : len - done;
+		memcpy((unsigned char *)buf + done, data, take);
+		job_consume(job, data, take);
+		done += take;
+	}
+
+	return (scar_ssize)done;
+}
+
+// Skip up to 'len' bytes of the decompressed segment, like 'job_read'.
+// If 'nonzero' isn't NULL, it's set to the offset of the first skipped
+// byte which isn't 0, or -1 if there is none.
+static int64_t job_skip(
+	struct verify_job *job, uint64_t len, scar_offset *nonzero
+) {
+	if (nonzero) {
+		*nonzero = -1;
+	}
+
+	uint64_t done = 0;
+	while (done < len) {
+		const unsigned char *data;
+		scar_ssize n = job_fill(job, &data);
+		if (n < 0) {
+			SCAR_ERETURN(-1);
+		} else if (n == 0) {
+			break;
+		}
+
+		size_t take = (size_t)n;
+		if ((uint64_t)take > len - done) {
+			take = (size_t)(len - done);
+		}
+
+		if (nonzero && *nonzero < 0) {
+			for (size_t i = 0; i < take; ++i) {
+				if (data[i] != 0) {
+					*nonzero = job->pos + (scar_offset)i;
+					break;
+				}
+			}
+		}
+
+		job_consume(job, data, take);
+		done += take;
+	}
+
+	return (int64_t)done;
+}
+
+// Walk through all the headers in the decompressed segment as it's read.
+// Returns 0 once it has read all of it, or -1 if it's broken.
+static int verify_segment_body(struct verify_job *job)
+{
+	scar_offset base = job->sj.seg.uncompressed_start;
+	unsigned char block[512];
+
+	while (1) {
+		scar_offset pos = job->pos;
+		scar_ssize n = job_read(job, block, 512);
+		if (n < 0) {
+			SCAR_ERETURN(-1);
+		} else if (n == 0) {
+			return 0;
+		} else if (n < 512) {
+			JOB_FAIL(job, base + pos, "Truncated header block");
+		}
+
+		// The end-of-archive indicator is two zero blocks,
+		// optionally followed by more zero padding
+		if (scar_ustar_block_is_zero(block)) {
+			if (!job->last) {
+				JOB_FAIL(
+					job, base + pos,
+					"End-of-archive indicator before the end of the tar body");
+			}
+
+			n = job_read(job, block, 512);
+			if (n < 0) {
+				SCAR_ERETURN(-1);
+			} else if (n < 512 || !scar_ustar_block_is_zero(block)) {
+				JOB_FAIL(job, base + pos, "Incomplete end-of-archive indicator");
+			}
+
+			scar_offset nonzero;
+			if (job_skip(job, UINT64_MAX, &nonzero) < 0) {
+				SCAR_ERETURN(-1);
+			} else if (nonzero >= 0) {
+				JOB_FAIL(
+					job, base + nonzero,
+					"Data after the end-of-archive indicator");
+			}
+
+			job->found_end = true;
+			return 0;
+		}
+
+		// Collect the metadata headers in front of the entry's
+		// own header, checking each header block along the way
+		scar_offset chain_start = pos;
+		job->chain.len = 0;
+		char type;
+		while (1) {
+			if (!scar_pax_block_checksum_ok(block)) {
+				JOB_FAIL(job, base + pos, "Bad header checksum");
+			}
+
+			if (scar_mem_writer_write(&job->chain.w, block, 512) < 0) {
+				SCAR_ERETURN(-1);
+			}
+
+			type = (char)block[SCAR_UST_TYPEFLAG.start];
+			if (type != 'x' && type != 'g' && type != 'L' && type != 'K') {
+				break;
+			}
+
+			// A size which is bigger than what's left of the segment
+			// is caught before anything is read into memory, if the
+			// checkpoints say how big the segment is
+			uint64_t datalen = round_up_block(
+				scar_ustar_read_size(block, SCAR_UST_SIZE));
+			if (
+				job->sj.seg.uncompressed_end >= 0 &&
+				datalen > (uint64_t)(
+					job->sj.seg.uncompressed_end - base - job->pos)
+			) {
+				JOB_FAIL(job, base + pos, "Truncated metadata entry");
+			}
+
+			while (datalen > 0) {
+				size_t take = SCAR_IO_CHUNK_SIZE;
+				if ((uint64_t)take > datalen) {
+					take = (size_t)datalen;
+				}
+
+				void *buf = scar_mem_writer_get_buffer(&job->chain, take);
+				if (!buf) {
+					SCAR_ERETURN(-1);
+				}
+
+				n = job_read(job, buf, take);
+				if (n < 0) {
+					SCAR_ERETURN(-1);
+				} else if ((size_t)n < take) {
+					JOB_FAIL(job, base + pos, "Truncated metadata entry");
+				}
+
+				datalen -= take;
+			}
+
+			// A 'g' entry stands on its own, and is indexed separately
+			if (type == 'g' && pos == chain_start) {
+				break;
+			}
+
+			// Checkpoints are allowed before any header block,
+			// so the entry's header might be in the next segment
+			pos = job->pos;
+			n = job_read(job, block, 512);
+			if (n < 0) {
+				SCAR_ERETURN(-1);
+			} else if (n == 0) {
+				if (job->last) {
+					JOB_FAIL(
+						job, base + chain_start,
+						"Entry is missing its header");
+				}
+
+				struct verify_entry ent = {
+					.offset = base + chain_start,
+					.path_hash = 0,
+					.ft = SCAR_FT_UNKNOWN,
+					.partial = true,
+				};
+				if (entries_push(&job->entries, &ent) < 0) {
+					SCAR_ERETURN(-1);
+				}
+
+				return 0;
+			} else if (n < 512) {
+				JOB_FAIL(job, base + pos, "Truncated header block");
+			}
+		}
+
+		if (type == 'g') {
+			continue;
+		}
+
+		enum scar_meta_filetype ft = scar_meta_filetype_from_char(type);
+		if (ft == SCAR_FT_UNKNOWN) {
+			JOB_FAIL(job, base + pos, "Unknown entry type '%c'", type);
+		}
+
+		// Let the pax parser deal with the metadata, since the path
+		// and size may come from the extended headers
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, job->chain.buf, job->chain.len);
+
+		struct scar_meta global;
+		struct scar_meta meta;
+		scar_meta_init_empty(&global);
+		scar_meta_arena_reset(job->arena);
+		int r = scar_pax_read_meta_arena(&mr.r, &global, &meta, job->arena);
+		scar_meta_destroy(&global);
+		if (r <= 0) {
+			JOB_FAIL(job, base + chain_start, "Malformed entry metadata");
+		}
+
+		struct verify_entry ent = {
+			.offset = base + chain_start,
+			.path_hash = meta.path ? hash_path(meta.path) : 0,
+			.ft = ft,
+			.partial = false,
+		};
+		uint64_t size = SCAR_META_HAS_SIZE(&meta) ? meta.size : 0;
+
+		if (entries_push(&job->entries, &ent) < 0) {
+			SCAR_ERETURN(-1);
+		}
+
+		// Content never crosses a segment boundary,
+		// since checkpoints are only created before header blocks
+		uint64_t datalen = round_up_block(size);
+		int64_t skipped = job_skip(job, datalen, NULL);
+		if (skipped < 0) {
+			SCAR_ERETURN(-1);
+		} else if ((uint64_t)skipped < datalen) {
+			JOB_FAIL(job, base + chain_start, "Truncated entry content");
+		}
+	}
+}
+
+static void verify_job_run(void *ptr)
+{
+	struct scar_segment_job *sj = ptr;
+	struct verify_job *job = SCAR_BASE(struct verify_job, sj);
+	struct scar_decompressor *decomp = NULL;
+	scar_mem_writer_init(&job->chain);
+	job->ret = -1;
+
+	decomp = scar_codec_pool_get_segment_decompressor(
+		job->codecs, scar_segment_job_reader(sj),
+		sj->seg.compressed_end - sj->seg.compressed_start, NULL);
+	if (!decomp) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	job->r = &decomp->r;
+	if (!job->r->fill_buf) {
+		job->buf = malloc(SCAR_IO_CHUNK_SIZE);
+		if (!job->buf) {
+			SCAR_ELOG();
+			goto exit;
+		}
+	}
+
+	job->arena = scar_meta_arena_create();
+	if (!job->arena) {
+		SCAR_ELOG();
+		goto exit;
+	}
+
+	// Problems are reported in the same order as if the segment had been
+	// decompressed before it was checked: a broken stream first, then
+	// a wrong length, then the headers, then the checksum. So when the
+	// headers are broken, the rest of the segment is still read.
+	int body = verify_segment_body(job);
+	if (body < 0 && !job->read_failed && job_skip(job, UINT64_MAX, NULL) < 0) {
+		SCAR_ELOG();
+	}
+
+	if (job->read_failed) {
+		report(
+			job->message, sizeof(job->message), &job->bad_offset,
+			job->sj.seg.uncompressed_start,
+			"Failed to decompress the segment at compressed offset %lld",
+			job->sj.seg.compressed_start);
+		goto exit;
+	}
+
+	scar_offset n = job->pos;
+	job->uncompressed_len = n;
+	if (
+		job->sj.seg.uncompressed_end >= 0 &&
+		n != job->sj.seg.uncompressed_end - job->sj.seg.uncompressed_start
+	) {
+		report(
+			job->message, sizeof(job->message), &job->bad_offset,
+			job->sj.seg.uncompressed_start,
+			"Segment at compressed offset %lld is %lld bytes, "
+			"but the checkpoints say it should be %lld bytes",
+			job->sj.seg.compressed_start, n,
+			job->sj.seg.uncompressed_end - job->sj.seg.uncompressed_start);
+		goto exit;
+	}
+
+	if (body < 0) {
+		goto exit;
+	}
+
+	// The headers look fine, but the content might still be corrupt
+	if (job->has_crc && job->crc != job->expected_crc) {
+		report(
+			job->message, sizeof(job->message), &job->bad_offset,
+			job->sj.seg.uncompressed_start,
+			"Segment at compressed offset %lld has CRC-32C %08lx, "
+			"but the checksums say it should be %08lx",
+			job->sj.seg.compressed_start, (unsigned long)job->crc,
+			(unsigned long)job->expected_crc);
+		goto exit;
+	}
+
+	job->ret = 0;
+
+exit:
+	if (job->arena) {
+		scar_meta_arena_free(job->arena);
+		job->arena = NULL;
+	}
+	scar_codec_pool_put_decompressor(job->codecs, decomp);
+	free(job->buf);
+	job->buf = NULL;
+	free(job->chain.buf);
+}
+
+static void verify_job_reset(struct verify_job *job)
+{
+	job->buf = NULL;
+	job->buf_pos = 0;
+	job->buf_len = 0;
+	job->pos = 0;
+	job->crc = 0;
+	job->read_failed = false;
+	free(job->entries.entries);
+	job->entries.entries = NULL;
+	job->entries.len = 0;
+	job->entries.cap = 0;
+	job->uncompressed_len = 0;
+	job->arena = NULL;
+	job->found_end = false;
+	job->bad_offset = -1;
+	job->message[0] = '\0';
+	job->ret = 0;
+}
+
+#define RESULT_FAIL(result, offset, ...) do { \
+	report( \
+		(result)->message, sizeof((result)->message), &(result)->bad_offset, \
+		(offset), __VA_ARGS__); \
+	goto exit; \
+} while (0)
+
+static int verify_index(
+	struct scar_reader *sr, const struct verify_entries *ents,
+	struct scar_verify_result *result
+) {
+	int ret = -1;
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	if (!it) {
+		RESULT_FAIL(result, -1, "Failed to read the index");
+	}
+
+	struct scar_index_entry entry;
+	int r;
+	while ((r = scar_index_iterator_next(it, &entry)) > 0) {
+		const struct verify_entry *ent = entries_find(ents, entry.offset);
+		if (!ent) {
+			RESULT_FAIL(
+				result, entry.offset,
+				"Index entry '%s' doesn't point to the start of an entry",
+				entry.name);
+		}
+
+		if (ent->partial) {
+			continue;
+		}
+
+		if (ent->ft != entry.ft) {
+			RESULT_FAIL(
+				result, entry.offset,
+				"Index entry '%s' has type '%c', but its header has type '%c'",
+				entry.name, scar_meta_filetype_to_char(entry.ft),
+				scar_meta_filetype_to_char(ent->ft));
+		}
+
+		if (ent->path_hash != hash_path(entry.name)) {
+			RESULT_FAIL(
+				result, entry.offset,
+				"Index entry '%s' doesn't match the path in its header",
+				entry.name);
+		}
+	}
+
+	if (r < 0) {
+		RESULT_FAIL(result, -1, "Failed to read the index");
+	}
+
+	ret = 0;
+
+exit:
+	if (it) {
+		scar_index_iterator_free(it);
+	}
+	return ret;
+}
+
+struct verify {
+	struct scar_reader *sr;
+	struct verify_job *jobs;
+	size_t segcount;
+	struct scar_verify_result *result;
+
+	// Every entry in the tar body, and where the next segment should start
+	struct verify_entries ents;
+	scar_offset expected_start;
+};
+
+static struct scar_segment_job *verify_prepare(
+	void *ptr, size_t slot, size_t idx
+) {
+	struct verify *v = ptr;
+	struct scar_verify_result *result = v->result;
+	struct verify_job *job = &v->jobs[slot];
+	struct scar_segment_job *ret = NULL;
+	if (scar_reader_get_segment(v->sr, idx, &job->sj.seg) < 0) {
+		RESULT_FAIL(result, -1, "Failed to read the checkpoints");
+	}
+
+	job->last = idx == v->segcount - 1;
+
+	int r = scar_reader_segment_checksum(v->sr, idx, &job->expected_crc);
+	if (r < 0) {
+		RESULT_FAIL(result, -1, "Failed to read the checksums");
+	}
+	job->has_crc = r > 0;
+
+	ret = &job->sj;
+
+exit:
+	return ret;
+}
+
+// Look at the results in order, so that we report
+// the first problem in the archive
+static int verify_finish(void *ptr, struct scar_segment_job *sj, size_t idx)
+{
+	(void)idx;
+	struct verify *v = ptr;
+	struct scar_verify_result *result = v->result;
+	struct verify_job *job = SCAR_BASE(struct verify_job, sj);
+	int ret = -1;
+	if (sj->seg.uncompressed_start != v->expected_start) {
+		RESULT_FAIL(
+			result, v->expected_start,
+			"Checkpoint at compressed offset %lld says it's at "
+			"offset %lld, but the previous segment ends at %lld",
+			sj->seg.compressed_start, sj->seg.uncompressed_start,
+			v->expected_start);
+	}
+
+	if (job->ret < 0) {
+		RESULT_FAIL(result, job->bad_offset, "%s", job->message);
+	}
+
+	for (size_t j = 0; j < job->entries.len; ++j) {
+		if (entries_push(&v->ents, &job->entries.entries[j]) < 0) {
+			RESULT_FAIL(result, -1, "Out of memory");
+		}
+	}
+
+	if (job->last && !job->found_end) {
+		RESULT_FAIL(
+			result, v->expected_start + job->uncompressed_len,
+			"Missing end-of-archive indicator");
+	}
+
+	v->expected_start += job->uncompressed_len;
+	result->compressed_size +=
+		sj->seg.compressed_end - sj->seg.compressed_start;
+	result->uncompressed_size += job->uncompressed_len;
+	result->segment_count += 1;
+	if (job->has_crc) {
+		result->checksummed_segment_count += 1;
+	}
+
+	ret = 0;
+
+exit:
+	verify_job_reset(job);
+	return ret;
+}
+
+static const struct scar_segment_batch_ops verify_ops = {
+	.prepare = verify_prepare,
+	.run = verify_job_run,
+	.finish = verify_finish,
+};
+
+int scar_verify(
+	struct scar_reader *sr, struct scar_pool *pool,
+	struct scar_verify_result *result
+) {
+	int ret = -1;
+	struct scar_segment_batch batch;
+	bool have_batch = false;
+	size_t njobs = 0;
+
+	struct verify v;
+	v.sr = sr;
+	v.jobs = NULL;
+	v.result = result;
+	v.ents.entries = NULL;
+	v.ents.len = 0;
+	v.ents.cap = 0;
+	v.expected_start = 0;
+
+	result->bad_offset = -1;
+	result->message[0] = '\0';
+	result->compressed_size = 0;
+	result->uncompressed_size = 0;
+	result->segment_count = 0;
+	result->checksummed_segment_count = 0;
+	result->entry_count = 0;
+
+	scar_ssize segcount = scar_reader_segment_count(sr);
+	if (segcount < 0) {
+		RESULT_FAIL(result, -1, "Failed to read the checkpoints");
+	}
+	v.segcount = (size_t)segcount;
+
+	if (scar_segment_batch_init(&batch, sr, pool) < 0) {
+		SCAR_ELOG();
+		RESULT_FAIL(result, -1, "Out of memory");
+	}
+	have_batch = true;
+
+	v.jobs = malloc(batch.size * sizeof(*v.jobs));
+	if (!v.jobs) {
+		SCAR_ELOG();
+		RESULT_FAIL(result, -1, "Out of memory");
+	}
+
+	for (; njobs < batch.size; ++njobs) {
+		v.jobs[njobs].codecs = batch.codecs;
+		v.jobs[njobs].entries.entries = NULL;
+		verify_job_reset(&v.jobs[njobs]);
+	}
+
+	if (scar_segment_batch_run(&batch, v.segcount, &verify_ops, &v) < 0) {
+		if (result->message[0] != '\0') {
+			goto exit;
+		} else if (batch.failed) {
+			RESULT_FAIL(
+				result, batch.failed->seg.uncompressed_start,
+				"Failed to read the segment at compressed offset %lld",
+				batch.failed->seg.compressed_start);
+		} else if (batch.read_failed) {
+			RESULT_FAIL(result, -1, "Failed to read from the archive");
+		} else {
+			RESULT_FAIL(result, -1, "Out of memory");
+		}
+	}
+
+	for (size_t i = 0; i < v.ents.len; ++i) {
+		if (!v.ents.entries[i].partial) {
+			result->entry_count += 1;
+		}
+	}
+
+	if (verify_index(sr, &v.ents, result) < 0) {
+		goto exit;
+	}
+
+	ret = 0;
+
+exit:
+	// The batch runner never leaves reads or workers using the jobs
+	if (have_batch) {
+		scar_segment_batch_destroy(&batch);
+	}
+	for (size_t i = 0; i < njobs; ++i) {
+		verify_job_reset(&v.jobs[i]);
+	}
+	free(v.jobs);
+	free(v.ents.entries);
+	return ret;
+}
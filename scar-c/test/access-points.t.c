@@ -0,0 +1,103 @@
+#include "scar-reader.h"
+
+#include <stdlib.h>
+
+#include "ioutil.h"
+#include "test.h"
+#include "test-util.h"
+
+#define FILE_COUNT 64
+#define FILE_SIZE (64 * 1024)
+#define SPAN (128 * 1024)
+
+TEST(seek_from_access_points)
+{
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, FILE_COUNT, FILE_SIZE);
+	a.content = SCAR_TEST_LETTERS;
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, mw.buf, mw.len);
+
+	struct scar_reader *sr = scar_reader_create_p(&cp.pr);
+	ASSERT(sr != NULL);
+	ASSERT2(scar_reader_segment_count(sr), ==, 1);
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+
+	scar_reader_set_access_points(sr, SPAN);
+	ASSERT2(scar_reader_access_point_count(sr), ==, (size_t)0);
+
+	// Reading the last file decompresses the whole segment,
+	// which records access points along the way
+	cp.bytes = 0;
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, offsets[FILE_COUNT - 1], FILE_COUNT - 1), ==, 0);
+	size_t full_read = cp.bytes;
+	size_t count = scar_reader_access_point_count(sr);
+	ASSERT2(count, >=, (size_t)(FILE_COUNT * FILE_SIZE / SPAN / 2));
+	ASSERT2(count, <=, (size_t)(FILE_COUNT * FILE_SIZE / SPAN));
+
+	// Reading any other file starts close to it
+	for (int i = 0; i < FILE_COUNT; i += 7) {
+		cp.bytes = 0;
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[i], i), ==, 0);
+		ASSERT2(cp.bytes, <, full_read / 4);
+	}
+
+	// Those reads started at access points, so they find no new ones
+	ASSERT2(scar_reader_access_point_count(sr), ==, count);
+
+	// The same goes for reads through a page cache
+	ASSERT2(scar_reader_set_page_cache(sr, 1024 * 1024), ==, 0);
+	cp.bytes = 0;
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, offsets[40], 40), ==, 0);
+	ASSERT2(cp.bytes, <, full_read / 4);
+	ASSERT2(scar_reader_set_page_cache(sr, 0), ==, 0);
+
+	// Turning access points off goes back to reading from the checkpoint
+	scar_reader_set_access_points(sr, 0);
+	ASSERT2(scar_reader_access_point_count(sr), ==, (size_t)0);
+	cp.bytes = 0;
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, offsets[FILE_COUNT - 1], FILE_COUNT - 1), ==, 0);
+	ASSERT2(cp.bytes, >=, full_read);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(plain_has_no_access_points)
+{
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, FILE_COUNT, FILE_SIZE);
+	a.comp = &plain;
+	a.content = SCAR_TEST_LETTERS;
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+
+	scar_reader_set_access_points(sr, SPAN);
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, offsets[FILE_COUNT - 1], FILE_COUNT - 1), ==, 0);
+	ASSERT2(scar_reader_access_point_count(sr), ==, (size_t)0);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(access_points, seek_from_access_points, plain_has_no_access_points);
@@ -0,0 +1,126 @@
+#include "block-cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "test.h"
+#include "test-util.h"
+
+#define DATA_SIZE 1000
+
+static void make_data(unsigned char *buf)
+{
+	for (size_t i = 0; i < DATA_SIZE; ++i) {
+		buf[i] = (unsigned char)(i % 251);
+	}
+}
+
+TEST(coalesce_and_hit)
+{
+	unsigned char data[DATA_SIZE];
+	make_data(data);
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, data, sizeof(data));
+
+	// 100 blocks of 10 bytes
+	struct scar_io_preader *pr = scar_block_cache_create(&cp.pr, 10, 16);
+	ASSERT(pr != NULL);
+
+	// Three missing blocks are fetched with one read
+	unsigned char buf[64];
+	ASSERT2(pr->read_at(pr, 15, buf, 20), ==, 20);
+	ASSERT2(memcmp(buf, &data[15], 20), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)1);
+	ASSERT2(cp.bytes, ==, (size_t)30);
+
+	// Reading within those blocks doesn't touch the inner preader
+	ASSERT2(pr->read_at(pr, 10, buf, 30), ==, 30);
+	ASSERT2(memcmp(buf, &data[10], 30), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)1);
+
+	// Only the missing run at the end is fetched
+	ASSERT2(pr->read_at(pr, 35, buf, 20), ==, 20);
+	ASSERT2(memcmp(buf, &data[35], 20), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)2);
+	ASSERT2(cp.bytes, ==, (size_t)50);
+
+	struct scar_block_cache_stats stats;
+	scar_block_cache_get_stats(pr, &stats);
+	ASSERT2(stats.hits, ==, (size_t)4);
+	ASSERT2(stats.misses, ==, (size_t)5);
+	ASSERT2(stats.inner_reads, ==, (size_t)2);
+
+	scar_block_cache_free(pr);
+	OK();
+}
+
+TEST(tail_prefetch)
+{
+	unsigned char data[DATA_SIZE];
+	make_data(data);
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, data, sizeof(data));
+
+	struct scar_io_preader *pr = scar_block_cache_create(&cp.pr, 10, 16);
+	ASSERT(pr != NULL);
+	ASSERT2(pr->size(pr), ==, DATA_SIZE);
+
+	// Reading the last few bytes brings in the last few blocks,
+	// so reading backwards through the footer is free
+	unsigned char buf[64];
+	ASSERT2(pr->read_at(pr, DATA_SIZE - 5, buf, sizeof(buf)), ==, 5);
+	ASSERT2(memcmp(buf, &data[DATA_SIZE - 5], 5), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)1);
+	ASSERT2(cp.bytes, ==, (size_t)(10 * SCAR_BLOCK_CACHE_TAIL_BLOCKS));
+
+	ASSERT2(pr->read_at(pr, DATA_SIZE - 35, buf, 30), ==, 30);
+	ASSERT2(memcmp(buf, &data[DATA_SIZE - 35], 30), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)1);
+
+	ASSERT2(pr->read_at(pr, DATA_SIZE, buf, sizeof(buf)), ==, 0);
+
+	scar_block_cache_free(pr);
+	OK();
+}
+
+TEST(eviction)
+{
+	unsigned char data[DATA_SIZE];
+	make_data(data);
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, data, sizeof(data));
+
+	struct scar_io_preader *pr = scar_block_cache_create(&cp.pr, 10, 4);
+	ASSERT(pr != NULL);
+
+	// Fill the cache with blocks 0 to 3, then use block 0 again
+	unsigned char buf[64];
+	for (int i = 0; i < 4; ++i) {
+		ASSERT2(pr->read_at(pr, i * 10, buf, 10), ==, 10);
+	}
+	ASSERT2(pr->read_at(pr, 0, buf, 10), ==, 10);
+	ASSERT2(cp.reads, ==, (size_t)4);
+
+	// Block 1 is the least recently used one, so it's evicted
+	ASSERT2(pr->read_at(pr, 40, buf, 10), ==, 10);
+	ASSERT2(memcmp(buf, &data[40], 10), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)5);
+	ASSERT2(pr->read_at(pr, 0, buf, 10), ==, 10);
+	ASSERT2(cp.reads, ==, (size_t)5);
+	ASSERT2(pr->read_at(pr, 10, buf, 10), ==, 10);
+	ASSERT2(memcmp(buf, &data[10], 10), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)6);
+
+	// Reads which are big compared to the cache go straight through
+	ASSERT2(pr->read_at(pr, 100, buf, 40), ==, 40);
+	ASSERT2(memcmp(buf, &data[100], 40), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)7);
+	ASSERT2(pr->read_at(pr, 100, buf, 10), ==, 10);
+	ASSERT2(cp.reads, ==, (size_t)8);
+
+	scar_block_cache_free(pr);
+	OK();
+}
+
+TESTGROUP(block_cache, coalesce_and_hit, tail_prefetch, eviction);
@@ -0,0 +1,98 @@
+#include "scar-reader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ioutil.h"
+#include "scar-writer.h"
+#include "test.h"
+#include "test-util.h"
+
+#define NPATHS 1000
+
+// Empty files, so that only their paths matter
+static int make_archive(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw,
+	int opts
+) {
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, NPATHS, 0);
+	a.comp = &plain;
+	a.opts = opts;
+	a.dir = "dir/";
+	a.path = "dir/file-%d.txt";
+	return scar_test_make_archive(scar_test_ctx, &a, mw);
+}
+
+TEST(no_false_negatives)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, SCAR_WRITER_BLOOM), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+
+	ASSERT2(scar_reader_may_contain(sr, "dir/"), ==, 1);
+	ASSERT2(scar_reader_may_contain(sr, "dir"), ==, 1);
+
+	for (int i = 0; i < NPATHS; ++i) {
+		char path[64];
+		snprintf(path, sizeof(path), "dir/file-%d.txt", i);
+		ASSERT2(scar_reader_may_contain(sr, path), ==, 1);
+	}
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(few_false_positives)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, SCAR_WRITER_BLOOM), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+
+	// The filter is sized for a ~1% false positive rate;
+	// allow a generous margin
+	int positives = 0;
+	for (int i = 0; i < NPATHS; ++i) {
+		char path[64];
+		snprintf(path, sizeof(path), "dir/missing-%d.txt", i);
+		int ret = scar_reader_may_contain(sr, path);
+		ASSERT(ret >= 0);
+		positives += ret;
+	}
+	ASSERT2(positives, <, NPATHS / 20);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(without_bloom)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, 0), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+
+	ASSERT2(scar_reader_may_contain(sr, "dir/missing.txt"), ==, 1);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(bloom, no_false_negatives, few_false_positives, without_bloom);
@@ -112,6 +112,235 @@ static int test_roundtrip_chunked(
 	OK();
 }
 
+// A reader which can't lend out a buffer
+struct unbuffered_reader {
+	struct scar_io_reader r;
+	struct scar_mem_reader *inner;
+};
+
+static scar_ssize unbuffered_read(
+	struct scar_io_reader *r, void *buf, size_t len
+) {
+	struct unbuffered_reader *ur = (struct unbuffered_reader *)r;
+	return ur->inner->r.read(&ur->inner->r, buf, len);
+}
+
+// Decompress with a mix of reads and borrowed buffers
+static int test_fill_buf(
+	struct scar_test_context scar_test_ctx,
+	struct scar_compression *comp
+) {
+	size_t len = 200000;
+	unsigned char *data = malloc(len);
+	ASSERT(data != NULL);
+	for (size_t i = 0; i < len; ++i) {
+		data[i] = (unsigned char)story[i * 7 % (sizeof(story) - 1)];
+	}
+
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	struct scar_compressor *compressor = comp->create_compressor(&mw.w, 6);
+	ASSERT2(compressor->w.write(&compressor->w, data, len), ==,
+		(scar_ssize)len);
+	ASSERT2(compressor->finish(compressor), ==, 0);
+	comp->destroy_compressor(compressor);
+
+	for (int buffered = 0; buffered <= 1; ++buffered) {
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, mw.buf, mw.len);
+		struct unbuffered_reader ur = {{unbuffered_read, NULL, NULL}, &mr};
+		struct scar_decompressor *decompressor =
+			comp->create_decompressor(buffered ? &mr.r : &ur.r);
+		ASSERT(decompressor != NULL);
+		struct scar_io_reader *r = &decompressor->r;
+
+		// Plain data can only be borrowed if the compressed data can
+		if (!r->fill_buf) {
+			ASSERT(!buffered);
+			comp->destroy_decompressor(decompressor);
+			continue;
+		}
+
+		size_t pos = 0;
+		for (int round = 0; pos < len; ++round) {
+			if (round % 3 == 2) {
+				unsigned char buf[777];
+				scar_ssize n = r->read(r, buf, sizeof(buf));
+				ASSERT2(n, >, 0);
+				ASSERT2(memcmp(buf, &data[pos], (size_t)n), ==, 0);
+				pos += (size_t)n;
+				continue;
+			}
+
+			const void *buf;
+			scar_ssize n = r->fill_buf(r, &buf);
+			ASSERT2(n, >, 0);
+			ASSERT2(pos + (size_t)n, <=, len);
+			ASSERT2(memcmp(buf, &data[pos], (size_t)n), ==, 0);
+
+			// Consume part of it, which the next call hands out again
+			size_t used = round % 3 == 0 ? (size_t)n : (size_t)n / 2 + 1;
+			r->consume(r, used);
+			pos += used;
+		}
+
+		const void *buf;
+		ASSERT2(r->fill_buf(r, &buf), ==, 0);
+		comp->destroy_decompressor(decompressor);
+	}
+
+	free(mw.buf);
+	free(data);
+	OK();
+}
+
+// Compressors and decompressors which are reset in the middle of a stream
+// start over as if they were new
+static int test_reset(
+	struct scar_test_context scar_test_ctx,
+	struct scar_compression *comp
+) {
+	size_t len = sizeof(story) - 1;
+	struct scar_mem_writer expected;
+	scar_mem_writer_init(&expected);
+	struct scar_compressor *compressor =
+		comp->create_compressor(&expected.w, 6);
+	ASSERT(compressor != NULL);
+	ASSERT2(compressor->w.write(&compressor->w, story, len), ==,
+		(scar_ssize)len);
+	ASSERT2(compressor->finish(compressor), ==, 0);
+
+	struct scar_mem_writer abandoned;
+	scar_mem_writer_init(&abandoned);
+	ASSERT2(comp->reset_compressor(compressor, &abandoned.w), ==, 0);
+	ASSERT2(compressor->w.write(&compressor->w, "abandoned", 9), ==, 9);
+
+	struct scar_mem_writer actual;
+	scar_mem_writer_init(&actual);
+	ASSERT2(comp->reset_compressor(compressor, &actual.w), ==, 0);
+	ASSERT2(compressor->w.write(&compressor->w, story, len), ==,
+		(scar_ssize)len);
+	ASSERT2(compressor->finish(compressor), ==, 0);
+	comp->destroy_compressor(compressor);
+
+	ASSERT2(actual.len, ==, expected.len);
+	ASSERT2(memcmp(actual.buf, expected.buf, expected.len), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, expected.buf, expected.len);
+	struct scar_decompressor *decompressor = comp->create_decompressor(&mr.r);
+	ASSERT(decompressor != NULL);
+	char buf[sizeof(story)];
+	ASSERT2(decompressor->r.read(&decompressor->r, buf, 100), ==, 100);
+
+	for (int buffered = 0; buffered <= 1; ++buffered) {
+		struct scar_mem_reader mr2;
+		scar_mem_reader_init(&mr2, expected.buf, expected.len);
+		struct unbuffered_reader ur = {{unbuffered_read, NULL, NULL}, &mr2};
+		ASSERT2(comp->reset_decompressor(
+			decompressor, buffered ? &mr2.r : &ur.r, NULL, NULL), ==, 0);
+		// A plain decompressor can only lend out what its new reader can
+		if (scar_compression_is_plain(comp)) {
+			ASSERT2(!!decompressor->r.fill_buf, ==, buffered);
+		}
+		ASSERT2(scar_io_read_full(&decompressor->r, buf, sizeof(buf)), ==,
+			(scar_ssize)len);
+		ASSERT2(memcmp(buf, story, len), ==, 0);
+	}
+	comp->destroy_decompressor(decompressor);
+
+	free(actual.buf);
+	free(abandoned.buf);
+	free(expected.buf);
+	OK();
+}
+
+// Compress with one gzip engine and decompress with the other,
+// from readers which lend out the whole member and from ones which don't.
+// A damaged member is an error with every engine.
+TEST(gzip_engines)
+{
+	enum scar_gzip_engine engines[2] = {SCAR_GZIP_ZLIB, SCAR_GZIP_ZLIB};
+	ASSERT(scar_gzip_engine_from_name("zlib", &engines[0]));
+	ASSERT(!scar_gzip_engine_from_name("zstd", &engines[1]));
+#ifdef SCAR_HAVE_LIBDEFLATE
+	ASSERT(scar_gzip_engine_from_name("libdeflate", &engines[1]));
+#else
+	ASSERT(!scar_gzip_engine_from_name("libdeflate", &engines[1]));
+	struct scar_compression unavailable;
+	ASSERT(!scar_compression_init_gzip_engine(
+		&unavailable, SCAR_GZIP_LIBDEFLATE));
+#endif
+
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+	ASSERT(!scar_compression_is_gzip(&plain));
+
+	size_t len = 200000;
+	unsigned char *data = malloc(len);
+	unsigned char *out = malloc(len);
+	ASSERT(data != NULL && out != NULL);
+	for (size_t i = 0; i < len; ++i) {
+		data[i] = (unsigned char)story[i * 7 % (sizeof(story) - 1)];
+	}
+
+	for (int from = 0; from < 2; ++from) {
+		struct scar_compression comp;
+		ASSERT(scar_compression_init_gzip_engine(&comp, engines[from]));
+		ASSERT(scar_compression_is_gzip(&comp));
+		struct scar_mem_writer mw;
+		scar_mem_writer_init(&mw);
+		struct scar_compressor *compressor = comp.create_compressor(&mw.w, 6);
+		ASSERT(compressor != NULL);
+		ASSERT2(compressor->w.write(&compressor->w, data, len), ==,
+			(scar_ssize)len);
+		ASSERT2(compressor->finish(compressor), ==, 0);
+		comp.destroy_compressor(compressor);
+
+		for (int to = 0; to < 2; ++to) {
+			ASSERT(scar_compression_init_gzip_engine(&comp, engines[to]));
+			for (int buffered = 0; buffered <= 1; ++buffered) {
+				struct scar_mem_reader mr;
+				scar_mem_reader_init(&mr, mw.buf, mw.len);
+				struct unbuffered_reader ur =
+					{{unbuffered_read, NULL, NULL}, &mr};
+				struct scar_decompressor *decompressor =
+					comp.create_decompressor(buffered ? &mr.r : &ur.r);
+				ASSERT(decompressor != NULL);
+				ASSERT2(scar_io_read_full(&decompressor->r, out, len), ==,
+					(scar_ssize)len);
+				ASSERT2(memcmp(out, data, len), ==, 0);
+				ASSERT2(decompressor->r.read(&decompressor->r, out, 1), ==, 0);
+				comp.destroy_decompressor(decompressor);
+			}
+
+			unsigned char *damaged = mw.buf;
+			damaged[mw.len / 2] ^= 0x10;
+			struct scar_mem_reader mr;
+			scar_mem_reader_init(&mr, mw.buf, mw.len);
+			struct scar_decompressor *decompressor =
+				comp.create_decompressor(&mr.r);
+			ASSERT(decompressor != NULL);
+			ASSERT2(scar_io_read_full(&decompressor->r, out, len), ==, -1);
+			comp.destroy_decompressor(decompressor);
+			damaged[mw.len / 2] ^= 0x10;
+		}
+
+		free(mw.buf);
+	}
+
+	free(out);
+	free(data);
+	OK();
+}
+
+#ifdef SCAR_HAVE_LIBDEFLATE
+static void scar_compression_init_libdeflate(struct scar_compression *comp)
+{
+	scar_compression_init_gzip_engine(comp, SCAR_GZIP_LIBDEFLATE);
+}
+#endif
+
 #define DEFTEST(fn, name) TEST(fn ## _ ## name) \
 { \
 	struct scar_compression comp; \
@@ -122,10 +351,24 @@ static int test_roundtrip_chunked(
 #define X(xname) \
 DEFTEST(roundtrip, xname) \
 DEFTEST(roundtrip_chunked, xname) \
+DEFTEST(fill_buf, xname) \
+DEFTEST(reset, xname) \
 //
 SCAR_COMPRESSOR_NAMES
+#ifdef SCAR_HAVE_LIBDEFLATE
+X(libdeflate)
+#endif
 #undef X
 
+#ifdef SCAR_HAVE_LIBDEFLATE
+TESTGROUP(compression,
+	roundtrip_plain, roundtrip_chunked_plain, fill_buf_plain, reset_plain,
+	roundtrip_gzip, roundtrip_chunked_gzip, fill_buf_gzip, reset_gzip,
+	roundtrip_libdeflate, roundtrip_chunked_libdeflate, fill_buf_libdeflate,
+	reset_libdeflate, gzip_engines);
+#else
 TESTGROUP(compression,
-	roundtrip_plain, roundtrip_chunked_plain,
-	roundtrip_gzip, roundtrip_chunked_gzip);
+	roundtrip_plain, roundtrip_chunked_plain, fill_buf_plain, reset_plain,
+	roundtrip_gzip, roundtrip_chunked_gzip, fill_buf_gzip, reset_gzip,
+	gzip_engines);
+#endif
@@ -0,0 +1,38 @@
+#include "crc32c.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+
+TEST(known_values)
+{
+	ASSERT2(scar_crc32c(0, "", 0), ==, (uint32_t)0);
+	ASSERT2(scar_crc32c(0, "123456789", 9), ==, (uint32_t)0xe3069283);
+
+	unsigned char zeros[32] = {0};
+	ASSERT2(scar_crc32c(0, zeros, sizeof(zeros)), ==, (uint32_t)0x8a9136aa);
+
+	OK();
+}
+
+TEST(chunked)
+{
+	unsigned char buf[1000];
+	for (size_t i = 0; i < sizeof(buf); ++i) {
+		buf[i] = (unsigned char)(i * 7 + 3);
+	}
+
+	uint32_t whole = scar_crc32c(0, buf, sizeof(buf));
+
+	// Split at odd offsets, so that the chunks aren't aligned
+	for (size_t split = 1; split < sizeof(buf); split += 37) {
+		uint32_t crc = scar_crc32c(0, buf, split);
+		crc = scar_crc32c(crc, buf + split, sizeof(buf) - split);
+		ASSERT2(crc, ==, whole);
+	}
+
+	OK();
+}
+
+TESTGROUP(crc32c, known_values, chunked);
@@ -0,0 +1,188 @@
+#include "scar-reader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "pool.h"
+#include "scar-writer.h"
+#include "test.h"
+
+#define FILE_COUNT 16
+#define JOB_COUNT 8
+
+struct cursor_job {
+	struct scar_reader *sr;
+	const struct scar_mem_writer *archive;
+	scar_offset offsets[FILE_COUNT];
+	int start;
+	int use_preader;
+	int ok;
+};
+
+static void make_content(int idx, char *buf, size_t size)
+{
+	snprintf(buf, size, "This is file number %d\n", idx);
+}
+
+// Read every file through a cursor of its own,
+// starting at a different file in each job
+static void cursor_job_run(void *arg)
+{
+	struct cursor_job *job = arg;
+	job->ok = 0;
+
+	struct scar_mem_reader mr;
+	struct scar_cursor *c;
+	if (job->use_preader) {
+		c = scar_cursor_create_p(job->sr);
+	} else {
+		scar_mem_reader_init(&mr, job->archive->buf, job->archive->len);
+		c = scar_cursor_create(job->sr, &mr.r, &mr.s);
+	}
+	if (!c) {
+		return;
+	}
+
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+
+	for (int n = 0; n < FILE_COUNT; ++n) {
+		int idx = (job->start + n) % FILE_COUNT;
+		struct scar_meta meta;
+		if (scar_cursor_read_meta(c, job->offsets[idx], &global, &meta) < 0) {
+			goto exit;
+		}
+
+		struct scar_mem_writer mw;
+		scar_mem_writer_init(&mw);
+		int ret = scar_cursor_read_content(c, &mw.w, meta.size);
+		scar_meta_destroy(&meta);
+
+		char expected[64];
+		make_content(idx, expected, sizeof(expected));
+		if (
+			ret < 0 || mw.len != strlen(expected) ||
+			memcmp(mw.buf, expected, mw.len) != 0
+		) {
+			free(mw.buf);
+			goto exit;
+		}
+
+		free(mw.buf);
+	}
+
+	if (scar_cursor_may_contain(c, "file-0.txt") != 1) {
+		goto exit;
+	}
+
+	job->ok = 1;
+
+exit:
+	scar_cursor_free(c);
+}
+
+static int run_cursors(
+	struct scar_test_context scar_test_ctx, int use_preader,
+	size_t page_cache
+) {
+	struct scar_compression gzip;
+	scar_compression_init_gzip(&gzip);
+
+	struct scar_mem_writer archive;
+	scar_mem_writer_init(&archive);
+	struct scar_writer *sw = scar_writer_create_opts(
+		&archive.w, &gzip, 6, SCAR_WRITER_BLOOM);
+	ASSERT(sw != NULL);
+
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		char path[32];
+		char content[64];
+		snprintf(path, sizeof(path), "file-%d.txt", i);
+		make_content(i, content, sizeof(content));
+
+		struct scar_meta meta;
+		scar_meta_init_file(&meta, path, strlen(content));
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, content, strlen(content));
+		ASSERT2(scar_writer_write_entry(sw, &meta, &mr.r), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+
+	ASSERT2(scar_writer_finish(sw), ==, 0);
+	scar_writer_free(sw);
+
+	// With a preader, all the cursors share the reader's preader
+	struct scar_mem_reader mr;
+	struct scar_mem_preader mp;
+	struct scar_reader *sr;
+	if (use_preader) {
+		scar_mem_preader_init(&mp, archive.buf, archive.len);
+		sr = scar_reader_create_p(&mp.pr);
+	} else {
+		scar_mem_reader_init(&mr, archive.buf, archive.len);
+		sr = scar_reader_create(&mr.r, &mr.s);
+	}
+	ASSERT(sr != NULL);
+	ASSERT2(scar_reader_set_page_cache(sr, page_cache), ==, 0);
+
+	struct cursor_job jobs[JOB_COUNT];
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+
+	struct scar_index_entry entry;
+	int count = 0;
+	while (scar_index_iterator_next(it, &entry) > 0) {
+		ASSERT(count < FILE_COUNT);
+		for (int j = 0; j < JOB_COUNT; ++j) {
+			jobs[j].offsets[count] = entry.offset;
+		}
+		count += 1;
+	}
+	scar_index_iterator_free(it);
+	ASSERT2(count, ==, FILE_COUNT);
+
+	struct scar_pool *pool = scar_pool_create(4);
+	ASSERT(pool != NULL);
+	for (int j = 0; j < JOB_COUNT; ++j) {
+		jobs[j].sr = sr;
+		jobs[j].archive = &archive;
+		jobs[j].start = j;
+		jobs[j].use_preader = use_preader;
+		ASSERT2(scar_pool_submit(pool, cursor_job_run, &jobs[j]), ==, 0);
+	}
+	scar_pool_wait(pool);
+	scar_pool_free(pool);
+
+	for (int j = 0; j < JOB_COUNT; ++j) {
+		ASSERT2(jobs[j].ok, ==, 1);
+	}
+
+	scar_reader_free(sr);
+	free(archive.buf);
+	return 0;
+}
+
+TEST(concurrent_cursors)
+{
+	ASSERT2(run_cursors(scar_test_ctx, 0, 0), ==, 0);
+	OK();
+}
+
+TEST(concurrent_preader_cursors)
+{
+	ASSERT2(run_cursors(scar_test_ctx, 1, 0), ==, 0);
+	OK();
+}
+
+// All the cursors fill and read the same pages
+TEST(concurrent_cached_cursors)
+{
+	ASSERT2(run_cursors(scar_test_ctx, 1, 1024 * 1024), ==, 0);
+	OK();
+}
+
+TESTGROUP(
+	cursor, concurrent_cursors, concurrent_preader_cursors,
+	concurrent_cached_cursors);
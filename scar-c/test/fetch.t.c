@@ -0,0 +1,156 @@
+// For fileno
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "fetch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "test.h"
+
+#define DATA_SIZE (256 * 1024)
+#define CHUNK_SIZE 4096
+#define CHUNK_COUNT (DATA_SIZE / CHUNK_SIZE)
+
+static void make_data(unsigned char *buf)
+{
+	for (size_t i = 0; i < DATA_SIZE; ++i) {
+		buf[i] = (unsigned char)(i * 7 + i / 251);
+	}
+}
+
+// Read every chunk of 'pr' through a fetcher with a small queue,
+// submitting a new read whenever one completes.
+static int fetch_all(
+	struct scar_test_context scar_test_ctx, struct scar_io_preader *pr,
+	const unsigned char *expected
+) {
+	unsigned char *bufs = malloc(DATA_SIZE);
+	ASSERT(bufs != NULL);
+
+	struct scar_fetcher *f = scar_fetcher_create(pr, 4);
+	ASSERT(f != NULL);
+	ASSERT2(scar_fetcher_depth(f), ==, 4u);
+
+	size_t next = 0;
+	size_t completed = 0;
+	while (completed < CHUNK_COUNT) {
+		while (next < CHUNK_COUNT && scar_fetcher_pending(f) < 4) {
+			ASSERT2(scar_fetcher_submit(
+				f, (scar_offset)(next * CHUNK_SIZE),
+				&bufs[next * CHUNK_SIZE], CHUNK_SIZE,
+				&bufs[next * CHUNK_SIZE]), ==, 0);
+			next += 1;
+		}
+
+		void *tag;
+		ASSERT2(scar_fetcher_wait(f, &tag), ==, 0);
+		ASSERT(tag != NULL);
+
+		size_t off = (size_t)((unsigned char *)tag - bufs);
+		ASSERT2(memcmp(tag, &expected[off], CHUNK_SIZE), ==, 0);
+		completed += 1;
+	}
+
+	ASSERT2(scar_fetcher_pending(f), ==, 0u);
+
+	scar_fetcher_free(f);
+	free(bufs);
+	return 0;
+}
+
+TEST(sync_fetch)
+{
+	unsigned char *data = malloc(DATA_SIZE);
+	ASSERT(data != NULL);
+	make_data(data);
+
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, data, DATA_SIZE);
+	ASSERT2(fetch_all(scar_test_ctx, &mp.pr, data), ==, 0);
+
+	free(data);
+	OK();
+}
+
+TEST(fetch_errors)
+{
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, "Hello World", 11);
+
+	struct scar_fetcher *f = scar_fetcher_create(&mp.pr, 2);
+	ASSERT(f != NULL);
+
+	// Nothing to wait for
+	void *tag = &tag;
+	ASSERT2(scar_fetcher_wait(f, &tag), ==, -1);
+	ASSERT(tag == NULL);
+
+	char a[5], b[5], c[5];
+	ASSERT2(scar_fetcher_submit(f, 0, a, sizeof(a), a), ==, 0);
+	ASSERT2(scar_fetcher_submit(f, 8, b, sizeof(b), b), ==, 0);
+
+	// The queue is full
+	ASSERT2(scar_fetcher_submit(f, 0, c, sizeof(c), c), ==, -1);
+
+	ASSERT2(scar_fetcher_wait(f, &tag), ==, 0);
+	ASSERT(tag == a);
+	ASSERT_STREQ_N(a, "Hello", 5);
+
+	// The second read goes past the end of the data
+	ASSERT2(scar_fetcher_wait(f, &tag), ==, -1);
+	ASSERT(tag == b);
+
+	scar_fetcher_free(f);
+	OK();
+}
+
+#ifndef _WIN32
+TEST(fd_fetch)
+{
+	unsigned char *data = malloc(DATA_SIZE);
+	ASSERT(data != NULL);
+	make_data(data);
+
+	FILE *f = tmpfile();
+	ASSERT(f != NULL);
+	ASSERT2(fwrite(data, 1, DATA_SIZE, f), ==, (size_t)DATA_SIZE);
+	ASSERT2(fflush(f), ==, 0);
+
+	struct scar_fd_preader fp;
+	ASSERT2(scar_fd_preader_init(&fp, fileno(f)), ==, 0);
+	ASSERT2(fetch_all(scar_test_ctx, &fp.pr, data), ==, 0);
+
+	// A read past the end is reported along with its tag,
+	// whichever way the reads are done
+	struct scar_fetcher *fetcher = scar_fetcher_create(&fp.pr, 0);
+	ASSERT(fetcher != NULL);
+	ASSERT2(scar_fetcher_depth(fetcher), ==, (unsigned int)SCAR_FETCH_DEFAULT_DEPTH);
+
+	unsigned char buf[16];
+	ASSERT2(scar_fetcher_submit(
+		fetcher, DATA_SIZE - 8, buf, sizeof(buf), buf), ==, 0);
+	void *tag;
+	ASSERT2(scar_fetcher_wait(fetcher, &tag), ==, -1);
+	ASSERT(tag == buf);
+
+	// Reads which are still in flight are waited for by free
+	ASSERT2(scar_fetcher_submit(fetcher, 0, buf, sizeof(buf), buf), ==, 0);
+	scar_fetcher_free(fetcher);
+	ASSERT2(memcmp(buf, data, sizeof(buf)), ==, 0);
+
+	fclose(f);
+	free(data);
+	OK();
+}
+#endif
+
+#ifdef _WIN32
+TESTGROUP(fetch, sync_fetch, fetch_errors);
+#else
+TESTGROUP(fetch, sync_fetch, fetch_errors, fd_fetch);
+#endif
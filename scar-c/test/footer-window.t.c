@@ -0,0 +1,175 @@
+#include "scar-reader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "scar-writer.h"
+#include "test.h"
+#include "test-util.h"
+
+static void describe_archive(struct scar_test_archive *a, int count)
+{
+	scar_test_archive_init(a, count, 5);
+	a->opts = SCAR_WRITER_META | SCAR_WRITER_CHECKSUMS;
+	a->path = "some/directory/file-%d.txt";
+	a->content = SCAR_TEST_TEXT;
+}
+
+// Iterate the index and look up a checksum, which reads from every
+// footer section. Returns the number of entries.
+static int read_footer(
+	struct scar_test_context scar_test_ctx, struct scar_reader *sr
+) {
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+	struct scar_index_entry entry;
+	int count = 0;
+	int ret;
+	while ((ret = scar_index_iterator_next(it, &entry)) > 0) {
+		ASSERT2(entry.size, ==, (uint64_t)5);
+		count += 1;
+	}
+	ASSERT2(ret, ==, 0);
+	scar_index_iterator_free(it);
+
+	uint32_t crc;
+	ASSERT2(scar_reader_segment_checksum(sr, 0, &crc), ==, 1);
+	return count;
+}
+
+TEST(one_read)
+{
+	struct scar_test_archive a;
+	describe_archive(&a, 100);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p_window(
+		&cp.pr, SCAR_FOOTER_DEFAULT_WINDOW);
+	ASSERT(sr != NULL);
+	ASSERT2(read_footer(scar_test_ctx, sr), ==, 100);
+	ASSERT2(cp.reads, ==, (size_t)1);
+
+	// Without a window, every section is a separate read
+	scar_reader_free(sr);
+	cp.reads = 0;
+	sr = scar_reader_create_p(&cp.pr);
+	ASSERT(sr != NULL);
+	ASSERT2(read_footer(scar_test_ctx, sr), ==, 100);
+	ASSERT2(cp.reads, >, (size_t)3);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(grow_once)
+{
+	struct scar_test_archive a;
+	describe_archive(&a, 5000);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p_window(&cp.pr, 1024);
+	ASSERT(sr != NULL);
+	ASSERT2(cp.reads, ==, (size_t)2);
+	ASSERT2(read_footer(scar_test_ctx, sr), ==, 5000);
+	ASSERT2(cp.reads, ==, (size_t)2);
+
+	// Cursors read the footer from memory too, and the tar body as usual
+	struct scar_cursor *c = scar_cursor_create_p(sr);
+	ASSERT(c != NULL);
+	struct scar_index_iterator *it = scar_cursor_iterate(c);
+	ASSERT(it != NULL);
+	struct scar_index_entry entry;
+	ASSERT2(scar_index_iterator_next(it, &entry), ==, 1);
+	scar_offset offset = entry.offset;
+	scar_index_iterator_free(it);
+	ASSERT2(cp.reads, ==, (size_t)2);
+
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+	struct scar_meta meta;
+	ASSERT2(scar_cursor_read_meta(c, offset, &global, &meta), ==, 0);
+	ASSERT2(strcmp(meta.path, "some/directory/file-0.txt"), ==, 0);
+	scar_meta_destroy(&meta);
+	ASSERT2(cp.reads, >, (size_t)2);
+
+	scar_cursor_free(c);
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(window_bigger_than_file)
+{
+	struct scar_test_archive a;
+	describe_archive(&a, 3);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_test_counting_preader cp;
+	scar_test_counting_preader_init(&cp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p_window(
+		&cp.pr, mw.len * 4);
+	ASSERT(sr != NULL);
+	ASSERT2(read_footer(scar_test_ctx, sr), ==, 3);
+
+	// The whole file fits, so reading an entry doesn't read again
+	struct scar_index_entry entry;
+	ASSERT2(scar_reader_find_entry(
+		sr, "some/directory/file-2.txt", &entry), ==, 1);
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, entry.offset, 2), ==, 0);
+	ASSERT2(cp.reads, ==, (size_t)1);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(read_across_window_start)
+{
+	// With plain compression, the window can start anywhere in the body,
+	// so entries' headers and content run from before the window into it
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, 20, 1000);
+	a.comp = &plain;
+	a.level = 0;
+	a.path = "file-%d";
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	for (size_t window = 8192; window < 8192 + 1024; window += 64) {
+		struct scar_test_counting_preader cp;
+		scar_test_counting_preader_init(&cp, mw.buf, mw.len);
+		struct scar_reader *sr = scar_reader_create_p_window(&cp.pr, window);
+		ASSERT(sr != NULL);
+
+		for (int i = 0; i < 20; ++i) {
+			char path[32];
+			snprintf(path, sizeof(path), "file-%d", i);
+			struct scar_index_entry entry;
+			ASSERT2(scar_reader_find_entry(sr, path, &entry), ==, 1);
+			ASSERT2(scar_test_check_file(
+				scar_test_ctx, &a, sr, entry.offset, i), ==, 0);
+		}
+
+		scar_reader_free(sr);
+	}
+
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(
+	footer_window, one_read, grow_once, window_bigger_than_file,
+	read_across_window_start);
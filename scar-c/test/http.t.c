@@ -0,0 +1,305 @@
+// For sockets, poll and MSG_NOSIGNAL
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "http.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+
+TEST(is_url)
+{
+	ASSERT(scar_http_is_url("http://example.com/a.scar"));
+	ASSERT(scar_http_is_url("https://example.com/a.scar"));
+	ASSERT(!scar_http_is_url("a.scar"));
+	ASSERT(!scar_http_is_url("/tmp/http://a.scar"));
+	ASSERT(!scar_http_is_url("ftp://example.com/a.scar"));
+	OK();
+}
+
+#if defined(SCAR_HAVE_CURL) && !defined(_WIN32)
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "block-cache.h"
+#include "ioutil.h"
+#include "scar-reader.h"
+#include "test-util.h"
+
+#define FILE_COUNT 200
+#define FILE_SIZE 4096
+
+// A minimal HTTP/1.1 server on localhost, which serves 'data'
+// with support for single byte ranges.
+struct test_server {
+	int fd;
+	int port;
+	const unsigned char *data;
+	size_t len;
+	bool ignore_ranges;
+	pthread_t thread;
+
+	pthread_mutex_t mut;
+	bool stop;
+	size_t requests;
+};
+
+static int send_all(int fd, const void *buf, size_t len)
+{
+	const char *ptr = buf;
+	while (len > 0) {
+		ssize_t n = send(fd, ptr, len, MSG_NOSIGNAL);
+		if (n <= 0) {
+			return -1;
+		}
+		ptr += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+static void serve_request(struct test_server *srv, int fd)
+{
+	char req[4096];
+	size_t len = 0;
+	while (len < sizeof(req) - 1) {
+		ssize_t n = recv(fd, &req[len], sizeof(req) - 1 - len, 0);
+		if (n <= 0) {
+			return;
+		}
+		len += (size_t)n;
+		req[len] = '\0';
+		if (strstr(req, "\r\n\r\n")) {
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&srv->mut);
+	srv->requests += 1;
+	pthread_mutex_unlock(&srv->mut);
+
+	bool head = strncmp(req, "HEAD ", 5) == 0;
+	size_t start = 0;
+	size_t end = srv->len;
+	bool ranged = false;
+	char *range = strstr(req, "Range: bytes=");
+	if (range && !srv->ignore_ranges) {
+		unsigned long long a, b;
+		if (sscanf(range, "Range: bytes=%llu-%llu", &a, &b) != 2) {
+			return;
+		}
+
+		if (a >= srv->len) {
+			const char *resp =
+				"HTTP/1.1 416 Range Not Satisfiable\r\n"
+				"Content-Length: 0\r\nConnection: close\r\n\r\n";
+			send_all(fd, resp, strlen(resp));
+			return;
+		}
+
+		start = (size_t)a;
+		end = b + 1 < srv->len ? (size_t)b + 1 : srv->len;
+		ranged = true;
+	}
+
+	char hdr[256];
+	if (ranged) {
+		snprintf(
+			hdr, sizeof(hdr),
+			"HTTP/1.1 206 Partial Content\r\n"
+			"Content-Range: bytes %zu-%zu/%zu\r\n"
+			"Content-Length: %zu\r\nConnection: close\r\n\r\n",
+			start, end - 1, srv->len, end - start);
+	} else {
+		snprintf(
+			hdr, sizeof(hdr),
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Length: %zu\r\nConnection: close\r\n\r\n",
+			srv->len);
+	}
+
+	if (send_all(fd, hdr, strlen(hdr)) < 0 || head) {
+		return;
+	}
+
+	send_all(fd, &srv->data[start], end - start);
+}
+
+static void *server_thread(void *ptr)
+{
+	struct test_server *srv = ptr;
+	while (1) {
+		pthread_mutex_lock(&srv->mut);
+		bool stop = srv->stop;
+		pthread_mutex_unlock(&srv->mut);
+		if (stop) {
+			break;
+		}
+
+		struct pollfd pfd = {srv->fd, POLLIN, 0};
+		if (poll(&pfd, 1, 20) <= 0) {
+			continue;
+		}
+
+		int fd = accept(srv->fd, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+
+		serve_request(srv, fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static int server_start(
+	struct test_server *srv, const void *data, size_t len
+) {
+	srv->data = data;
+	srv->len = len;
+	srv->ignore_ranges = false;
+	srv->stop = false;
+	srv->requests = 0;
+
+	srv->fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (srv->fd < 0) {
+		return -1;
+	}
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t addrlen = sizeof(addr);
+	if (
+		bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+		listen(srv->fd, 16) < 0 ||
+		getsockname(srv->fd, (struct sockaddr *)&addr, &addrlen) < 0
+	) {
+		close(srv->fd);
+		return -1;
+	}
+	srv->port = ntohs(addr.sin_port);
+
+	pthread_mutex_init(&srv->mut, NULL);
+	if (pthread_create(&srv->thread, NULL, server_thread, srv) != 0) {
+		pthread_mutex_destroy(&srv->mut);
+		close(srv->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static size_t server_stop(struct test_server *srv)
+{
+	pthread_mutex_lock(&srv->mut);
+	srv->stop = true;
+	pthread_mutex_unlock(&srv->mut);
+
+	pthread_join(srv->thread, NULL);
+	close(srv->fd);
+	pthread_mutex_destroy(&srv->mut);
+	return srv->requests;
+}
+
+TEST(ranged_reads)
+{
+	unsigned char data[1000];
+	for (size_t i = 0; i < sizeof(data); ++i) {
+		data[i] = (unsigned char)(i % 251);
+	}
+
+	struct test_server srv;
+	ASSERT2(server_start(&srv, data, sizeof(data)), ==, 0);
+
+	char url[64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%d/data", srv.port);
+	struct scar_io_preader *pr = scar_http_preader_create(url);
+	ASSERT(pr != NULL);
+
+	unsigned char buf[64];
+	ASSERT2(pr->size(pr), ==, 1000);
+	ASSERT2(pr->read_at(pr, 100, buf, 20), ==, 20);
+	ASSERT2(memcmp(buf, &data[100], 20), ==, 0);
+	ASSERT2(pr->read_at(pr, 990, buf, sizeof(buf)), ==, 10);
+	ASSERT2(memcmp(buf, &data[990], 10), ==, 0);
+	ASSERT2(pr->read_at(pr, 1000, buf, sizeof(buf)), ==, 0);
+
+	// A server which ignores the range still gives the right data
+	pthread_mutex_lock(&srv.mut);
+	srv.ignore_ranges = true;
+	pthread_mutex_unlock(&srv.mut);
+	ASSERT2(pr->read_at(pr, 500, buf, 20), ==, 20);
+	ASSERT2(memcmp(buf, &data[500], 20), ==, 0);
+
+	ASSERT2(scar_http_preader_request_count(pr), ==, (size_t)5);
+	scar_http_preader_free(pr);
+	ASSERT2(server_stop(&srv), ==, (size_t)5);
+	OK();
+}
+
+TEST(remote_archive)
+{
+	// Random bytes, which don't compress, so that the archive is big
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, FILE_COUNT, FILE_SIZE);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct test_server srv;
+	ASSERT2(server_start(&srv, mw.buf, mw.len), ==, 0);
+
+	char url[64];
+	snprintf(url, sizeof(url), "http://127.0.0.1:%d/a.scar", srv.port);
+	struct scar_io_preader *hp = scar_http_preader_create(url);
+	ASSERT(hp != NULL);
+	struct scar_io_preader *pr = scar_block_cache_create(hp, 0, 0);
+	ASSERT(pr != NULL);
+
+	struct scar_reader *sr = scar_reader_create_p(pr);
+	ASSERT(sr != NULL);
+
+	// Opening the archive and listing it only needs the footer:
+	// a HEAD request for the size, and one for the end of the file
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+	ASSERT2(scar_http_preader_request_count(hp), ==, (size_t)2);
+
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, offsets[150], 150), ==, 0);
+
+	// Reading one file means decompressing from the start of its segment,
+	// which the cache's read-ahead does in a few big requests
+	size_t requests = scar_http_preader_request_count(hp);
+	ASSERT2(requests, <=, (size_t)6);
+	ASSERT2(mw.len, >, (size_t)(FILE_COUNT * FILE_SIZE));
+
+	scar_reader_free(sr);
+	scar_block_cache_free(pr);
+	scar_http_preader_free(hp);
+	ASSERT2(server_stop(&srv), ==, requests);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(http, is_url, ranged_reads, remote_archive);
+
+#else
+
+TESTGROUP(http, is_url);
+
+#endif
@@ -0,0 +1,89 @@
+#include "scar-reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "scar-writer.h"
+#include "test.h"
+#include "test-util.h"
+
+static int make_archive(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw,
+	int opts
+) {
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, 1, 12);
+	a.opts = opts;
+	a.dir = "dir/";
+	a.path = "dir/file-%d.txt";
+	a.content = SCAR_TEST_TEXT;
+	a.mode = 0644;
+	a.mtime = 1700000000.25;
+	return scar_test_make_archive(scar_test_ctx, &a, mw);
+}
+
+TEST(with_meta)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, SCAR_WRITER_META), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+
+	struct scar_index_entry entry;
+	ASSERT2(scar_index_iterator_next(it, &entry), ==, 1);
+	ASSERT2(strcmp(entry.name, "dir/"), ==, 0);
+	ASSERT2(entry.mode, ==, 0755u);
+	ASSERT(!SCAR_META_IS_UINT(entry.size));
+	ASSERT2(entry.mtime, ==, 1700000000.25);
+
+	ASSERT2(scar_index_iterator_next(it, &entry), ==, 1);
+	ASSERT2(strcmp(entry.name, "dir/file-0.txt"), ==, 0);
+	ASSERT2(entry.mode, ==, 0644u);
+	ASSERT2(entry.size, ==, (uint64_t)12);
+	ASSERT2(entry.mtime, ==, 1700000000.25);
+
+	ASSERT2(scar_index_iterator_next(it, &entry), ==, 0);
+
+	scar_index_iterator_free(it);
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(without_meta)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, 0), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+
+	struct scar_index_entry entry;
+	int count = 0;
+	while (scar_index_iterator_next(it, &entry) > 0) {
+		ASSERT(!SCAR_META_IS_UINT(entry.mode));
+		ASSERT(!SCAR_META_IS_UINT(entry.size));
+		ASSERT(!SCAR_META_IS_FLOAT(entry.mtime));
+		count += 1;
+	}
+	ASSERT2(count, ==, 2);
+
+	scar_index_iterator_free(it);
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(index_meta, with_meta, without_meta);
@@ -1,7 +1,23 @@
 #include "ioutil.h"
 
+#include <stdio.h>
+#include <string.h>
+
 #include "test.h"
 
+// A reader which can't lend out a buffer, and hands out
+// at most 100 bytes per read
+struct small_reader {
+	struct scar_io_reader r;
+	struct scar_mem_reader *inner;
+};
+
+static scar_ssize small_read(struct scar_io_reader *r, void *buf, size_t len)
+{
+	struct small_reader *sr = (struct small_reader *)r;
+	return sr->inner->r.read(&sr->inner->r, buf, len < 100 ? len : 100);
+}
+
 TEST(repeated_consume) {
 	unsigned char text[4000];
 	for (size_t i = 0; i < sizeof(text); ++i) {
@@ -26,4 +42,77 @@ TEST(repeated_consume) {
 	OK();
 }
 
-TESTGROUP(ioutil_block_reader, repeated_consume);
+TEST(borrows_buffer)
+{
+	const char *text = "first line\nsecond line\r\n";
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, text, strlen(text));
+
+	// The bytes are parsed where they are
+	struct scar_block_reader br;
+	scar_block_reader_init(&br, &mr.r);
+	ASSERT((const char *)br.buf == text);
+
+	char line[64];
+	ASSERT2(scar_block_reader_read_line(&br, line, sizeof(line)), ==, 10);
+	ASSERT_STREQ(line, "first line");
+	ASSERT((const char *)&br.buf[br.index - 1] == &text[11]);
+	ASSERT2(scar_block_reader_read_line(&br, line, sizeof(line)), ==, 11);
+	ASSERT_STREQ(line, "second line");
+	ASSERT(br.next == EOF);
+	ASSERT(!br.error);
+
+	OK();
+}
+
+TEST(lines_and_reads)
+{
+	char text[3000];
+	size_t len = 0;
+	for (int i = 0; i < 200; ++i) {
+		len += (size_t)snprintf(&text[len], sizeof(text) - len, "line %d\n", i);
+	}
+
+	for (int buffered = 0; buffered <= 1; ++buffered) {
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, text, len);
+		struct small_reader sr = {{small_read, NULL, NULL}, &mr};
+		struct scar_block_reader br;
+		scar_block_reader_init(&br, buffered ? &mr.r : &sr.r);
+
+		// Lines which run over the end of the buffer
+		char line[16];
+		char expected[32];
+		for (int i = 0; i < 100; ++i) {
+			scar_ssize n = scar_block_reader_read_line(&br, line, sizeof(line));
+			snprintf(expected, sizeof(expected), "line %d", i);
+			ASSERT2(n, ==, (scar_ssize)strlen(expected));
+			ASSERT_STREQ(line, expected);
+		}
+
+		// Lines which are too long are cut short, and the rest is
+		// the next line
+		ASSERT2(scar_block_reader_read_line(&br, line, 5), ==, 4);
+		ASSERT_STREQ(line, "line");
+		ASSERT2(scar_block_reader_read_line(&br, line, sizeof(line)), ==, 4);
+		ASSERT_STREQ(line, " 100");
+
+		ASSERT2(scar_block_reader_skip(&br, 9), ==, 0);
+		char buf[8];
+		ASSERT2(scar_block_reader_read(&br.r, buf, 8), ==, 8);
+		ASSERT(memcmp(buf, "line 102", 8) == 0);
+
+		// Skip all but the last byte, then past the end
+		const char *rest = strstr(text, "line 103\n");
+		size_t left = len - (size_t)(rest - text) + 1;
+		ASSERT2(scar_block_reader_skip(&br, left - 1), ==, 0);
+		ASSERT2(br.next, ==, '\n');
+		ASSERT2(scar_block_reader_skip(&br, 2), ==, -1);
+		ASSERT(br.next == EOF);
+		ASSERT(!br.error);
+	}
+
+	OK();
+}
+
+TESTGROUP(ioutil_block_reader, repeated_consume, borrows_buffer, lines_and_reads);
@@ -0,0 +1,159 @@
+#include "ioutil.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pax.h"
+#include "test.h"
+
+// A reader which hands out at most 'max' bytes per read
+struct trickle_reader {
+	struct scar_io_reader r;
+	struct scar_mem_reader *inner;
+	size_t max;
+};
+
+static scar_ssize trickle_read(struct scar_io_reader *r, void *buf, size_t len)
+{
+	struct trickle_reader *tr = (struct trickle_reader *)r;
+	if (len > tr->max) {
+		len = tr->max;
+	}
+
+	return tr->inner->r.read(&tr->inner->r, buf, len);
+}
+
+// A writer which counts its write calls
+struct call_counting_writer {
+	struct scar_io_writer w;
+	struct scar_mem_writer *inner;
+	size_t calls;
+};
+
+static scar_ssize call_counting_write(
+	struct scar_io_writer *w, const void *buf, size_t len
+) {
+	struct call_counting_writer *cw = (struct call_counting_writer *)w;
+	cw->calls += 1;
+	return cw->inner->w.write(&cw->inner->w, buf, len);
+}
+
+static unsigned char *make_data(size_t len)
+{
+	unsigned char *data = malloc(len + 1);
+	for (size_t i = 0; data && i < len; ++i) {
+		data[i] = (unsigned char)(i * 7 % 251);
+	}
+
+	return data;
+}
+
+TEST(read_full)
+{
+	unsigned char *data = make_data(5000);
+	ASSERT(data != NULL);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, data, 5000);
+
+	// Whatever was in the struct before,
+	// the reader only has 'read' once it's set up
+	struct trickle_reader tr;
+	memset(&tr, 0xff, sizeof(tr));
+	scar_io_reader_init(&tr.r, trickle_read);
+	tr.inner = &mr;
+	tr.max = 7;
+	ASSERT(tr.r.fill_buf == NULL && tr.r.consume == NULL);
+
+	unsigned char buf[4096];
+	ASSERT2(scar_io_read_full(&tr.r, buf, sizeof(buf)), ==, 4096);
+	ASSERT2(memcmp(buf, data, 4096), ==, 0);
+
+	// Short only at the end of the data
+	ASSERT2(scar_io_read_full(&tr.r, buf, sizeof(buf)), ==, 904);
+	ASSERT2(memcmp(buf, &data[4096], 904), ==, 0);
+	ASSERT2(scar_io_read_full(&tr.r, buf, sizeof(buf)), ==, 0);
+
+	free(data);
+	OK();
+}
+
+TEST(copy_in_chunks)
+{
+	size_t len = 3 * SCAR_IO_CHUNK_SIZE + 100;
+	unsigned char *data = make_data(len);
+	ASSERT(data != NULL);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, data, len);
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	struct call_counting_writer cw = {{call_counting_write}, &mw, 0};
+
+	ASSERT2(scar_io_copy(&mr.r, &cw.w), ==, (scar_ssize)len);
+	ASSERT2(mw.len, ==, len);
+	ASSERT2(memcmp(mw.buf, data, len), ==, 0);
+	ASSERT2(cw.calls, ==, (size_t)4);
+
+	free(mw.buf);
+	free(data);
+	OK();
+}
+
+TEST(pax_content)
+{
+	static const size_t sizes[] = {
+		0, 1, 511, 512, 513, 8192, 8193, SCAR_IO_CHUNK_SIZE,
+		SCAR_IO_CHUNK_SIZE + 700, 3 * SCAR_IO_CHUNK_SIZE - 1,
+	};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+		size_t size = sizes[i];
+		size_t padded = (size + 511) / 512 * 512;
+		unsigned char *data = make_data(size);
+		ASSERT(data != NULL);
+
+		// Write from a reader which only has the content
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, data, size);
+		struct trickle_reader tr = {{trickle_read, NULL, NULL}, &mr, 1000};
+		struct scar_mem_writer tar;
+		scar_mem_writer_init(&tar);
+		struct call_counting_writer cw = {{call_counting_write}, &tar, 0};
+		ASSERT2(scar_pax_write_content(&tr.r, &cw.w, size), ==, 0);
+		ASSERT2(tar.len, ==, padded);
+		ASSERT2(cw.calls, ==, (padded + SCAR_IO_CHUNK_SIZE - 1) /
+			SCAR_IO_CHUNK_SIZE);
+		ASSERT(size == 0 || memcmp(tar.buf, data, size) == 0);
+		for (size_t j = size; j < padded; ++j) {
+			ASSERT2(((unsigned char *)tar.buf)[j], ==, 0);
+		}
+
+		// Reading it back stops right after the padding
+		ASSERT2(scar_mem_writer_write(&tar.w, "next", 4), ==, 4);
+		scar_mem_reader_init(&mr, tar.buf, tar.len);
+		struct scar_mem_writer out;
+		scar_mem_writer_init(&out);
+		ASSERT2(scar_pax_read_content(&tr.r, &out.w, size), ==, 0);
+		ASSERT2(out.len, ==, size);
+		ASSERT(size == 0 || memcmp(out.buf, data, size) == 0);
+
+		char next[5] = {0};
+		ASSERT2(mr.r.read(&mr.r, next, 4), ==, 4);
+		ASSERT_STREQ(next, "next");
+
+		// Content which runs out early is an error
+		scar_mem_reader_init(&mr, data, size);
+		if (size > 0) {
+			ASSERT2(scar_pax_write_content(&tr.r, &cw.w, size + 1), ==, -1);
+		}
+
+		free(out.buf);
+		free(tar.buf);
+		free(data);
+	}
+
+	OK();
+}
+
+TESTGROUP(ioutil_copy, read_full, copy_in_chunks, pax_content);
@@ -0,0 +1,106 @@
+#include "ioutil.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meta.h"
+#include "pax.h"
+#include "test.h"
+
+static const uint64_t unsigned_values[] = {
+	0, 1, 7, 8, 9, 10, 99, 100, 511, 512, 4095, 07777777, 010000000,
+	077777777777ull, 0777777777777ull, 1000000000000ull,
+	INT64_MAX, (uint64_t)INT64_MAX + 1, UINT64_MAX - 1, UINT64_MAX,
+};
+
+static const int64_t signed_values[] = {
+	0, 1, -1, 9, -9, 10, -10, 1700000000, -1700000000,
+	INT64_MAX, INT64_MIN + 1, INT64_MIN,
+};
+
+#define COUNT(arr) (sizeof(arr) / sizeof(*(arr)))
+
+TEST(format_decimal)
+{
+	char buf[SCAR_FORMAT_MAX + 1];
+	char expected[32];
+
+	for (size_t i = 0; i < COUNT(unsigned_values); ++i) {
+		uint64_t num = unsigned_values[i];
+		size_t len = scar_format_u64(buf, num);
+		buf[len] = '\0';
+		snprintf(expected, sizeof(expected), "%" PRIu64, num);
+		ASSERT_STREQ(buf, expected);
+	}
+
+	for (size_t i = 0; i < COUNT(signed_values); ++i) {
+		int64_t num = signed_values[i];
+		size_t len = scar_format_i64(buf, num);
+		buf[len] = '\0';
+		snprintf(expected, sizeof(expected), "%" PRId64, num);
+		ASSERT_STREQ(buf, expected);
+	}
+
+	OK();
+}
+
+TEST(format_octal)
+{
+	char buf[SCAR_FORMAT_MAX + 1];
+	char expected[32];
+
+	for (size_t i = 0; i < COUNT(unsigned_values); ++i) {
+		uint64_t num = unsigned_values[i];
+		size_t len = scar_format_octal(buf, num);
+		buf[len] = '\0';
+		snprintf(expected, sizeof(expected), "%" PRIo64, num);
+		ASSERT_STREQ(buf, expected);
+	}
+
+	OK();
+}
+
+TEST(pax_scratch_is_reused)
+{
+	struct scar_mem_writer scratch;
+	scar_mem_writer_init(&scratch);
+
+	// A long path needs a pax extended header
+	char path[300];
+	memset(path, 'a', sizeof(path) - 1);
+	path[sizeof(path) - 1] = '\0';
+
+	struct scar_meta meta;
+	scar_meta_init_file(&meta, path, 10);
+	meta.mode = 0644;
+	meta.uid = 010000000;
+	meta.mtime = 1700000000.5;
+
+	struct scar_mem_writer a, b;
+	scar_mem_writer_init(&a);
+	scar_mem_writer_init(&b);
+	ASSERT2(scar_pax_write_meta(&meta, &a.w), ==, 0);
+	ASSERT2(scar_pax_write_meta_scratch(&meta, &b.w, &scratch), ==, 0);
+	ASSERT2(a.len, ==, (size_t)1536);
+	ASSERT2(a.len, ==, b.len);
+	ASSERT2(memcmp(a.buf, b.buf, a.len), ==, 0);
+
+	// Writing the same header again doesn't need a bigger buffer
+	void *buf = scratch.buf;
+	size_t cap = scratch.cap;
+	ASSERT2(scar_pax_write_meta_scratch(&meta, &b.w, &scratch), ==, 0);
+	ASSERT(scratch.buf == buf);
+	ASSERT2(scratch.cap, ==, cap);
+	ASSERT2(b.len, ==, 2 * a.len);
+	ASSERT2(memcmp(a.buf, (char *)b.buf + a.len, a.len), ==, 0);
+
+	scar_meta_destroy(&meta);
+	free(a.buf);
+	free(b.buf);
+	free(scratch.buf);
+	OK();
+}
+
+TESTGROUP(ioutil_format, format_decimal, format_octal, pax_scratch_is_reused);
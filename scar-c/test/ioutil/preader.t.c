@@ -0,0 +1,96 @@
+// For fileno
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "io.h"
+#include "test.h"
+
+TEST(mem_preader_read_at)
+{
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, "Hello World", 11);
+
+	char buf[4];
+	ASSERT2(mp.pr.read_at(&mp.pr, 6, buf, sizeof(buf)), ==, 4);
+	ASSERT_STREQ_N(buf, "Worl", 4);
+	ASSERT2(mp.pr.read_at(&mp.pr, 0, buf, sizeof(buf)), ==, 4);
+	ASSERT_STREQ_N(buf, "Hell", 4);
+	ASSERT2(mp.pr.read_at(&mp.pr, 9, buf, sizeof(buf)), ==, 2);
+	ASSERT_STREQ_N(buf, "ld", 2);
+	ASSERT2(mp.pr.read_at(&mp.pr, 11, buf, sizeof(buf)), ==, 0);
+	ASSERT2(mp.pr.size(&mp.pr), ==, 11);
+
+	OK();
+}
+
+TEST(preader_stream)
+{
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, "Hello World", 11);
+
+	// Two streams on one preader have separate positions
+	struct scar_preader_stream a, b;
+	scar_preader_stream_init(&a, &mp.pr);
+	scar_preader_stream_init(&b, &mp.pr);
+
+	char buf[3];
+	ASSERT2(b.s.seek(&b.s, -3, SCAR_SEEK_END), ==, 0);
+	ASSERT2(a.r.read(&a.r, buf, sizeof(buf)), ==, 3);
+	ASSERT_STREQ_N(buf, "Hel", 3);
+	ASSERT2(b.r.read(&b.r, buf, sizeof(buf)), ==, 3);
+	ASSERT_STREQ_N(buf, "rld", 3);
+	ASSERT2(a.r.read(&a.r, buf, sizeof(buf)), ==, 3);
+	ASSERT_STREQ_N(buf, "lo ", 3);
+	ASSERT2(a.s.tell(&a.s), ==, 6);
+	ASSERT2(b.s.tell(&b.s), ==, 11);
+
+	ASSERT2(a.s.seek(&a.s, -2, SCAR_SEEK_CURRENT), ==, 0);
+	ASSERT2(a.r.read(&a.r, buf, sizeof(buf)), ==, 3);
+	ASSERT_STREQ_N(buf, "o W", 3);
+
+	OK();
+}
+
+#ifndef _WIN32
+TEST(fd_and_mmap_preader)
+{
+	FILE *f = tmpfile();
+	ASSERT(f != NULL);
+	ASSERT2(fputs("Hello World", f), >=, 0);
+	ASSERT2(fflush(f), ==, 0);
+
+	struct scar_fd_preader fp;
+	ASSERT2(scar_fd_preader_init(&fp, fileno(f)), ==, 0);
+	ASSERT2(fp.pr.size(&fp.pr), ==, 11);
+
+	char buf[5];
+	ASSERT2(fp.pr.read_at(&fp.pr, 6, buf, sizeof(buf)), ==, 5);
+	ASSERT_STREQ_N(buf, "World", 5);
+	ASSERT2(fp.pr.read_at(&fp.pr, 0, buf, sizeof(buf)), ==, 5);
+	ASSERT_STREQ_N(buf, "Hello", 5);
+	ASSERT2(fp.pr.read_at(&fp.pr, 20, buf, sizeof(buf)), ==, 0);
+
+	struct scar_mmap_preader mm;
+	ASSERT2(scar_mmap_preader_init(&mm, fileno(f)), ==, 0);
+	ASSERT2(mm.mp.pr.size(&mm.mp.pr), ==, 11);
+	ASSERT2(mm.mp.pr.read_at(&mm.mp.pr, 6, buf, sizeof(buf)), ==, 5);
+	ASSERT_STREQ_N(buf, "World", 5);
+	scar_mmap_preader_destroy(&mm);
+
+	fclose(f);
+	OK();
+}
+#endif
+
+#ifdef _WIN32
+TESTGROUP(ioutil_preader, mem_preader_read_at, preader_stream);
+#else
+TESTGROUP(ioutil_preader,
+	mem_preader_read_at, preader_stream, fd_and_mmap_preader);
+#endif
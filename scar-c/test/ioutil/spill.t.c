@@ -0,0 +1,160 @@
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io.h"
+#include "scar-reader.h"
+#include "scar-writer.h"
+#include "test.h"
+#include "test-util.h"
+
+static void fill(unsigned char *buf, size_t len, unsigned int seed)
+{
+	for (size_t i = 0; i < len; ++i) {
+		buf[i] = (unsigned char)(seed + i * 7 + i / 251);
+	}
+}
+
+// Write 'len' bytes in uneven chunks.
+static int write_chunks(
+	struct scar_test_context scar_test_ctx, struct scar_spill_writer *sw,
+	const unsigned char *buf, size_t len
+) {
+	size_t pos = 0;
+	size_t chunk = 1;
+	while (pos < len) {
+		size_t n = chunk < len - pos ? chunk : len - pos;
+		ASSERT2(sw->w.write(&sw->w, &buf[pos], n), ==, (scar_ssize)n);
+		pos += n;
+		chunk = chunk * 3 + 1;
+	}
+	return 0;
+}
+
+TEST(stays_in_memory)
+{
+	unsigned char data[1000];
+	fill(data, sizeof(data), 1);
+
+	struct scar_spill_writer sw;
+	scar_spill_writer_init(&sw, 4096);
+	ASSERT2(write_chunks(scar_test_ctx, &sw, data, sizeof(data)), ==, 0);
+	ASSERT(sw.f == NULL);
+	ASSERT2(sw.len, ==, (scar_offset)sizeof(data));
+
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	ASSERT2(scar_spill_writer_copy_to(&sw, &mw.w), ==, 0);
+	ASSERT2(mw.len, ==, sizeof(data));
+	ASSERT2(memcmp(mw.buf, data, sizeof(data)), ==, 0);
+
+	free(mw.buf);
+	scar_spill_writer_destroy(&sw);
+	OK();
+}
+
+TEST(spills_to_file)
+{
+	static unsigned char data[300 * 1000];
+	fill(data, sizeof(data), 2);
+
+	struct scar_spill_writer sw;
+	scar_spill_writer_init(&sw, 4096);
+	ASSERT2(write_chunks(scar_test_ctx, &sw, data, sizeof(data)), ==, 0);
+	ASSERT(sw.f != NULL);
+	ASSERT(sw.mem.buf == NULL);
+	ASSERT2(sw.len, ==, (scar_offset)sizeof(data));
+
+	// Copying to memory goes through a buffer
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	ASSERT2(scar_spill_writer_copy_to(&sw, &mw.w), ==, 0);
+	ASSERT2(mw.len, ==, sizeof(data));
+	ASSERT2(memcmp(mw.buf, data, sizeof(data)), ==, 0);
+	free(mw.buf);
+
+	// Copying to a file may go from file to file, after what's been
+	// written to the file handle so far
+	FILE *f = tmpfile();
+	ASSERT(f != NULL);
+	struct scar_file_handle fh;
+	scar_file_handle_init(&fh, f);
+	ASSERT2(scar_io_puts(&fh.w, "head"), ==, 4);
+	ASSERT2(scar_spill_writer_copy_to(&sw, &fh.w), ==, 0);
+	ASSERT2(scar_io_puts(&fh.w, "tail"), ==, 4);
+	ASSERT2(fflush(f), ==, 0);
+
+	ASSERT2(fseek(f, 0, SEEK_END), ==, 0);
+	ASSERT2(ftell(f), ==, (long)sizeof(data) + 8);
+	ASSERT2(fseek(f, 0, SEEK_SET), ==, 0);
+	unsigned char *back = malloc(sizeof(data) + 8);
+	ASSERT(back != NULL);
+	ASSERT2(fread(back, 1, sizeof(data) + 8, f), ==, sizeof(data) + 8);
+	ASSERT2(memcmp(back, "head", 4), ==, 0);
+	ASSERT2(memcmp(&back[4], data, sizeof(data)), ==, 0);
+	ASSERT2(memcmp(&back[4 + sizeof(data)], "tail", 4), ==, 0);
+	free(back);
+	fclose(f);
+
+	scar_spill_writer_destroy(&sw);
+	OK();
+}
+
+// Write an archive with many entries, spilling after 'threshold' bytes.
+static int make_archive(
+	struct scar_test_context scar_test_ctx, struct scar_io_writer *w,
+	size_t threshold
+) {
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, 3000, 2);
+	a.opts = SCAR_WRITER_META | SCAR_WRITER_CHECKSUMS;
+	a.spill_threshold = threshold;
+	a.path = "dir/file-%d.txt";
+	a.content = SCAR_TEST_TEXT;
+	return scar_test_write_archive(scar_test_ctx, &a, w);
+}
+
+TEST(writer_output_is_the_same)
+{
+	struct scar_mem_writer expected;
+	scar_mem_writer_init(&expected);
+	ASSERT2(make_archive(scar_test_ctx, &expected.w, 0), ==, 0);
+
+	struct scar_mem_writer spilled;
+	scar_mem_writer_init(&spilled);
+	ASSERT2(make_archive(scar_test_ctx, &spilled.w, 256), ==, 0);
+	ASSERT2(spilled.len, ==, expected.len);
+	ASSERT2(memcmp(spilled.buf, expected.buf, expected.len), ==, 0);
+
+	FILE *f = tmpfile();
+	ASSERT(f != NULL);
+	struct scar_file_handle fh;
+	scar_file_handle_init(&fh, f);
+	ASSERT2(make_archive(scar_test_ctx, &fh.w, 256), ==, 0);
+	ASSERT2(fflush(f), ==, 0);
+	ASSERT2(fseek(f, 0, SEEK_SET), ==, 0);
+	unsigned char *back = malloc(expected.len + 1);
+	ASSERT(back != NULL);
+	ASSERT2(fread(back, 1, expected.len + 1, f), ==, expected.len);
+	ASSERT2(memcmp(back, expected.buf, expected.len), ==, 0);
+	free(back);
+	fclose(f);
+
+	// And it reads back
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, spilled.buf, spilled.len);
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+	struct scar_index_entry entry;
+	ASSERT2(scar_reader_find_entry(sr, "dir/file-2999.txt", &entry), ==, 1);
+	ASSERT2(entry.size, ==, (uint64_t)2);
+	scar_reader_free(sr);
+
+	free(expected.buf);
+	free(spilled.buf);
+	OK();
+}
+
+TESTGROUP(ioutil_spill, stays_in_memory, spills_to_file, writer_output_is_the_same);
@@ -4,10 +4,32 @@
 #include <string.h>
 
 #define TEST_GROUPS \
+	X(access_points) \
+	X(block_cache) \
+	X(bloom) \
 	X(compression) \
+	X(crc32c) \
+	X(cursor) \
+	X(fetch) \
+	X(footer_window) \
+	X(http) \
+	X(index_meta) \
 	X(ioutil_block_reader) \
+	X(ioutil_copy) \
+	X(ioutil_format) \
 	X(ioutil_mem) \
+	X(ioutil_preader) \
+	X(ioutil_spill) \
+	X(meta_arena) \
+	X(meta_global) \
+	X(page_cache) \
+	X(parallel_inflate) \
 	X(pax_syntax) \
+	X(plain_direct) \
+	X(recompress) \
+	X(sidecar) \
+	X(ustar) \
+	X(verify) \
 //
 
 #define X(name) extern struct scar_test_group name ## __test_group;
@@ -0,0 +1,254 @@
+#include "meta-arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "meta.h"
+#include "pax.h"
+#include "test.h"
+#include "ustar.h"
+
+TEST(alloc_and_reset)
+{
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	char *a = scar_meta_arena_strndup(arena, "hello world", 5);
+	ASSERT(a != NULL);
+	ASSERT_STREQ(a, "hello");
+
+	// Strings bigger than a chunk get a chunk of their own
+	size_t biglen = 3 * 1024 * 1024;
+	char *big = scar_meta_arena_alloc(arena, biglen);
+	ASSERT(big != NULL);
+	memset(big, 'x', biglen);
+
+	char *b = scar_meta_arena_strndup(arena, "after", 5);
+	ASSERT(b != NULL);
+	ASSERT_STREQ(a, "hello");
+	ASSERT_STREQ(b, "after");
+
+	// After a reset, the memory is handed out again
+	scar_meta_arena_reset(arena);
+	char *c = scar_meta_arena_strndup(arena, "again", 5);
+	ASSERT(c == a);
+	big = scar_meta_arena_alloc(arena, biglen);
+	ASSERT(big != NULL);
+	memset(big, 'y', biglen);
+
+	scar_meta_arena_free(arena);
+	OK();
+}
+
+TEST(intern)
+{
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	char *root = scar_meta_arena_intern(arena, "root", 4);
+	ASSERT(root != NULL);
+	ASSERT_STREQ(root, "root");
+	ASSERT(scar_meta_arena_intern(arena, "root", 4) == root);
+	ASSERT(scar_meta_arena_intern(arena, "rootless", 4) == root);
+
+	char *wheel = scar_meta_arena_intern(arena, "wheel", 5);
+	ASSERT(wheel != NULL);
+	ASSERT(wheel != root);
+	ASSERT_STREQ(wheel, "wheel");
+
+	// An equal string which was just allocated is given back to the arena
+	char *dup = scar_meta_arena_strndup(arena, "wheel", 5);
+	ASSERT(scar_meta_arena_intern(arena, dup, 5) == wheel);
+	char *next = scar_meta_arena_strndup(arena, "x", 1);
+	ASSERT(next == dup);
+
+	// A new string which was just allocated is used as it is
+	char *fresh = scar_meta_arena_strndup(arena, "staff", 5);
+	ASSERT(scar_meta_arena_intern(arena, fresh, 5) == fresh);
+
+	// Lots of distinct strings make the table grow
+	char *names[100];
+	for (int i = 0; i < 100; ++i) {
+		char name[16];
+		size_t len = scar_format_u64(name, (uint64_t)i);
+		names[i] = scar_meta_arena_intern(arena, name, len);
+		ASSERT(names[i] != NULL);
+	}
+	for (int i = 0; i < 100; ++i) {
+		char name[16];
+		size_t len = scar_format_u64(name, (uint64_t)i);
+		ASSERT(scar_meta_arena_intern(arena, name, len) == names[i]);
+	}
+	ASSERT(scar_meta_arena_intern(arena, "root", 4) == root);
+
+	scar_meta_arena_free(arena);
+	OK();
+}
+
+TEST(copy_arena)
+{
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	struct scar_meta src;
+	scar_meta_init_symlink(&src, "some/link", "some/target");
+	src.uname = malloc(5);
+	memcpy(src.uname, "user", 5);
+	src.comment = malloc(6);
+	memcpy(src.comment, "hello", 6);
+	src.uid = 1000;
+
+	struct scar_meta a, b;
+	ASSERT2(scar_meta_copy_arena(&a, &src, arena), ==, 0);
+	ASSERT2(scar_meta_copy_arena(&b, &src, arena), ==, 0);
+	scar_meta_destroy(&src);
+
+	ASSERT(a.type == SCAR_FT_SYMLINK);
+	ASSERT2(a.uid, ==, (uint64_t)1000);
+	ASSERT_STREQ(a.path, "some/link");
+	ASSERT_STREQ(a.linkpath, "some/target");
+	ASSERT_STREQ(a.comment, "hello");
+	ASSERT_STREQ(a.uname, "user");
+	ASSERT(a.gname == NULL);
+	ASSERT(a.charset == NULL);
+
+	ASSERT(a.path != b.path);
+	ASSERT(a.uname == b.uname);
+	ASSERT_STREQ(b.path, "some/link");
+
+	scar_meta_arena_free(arena);
+	OK();
+}
+
+// Write a few entries which need a pax header, ustar string fields,
+// and a global header
+static int write_entries(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw
+) {
+	scar_mem_writer_init(mw);
+
+	unsigned char block[512] = {0};
+	const char *global = "18 comment=global\n";
+	memcpy(&block[SCAR_UST_MAGIC.start], "ustar", 6);
+	block[SCAR_UST_TYPEFLAG.start] = 'g';
+	memcpy(&block[SCAR_UST_SIZE.start], "00000000022", 11);
+	scar_ustar_write_checksum(block);
+	ASSERT2(scar_mem_writer_write(&mw->w, block, 512), ==, 512);
+	memset(block, 0, sizeof(block));
+	memcpy(block, global, strlen(global));
+	ASSERT2(scar_mem_writer_write(&mw->w, block, 512), ==, 512);
+
+	char longpath[201];
+	memset(longpath, 'p', 200);
+	longpath[200] = '\0';
+
+	for (int i = 0; i < 3; ++i) {
+		struct scar_meta meta;
+		scar_meta_init_file(&meta, i == 1 ? longpath : "short", 0);
+		meta.uname = malloc(6);
+		memcpy(meta.uname, "alice", 6);
+		meta.gname = malloc(6);
+		memcpy(meta.gname, "staff", 6);
+		meta.mode = 0644;
+		meta.mtime = 1700000000;
+		ASSERT2(scar_pax_write_meta(&meta, &mw->w), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+
+	ASSERT2(scar_pax_write_end(&mw->w), ==, 0);
+	return 0;
+}
+
+TEST(read_meta_arena)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(write_entries(scar_test_ctx, &mw), ==, 0);
+
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	struct scar_mem_reader heap_r, arena_r;
+	scar_mem_reader_init(&heap_r, mw.buf, mw.len);
+	scar_mem_reader_init(&arena_r, mw.buf, mw.len);
+
+	struct scar_meta heap_global, arena_global;
+	scar_meta_init_empty(&heap_global);
+	scar_meta_init_empty(&arena_global);
+
+	char *uname = NULL;
+	for (int i = 0; i < 3; ++i) {
+		struct scar_meta heap, meta;
+		ASSERT2(scar_pax_read_meta(&heap_r.r, &heap_global, &heap), ==, 1);
+		ASSERT2(scar_pax_read_meta_arena(
+			&arena_r.r, &arena_global, &meta, arena), ==, 1);
+
+		ASSERT_STREQ(meta.path, heap.path);
+		ASSERT_STREQ(meta.uname, "alice");
+		ASSERT_STREQ(meta.gname, "staff");
+		ASSERT_STREQ(meta.comment, "global");
+		ASSERT_STREQ(meta.linkpath, "");
+		ASSERT2(meta.mode, ==, heap.mode);
+		ASSERT2(meta.size, ==, heap.size);
+		ASSERT(meta.mtime == heap.mtime);
+		scar_meta_destroy(&heap);
+
+		// Every entry shares the same user name
+		if (uname) {
+			ASSERT(meta.uname == uname);
+		}
+		uname = meta.uname;
+	}
+
+	struct scar_meta meta;
+	ASSERT2(scar_pax_read_meta_arena(
+		&arena_r.r, &arena_global, &meta, arena), ==, 0);
+	ASSERT_STREQ(arena_global.comment, "global");
+
+	scar_meta_destroy(&heap_global);
+	scar_meta_destroy(&arena_global);
+	scar_meta_arena_free(arena);
+	free(mw.buf);
+	OK();
+}
+
+TEST(ustar_prefix_path)
+{
+	// A ustar header whose name is longer than its prefix
+	unsigned char block[1536] = {0};
+	memcpy(&block[SCAR_UST_MAGIC.start], "ustar", 6);
+	block[SCAR_UST_TYPEFLAG.start] = '0';
+	memcpy(&block[SCAR_UST_SIZE.start], "00000000000", 11);
+	memset(&block[SCAR_UST_NAME.start], 'n', SCAR_UST_NAME.length);
+	block[SCAR_UST_PREFIX.start] = 'p';
+	scar_ustar_write_checksum(block);
+
+	char expected[103];
+	expected[0] = 'p';
+	expected[1] = '/';
+	memset(&expected[2], 'n', 100);
+	expected[102] = '\0';
+
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	for (int with_arena = 0; with_arena <= 1; ++with_arena) {
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, block, sizeof(block));
+		struct scar_meta global, meta;
+		scar_meta_init_empty(&global);
+		ASSERT2(scar_pax_read_meta_arena(
+			&mr.r, &global, &meta, with_arena ? arena : NULL), ==, 1);
+		ASSERT_STREQ(meta.path, expected);
+		if (!with_arena) {
+			scar_meta_destroy(&meta);
+		}
+	}
+
+	scar_meta_arena_free(arena);
+	OK();
+}
+
+TESTGROUP(
+	meta_arena, alloc_and_reset, intern, copy_arena, read_meta_arena,
+	ustar_prefix_path);
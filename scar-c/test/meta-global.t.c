@@ -0,0 +1,237 @@
+#include "meta.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "meta-arena.h"
+#include "pax.h"
+#include "pax-syntax.h"
+#include "scar-reader.h"
+#include "test.h"
+#include "test-util.h"
+#include "ustar.h"
+
+static struct scar_meta_global *create_empty(void)
+{
+	struct scar_meta meta;
+	scar_meta_init_empty(&meta);
+	return scar_meta_global_create(&meta);
+}
+
+TEST(copy_on_write)
+{
+	struct scar_meta meta;
+	scar_meta_init_empty(&meta);
+	meta.uname = malloc(5);
+	memcpy(meta.uname, "root", 5);
+
+	struct scar_meta_global *global = scar_meta_global_create(&meta);
+	ASSERT(global != NULL);
+	ASSERT(meta.uname == NULL);
+	ASSERT_STREQ(global->meta.uname, "root");
+
+	// Parsing attributes makes a new one, and leaves the old one alone
+	struct scar_meta_global *old = scar_meta_global_ref(global);
+	const char *attrs = "18 comment=global\n";
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, attrs, strlen(attrs));
+	ASSERT2(scar_pax_parse_global(&global, &mr.r, strlen(attrs)), ==, 0);
+	ASSERT(global != old);
+	ASSERT_STREQ(global->meta.comment, "global");
+	ASSERT_STREQ(global->meta.uname, "root");
+	ASSERT(old->meta.comment == NULL);
+	ASSERT_STREQ(old->meta.uname, "root");
+
+	// Bad attributes leave it as it was
+	const char *bad = "99 comment=bad\n";
+	struct scar_meta_global *before = global;
+	scar_mem_reader_init(&mr, bad, strlen(bad));
+	ASSERT2(scar_pax_parse_global(&global, &mr.r, strlen(bad)), ==, -1);
+	ASSERT(global == before);
+
+	scar_meta_global_unref(old);
+	scar_meta_global_unref(global);
+	scar_meta_global_unref(NULL);
+	OK();
+}
+
+// Write a global header with a long comment, followed by a few entries
+static int write_entries(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw,
+	size_t comment_len
+) {
+	scar_mem_writer_init(mw);
+
+	struct scar_mem_writer attrs;
+	scar_mem_writer_init(&attrs);
+	char *comment = malloc(comment_len + 1);
+	ASSERT(comment != NULL);
+	memset(comment, 'c', comment_len);
+	comment[comment_len] = '\0';
+	// A record's length includes the digits of the length itself
+	size_t len = comment_len + strlen(" comment=\n");
+	for (size_t digits = 1; ; ++digits) {
+		if ((size_t)snprintf(NULL, 0, "%zu", len + digits) == digits) {
+			len += digits;
+			break;
+		}
+	}
+	ASSERT2(scar_io_printf(&attrs.w, "%zu comment=%s\n", len, comment), ==,
+		(scar_ssize)len);
+	free(comment);
+
+	unsigned char block[512] = {0};
+	memcpy(&block[SCAR_UST_MAGIC.start], "ustar", 6);
+	block[SCAR_UST_TYPEFLAG.start] = 'g';
+	snprintf((char *)&block[SCAR_UST_SIZE.start], 12, "%011zo", attrs.len);
+	scar_ustar_write_checksum(block);
+	ASSERT2(scar_mem_writer_write(&mw->w, block, 512), ==, 512);
+	ASSERT2(scar_mem_writer_write(&mw->w, attrs.buf, attrs.len), ==,
+		(scar_ssize)attrs.len);
+	memset(block, 0, sizeof(block));
+	size_t pad = (512 - attrs.len % 512) % 512;
+	ASSERT2(scar_mem_writer_write(&mw->w, block, pad), ==, (scar_ssize)pad);
+	free(attrs.buf);
+
+	for (int i = 0; i < 3; ++i) {
+		char path[32];
+		snprintf(path, sizeof(path), "file-%d", i);
+		struct scar_meta meta;
+		scar_meta_init_file(&meta, path, 0);
+		meta.mode = 0644;
+		meta.mtime = 1700000000;
+		ASSERT2(scar_pax_write_meta(&meta, &mw->w), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+
+	ASSERT2(scar_pax_write_end(&mw->w), ==, 0);
+	return 0;
+}
+
+TEST(read_meta_shared)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(write_entries(scar_test_ctx, &mw, 10000), ==, 0);
+
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+	struct scar_meta_global *global = create_empty();
+	ASSERT(global != NULL);
+	struct scar_meta_global *initial = scar_meta_global_ref(global);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+
+	const char *comment = NULL;
+	for (int i = 0; i < 3; ++i) {
+		struct scar_meta meta;
+		scar_meta_arena_reset(arena);
+		ASSERT2(scar_pax_read_meta_shared(&mr.r, &global, &meta, arena), ==, 1);
+
+		char path[32];
+		snprintf(path, sizeof(path), "file-%d", i);
+		ASSERT_STREQ(meta.path, path);
+		ASSERT2(meta.mode, ==, 0644u);
+		ASSERT2(strlen(meta.comment), ==, (size_t)10000);
+
+		// The comment is never copied
+		ASSERT(meta.comment == global->meta.comment);
+		if (comment) {
+			ASSERT(meta.comment == comment);
+		}
+		comment = meta.comment;
+	}
+
+	ASSERT(global != initial);
+	ASSERT(initial->meta.comment == NULL);
+
+	// The arena keeps the global metadata alive until it's reset
+	struct scar_meta meta;
+	scar_meta_arena_reset(arena);
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_meta_global *g = scar_meta_global_ref(initial);
+	ASSERT2(scar_pax_read_meta_shared(&mr.r, &g, &meta, arena), ==, 1);
+	scar_meta_global_unref(g);
+	ASSERT2(strlen(meta.comment), ==, (size_t)10000);
+
+	scar_meta_arena_free(arena);
+	scar_meta_global_unref(initial);
+	scar_meta_global_unref(global);
+	free(mw.buf);
+	OK();
+}
+
+static int make_archive(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw
+) {
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, 10, 5);
+	a.path = "dir/file-%d.txt";
+	a.content = SCAR_TEST_TEXT;
+	return scar_test_make_archive(scar_test_ctx, &a, mw);
+}
+
+TEST(index_entries_share_global)
+{
+	struct scar_mem_writer archive;
+	ASSERT2(make_archive(scar_test_ctx, &archive), ==, 0);
+
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, archive.buf, archive.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+
+	struct scar_meta_global *first = NULL;
+	struct scar_index_entry entry;
+	int count = 0;
+	int ret;
+	while ((ret = scar_index_iterator_next(it, &entry)) > 0) {
+		ASSERT(entry.shared_global != NULL);
+		ASSERT(entry.global == &entry.shared_global->meta);
+		if (first) {
+			ASSERT(entry.shared_global == first);
+		} else {
+			first = scar_meta_global_ref(entry.shared_global);
+		}
+
+		struct scar_meta meta;
+		scar_meta_arena_reset(arena);
+		ASSERT2(scar_reader_read_meta_shared(
+			sr, entry.offset, entry.shared_global, &meta, arena), ==, 0);
+		ASSERT_STREQ(meta.path, entry.name);
+		ASSERT2(meta.size, ==, (uint64_t)5);
+		count += 1;
+	}
+	ASSERT2(ret, ==, 0);
+	ASSERT2(count, ==, 10);
+	scar_index_iterator_free(it);
+
+	// The entry found by path holds on to the global metadata,
+	// even after the iterator it came from is gone
+	ASSERT2(scar_reader_find_entry(sr, "dir/file-3.txt", &entry), ==, 1);
+	ASSERT(entry.shared_global != NULL);
+	ASSERT(entry.global == &entry.shared_global->meta);
+	ASSERT(entry.global->comment == NULL);
+	struct scar_meta meta;
+	scar_meta_arena_reset(arena);
+	ASSERT2(scar_reader_read_meta_shared(
+		sr, entry.offset, entry.shared_global, &meta, arena), ==, 0);
+	ASSERT_STREQ(meta.path, "dir/file-3.txt");
+
+	scar_meta_global_unref(first);
+	scar_meta_arena_free(arena);
+	scar_reader_free(sr);
+	free(archive.buf);
+	OK();
+}
+
+TESTGROUP(
+	meta_global, copy_on_write, read_meta_shared, index_entries_share_global);
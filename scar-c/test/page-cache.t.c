@@ -0,0 +1,150 @@
+#include "scar-reader.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "test.h"
+#include "test-util.h"
+
+#define FILE_COUNT 40
+#define BIG_FILE 20
+#define BIG_SIZE (200 * 1024)
+
+static size_t file_size(int idx)
+{
+	return idx == BIG_FILE ? BIG_SIZE : 1000 + (size_t)idx * 500;
+}
+
+// Random bytes, which don't compress, so that the archive spans many pages
+static void describe_archive(struct scar_test_archive *a)
+{
+	scar_test_archive_init(a, FILE_COUNT, 0);
+	a->file_size = file_size;
+}
+
+TEST(hot_entries)
+{
+	struct scar_test_archive a;
+	describe_archive(&a);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+
+	// Without a cache, there are no counters
+	struct scar_page_cache_stats stats;
+	scar_reader_page_cache_stats(sr, &stats);
+	ASSERT2(stats.hits + stats.misses, ==, (size_t)0);
+
+	ASSERT2(scar_reader_set_page_cache(sr, 16 * 1024 * 1024), ==, 0);
+	struct scar_cursor *c = scar_cursor_create_p(sr);
+	ASSERT(c != NULL);
+
+	// Reading everything in order decompresses each page once
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		ASSERT2(scar_test_check_cursor_file(
+			scar_test_ctx, &a, c, offsets[i], i), ==, 0);
+	}
+	scar_reader_page_cache_stats(sr, &stats);
+	size_t misses = stats.misses;
+	ASSERT(misses > 0);
+	ASSERT(stats.bytes > (size_t)BIG_SIZE);
+
+	// Reading them again, in any order, is served from the cache,
+	// by other cursors as well
+	struct scar_cursor *c2 = scar_cursor_create_p(sr);
+	ASSERT(c2 != NULL);
+	for (int i = FILE_COUNT - 1; i >= 0; --i) {
+		ASSERT2(scar_test_check_cursor_file(
+			scar_test_ctx, &a, c2, offsets[i], i), ==, 0);
+		ASSERT2(scar_test_check_cursor_file(
+			scar_test_ctx, &a, c, offsets[i], i), ==, 0);
+	}
+	scar_reader_page_cache_stats(sr, &stats);
+	ASSERT2(stats.misses, ==, misses);
+	ASSERT(stats.hits > 0);
+
+	scar_cursor_free(c2);
+	scar_cursor_free(c);
+
+	// Turning the cache off reads through the decompressor again
+	ASSERT2(scar_reader_set_page_cache(sr, 0), ==, 0);
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+	struct scar_meta meta;
+	ASSERT2(scar_reader_read_meta(
+		sr, offsets[BIG_FILE], &global, &meta), ==, 0);
+	struct scar_mem_writer content;
+	scar_mem_writer_init(&content);
+	ASSERT2(scar_reader_read_content(sr, &content.w, meta.size), ==, 0);
+	ASSERT2(content.len, ==, (size_t)BIG_SIZE);
+	scar_meta_destroy(&meta);
+	scar_meta_destroy(&global);
+	free(content.buf);
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(memory_limit)
+{
+	struct scar_test_archive a;
+	describe_archive(&a);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+
+	// Room for just two pages
+	size_t limit = 2 * 64 * 1024;
+	ASSERT2(scar_reader_set_page_cache(sr, limit), ==, 0);
+	struct scar_cursor *c = scar_cursor_create_p(sr);
+	ASSERT(c != NULL);
+
+	struct scar_page_cache_stats stats;
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		ASSERT2(scar_test_check_cursor_file(
+			scar_test_ctx, &a, c, offsets[i], i), ==, 0);
+		scar_reader_page_cache_stats(sr, &stats);
+		ASSERT2(stats.bytes, <=, limit);
+	}
+
+	// The last file is still cached, the first one has been evicted
+	size_t misses = stats.misses;
+	ASSERT2(scar_test_check_cursor_file(
+		scar_test_ctx, &a, c, offsets[FILE_COUNT - 1], FILE_COUNT - 1), ==, 0);
+	scar_reader_page_cache_stats(sr, &stats);
+	ASSERT2(stats.misses, ==, misses);
+	ASSERT2(scar_test_check_cursor_file(
+		scar_test_ctx, &a, c, offsets[0], 0), ==, 0);
+	scar_reader_page_cache_stats(sr, &stats);
+	ASSERT(stats.misses > misses);
+	ASSERT2(stats.bytes, <=, limit);
+
+	// A cache smaller than a page never holds anything, but still works
+	ASSERT2(scar_reader_set_page_cache(sr, 1000), ==, 0);
+	ASSERT2(scar_test_check_cursor_file(
+		scar_test_ctx, &a, c, offsets[BIG_FILE], BIG_FILE), ==, 0);
+	scar_reader_page_cache_stats(sr, &stats);
+	ASSERT2(stats.bytes, ==, (size_t)0);
+	ASSERT2(stats.hits, ==, (size_t)0);
+
+	scar_cursor_free(c);
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(page_cache, hot_entries, memory_limit);
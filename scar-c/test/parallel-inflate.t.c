@@ -0,0 +1,267 @@
+#include "scar-reader.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "pool.h"
+#include "recompress.h"
+#include "test.h"
+#include "test-util.h"
+#include "verify.h"
+
+#define FILE_COUNT 48
+#define FILE_SIZE (64 * 1024)
+#define THREADS 4
+#define CHUNK (32 * 1024)
+#define SPAN (128 * 1024)
+
+// Content which makes zlib use every kind of block
+static void describe_archive(
+	struct scar_test_archive *a, int level, int count
+) {
+	scar_test_archive_init(a, count, FILE_SIZE);
+	a->level = level;
+	a->content = SCAR_TEST_MIXED;
+}
+
+TEST(read_entries)
+{
+	int levels[] = {1, 6, 9};
+	for (size_t l = 0; l < sizeof(levels) / sizeof(*levels); ++l) {
+		struct scar_test_archive a;
+		describe_archive(&a, levels[l], FILE_COUNT);
+		struct scar_mem_writer mw;
+		ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+		struct scar_mem_preader mp;
+		scar_mem_preader_init(&mp, mw.buf, mw.len);
+		struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+		ASSERT(sr != NULL);
+		ASSERT2(scar_reader_segment_count(sr), ==, 1);
+		scar_offset offsets[FILE_COUNT];
+		ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+
+		size_t chunk_size;
+		ASSERT2(scar_reader_parallel_inflate(sr, &chunk_size), ==, 0u);
+		scar_reader_set_parallel_inflate(sr, THREADS, CHUNK);
+		ASSERT2(
+			scar_reader_parallel_inflate(sr, &chunk_size), ==,
+			(unsigned int)THREADS);
+		ASSERT2(chunk_size, ==, (size_t)CHUNK);
+
+		// Every read starts at the checkpoint; the ones past the first
+		// chunk decompress the segment up to the file with several threads,
+		// and the others on one
+		for (int i = FILE_COUNT - 1; i >= 0; i -= 5) {
+			ASSERT2(scar_test_check_file(
+				scar_test_ctx, &a, sr, offsets[i], i), ==, 0);
+		}
+
+		// The reader's cursor still has the parallel inflater,
+		// so a separate cursor makes do with zlib
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[FILE_COUNT - 1],
+			FILE_COUNT - 1), ==, 0);
+		struct scar_cursor *c = scar_cursor_create_p(sr);
+		ASSERT(c != NULL);
+		struct scar_meta global;
+		scar_meta_init_empty(&global);
+		struct scar_meta meta;
+		ASSERT2(scar_cursor_read_meta(
+			c, offsets[FILE_COUNT - 2], &global, &meta), ==, 0);
+		ASSERT2(meta.size, ==, (uint64_t)FILE_SIZE);
+		scar_meta_destroy(&meta);
+
+		// Once it's given back, the separate cursor can have it
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[0], 0), ==, 0);
+		ASSERT2(scar_cursor_read_meta(
+			c, offsets[FILE_COUNT - 3], &global, &meta), ==, 0);
+		ASSERT2(meta.size, ==, (uint64_t)FILE_SIZE);
+		scar_meta_destroy(&meta);
+
+		// Changing the threads while it's lent out replaces it
+		// when it comes back
+		scar_reader_set_parallel_inflate(sr, THREADS - 1, CHUNK);
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[FILE_COUNT - 4],
+			FILE_COUNT - 4), ==, 0);
+		scar_meta_destroy(&global);
+		scar_cursor_free(c);
+
+		scar_reader_set_parallel_inflate(sr, 0, 0);
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[0], 0), ==, 0);
+
+		scar_reader_free(sr);
+		free(mw.buf);
+	}
+
+	OK();
+}
+
+TEST(access_points)
+{
+	struct scar_test_archive a;
+	describe_archive(&a, 6, FILE_COUNT);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+
+	scar_reader_set_parallel_inflate(sr, THREADS, CHUNK);
+	scar_reader_set_access_points(sr, SPAN);
+
+	// The chunks which were decompressed in parallel start
+	// at access points
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, &a, sr, offsets[FILE_COUNT - 1],
+		FILE_COUNT - 1), ==, 0);
+	size_t count = scar_reader_access_point_count(sr);
+	ASSERT2(count, >, (size_t)0);
+	ASSERT2(count, <=, (size_t)(FILE_COUNT * FILE_SIZE / SPAN));
+
+	// Reads which start at them still give the right data
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[i], i), ==, 0);
+	}
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+static int check_segments(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw,
+	int count, unsigned int nthreads, struct scar_mem_writer *out
+) {
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw->buf, mw->len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	scar_reader_set_parallel_inflate(sr, nthreads, CHUNK);
+
+	struct scar_pool *pool = scar_pool_create(2);
+	ASSERT(pool != NULL);
+	struct scar_verify_result result;
+	ASSERT2(scar_verify(sr, pool, &result), ==, 0);
+	ASSERT2(result.entry_count, ==, (size_t)count);
+
+	struct scar_compression gzip;
+	scar_compression_init_gzip(&gzip);
+	scar_mem_writer_init(out);
+	ASSERT2(scar_recompress(sr, &out->w, &gzip, 1, pool), ==, 0);
+
+	scar_pool_free(pool);
+	scar_reader_free(sr);
+	return 0;
+}
+
+TEST(verify_and_recompress)
+{
+	struct scar_test_archive a;
+	describe_archive(&a, 6, FILE_COUNT);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	// The segment comes out the same either way
+	struct scar_mem_writer serial, parallel;
+	ASSERT2(check_segments(
+		scar_test_ctx, &mw, FILE_COUNT, 0, &serial), ==, 0);
+	ASSERT2(check_segments(
+		scar_test_ctx, &mw, FILE_COUNT, THREADS, &parallel), ==, 0);
+	ASSERT2(parallel.len, ==, serial.len);
+	ASSERT2(memcmp(parallel.buf, serial.buf, serial.len), ==, 0);
+
+	free(serial.buf);
+	free(parallel.buf);
+	free(mw.buf);
+	OK();
+}
+
+TEST(many_segments)
+{
+	// Big enough for a few segments, each of which ends
+	// with a block boundary right before the gzip trailer.
+	// The workers take turns using the one parallel inflater.
+	int count = 330;
+	struct scar_test_archive a;
+	describe_archive(&a, 1, count);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	ASSERT2(scar_reader_segment_count(sr), >, 2);
+	scar_reader_free(sr);
+
+	struct scar_mem_writer serial, parallel;
+	ASSERT2(check_segments(scar_test_ctx, &mw, count, 0, &serial), ==, 0);
+	ASSERT2(check_segments(
+		scar_test_ctx, &mw, count, THREADS, &parallel), ==, 0);
+	ASSERT2(parallel.len, ==, serial.len);
+	ASSERT2(memcmp(parallel.buf, serial.buf, serial.len), ==, 0);
+
+	free(serial.buf);
+	free(parallel.buf);
+	free(mw.buf);
+	OK();
+}
+
+TEST(corrupt_segment)
+{
+	struct scar_test_archive a;
+	describe_archive(&a, 6, FILE_COUNT);
+	struct scar_mem_writer mw;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &mw), ==, 0);
+
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+	scar_reader_set_parallel_inflate(sr, THREADS, CHUNK);
+
+	struct scar_segment seg;
+	ASSERT2(scar_reader_get_segment(sr, 0, &seg), ==, 0);
+
+	// A flipped bit in the middle of the segment, and a wrong CRC
+	// in its trailer, both make reading to the end of it fail,
+	// since the CRC is checked before the last chunk is handed out
+	scar_offset at[] = {
+		(seg.compressed_start + seg.compressed_end) / 2,
+		seg.compressed_end - 8,
+	};
+	unsigned char *buf = mw.buf;
+	for (size_t i = 0; i < sizeof(at) / sizeof(*at); ++i) {
+		buf[at[i]] ^= 0x10;
+		ASSERT2(scar_test_check_file(
+			scar_test_ctx, &a, sr, offsets[FILE_COUNT - 1],
+			FILE_COUNT - 1), ==, 1);
+
+		struct scar_pool *pool = scar_pool_create(2);
+		struct scar_verify_result result;
+		ASSERT2(scar_verify(sr, pool, &result), ==, -1);
+		scar_pool_free(pool);
+		buf[at[i]] ^= 0x10;
+	}
+
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(
+	parallel_inflate, read_entries, access_points, verify_and_recompress,
+	many_segments, corrupt_segment);
@@ -1,10 +1,13 @@
 #include "pax-syntax.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "ioutil.h"
 #include "test.h"
 #include "meta.h"
+#include "meta-arena.h"
+#include "pax.h"
 
 TEST(basic_parsing)
 {
@@ -80,4 +83,164 @@ TEST(no_overread_block_aligned)
 	OK();
 }
 
-TESTGROUP(pax_syntax, basic_parsing, no_overread, no_overread_block_aligned);
+TEST(negative_time)
+{
+	const char *pax =
+		"16 mtime=-12345\n"
+		"15 atime=+1.25\n";
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, pax, strlen(pax));
+
+	struct scar_meta meta;
+	scar_meta_init_empty(&meta);
+	ASSERT2(scar_pax_parse(&meta, &mr.r, mr.len), ==, 0);
+	ASSERT(meta.mtime == -12345);
+	ASSERT(meta.atime == 1.25);
+
+	// It survives being written out and read back
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	meta.type = SCAR_FT_FILE;
+	meta.size = 0;
+	ASSERT2(scar_pax_write_meta(&meta, &mw.w), ==, 0);
+
+	struct scar_mem_reader rr;
+	scar_mem_reader_init(&rr, mw.buf, mw.len);
+	struct scar_meta global, back;
+	scar_meta_init_empty(&global);
+	ASSERT2(scar_pax_read_meta(&rr.r, &global, &back), ==, 1);
+	ASSERT(back.mtime == -12345);
+	ASSERT(back.atime == 1.25);
+	scar_meta_destroy(&back);
+	free(mw.buf);
+	OK();
+}
+
+TEST(malformed)
+{
+	const char *bad[] = {
+		"99 path=foo\n", // Longer than the header
+		"12 path=foo\n\n", // No newline at the end of the record
+		"8 path\n", // No '='
+		" 8 path=\n", // No length
+		"11 size=1x\n", // Not a number
+		"12 mtime=1.x\n", // Not a time
+		"3 \n", // Too short to have a keyword
+	};
+
+	for (size_t i = 0; i < sizeof(bad) / sizeof(*bad); ++i) {
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, bad[i], strlen(bad[i]));
+		struct scar_meta meta;
+		scar_meta_init_empty(&meta);
+		ASSERT2(scar_pax_parse(&meta, &mr.r, mr.len), ==, -1);
+		scar_meta_destroy(&meta);
+	}
+
+	OK();
+}
+
+static const char xattr_pax[] =
+	"29 SCHILY.xattr.user.a=hello\n"
+	"29 SCHILY.xattr.user.b=world\n"
+	"20 path=hello world\n"
+	"24 LIBARCHIVE.creator=x\n"
+	"18 SCHILY.dev=123\n"
+	"20 unknown.key=skip\n";
+
+static const char xattr_kept[] =
+	"29 SCHILY.xattr.user.a=hello\n"
+	"29 SCHILY.xattr.user.b=world\n"
+	"24 LIBARCHIVE.creator=x\n";
+
+TEST(kept_records)
+{
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+
+	for (int with_arena = 0; with_arena <= 1; ++with_arena) {
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, xattr_pax, strlen(xattr_pax));
+
+		struct scar_meta meta;
+		scar_meta_init_empty(&meta);
+		ASSERT2(scar_pax_parse_arena(
+			&meta, &mr.r, mr.len, with_arena ? arena : NULL), ==, 0);
+		ASSERT_STREQ(meta.path, "hello world");
+		ASSERT2(meta.records_len, ==, strlen(xattr_kept));
+		ASSERT(memcmp(meta.records, xattr_kept, meta.records_len) == 0);
+
+		// Written out again, they're in the extended header
+		struct scar_mem_writer mw;
+		scar_mem_writer_init(&mw);
+		meta.type = SCAR_FT_FILE;
+		meta.size = 0;
+		ASSERT2(scar_pax_write_meta(&meta, &mw.w), ==, 0);
+
+		struct scar_mem_reader rr;
+		scar_mem_reader_init(&rr, mw.buf, mw.len);
+		struct scar_meta global, back;
+		scar_meta_init_empty(&global);
+		ASSERT2(scar_pax_read_meta(&rr.r, &global, &back), ==, 1);
+		ASSERT_STREQ(back.path, "hello world");
+		ASSERT2(back.records_len, ==, strlen(xattr_kept));
+		ASSERT(memcmp(back.records, xattr_kept, back.records_len) == 0);
+		scar_meta_destroy(&back);
+		free(mw.buf);
+
+		if (!with_arena) {
+			scar_meta_destroy(&meta);
+		}
+	}
+
+	scar_meta_arena_free(arena);
+	OK();
+}
+
+TEST(full_width_strings)
+{
+	// The ustar fields are NUL-terminated when they're written,
+	// so strings which are exactly as long as them need pax records
+	char path[101], linkpath[101], uname[33], gname[33];
+	memset(path, 'p', 100);
+	path[100] = '\0';
+	memset(linkpath, 'l', 100);
+	linkpath[100] = '\0';
+	memset(uname, 'u', 32);
+	uname[32] = '\0';
+	memset(gname, 'g', 32);
+	gname[32] = '\0';
+
+	struct scar_meta meta;
+	scar_meta_init_empty(&meta);
+	meta.type = SCAR_FT_SYMLINK;
+	meta.path = path;
+	meta.linkpath = linkpath;
+	meta.uname = uname;
+	meta.gname = gname;
+	meta.size = 0;
+
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	ASSERT2(scar_pax_write_meta(&meta, &mw.w), ==, 0);
+	ASSERT2(scar_pax_write_end(&mw.w), ==, 0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	struct scar_meta global, read;
+	scar_meta_init_empty(&global);
+	ASSERT2(scar_pax_read_meta(&mr.r, &global, &read), ==, 1);
+	ASSERT_STREQ(read.path, path);
+	ASSERT_STREQ(read.linkpath, linkpath);
+	ASSERT_STREQ(read.uname, uname);
+	ASSERT_STREQ(read.gname, gname);
+
+	scar_meta_destroy(&read);
+	scar_meta_destroy(&global);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(
+	pax_syntax, basic_parsing, no_overread, no_overread_block_aligned,
+	negative_time, malformed, kept_records, full_width_strings);
@@ -0,0 +1,217 @@
+// For fileno
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "ioutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scar-reader.h"
+#include "scar-writer.h"
+#include "test.h"
+
+static const size_t sizes[] = {0, 3, 512, 1000, 300000};
+
+static unsigned char *make_data(size_t len)
+{
+	unsigned char *data = malloc(len + 1);
+	for (size_t i = 0; data && i < len; ++i) {
+		data[i] = (unsigned char)(i * 7 % 251);
+	}
+
+	return data;
+}
+
+TEST(copy_fd_needs_file_handle)
+{
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	ASSERT2(scar_io_copy_fd(0, 0, 10, &mw.w), ==, 0);
+	ASSERT2(mw.len, ==, (size_t)0);
+
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, "hello", 5);
+	ASSERT2(scar_file_handle_copy_to(&mr.r, &mw.w, 5), ==, 0);
+	ASSERT2(mw.len, ==, (size_t)0);
+
+	free(mw.buf);
+	OK();
+}
+
+#ifndef _WIN32
+// Write an archive with one entry of each of 'sizes'. The content
+// is read from memory, or if 'from_files' is set, from a temporary file
+// for each entry.
+static int write_archive(
+	struct scar_test_context scar_test_ctx, struct scar_io_writer *w,
+	int from_files, int opts
+) {
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+	struct scar_writer *sw = scar_writer_create_opts(w, &plain, 0, opts);
+	ASSERT(sw != NULL);
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+		unsigned char *data = make_data(sizes[i]);
+		ASSERT(data != NULL);
+		char path[32];
+		snprintf(path, sizeof(path), "file-%zu", i);
+		struct scar_meta meta;
+		scar_meta_init_file(&meta, path, sizes[i]);
+
+		if (from_files) {
+			FILE *f = tmpfile();
+			ASSERT(f != NULL);
+			ASSERT2(fwrite(data, 1, sizes[i], f), ==, sizes[i]);
+			ASSERT2(fseek(f, 0, SEEK_SET), ==, 0);
+			struct scar_file_handle sf;
+			scar_file_handle_init(&sf, f);
+			ASSERT2(scar_writer_write_entry(sw, &meta, &sf.r), ==, 0);
+			ASSERT2(ftell(f), ==, (long)sizes[i]);
+			fclose(f);
+		} else {
+			struct scar_mem_reader mr;
+			scar_mem_reader_init(&mr, data, sizes[i]);
+			ASSERT2(scar_writer_write_entry(sw, &meta, &mr.r), ==, 0);
+		}
+
+		scar_meta_destroy(&meta);
+		free(data);
+	}
+
+	ASSERT2(scar_writer_finish(sw), ==, 0);
+	scar_writer_free(sw);
+	return 0;
+}
+
+static int read_file(
+	struct scar_test_context scar_test_ctx, FILE *f, struct scar_mem_writer *mw
+) {
+	ASSERT2(fflush(f), ==, 0);
+	ASSERT2(fseek(f, 0, SEEK_SET), ==, 0);
+	struct scar_file_handle sf;
+	scar_file_handle_init(&sf, f);
+	scar_mem_writer_init(mw);
+	ASSERT2(scar_io_copy(&sf.r, &mw->w), >=, 0);
+	return 0;
+}
+
+TEST(write_from_files)
+{
+	int opts[] = {0, SCAR_WRITER_CHECKSUMS};
+	for (size_t i = 0; i < sizeof(opts) / sizeof(*opts); ++i) {
+		// The archive is the same whether the content is copied
+		// by the kernel or read from memory. With checksums,
+		// the writer has to see the content, so it doesn't take the shortcut.
+		struct scar_mem_writer expected;
+		scar_mem_writer_init(&expected);
+		ASSERT2(write_archive(scar_test_ctx, &expected.w, 0, opts[i]), ==, 0);
+
+		FILE *out = tmpfile();
+		ASSERT(out != NULL);
+		struct scar_file_handle sf;
+		scar_file_handle_init(&sf, out);
+		ASSERT2(write_archive(scar_test_ctx, &sf.w, 1, opts[i]), ==, 0);
+
+		struct scar_mem_writer actual;
+		ASSERT2(read_file(scar_test_ctx, out, &actual), ==, 0);
+		ASSERT2(actual.len, ==, expected.len);
+		ASSERT2(memcmp(actual.buf, expected.buf, expected.len), ==, 0);
+
+		fclose(out);
+		free(actual.buf);
+		free(expected.buf);
+	}
+
+	OK();
+}
+
+TEST(source_ends_early)
+{
+	FILE *src = tmpfile();
+	ASSERT(src != NULL);
+	ASSERT2(fputs("hello", src), >=, 0);
+	ASSERT2(fseek(src, 0, SEEK_SET), ==, 0);
+	FILE *out = tmpfile();
+	ASSERT(out != NULL);
+
+	struct scar_file_handle in_sf, out_sf;
+	scar_file_handle_init(&in_sf, src);
+	scar_file_handle_init(&out_sf, out);
+	ASSERT2(scar_file_handle_copy_to(&in_sf.r, &out_sf.w, 10), ==, -1);
+
+	fclose(out);
+	fclose(src);
+	OK();
+}
+
+TEST(read_to_file)
+{
+	struct scar_mem_writer archive;
+	scar_mem_writer_init(&archive);
+	ASSERT2(write_archive(scar_test_ctx, &archive.w, 0, 0), ==, 0);
+
+	FILE *f = tmpfile();
+	ASSERT(f != NULL);
+	ASSERT2(fwrite(archive.buf, 1, archive.len, f), ==, archive.len);
+	ASSERT2(fflush(f), ==, 0);
+	struct scar_fd_preader fp;
+	ASSERT2(scar_fd_preader_init(&fp, fileno(f)), ==, 0);
+	struct scar_reader *sr = scar_reader_create_p(&fp.pr);
+	ASSERT(sr != NULL);
+
+	// Write every entry to the same file, after something else,
+	// in the opposite order to the archive's
+	FILE *out = tmpfile();
+	ASSERT(out != NULL);
+	ASSERT2(fputs("head", out), >=, 0);
+	struct scar_file_handle sf;
+	scar_file_handle_init(&sf, out);
+
+	size_t count = sizeof(sizes) / sizeof(*sizes);
+	for (size_t i = count; i-- > 0;) {
+		char path[32];
+		snprintf(path, sizeof(path), "file-%zu", i);
+		struct scar_index_entry entry;
+		ASSERT2(scar_reader_find_entry(sr, path, &entry), ==, 1);
+		struct scar_meta meta;
+		ASSERT2(scar_reader_read_meta(
+			sr, entry.offset, entry.global, &meta), ==, 0);
+		ASSERT2(scar_reader_read_content(sr, &sf.w, meta.size), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+
+	struct scar_mem_writer actual;
+	ASSERT2(read_file(scar_test_ctx, out, &actual), ==, 0);
+	ASSERT_STREQ_N((char *)actual.buf, "head", 4);
+	size_t pos = 4;
+	for (size_t i = count; i-- > 0;) {
+		unsigned char *data = make_data(sizes[i]);
+		ASSERT(data != NULL);
+		ASSERT2(actual.len, >=, pos + sizes[i]);
+		ASSERT(sizes[i] == 0 || memcmp(
+			(unsigned char *)actual.buf + pos, data, sizes[i]) == 0);
+		pos += sizes[i];
+		free(data);
+	}
+	ASSERT2(actual.len, ==, pos);
+
+	scar_reader_free(sr);
+	fclose(out);
+	fclose(f);
+	free(actual.buf);
+	free(archive.buf);
+	OK();
+}
+#endif
+
+#ifdef _WIN32
+TESTGROUP(plain_direct, copy_fd_needs_file_handle);
+#else
+TESTGROUP(plain_direct,
+	copy_fd_needs_file_handle, write_from_files, source_ends_early,
+	read_to_file);
+#endif
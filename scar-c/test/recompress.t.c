@@ -0,0 +1,188 @@
+#include "recompress.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "pool.h"
+#include "scar-reader.h"
+#include "scar-writer.h"
+#include "test.h"
+
+// Big enough that the writer has to insert checkpoints,
+// so that the archive has multiple segments
+#define FILE_SIZE (4 * 1024 * 1024)
+#define FILE_COUNT 4
+
+static unsigned char *make_content(void)
+{
+	unsigned char *buf = malloc(FILE_SIZE);
+	uint32_t state = 1;
+	for (size_t i = 0; i < FILE_SIZE; ++i) {
+		state = state * 1103515245 + 12345;
+		buf[i] = "abcdefgh"[(state >> 16) & 7];
+	}
+
+	return buf;
+}
+
+static int check_archive(
+	struct scar_test_context scar_test_ctx,
+	struct scar_mem_writer *archive, const unsigned char *content
+) {
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, archive->buf, archive->len);
+
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	ASSERT(sr != NULL);
+	ASSERT2(scar_reader_segment_count(sr), >, 1);
+
+	// The extension sections should survive recompression
+	uint32_t crc;
+	ASSERT2(scar_reader_segment_checksum(sr, 0, &crc), ==, 1);
+
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+
+	int count = 0;
+	struct scar_index_entry entry;
+	while (scar_index_iterator_next(it, &entry) > 0) {
+		struct scar_meta meta;
+		ASSERT2(scar_reader_read_meta(sr, entry.offset, entry.global, &meta), ==, 0);
+		ASSERT2(meta.size, ==, (uint64_t)FILE_SIZE);
+
+		struct scar_mem_writer mw;
+		scar_mem_writer_init(&mw);
+		ASSERT2(scar_reader_read_content(sr, &mw.w, meta.size), ==, 0);
+		ASSERT2(mw.len, ==, (size_t)FILE_SIZE);
+		ASSERT2(memcmp(mw.buf, content, FILE_SIZE), ==, 0);
+
+		free(mw.buf);
+		scar_meta_destroy(&meta);
+		count += 1;
+	}
+
+	ASSERT2(count, ==, FILE_COUNT);
+
+	scar_index_iterator_free(it);
+	scar_reader_free(sr);
+	return 0;
+}
+
+// With a 'batch_bytes' other than 0, the archive is read through
+// a preader, in batches of at most that many compressed bytes
+static int recompress(
+	struct scar_test_context scar_test_ctx,
+	struct scar_mem_writer *in, struct scar_mem_writer *out,
+	struct scar_compression *comp, struct scar_pool *pool, size_t batch_bytes
+) {
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, in->buf, in->len);
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, in->buf, in->len);
+
+	struct scar_reader *sr;
+	if (batch_bytes > 0) {
+		sr = scar_reader_create_p(&mp.pr);
+		ASSERT(sr != NULL);
+		scar_reader_set_batch_bytes(sr, batch_bytes);
+		ASSERT2(scar_reader_batch_bytes(sr), ==, batch_bytes);
+	} else {
+		sr = scar_reader_create(&mr.r, &mr.s);
+		ASSERT(sr != NULL);
+	}
+
+	scar_mem_writer_init(out);
+	ASSERT2(scar_recompress(sr, &out->w, comp, 1, pool), ==, 0);
+
+	scar_reader_free(sr);
+	return 0;
+}
+
+static int test_roundtrip(
+	struct scar_test_context scar_test_ctx, int nthreads, size_t batch_bytes
+) {
+	unsigned char *content = make_content();
+
+	struct scar_compression gzip;
+	scar_compression_init_gzip(&gzip);
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+
+	struct scar_mem_writer gz_archive;
+	scar_mem_writer_init(&gz_archive);
+	struct scar_writer *sw = scar_writer_create_opts(
+		&gz_archive.w, &gzip, 1, SCAR_WRITER_CHECKSUMS);
+	ASSERT(sw != NULL);
+
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		char path[32];
+		snprintf(path, sizeof(path), "file-%d.txt", i);
+
+		struct scar_meta meta;
+		scar_meta_init_file(&meta, path, FILE_SIZE);
+
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, content, FILE_SIZE);
+		ASSERT2(scar_writer_write_entry(sw, &meta, &mr.r), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+
+	ASSERT2(scar_writer_finish(sw), ==, 0);
+	scar_writer_free(sw);
+
+	struct scar_pool *pool = scar_pool_create(nthreads);
+	ASSERT(pool != NULL);
+
+	struct scar_mem_writer plain_archive;
+	ASSERT2(recompress(
+		scar_test_ctx, &gz_archive, &plain_archive, &plain, pool,
+		batch_bytes), ==, 0);
+	ASSERT2(check_archive(scar_test_ctx, &plain_archive, content), ==, 0);
+
+	struct scar_mem_writer regz_archive;
+	ASSERT2(recompress(
+		scar_test_ctx, &plain_archive, &regz_archive, &gzip, pool,
+		batch_bytes), ==, 0);
+	ASSERT2(check_archive(scar_test_ctx, &regz_archive, content), ==, 0);
+
+	// Both gzip archives were made at the same level with the same
+	// segment boundaries, so they should be byte for byte identical
+	ASSERT2(regz_archive.len, ==, gz_archive.len);
+	ASSERT2(memcmp(regz_archive.buf, gz_archive.buf, gz_archive.len), ==, 0);
+
+	scar_pool_free(pool);
+	free(regz_archive.buf);
+	free(plain_archive.buf);
+	free(gz_archive.buf);
+	free(content);
+	OK();
+}
+
+TEST(roundtrip_serial)
+{
+	return test_roundtrip(scar_test_ctx, 1, 0);
+}
+
+TEST(roundtrip_threaded)
+{
+	return test_roundtrip(scar_test_ctx, 4, 0);
+}
+
+TEST(roundtrip_small_batches)
+{
+	// Batches of a few segments, whose output partly spills to disk
+	return test_roundtrip(scar_test_ctx, 4, 1024 * 1024);
+}
+
+TEST(roundtrip_streamed)
+{
+	// Every segment is bigger than a batch, so each one is read
+	// as it's decompressed, and its output goes straight to disk
+	return test_roundtrip(scar_test_ctx, 4, 1);
+}
+
+TESTGROUP(
+	recompress, roundtrip_serial, roundtrip_threaded,
+	roundtrip_small_batches, roundtrip_streamed);
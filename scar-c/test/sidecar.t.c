@@ -0,0 +1,223 @@
+#include "sidecar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "scar-reader.h"
+#include "scar-writer.h"
+#include "test.h"
+#include "test-util.h"
+
+#define FILE_COUNT 50
+
+// The stamp of an archive file which is 'len' bytes
+static struct scar_sidecar_stamp make_stamp(size_t len)
+{
+	struct scar_sidecar_stamp stamp = {len, 1700000000, 250};
+	return stamp;
+}
+
+static size_t file_size(int idx)
+{
+	return 10 + (size_t)idx;
+}
+
+// Write the files in reverse order, so that the index isn't sorted,
+// and write file-7.txt twice
+static void describe_archive(struct scar_test_archive *a)
+{
+	static int order[FILE_COUNT + 1];
+	order[0] = 7;
+	for (int i = 0; i < FILE_COUNT; ++i) {
+		order[i + 1] = FILE_COUNT - 1 - i;
+	}
+
+	scar_test_archive_init(a, FILE_COUNT + 1, 0);
+	a->opts = SCAR_WRITER_META;
+	a->path = "dir/file-%d.txt";
+	a->order = order;
+	a->file_size = file_size;
+	a->content = SCAR_TEST_TEXT;
+	a->mode = 0644;
+	a->mtime = 1700000000;
+}
+
+static int make_sidecar(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *archive,
+	struct scar_mem_writer *sidecar
+) {
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, archive->buf, archive->len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+
+	struct scar_sidecar_stamp stamp = make_stamp(archive->len);
+	scar_mem_writer_init(sidecar);
+	ASSERT2(scar_sidecar_write(sr, &stamp, &sidecar->w), ==, 0);
+	scar_reader_free(sr);
+	return 0;
+}
+
+static int check_same_entries(
+	struct scar_test_context scar_test_ctx,
+	struct scar_reader *a, struct scar_reader *b
+) {
+	struct scar_index_iterator *ita = scar_reader_iterate(a);
+	ASSERT(ita != NULL);
+	struct scar_index_iterator *itb = scar_reader_iterate(b);
+	ASSERT(itb != NULL);
+
+	int count = 0;
+	while (true) {
+		struct scar_index_entry ea, eb;
+		int ra = scar_index_iterator_next(ita, &ea);
+		int rb = scar_index_iterator_next(itb, &eb);
+		ASSERT2(ra, >=, 0);
+		ASSERT2(ra, ==, rb);
+		if (ra == 0) {
+			break;
+		}
+
+		ASSERT2(strcmp(ea.name, eb.name), ==, 0);
+		ASSERT2(ea.ft, ==, eb.ft);
+		ASSERT2(ea.offset, ==, eb.offset);
+		ASSERT2(ea.mode, ==, eb.mode);
+		ASSERT2(ea.size, ==, eb.size);
+		ASSERT2(ea.mtime, ==, eb.mtime);
+		ASSERT(ea.global != NULL);
+		ASSERT(eb.global != NULL);
+		ASSERT2(ea.global->type, ==, eb.global->type);
+		count += 1;
+	}
+
+	scar_index_iterator_free(ita);
+	scar_index_iterator_free(itb);
+	ASSERT2(count, ==, FILE_COUNT + 1);
+	return 0;
+}
+
+// Find file number 'idx', which should be the entry at 'offsets[idx]',
+// and check its content.
+static int check_find(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_reader *sr, const scar_offset *offsets, int idx
+) {
+	char path[32];
+	snprintf(path, sizeof(path), a->path, idx);
+	struct scar_index_entry entry;
+	ASSERT2(scar_reader_find_entry(sr, path, &entry), ==, 1);
+	ASSERT2(strcmp(entry.name, path), ==, 0);
+	ASSERT2(entry.offset, ==, offsets[idx]);
+	ASSERT2(scar_test_check_file(
+		scar_test_ctx, a, sr, entry.offset, idx), ==, 0);
+	return 0;
+}
+
+TEST(fresh_sidecar)
+{
+	struct scar_test_archive a;
+	describe_archive(&a);
+	struct scar_mem_writer archive, sidecar;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &archive), ==, 0);
+	ASSERT2(make_sidecar(scar_test_ctx, &archive, &sidecar), ==, 0);
+
+	struct scar_sidecar_stamp stamp = make_stamp(archive.len);
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, archive.buf, archive.len);
+	struct scar_reader *plain = scar_reader_create_p(&mp.pr);
+	ASSERT(plain != NULL);
+	ASSERT(!scar_reader_has_sidecar(plain));
+
+	struct scar_reader *sr = scar_reader_create_p_sidecar(
+		&mp.pr, sidecar.buf, sidecar.len, &stamp);
+	ASSERT(sr != NULL);
+	ASSERT(scar_reader_has_sidecar(sr));
+	ASSERT2(scar_reader_segment_count(sr), ==, scar_reader_segment_count(plain));
+
+	ASSERT2(check_same_entries(scar_test_ctx, plain, sr), ==, 0);
+
+	// The last of the duplicate entries wins, with or without a sidecar
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, plain, offsets), ==, 0);
+	ASSERT2(check_find(scar_test_ctx, &a, sr, offsets, 0), ==, 0);
+	ASSERT2(check_find(scar_test_ctx, &a, sr, offsets, 7), ==, 0);
+	ASSERT2(check_find(scar_test_ctx, &a, plain, offsets, 7), ==, 0);
+	ASSERT2(check_find(scar_test_ctx, &a, sr, offsets, 49), ==, 0);
+
+	struct scar_index_entry entry;
+	ASSERT2(scar_reader_find_entry(sr, "dir/file-50.txt", &entry), ==, 0);
+	ASSERT2(scar_reader_find_entry(sr, "a", &entry), ==, 0);
+	ASSERT2(scar_reader_find_entry(sr, "z", &entry), ==, 0);
+	ASSERT2(scar_reader_find_entry(plain, "z", &entry), ==, 0);
+
+	scar_reader_free(sr);
+	scar_reader_free(plain);
+	free(sidecar.buf);
+	free(archive.buf);
+	OK();
+}
+
+TEST(stale_or_corrupt_sidecar)
+{
+	struct scar_test_archive a;
+	describe_archive(&a);
+	struct scar_mem_writer archive, sidecar;
+	ASSERT2(scar_test_make_archive(scar_test_ctx, &a, &archive), ==, 0);
+	ASSERT2(make_sidecar(scar_test_ctx, &archive, &sidecar), ==, 0);
+
+	struct scar_sidecar_stamp stamp = make_stamp(archive.len);
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, archive.buf, archive.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	scar_offset offsets[FILE_COUNT];
+	ASSERT2(scar_test_find_offsets(scar_test_ctx, &a, sr, offsets), ==, 0);
+	scar_reader_free(sr);
+
+	// A different mtime means the archive was replaced
+	struct scar_sidecar_stamp other = stamp;
+	other.mtime_nsec += 1;
+	sr = scar_reader_create_p_sidecar(
+		&mp.pr, sidecar.buf, sidecar.len, &other);
+	ASSERT(sr != NULL);
+	ASSERT(!scar_reader_has_sidecar(sr));
+	ASSERT2(check_find(scar_test_ctx, &a, sr, offsets, 3), ==, 0);
+	scar_reader_free(sr);
+
+	// So does a sidecar whose footer offsets don't match the archive's
+	struct scar_mem_writer copy;
+	scar_mem_writer_init(&copy);
+	ASSERT2(
+		scar_mem_writer_write(&copy.w, sidecar.buf, sidecar.len),
+		==, (scar_ssize)sidecar.len);
+	((unsigned char *)copy.buf)[40] ^= 1;
+	sr = scar_reader_create_p_sidecar(&mp.pr, copy.buf, copy.len, &stamp);
+	ASSERT(sr != NULL);
+	ASSERT(!scar_reader_has_sidecar(sr));
+	ASSERT2(check_find(scar_test_ctx, &a, sr, offsets, 3), ==, 0);
+	scar_reader_free(sr);
+	free(copy.buf);
+
+	// Truncated or corrupt sidecars are ignored
+	size_t lens[] = {0, 8, 100, sidecar.len / 2, sidecar.len - 1};
+	for (size_t i = 0; i < sizeof(lens) / sizeof(*lens); ++i) {
+		sr = scar_reader_create_p_sidecar(&mp.pr, sidecar.buf, lens[i], &stamp);
+		ASSERT(sr != NULL);
+		ASSERT(!scar_reader_has_sidecar(sr));
+		scar_reader_free(sr);
+	}
+
+	((unsigned char *)sidecar.buf)[8] += 1;
+	sr = scar_reader_create_p_sidecar(&mp.pr, sidecar.buf, sidecar.len, &stamp);
+	ASSERT(sr != NULL);
+	ASSERT(!scar_reader_has_sidecar(sr));
+	scar_reader_free(sr);
+
+	free(sidecar.buf);
+	free(archive.buf);
+	OK();
+}
+
+TESTGROUP(sidecar, fresh_sidecar, stale_or_corrupt_sidecar);
@@ -0,0 +1,273 @@
+#include "test-util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scar-writer.h"
+#include "util.h"
+
+static scar_ssize counting_read_at(
+	struct scar_io_preader *pr, scar_offset offset, void *buf, size_t len
+) {
+	struct scar_test_counting_preader *cp =
+		SCAR_BASE(struct scar_test_counting_preader, pr);
+	cp->reads += 1;
+	scar_ssize n = cp->mp.pr.read_at(&cp->mp.pr, offset, buf, len);
+	if (n > 0) {
+		cp->bytes += (size_t)n;
+	}
+	return n;
+}
+
+static scar_offset counting_size(struct scar_io_preader *pr)
+{
+	struct scar_test_counting_preader *cp =
+		SCAR_BASE(struct scar_test_counting_preader, pr);
+	return cp->mp.pr.size(&cp->mp.pr);
+}
+
+void scar_test_counting_preader_init(
+	struct scar_test_counting_preader *cp, const void *buf, size_t len
+) {
+	cp->pr.read_at = counting_read_at;
+	cp->pr.size = counting_size;
+	scar_mem_preader_init(&cp->mp, buf, len);
+	cp->reads = 0;
+	cp->bytes = 0;
+}
+
+void scar_test_archive_init(
+	struct scar_test_archive *a, int count, size_t size
+) {
+	a->comp = NULL;
+	a->level = 6;
+	a->opts = 0;
+	a->spill_threshold = 0;
+	a->dir = NULL;
+	a->count = count;
+	a->path = "file-%d.bin";
+	a->order = NULL;
+	a->size = size;
+	a->file_size = NULL;
+	a->content = SCAR_TEST_RANDOM;
+	a->mode = 0;
+	a->mtime = 0;
+}
+
+size_t scar_test_file_size(const struct scar_test_archive *a, int idx)
+{
+	return a->file_size ? a->file_size(idx) : a->size;
+}
+
+void scar_test_file_content(
+	const struct scar_test_archive *a, int idx, unsigned char *buf
+) {
+	static const char text[] = "Hello World\n";
+	static const char *words[] = {
+		"archive ", "segment ", "checkpoint ", "inflate ", "window ",
+		"deflate ", "block ", "reader ", "\n", "0123 ", "scar ",
+	};
+
+	size_t size = scar_test_file_size(a, idx);
+	if (a->content == SCAR_TEST_TEXT) {
+		for (size_t i = 0; i < size; ++i) {
+			buf[i] = (unsigned char)text[i % (sizeof(text) - 1)];
+		}
+		return;
+	}
+
+	// Mixed content goes through words, letters, random bytes and runs
+	int kind = idx % 4;
+	if (a->content == SCAR_TEST_LETTERS) {
+		kind = 1;
+	} else if (a->content == SCAR_TEST_RANDOM) {
+		kind = 2;
+	}
+
+	uint32_t x = 2463534242u + (uint32_t)idx;
+	size_t i = 0;
+	while (i < size) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		switch (kind) {
+		case 0:
+			for (const char *w = words[x % 11]; *w && i < size; ++w) {
+				buf[i++] = (unsigned char)*w;
+			}
+			break;
+		case 1:
+			buf[i++] = (unsigned char)('a' + x % 16);
+			break;
+		case 2:
+			buf[i++] = (unsigned char)x;
+			break;
+		default:
+			buf[i] = (unsigned char)(i / 4096);
+			i += 1;
+			break;
+		}
+	}
+}
+
+int scar_test_write_archive(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_io_writer *w
+) {
+	struct scar_compression gzip;
+	struct scar_compression *comp = a->comp;
+	if (!comp) {
+		scar_compression_init_gzip(&gzip);
+		comp = &gzip;
+	}
+
+	struct scar_writer *sw = scar_writer_create_opts(
+		w, comp, a->level, a->opts);
+	ASSERT(sw != NULL);
+	if (a->spill_threshold > 0) {
+		scar_writer_set_spill_threshold(sw, a->spill_threshold);
+	}
+
+	struct scar_meta meta;
+	if (a->dir) {
+		scar_meta_init_directory(&meta, (char *)a->dir);
+		if (a->mode) {
+			meta.mode = a->mode | 0111;
+		}
+		if (a->mtime) {
+			meta.mtime = a->mtime;
+		}
+		ASSERT2(scar_writer_write_entry(sw, &meta, NULL), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+
+	unsigned char *content = NULL;
+	for (int i = 0; i < a->count; ++i) {
+		int idx = a->order ? a->order[i] : i;
+		size_t size = scar_test_file_size(a, idx);
+		unsigned char *newcontent = realloc(content, size > 0 ? size : 1);
+		ASSERT(newcontent != NULL);
+		content = newcontent;
+		scar_test_file_content(a, idx, content);
+
+		char path[64];
+		snprintf(path, sizeof(path), a->path, idx);
+		scar_meta_init_file(&meta, path, size);
+		if (a->mode) {
+			meta.mode = a->mode;
+		}
+		if (a->mtime) {
+			meta.mtime = a->mtime + idx;
+		}
+
+		struct scar_mem_reader mr;
+		scar_mem_reader_init(&mr, content, size);
+		ASSERT2(scar_writer_write_entry(sw, &meta, &mr.r), ==, 0);
+		scar_meta_destroy(&meta);
+	}
+	free(content);
+
+	ASSERT2(scar_writer_finish(sw), ==, 0);
+	scar_writer_free(sw);
+	return 0;
+}
+
+int scar_test_make_archive(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_mem_writer *mw
+) {
+	scar_mem_writer_init(mw);
+	return scar_test_write_archive(scar_test_ctx, a, &mw->w);
+}
+
+int scar_test_find_offsets(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_reader *sr, scar_offset *offsets
+) {
+	struct scar_index_iterator *it = scar_reader_iterate(sr);
+	ASSERT(it != NULL);
+
+	struct scar_index_entry entry;
+	int count = 0;
+	while (scar_index_iterator_next(it, &entry) > 0) {
+		if (entry.ft != SCAR_FT_FILE) {
+			continue;
+		}
+
+		int idx;
+		ASSERT2(sscanf(entry.name, a->path, &idx), ==, 1);
+		ASSERT(idx >= 0);
+		offsets[idx] = entry.offset;
+		count += 1;
+	}
+	scar_index_iterator_free(it);
+	ASSERT2(count, ==, a->count);
+	return 0;
+}
+
+// Check that 'mw' has the content of file number 'idx', and free it.
+static int check_content(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_mem_writer *mw, int idx
+) {
+	size_t size = scar_test_file_size(a, idx);
+	unsigned char *expected = malloc(size > 0 ? size : 1);
+	ASSERT(expected != NULL);
+	scar_test_file_content(a, idx, expected);
+	ASSERT2(mw->len, ==, size);
+	ASSERT2(memcmp(mw->buf, expected, size), ==, 0);
+	free(expected);
+	free(mw->buf);
+	return 0;
+}
+
+int scar_test_check_file(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_reader *sr, scar_offset offset, int idx
+) {
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+	struct scar_meta meta;
+	if (scar_reader_read_meta(sr, offset, &global, &meta) < 0) {
+		scar_meta_destroy(&global);
+		return 1;
+	}
+
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	int ret = scar_reader_read_content(sr, &mw.w, meta.size);
+	scar_meta_destroy(&meta);
+	scar_meta_destroy(&global);
+	if (ret < 0) {
+		free(mw.buf);
+		return 1;
+	}
+
+	return check_content(scar_test_ctx, a, &mw, idx);
+}
+
+int scar_test_check_cursor_file(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_cursor *c, scar_offset offset, int idx
+) {
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+	struct scar_meta meta;
+	if (scar_cursor_read_meta(c, offset, &global, &meta) < 0) {
+		scar_meta_destroy(&global);
+		return 1;
+	}
+
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	int ret = scar_cursor_read_content(c, &mw.w, meta.size);
+	scar_meta_destroy(&meta);
+	scar_meta_destroy(&global);
+	if (ret < 0) {
+		free(mw.buf);
+		return 1;
+	}
+
+	return check_content(scar_test_ctx, a, &mw, idx);
+}
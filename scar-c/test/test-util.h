@@ -0,0 +1,113 @@
+#ifndef SCAR_TEST_UTIL_H
+#define SCAR_TEST_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "compression.h"
+#include "ioutil.h"
+#include "scar-reader.h"
+#include "test.h"
+
+/// A preader over a buffer, which counts how often it's read from,
+/// and how many bytes it returns.
+struct scar_test_counting_preader {
+	struct scar_io_preader pr;
+	struct scar_mem_preader mp;
+	size_t reads;
+	size_t bytes;
+};
+
+/// Read 'len' bytes from 'buf', with the counters at 0.
+void scar_test_counting_preader_init(
+	struct scar_test_counting_preader *cp, const void *buf, size_t len);
+
+/// What the files of a test archive contain.
+enum scar_test_content {
+	/// "Hello World\n", over and over.
+	SCAR_TEST_TEXT,
+	/// Random letters from a small alphabet, which compress to about half,
+	/// in many deflate blocks.
+	SCAR_TEST_LETTERS,
+	/// Random bytes, which don't compress.
+	SCAR_TEST_RANDOM,
+	/// Text with lots of back-references, letters, random bytes or long runs,
+	/// depending on the file, so that zlib uses every kind of block.
+	SCAR_TEST_MIXED,
+};
+
+/// Describes an archive for 'scar_test_make_archive': 'count' files,
+/// whose paths are 'path' formatted with the file's number.
+/// Set it up with 'scar_test_archive_init', then change what the test needs.
+struct scar_test_archive {
+	/// The compression (gzip if NULL), its level, and SCAR_WRITER_* options.
+	struct scar_compression *comp;
+	int level;
+	int opts;
+
+	/// The writer's spill threshold, unless it's 0.
+	size_t spill_threshold;
+
+	/// A directory which is written before the files, unless it's NULL.
+	const char *dir;
+
+	int count;
+	const char *path;
+
+	/// The numbers of the 'count' files in the order they're written,
+	/// or NULL for 0 to 'count - 1'. A number may come up more than once.
+	const int *order;
+
+	/// The size of every file, or 'file_size(number)' if it isn't NULL.
+	size_t size;
+	size_t (*file_size)(int idx);
+	enum scar_test_content content;
+
+	/// Unless they're 0, the mode of every file, and the mtime of the
+	/// directory; file number 'idx' gets 'mtime + idx'.
+	/// The directory gets the mode with the search bits set too.
+	uint32_t mode;
+	double mtime;
+};
+
+/// Describe a gzip archive of 'count' files of 'size' random bytes,
+/// which are called "file-<number>.bin".
+void scar_test_archive_init(
+	struct scar_test_archive *a, int count, size_t size);
+
+/// Get the size of file number 'idx'.
+size_t scar_test_file_size(const struct scar_test_archive *a, int idx);
+
+/// Fill 'buf' with the content of file number 'idx'.
+void scar_test_file_content(
+	const struct scar_test_archive *a, int idx, unsigned char *buf);
+
+/// Write the archive to 'w'.
+int scar_test_write_archive(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_io_writer *w);
+
+/// Write the archive to 'mw', which is initialized first.
+int scar_test_make_archive(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_mem_writer *mw);
+
+/// Find the offset of every file in the index. 'offsets' is indexed by
+/// the file's number, and gets the last entry of a number which comes up
+/// more than once.
+int scar_test_find_offsets(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_reader *sr, scar_offset *offsets);
+
+/// Read the file number 'idx' at 'offset', and check its content.
+/// Returns 1 if it can't be read.
+int scar_test_check_file(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_reader *sr, scar_offset offset, int idx);
+
+/// The same as 'scar_test_check_file', but reads through a cursor.
+int scar_test_check_cursor_file(
+	struct scar_test_context scar_test_ctx, const struct scar_test_archive *a,
+	struct scar_cursor *c, scar_offset offset, int idx);
+
+#endif
@@ -0,0 +1,198 @@
+#include "ustar.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "meta.h"
+#include "meta-arena.h"
+#include "pax.h"
+#include "test.h"
+
+// Straightforward versions of the block routines, to compare against
+static uint64_t reference_octal(const char *text, size_t len)
+{
+	uint64_t num = 0;
+	for (size_t i = 0; i < len && text[i] >= '0' && text[i] <= '7'; ++i) {
+		num = num * 8 + (uint64_t)(text[i] - '0');
+	}
+
+	return num;
+}
+
+static void reference_sums(
+	const unsigned char *block, uint64_t *usum, int64_t *ssum
+) {
+	*usum = 0;
+	*ssum = 0;
+	for (size_t i = 0; i < 512; ++i) {
+		unsigned char ch = block[i];
+		if (i >= 148 && i < 156) {
+			ch = ' ';
+		}
+
+		*usum += ch;
+		*ssum += (signed char)ch;
+	}
+}
+
+TEST(read_octal)
+{
+	static const char *fields[] = {
+		"", "0", "7", "8", "0000644", "0000644 ", "00000000000",
+		"77777777777", "12345670123", "1234567", "12345678",
+		" 1234", "00001750\0001", "0001750 0001", "17777777777777777777",
+	};
+
+	for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); ++i) {
+		size_t len = strlen(fields[i]);
+		for (size_t flen = 1; flen <= 16; ++flen) {
+			unsigned char block[512] = {0};
+			memcpy(&block[100], fields[i], len < flen ? len : flen);
+			struct scar_ustar_field field = {100, flen};
+			uint64_t expected = reference_octal(
+				(const char *)&block[100], flen);
+			ASSERT2(scar_ustar_read_octal(block, field), ==, expected);
+		}
+	}
+
+	// Sizes which don't fit in octal are in base 256
+	unsigned char block[512] = {0};
+	block[SCAR_UST_SIZE.start] = 0x80;
+	block[SCAR_UST_SIZE.start + 7] = 0x01;
+	block[SCAR_UST_SIZE.start + 11] = 0x02;
+	ASSERT2(
+		scar_ustar_read_size(block, SCAR_UST_SIZE), ==,
+		((uint64_t)1 << 32) + 2);
+
+	OK();
+}
+
+TEST(write_octal)
+{
+	static const uint64_t values[] = {
+		0, 1, 7, 8, 0644, 0777777, 07777777, 010000000, 012345670123,
+		077777777777ull, 0100000000000ull, UINT64_MAX,
+	};
+	static const struct scar_ustar_field fields[] = {
+		{100, 8}, {124, 12}, {0, 2}, {0, 9}, {0, 17}, {0, 24},
+	};
+
+	for (size_t f = 0; f < sizeof(fields) / sizeof(*fields); ++f) {
+		size_t width = fields[f].length - 1;
+		for (size_t i = 0; i < sizeof(values) / sizeof(*values); ++i) {
+			unsigned char block[512];
+			memset(block, 'x', sizeof(block));
+			scar_ustar_write_octal(block, fields[f], values[i]);
+
+			// Numbers which don't fit keep their most significant digits
+			char expected[64];
+			snprintf(
+				expected, sizeof(expected), "%0*" PRIo64,
+				(int)width, values[i]);
+			expected[width] = '\0';
+			ASSERT_STREQ((char *)&block[fields[f].start], expected);
+			ASSERT2(block[fields[f].start + width + 1], ==, 'x');
+			ASSERT2(
+				scar_ustar_read_octal(block, fields[f]), ==,
+				reference_octal(expected, width));
+		}
+	}
+
+	OK();
+}
+
+TEST(block_is_zero)
+{
+	unsigned char block[512] = {0};
+	ASSERT2(scar_ustar_block_is_zero(block), ==, 1);
+
+	for (size_t i = 0; i < sizeof(block); ++i) {
+		block[i] = (unsigned char)(1 + i % 255);
+		ASSERT2(scar_ustar_block_is_zero(block), ==, 0);
+		block[i] = 0;
+	}
+
+	ASSERT2(scar_ustar_block_is_zero(block), ==, 1);
+	OK();
+}
+
+TEST(block_sums)
+{
+	unsigned char block[512];
+	uint32_t state = 12345;
+	for (int round = 0; round < 100; ++round) {
+		for (size_t i = 0; i < sizeof(block); ++i) {
+			state = state * 1103515245 + 12345;
+			block[i] = (unsigned char)(state >> 16);
+		}
+
+		// All high or all low bytes are the extremes of either sum
+		if (round == 0) {
+			memset(block, 0xff, sizeof(block));
+		} else if (round == 1) {
+			memset(block, 0x80, sizeof(block));
+		}
+
+		uint64_t usum, expected_usum;
+		int64_t ssum, expected_ssum;
+		scar_ustar_block_sums(block, &usum, &ssum);
+		reference_sums(block, &expected_usum, &expected_ssum);
+		ASSERT2(usum, ==, expected_usum);
+		ASSERT2(ssum, ==, expected_ssum);
+
+		scar_ustar_write_checksum(block);
+		ASSERT2(scar_pax_block_checksum_ok(block), ==, 1);
+		ASSERT2(
+			scar_ustar_read_octal(block, SCAR_UST_CHKSUM), ==,
+			expected_usum);
+	}
+
+	OK();
+}
+
+TEST(bad_checksum)
+{
+	struct scar_mem_writer mw;
+	scar_mem_writer_init(&mw);
+	struct scar_meta meta;
+	scar_meta_init_file(&meta, "file", 0);
+	meta.mode = 0644;
+	ASSERT2(scar_pax_write_meta(&meta, &mw.w), ==, 0);
+	ASSERT2(scar_pax_write_end(&mw.w), ==, 0);
+	scar_meta_destroy(&meta);
+
+	struct scar_mem_reader mr;
+	struct scar_meta global;
+	scar_meta_init_empty(&global);
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	ASSERT2(scar_pax_read_meta(&mr.r, &global, &meta), ==, 1);
+	scar_meta_destroy(&meta);
+
+	// Flip a bit in the mode, which the checksum catches
+	unsigned char *block = mw.buf;
+	block[SCAR_UST_MODE.start + 5] ^= 0x01;
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	ASSERT2(scar_pax_read_meta(&mr.r, &global, &meta), ==, -1);
+
+	// Unless we've been told to ignore it
+	struct scar_meta_arena *arena = scar_meta_arena_create();
+	ASSERT(arena != NULL);
+	struct scar_meta_global *shared = scar_meta_global_create(&global);
+	ASSERT(shared != NULL);
+	scar_mem_reader_init(&mr, mw.buf, mw.len);
+	ASSERT2(scar_pax_read_meta_shared_opts(
+		&mr.r, &shared, &meta, arena, SCAR_PAX_IGNORE_CHECKSUM), ==, 1);
+	ASSERT_STREQ(meta.path, "file");
+	ASSERT2(meta.mode, ==, 0654u);
+
+	scar_meta_arena_free(arena);
+	scar_meta_global_unref(shared);
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(
+	ustar, read_octal, write_octal, block_is_zero, block_sums, bad_checksum);
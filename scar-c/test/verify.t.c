@@ -0,0 +1,210 @@
+#include "verify.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ioutil.h"
+#include "pool.h"
+#include "scar-reader.h"
+#include "scar-writer.h"
+#include "test.h"
+#include "test-util.h"
+
+// Write a small plain archive of "Hello World\n" files,
+// so that the tests can easily find and corrupt parts of it.
+static int make_archive(
+	struct scar_test_context scar_test_ctx, struct scar_mem_writer *mw,
+	int opts
+) {
+	struct scar_compression plain;
+	scar_compression_init_plain(&plain);
+
+	struct scar_test_archive a;
+	scar_test_archive_init(&a, 3, 12);
+	a.comp = &plain;
+	a.opts = opts;
+	a.path = "file-%d.txt";
+	a.content = SCAR_TEST_TEXT;
+	return scar_test_make_archive(scar_test_ctx, &a, mw);
+}
+
+static int verify(
+	struct scar_mem_writer *mw, struct scar_verify_result *result
+) {
+	struct scar_mem_reader mr;
+	scar_mem_reader_init(&mr, mw->buf, mw->len);
+
+	struct scar_reader *sr = scar_reader_create(&mr.r, &mr.s);
+	if (!sr) {
+		return -2;
+	}
+
+	struct scar_pool *pool = scar_pool_create(2);
+	int ret = scar_verify(sr, pool, result);
+	scar_pool_free(pool);
+	scar_reader_free(sr);
+	return ret;
+}
+
+TEST(intact)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, 0), ==, 0);
+
+	struct scar_verify_result result;
+	ASSERT2(verify(&mw, &result), ==, 0);
+	ASSERT2(result.bad_offset, ==, -1);
+	ASSERT2(result.entry_count, ==, (size_t)3);
+	ASSERT2(result.segment_count, ==, (size_t)1);
+	ASSERT2(result.uncompressed_size, ==, (scar_offset)(3 * 1024 + 1024));
+
+	free(mw.buf);
+	OK();
+}
+
+TEST(intact_preader)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, SCAR_WRITER_CHECKSUMS), ==, 0);
+
+	// With a preader, the segments are read through a fetcher
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw.buf, mw.len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	ASSERT(sr != NULL);
+	scar_reader_set_queue_depth(sr, 1);
+
+	struct scar_pool *pool = scar_pool_create(2);
+	ASSERT(pool != NULL);
+
+	struct scar_verify_result result;
+	ASSERT2(scar_verify(sr, pool, &result), ==, 0);
+	ASSERT2(result.entry_count, ==, (size_t)3);
+	ASSERT2(result.checksummed_segment_count, ==, (size_t)1);
+
+	scar_pool_free(pool);
+	scar_reader_free(sr);
+	free(mw.buf);
+	OK();
+}
+
+TEST(bad_header_checksum)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, 0), ==, 0);
+
+	// Corrupt the path of the second entry
+	unsigned char *buf = mw.buf;
+	ASSERT2(memcmp(&buf[1024], "file-1.txt", 10), ==, 0);
+	buf[1024] = 'F';
+
+	struct scar_verify_result result;
+	ASSERT2(verify(&mw, &result), ==, -1);
+	ASSERT2(result.bad_offset, ==, 1024);
+	ASSERT(strstr(result.message, "checksum") != NULL);
+
+	free(mw.buf);
+	OK();
+}
+
+TEST(bad_index_entry)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, 0), ==, 0);
+
+	// Corrupt the path of the last entry in the index
+	char *buf = mw.buf;
+	char *entry = NULL;
+	for (size_t i = 0; i + 10 <= mw.len; ++i) {
+		if (memcmp(&buf[i], "file-2.txt", 10) == 0) {
+			entry = &buf[i];
+		}
+	}
+
+	ASSERT(entry != NULL);
+	entry[0] = 'F';
+
+	struct scar_verify_result result;
+	ASSERT2(verify(&mw, &result), ==, -1);
+	ASSERT2(result.bad_offset, ==, 2048);
+	ASSERT(strstr(result.message, "File-2.txt") != NULL);
+
+	free(mw.buf);
+	OK();
+}
+
+TEST(bad_segment_checksum)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, SCAR_WRITER_CHECKSUMS), ==, 0);
+
+	struct scar_verify_result result;
+	ASSERT2(verify(&mw, &result), ==, 0);
+	ASSERT2(result.checksummed_segment_count, ==, (size_t)1);
+
+	// Corrupt the content of the first file,
+	// which only the checksum can catch
+	unsigned char *buf = mw.buf;
+	ASSERT2(memcmp(&buf[512], "Hello World\n", 12), ==, 0);
+	buf[512] = 'J';
+
+	ASSERT2(verify(&mw, &result), ==, -1);
+	ASSERT2(result.bad_offset, ==, 0);
+	ASSERT(strstr(result.message, "CRC-32C") != NULL);
+
+	free(mw.buf);
+	OK();
+}
+
+static int verify_streamed(
+	struct scar_mem_writer *mw, struct scar_verify_result *result
+) {
+	struct scar_mem_preader mp;
+	scar_mem_preader_init(&mp, mw->buf, mw->len);
+	struct scar_reader *sr = scar_reader_create_p(&mp.pr);
+	if (!sr) {
+		return -2;
+	}
+
+	// Every segment is bigger than a batch,
+	// so it's read as it's decompressed
+	scar_reader_set_batch_bytes(sr, 1);
+
+	struct scar_pool *pool = scar_pool_create(2);
+	int ret = scar_verify(sr, pool, result);
+	scar_pool_free(pool);
+	scar_reader_free(sr);
+	return ret;
+}
+
+TEST(streamed)
+{
+	struct scar_mem_writer mw;
+	ASSERT2(make_archive(scar_test_ctx, &mw, SCAR_WRITER_CHECKSUMS), ==, 0);
+
+	struct scar_verify_result result;
+	ASSERT2(verify_streamed(&mw, &result), ==, 0);
+	ASSERT2(result.entry_count, ==, (size_t)3);
+	ASSERT2(result.checksummed_segment_count, ==, (size_t)1);
+	ASSERT2(result.uncompressed_size, ==, (scar_offset)(3 * 1024 + 1024));
+
+	// Problems are still found, and reported at the same offsets
+	unsigned char *buf = mw.buf;
+	buf[1024] = 'F';
+	ASSERT2(verify_streamed(&mw, &result), ==, -1);
+	ASSERT2(result.bad_offset, ==, 1024);
+	ASSERT(strstr(result.message, "checksum") != NULL);
+	buf[1024] = 'f';
+
+	buf[512] = 'J';
+	ASSERT2(verify_streamed(&mw, &result), ==, -1);
+	ASSERT2(result.bad_offset, ==, 0);
+	ASSERT(strstr(result.message, "CRC-32C") != NULL);
+
+	free(mw.buf);
+	OK();
+}
+
+TESTGROUP(verify,
+	intact, intact_preader, bad_header_checksum, bad_index_entry,
+	bad_segment_checksum, streamed);
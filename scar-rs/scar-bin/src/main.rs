@@ -2,7 +2,7 @@ use regex::Regex;
 use scar::compression;
 use scar::pax::{self, PaxReader};
 use scar::read::ScarReader;
-use scar::write::ScarWriter;
+use scar::write::{ScarWriter, DEFAULT_SPILL_THRESHOLD};
 use std::env;
 use std::ffi::{OsStr, OsString};
 use std::fs::File;
@@ -93,7 +93,7 @@ fn cmd_list(
     mut ofile: Box<dyn Write>,
     comp: Compression,
 ) -> Result<()> {
-    let mut reader = comp.create_reader(ifile)?;
+    let reader = comp.create_reader(ifile)?;
     for entry in reader.index()? {
         let entry = entry?;
         write!(ofile, "{}\n", String::from_utf8_lossy(&entry.path))?;
@@ -114,7 +114,7 @@ fn cmd_cat(
         patterns.push(glob_to_regex(&arg.to_string_lossy())?);
     }
 
-    let mut reader = comp.create_reader(ifile)?;
+    let reader = comp.create_reader(ifile)?;
     for pattern in patterns {
         for entry in reader.index()? {
             let entry = entry?;
@@ -156,7 +156,7 @@ fn cmd_ls(
         patterns.push(glob_to_regex("/*".into())?);
     }
 
-    let mut reader = comp.create_reader(ifile)?;
+    let reader = comp.create_reader(ifile)?;
     for pattern in patterns {
         for entry in reader.index()? {
             let entry = entry?;
@@ -182,7 +182,7 @@ fn cmd_stat(
         patterns.push(glob_to_regex(&arg.to_string_lossy())?);
     }
 
-    let mut reader = comp.create_reader(ifile)?;
+    let reader = comp.create_reader(ifile)?;
     let mut first = true;
     for pattern in patterns {
         for entry in reader.index()? {
@@ -277,6 +277,7 @@ fn cmd_convert(
 
     let cf = comp.create_compressor_factory();
     let mut writer = ScarWriter::new(cf, ofile)?;
+    writer.set_spill_threshold(DEFAULT_SPILL_THRESHOLD);
 
     let mut block = pax::new_block();
     while let Some(header) = reader.next_header()? {
@@ -28,7 +28,7 @@ pub trait CompressorFactory {
     fn eof_marker(&self) -> &'static [u8];
 }
 
-pub trait DecompressorFactory {
+pub trait DecompressorFactory: Send + Sync {
     fn create_decompressor(&self, w: Box<dyn Read>) -> io::Result<Box<dyn Decompressor>>;
     fn eof_marker(&self) -> &'static [u8];
     fn magic(&self) -> &'static [u8];
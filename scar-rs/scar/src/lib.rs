@@ -4,3 +4,6 @@ pub mod read;
 pub mod write;
 
 mod util;
+
+#[cfg(test)]
+mod test_util;
@@ -3,6 +3,7 @@ use std::cmp::min;
 use std::fmt;
 use std::io::{Read, Write};
 use std::mem::size_of;
+use std::sync::Arc;
 use anyhow::{Result, anyhow};
 
 #[derive(Copy, Clone)]
@@ -357,39 +358,69 @@ fn write_header_block<W: Write>(w: &mut W, block: &mut Block) -> Result<()> {
     Ok(())
 }
 
-pub fn write_content<W: Write, R: Read>(w: &mut W, r: &mut R, mut count: u64) -> Result<()> {
-    let mut block = [0u8; size_of::<Block>()];
+// Entry content is copied this much at a time, so that the per-call
+// overhead of the readers and writers disappears next to the data itself
+const CHUNK_SIZE: usize = 256 * 1024;
 
-    while count >= size_of::<Block>() as u64 {
-        r.read_exact(&mut block)?;
-        w.write_all(&block)?;
-        count -= size_of::<Block>() as u64;
-    }
+// Entries which fit in this much stack space don't need a heap buffer
+const SMALL_CONTENT_SIZE: usize = 8192;
 
-    if count > 0 {
-        r.read_exact(&mut block[0..(count as usize)])?;
-        block[(count as usize)..].fill(0);
-        w.write_all(&block)?;
-    }
+fn padded_size(count: u64) -> Result<u64> {
+    let block = size_of::<Block>() as u64;
+    count
+        .checked_add(block - 1)
+        .map(|n| n / block * block)
+        .ok_or_else(|| anyhow!("Content size too large"))
+}
 
-    Ok(())
+// Call 'f' with a buffer for copying 'padded' bytes of content.
+// Its length is a multiple of the block size.
+fn with_content_buffer<T>(padded: u64, f: impl FnOnce(&mut [u8]) -> T) -> T {
+    if padded <= SMALL_CONTENT_SIZE as u64 {
+        let mut stack = [0u8; SMALL_CONTENT_SIZE];
+        f(&mut stack)
+    } else {
+        let mut heap = vec![0u8; min(padded, CHUNK_SIZE as u64) as usize];
+        f(&mut heap)
+    }
 }
 
-pub fn read_content<W: Write, R: Read>(w: &mut W, r: &mut R, mut count: u64) -> Result<()> {
-    let mut block = [0u8; size_of::<Block>()];
+pub fn write_content<W: Write, R: Read>(w: &mut W, r: &mut R, count: u64) -> Result<()> {
+    let block = size_of::<Block>();
+    with_content_buffer(padded_size(count)?, |buf| {
+        let mut left = count;
+        while left > 0 {
+            let n = min(left, buf.len() as u64) as usize;
+            r.read_exact(&mut buf[..n])?;
 
-    while count >= size_of::<Block>() as u64 {
-        r.read_exact(&mut block)?;
-        w.write_all(&block)?;
-        count -= size_of::<Block>() as u64;
-    }
+            // Only the last chunk needs padding
+            let padded = (n + block - 1) / block * block;
+            buf[n..padded].fill(0);
+            w.write_all(&buf[..padded])?;
+            left -= n as u64;
+        }
 
-    if count > 0 {
-        r.read_exact(&mut block)?;
-        w.write_all(&block[0..(count as usize)])?;
-    }
+        Ok(())
+    })
+}
 
-    Ok(())
+pub fn read_content<W: Write, R: Read>(w: &mut W, r: &mut R, count: u64) -> Result<()> {
+    let mut padded = padded_size(count)?;
+    with_content_buffer(padded, |buf| {
+        // Read whole blocks, but only write the content,
+        // not the padding at the end
+        let mut left = count;
+        while padded > 0 {
+            let n = min(padded, buf.len() as u64) as usize;
+            r.read_exact(&mut buf[..n])?;
+            let content = min(left, n as u64) as usize;
+            w.write_all(&buf[..content])?;
+            padded -= n as u64;
+            left -= content as u64;
+        }
+
+        Ok(())
+    })
 }
 
 pub fn write_header<'a, W: Write>(w: &mut W, meta: &Metadata) -> Result<()> {
@@ -667,14 +698,14 @@ impl PaxMeta {
 
 pub struct PaxReader<R: Read> {
     r: R,
-    pub global_meta: PaxMeta,
+    pub global_meta: Arc<PaxMeta>,
 }
 
 impl<R: Read> PaxReader<R> {
     pub fn new(r: R) -> Self {
         Self {
             r,
-            global_meta: PaxMeta::new(),
+            global_meta: Arc::new(PaxMeta::new()),
         }
     }
 
@@ -695,7 +726,9 @@ impl<R: Read> PaxReader<R> {
 
             match typeflag {
                 MetaType::PaxNext => next_meta.parse(&mut content.as_slice())?,
-                MetaType::PaxGlobal => self.global_meta.parse(&mut content.as_slice())?,
+                MetaType::PaxGlobal => {
+                    Arc::make_mut(&mut self.global_meta).parse(&mut content.as_slice())?
+                }
                 MetaType::GnuPath => next_meta.path = Some(content),
                 MetaType::GnuLinkPath => next_meta.linkpath = Some(content),
             }
@@ -817,3 +850,29 @@ impl<R: Read> PaxReader<R> {
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn content_round_trip() {
+        let chunk = 256 * 1024;
+        for size in [0, 1, 511, 512, 8192, 8193, chunk, chunk + 700, 3 * chunk - 1] {
+            let data: Vec<u8> = (0..size).map(|i| (i * 7 % 251) as u8).collect();
+            let mut tar = Vec::new();
+            write_content(&mut tar, &mut &data[..], size as u64).unwrap();
+            assert_eq!(tar.len(), (size + 511) / 512 * 512);
+            assert_eq!(&tar[..size], &data[..]);
+            assert!(tar[size..].iter().all(|&b| b == 0));
+
+            // Reading it back stops right after the padding
+            tar.extend_from_slice(b"next");
+            let mut r = &tar[..];
+            let mut out = Vec::new();
+            read_content(&mut out, &mut r, size as u64).unwrap();
+            assert_eq!(out, data);
+            assert_eq!(r, b"next");
+        }
+    }
+}
@@ -1,37 +1,182 @@
 use crate::compression::{self, Decompressor, DecompressorFactory};
 use crate::pax;
 use crate::util::{find_last_occurrence, read_num_from_bufread, Checkpoint, ReadSeek};
-use std::cell::RefCell;
 use std::cmp::min;
 use std::fmt;
 use std::io::{self, BufRead, BufReader, Read, Seek};
 use std::iter::Iterator;
-use std::rc::Rc;
+use std::sync::{Arc, Mutex, MutexGuard};
 use anyhow::{Result, anyhow};
 
+/// The default size of the window at the end of an archive
+/// which ScarReader reads in one go when it's created.
+pub const DEFAULT_FOOTER_WINDOW: u64 = 256 * 1024;
+
+/// The most the footer window is grown to,
+/// when the footer sections don't fit in the window.
+pub const MAX_FOOTER_WINDOW: u64 = 64 * 1024 * 1024;
+
+struct SharedStream {
+    r: Box<dyn ReadSeek + Send>,
+
+    // Where the underlying stream is positioned,
+    // so that we only have to seek it when switching between cursors
+    pos: u64,
+}
+
+/// A cursor into a stream which is shared between threads.
+/// Every clone has its own position, and the underlying stream is
+/// seeked to that position before each read, so clones never
+/// disturb each other.
+/// Reads of the end of the stream are served from the footer,
+/// if one has been loaded, without touching the stream.
 #[derive(Clone)]
 pub struct RSCell {
-    r: Rc<RefCell<Box<dyn ReadSeek>>>,
+    r: Arc<Mutex<SharedStream>>,
+    footer: Option<Arc<Footer>>,
+    pos: u64,
+}
+
+/// The end of a stream, from 'start' to the end.
+struct Footer {
+    start: u64,
+    data: Vec<u8>,
 }
 
 impl RSCell {
-    pub fn new(r: Rc<RefCell<Box<dyn ReadSeek>>>) -> Self {
-        Self { r }
+    pub fn new(r: Box<dyn ReadSeek + Send>) -> Self {
+        Self {
+            r: Arc::new(Mutex::new(SharedStream { r, pos: u64::MAX })),
+            footer: None,
+            pos: 0,
+        }
+    }
+
+    /// Read the last 'window' bytes of the stream with a single read,
+    /// and serve all later reads of them from memory.
+    pub fn load_footer(&mut self, window: u64) -> io::Result<()> {
+        let mut shared = lock_stream(&self.r);
+        shared.pos = u64::MAX;
+        let len = shared.r.seek(io::SeekFrom::End(0))?;
+        let start = len - min(len, window);
+        shared.r.seek(io::SeekFrom::Start(start))?;
+
+        let mut data = vec![0u8; (len - start) as usize];
+        shared.r.read_exact(&mut data)?;
+        shared.pos = len;
+
+        self.footer = Some(Arc::new(Footer { start, data }));
+        Ok(())
+    }
+
+    /// Grow the footer to begin at 'start', with one more read.
+    /// Clones made before this keep the old footer.
+    pub fn grow_footer(&mut self, start: u64) -> io::Result<()> {
+        let footer = match &self.footer {
+            Some(footer) if start < footer.start => footer.clone(),
+            _ => return Ok(()),
+        };
+
+        let mut data = vec![0u8; (footer.start - start) as usize];
+        {
+            let mut shared = lock_stream(&self.r);
+            shared.pos = u64::MAX;
+            shared.r.seek(io::SeekFrom::Start(start))?;
+            shared.r.read_exact(&mut data)?;
+            shared.pos = footer.start;
+        }
+
+        data.extend_from_slice(&footer.data);
+        self.footer = Some(Arc::new(Footer { start, data }));
+        Ok(())
     }
+
+    fn footer_start(&self) -> Option<u64> {
+        self.footer.as_ref().map(|footer| footer.start)
+    }
+}
+
+fn lock_stream(r: &Mutex<SharedStream>) -> MutexGuard<'_, SharedStream> {
+    // A panic while holding the lock can't leave the stream in a state
+    // we rely on, since we always seek before reading anyway
+    r.lock().unwrap_or_else(|err| err.into_inner())
 }
 
 impl Read for RSCell {
-    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
-        self.r.borrow_mut().read(buf)
+    fn read(&mut self, mut buf: &mut [u8]) -> io::Result<usize> {
+        if let Some(footer) = &self.footer {
+            if self.pos >= footer.start {
+                let offset = min(self.pos - footer.start, footer.data.len() as u64) as usize;
+                let n = min(buf.len(), footer.data.len() - offset);
+                buf[..n].copy_from_slice(&footer.data[offset..offset + n]);
+                self.pos += n as u64;
+                return Ok(n);
+            }
+
+            // Reads which run into the footer stop at its start
+            let max = (footer.start - self.pos) as usize;
+            if buf.len() > max {
+                buf = &mut buf[..max];
+            }
+        }
+
+        let mut shared = lock_stream(&self.r);
+        if shared.pos != self.pos {
+            shared.pos = u64::MAX;
+            shared.pos = shared.r.seek(io::SeekFrom::Start(self.pos))?;
+        }
+
+        let n = match shared.r.read(buf) {
+            Ok(n) => n,
+            Err(err) => {
+                shared.pos = u64::MAX;
+                return Err(err);
+            }
+        };
+
+        shared.pos += n as u64;
+        self.pos += n as u64;
+        Ok(n)
     }
 }
 
 impl Seek for RSCell {
     fn seek(&mut self, pos: io::SeekFrom) -> io::Result<u64> {
-        self.r.borrow_mut().seek(pos)
+        self.pos = match pos {
+            io::SeekFrom::Start(n) => n,
+            io::SeekFrom::Current(n) => self.pos.checked_add_signed(n).ok_or_else(|| {
+                io::Error::new(io::ErrorKind::InvalidInput, "Invalid seek position")
+            })?,
+            io::SeekFrom::End(n) if self.footer.is_some() => {
+                let footer = self.footer.as_ref().unwrap();
+                let end = footer.start + footer.data.len() as u64;
+                end.checked_add_signed(n).ok_or_else(|| {
+                    io::Error::new(io::ErrorKind::InvalidInput, "Invalid seek position")
+                })?
+            }
+            io::SeekFrom::End(_) => {
+                let mut shared = lock_stream(&self.r);
+                shared.pos = u64::MAX;
+                let end = shared.r.seek(pos)?;
+                shared.pos = end;
+                end
+            }
+        };
+
+        Ok(self.pos)
     }
 }
 
+/// A reader for scar archives.
+/// The reader itself is never modified after it has been created;
+/// every index iterator and item reader gets its own cursor into the stream,
+/// so a single ScarReader can be shared between threads.
+///
+/// When it's created, the reader reads the end of the archive in one go
+/// (see DEFAULT_FOOTER_WINDOW), and grows that window once if the footer
+/// sections don't fit, so that the tail, the checkpoints and the index
+/// are all parsed from memory. On storage where every read is a round trip,
+/// this makes opening an archive and listing it take one or two of them.
 pub struct ScarReader {
     r: RSCell,
     df: Box<dyn DecompressorFactory>,
@@ -40,33 +185,44 @@ pub struct ScarReader {
 }
 
 impl ScarReader {
-    pub fn new<R: ReadSeek + 'static>(mut r: R) -> Result<Self> {
-        let df = compression::guess_decompressor(&mut r)?;
-        Self::create(Rc::new(RefCell::new(Box::new(r))), df)
+    pub fn new<R: ReadSeek + Send + 'static>(r: R) -> Result<Self> {
+        Self::with_footer_window(r, None, DEFAULT_FOOTER_WINDOW)
     }
 
-    pub fn with_decompressor<R: ReadSeek + 'static>(
+    pub fn with_decompressor<R: ReadSeek + Send + 'static>(
         r: R,
         df: Box<dyn DecompressorFactory>,
     ) -> Result<Self> {
-        Self::create(Rc::new(RefCell::new(Box::new(r))), df)
+        Self::with_footer_window(r, Some(df), DEFAULT_FOOTER_WINDOW)
     }
 
-    fn create(
-        rc: Rc<RefCell<Box<dyn ReadSeek>>>,
-        df: Box<dyn DecompressorFactory>,
+    /// Create a reader which reads the last 'window' bytes of the archive
+    /// in one go, or reads each footer section separately if 'window' is 0.
+    /// The decompressor is guessed from the end of the archive if 'df' is None.
+    pub fn with_footer_window<R: ReadSeek + Send + 'static>(
+        r: R,
+        df: Option<Box<dyn DecompressorFactory>>,
+        window: u64,
     ) -> Result<Self> {
-        let mut r = RSCell::new(rc.clone());
+        let mut r = RSCell::new(Box::new(r));
+        if window > 0 {
+            r.load_footer(window)?;
+        }
+
+        let df = match df {
+            Some(df) => df,
+            None => compression::guess_decompressor(r.clone())?,
+        };
+        Self::create(r, df)
+    }
 
+    fn create(mut r: RSCell, df: Box<dyn DecompressorFactory>) -> Result<Self> {
         let file_len = r.seek(io::SeekFrom::End(0))?;
         let tail_block_len = min(file_len, 512);
-        if file_len <= 512 {
-            r.seek(io::SeekFrom::Start(0))?;
-        } else {
-            r.seek(io::SeekFrom::Start(512))?;
-        }
+        r.seek(io::SeekFrom::End(-(tail_block_len as i64)))?;
         let mut compressed_tail_block = [0; 512];
-        let mut end = r.read(&mut compressed_tail_block)?;
+        let mut end = tail_block_len as usize;
+        r.read_exact(&mut compressed_tail_block[..end])?;
 
         let magic = df.magic();
         loop {
@@ -77,7 +233,7 @@ impl ScarReader {
             end = idx + magic.len() - 1;
 
             r.seek(io::SeekFrom::End(idx as i64 - tail_block_len as i64))?;
-            let dc = df.create_decompressor(Box::new(RSCell::new(rc.clone())))?;
+            let dc = df.create_decompressor(Box::new(r.clone()))?;
             let mut br = io::BufReader::new(dc);
 
             let mut line = Vec::<u8>::new();
@@ -104,7 +260,16 @@ impl ScarReader {
             let compressed_checkpoints_loc =
                 String::from_utf8_lossy(&line[..line.len() - 1]).parse::<u64>()?;
 
-            let checkpoints = Self::read_checkpoints(rc, compressed_checkpoints_loc, &df)?;
+            // Make sure the index and the checkpoints are in the footer,
+            // unless they're too big to keep in memory
+            let footer_start = min(compressed_index_loc, compressed_checkpoints_loc);
+            if let Some(start) = r.footer_start() {
+                if footer_start < start && file_len - footer_start <= MAX_FOOTER_WINDOW {
+                    r.grow_footer(footer_start)?;
+                }
+            }
+
+            let checkpoints = Self::read_checkpoints(r.clone(), compressed_checkpoints_loc, &df)?;
 
             return Ok(Self {
                 r,
@@ -116,13 +281,12 @@ impl ScarReader {
     }
 
     fn read_checkpoints(
-        rc: Rc<RefCell<Box<dyn ReadSeek>>>,
+        mut r: RSCell,
         compressed_checkpoints_loc: u64,
         df: &Box<dyn DecompressorFactory>,
     ) -> Result<Vec<Checkpoint>> {
-        rc.borrow_mut()
-            .seek(io::SeekFrom::Start(compressed_checkpoints_loc))?;
-        let dc = df.create_decompressor(Box::new(RSCell::new(rc.clone())))?;
+        r.seek(io::SeekFrom::Start(compressed_checkpoints_loc))?;
+        let dc = df.create_decompressor(Box::new(r))?;
         let mut br = io::BufReader::new(dc);
         let mut chs = [0u8; 1];
         let mut checkpoints = Vec::<Checkpoint>::new();
@@ -166,11 +330,11 @@ impl ScarReader {
         Ok(checkpoints)
     }
 
-    pub fn index(&mut self) -> Result<IndexIter> {
-        self.r
-            .seek(io::SeekFrom::Start(self.compressed_index_loc))?;
+    pub fn index(&self) -> Result<IndexIter> {
+        let mut r = self.r.clone();
+        r.seek(io::SeekFrom::Start(self.compressed_index_loc))?;
 
-        let mut br = BufReader::new(self.df.create_decompressor(Box::new(self.r.clone()))?);
+        let mut br = BufReader::new(self.df.create_decompressor(Box::new(r))?);
 
         let mut line = Vec::<u8>::new();
         br.read_until(b'\n', &mut line)?;
@@ -178,27 +342,23 @@ impl ScarReader {
             return Err(anyhow!("Invalid index header"));
         }
 
-        let seek_pos = self.r.seek(io::SeekFrom::Current(0))?;
-
         Ok(IndexIter {
-            r: self.r.clone(),
             br,
-            global_meta: pax::PaxMeta::new(),
-            seek_pos,
+            global_meta: Arc::new(pax::PaxMeta::new()),
         })
     }
 
     pub fn read_item(
-        &mut self,
+        &self,
         item: &IndexItem,
     ) -> Result<pax::PaxReader<Box<dyn Decompressor>>> {
         let dc = self.seek_to_raw_loc(item.offset)?;
         let mut pr = pax::PaxReader::new(dc);
-        pr.global_meta = item.global_meta.clone();
+        pr.global_meta = Arc::clone(&item.global_meta);
         Ok(pr)
     }
 
-    fn seek_to_raw_loc(&mut self, raw_loc: u64) -> io::Result<Box<dyn Decompressor>> {
+    fn seek_to_raw_loc(&self, raw_loc: u64) -> io::Result<Box<dyn Decompressor>> {
         let mut checkpoint = Checkpoint {
             compressed_loc: 0,
             raw_loc: 0,
@@ -212,9 +372,9 @@ impl ScarReader {
             }
         }
 
-        self.r
-            .seek(io::SeekFrom::Start(checkpoint.compressed_loc))?;
-        let mut dc = self.df.create_decompressor(Box::new(self.r.clone()))?;
+        let mut r = self.r.clone();
+        r.seek(io::SeekFrom::Start(checkpoint.compressed_loc))?;
+        let mut dc = self.df.create_decompressor(Box::new(r))?;
 
         let mut diff = raw_loc - checkpoint.raw_loc;
         let mut buf = [0u8; 1024];
@@ -236,7 +396,8 @@ pub struct IndexItem {
     pub path: Vec<u8>,
     pub typeflag: pax::FileType,
     pub offset: u64,
-    pub global_meta: pax::PaxMeta,
+    /// Shared by every item until the next global header
+    pub global_meta: Arc<pax::PaxMeta>,
 }
 
 impl fmt::Display for IndexItem {
@@ -251,20 +412,14 @@ impl fmt::Display for IndexItem {
 }
 
 pub struct IndexIter {
-    r: RSCell,
     br: BufReader<Box<dyn Decompressor>>,
-    global_meta: pax::PaxMeta,
-    seek_pos: u64,
+    global_meta: Arc<pax::PaxMeta>,
 }
 
 impl Iterator for IndexIter {
     type Item = Result<IndexItem>;
 
     fn next(&mut self) -> Option<Result<IndexItem>> {
-        if let Err(err) = self.r.seek(io::SeekFrom::Start(self.seek_pos)) {
-            return Some(Err(err.into()));
-        }
-
         let b = match self.br.fill_buf() {
             Err(_) => return None,
             Ok(b) => b,
@@ -328,7 +483,9 @@ impl Iterator for IndexIter {
                     return Some(Err(err.into()));
                 }
 
-                if let Err(err) = self.global_meta.parse(&mut content.as_slice()) {
+                // Items handed out earlier keep the old global meta
+                let global_meta = Arc::make_mut(&mut self.global_meta);
+                if let Err(err) = global_meta.parse(&mut content.as_slice()) {
                     return Some(Err(err.into()));
                 }
 
@@ -355,16 +512,141 @@ impl Iterator for IndexIter {
             return Some(Err(anyhow!("Invalid index entry")));
         }
 
-        self.seek_pos = match self.r.seek(io::SeekFrom::Current(0)) {
-            Ok(pos) => pos,
-            Err(err) => return Some(Err(err.into())),
-        };
-
         Some(Ok(IndexItem {
             path: content,
             typeflag: pax::FileType::from_char(typeflag),
             offset,
-            global_meta: self.global_meta.clone(),
+            global_meta: Arc::clone(&self.global_meta),
         }))
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::test_util;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    // A stream which counts how often it's read from
+    struct CountingStream {
+        inner: io::Cursor<Vec<u8>>,
+        reads: Arc<AtomicUsize>,
+    }
+
+    impl Read for CountingStream {
+        fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+            self.reads.fetch_add(1, Ordering::Relaxed);
+            self.inner.read(buf)
+        }
+    }
+
+    impl Seek for CountingStream {
+        fn seek(&mut self, pos: io::SeekFrom) -> io::Result<u64> {
+            self.inner.seek(pos)
+        }
+    }
+
+    fn make_archive(count: usize) -> Vec<u8> {
+        test_util::make_archive(|sw| {
+            for i in 0..count {
+                let path = format!("some/directory/file-{}.txt", i);
+                let meta = pax::Metadata::new_file(path.into_bytes(), 5);
+                sw.add_file(&mut &b"hello"[..], &meta).unwrap();
+            }
+        })
+    }
+
+    fn open_counting(data: Vec<u8>, window: u64) -> (ScarReader, Arc<AtomicUsize>) {
+        let reads = Arc::new(AtomicUsize::new(0));
+        let stream = CountingStream {
+            inner: io::Cursor::new(data),
+            reads: reads.clone(),
+        };
+        let sr = ScarReader::with_footer_window(stream, None, window).unwrap();
+        (sr, reads)
+    }
+
+    fn assert_send_sync<T: Send + Sync>() {}
+
+    #[test]
+    fn reader_is_send_and_sync() {
+        assert_send_sync::<ScarReader>();
+    }
+
+    #[test]
+    fn footer_is_read_once() {
+        let (sr, reads) = open_counting(make_archive(100), DEFAULT_FOOTER_WINDOW);
+        assert_eq!(sr.index().unwrap().count(), 100);
+        assert_eq!(reads.load(Ordering::Relaxed), 1);
+
+        // Without a window, every section is read separately
+        let (sr, reads) = open_counting(make_archive(100), 0);
+        assert_eq!(sr.index().unwrap().count(), 100);
+        assert!(reads.load(Ordering::Relaxed) > 3);
+    }
+
+    #[test]
+    fn footer_grows_once() {
+        let (sr, reads) = open_counting(make_archive(2000), 1024);
+        assert_eq!(reads.load(Ordering::Relaxed), 2);
+
+        let items: Vec<IndexItem> = sr.index().unwrap().map(|item| item.unwrap()).collect();
+        assert_eq!(items.len(), 2000);
+        assert_eq!(reads.load(Ordering::Relaxed), 2);
+
+        let mut pr = sr.read_item(&items[1234]).unwrap();
+        let meta = pr.next_header().unwrap().unwrap();
+        assert_eq!(meta.path, b"some/directory/file-1234.txt");
+    }
+
+    #[test]
+    fn global_meta_is_shared() {
+        let data = test_util::make_archive(|sw| {
+            let mut global = pax::PaxMeta::new();
+            global.comment = Some(b"x".repeat(10000));
+            sw.add_global_meta(&global).unwrap();
+            for i in 0..3 {
+                let meta = pax::Metadata::new_file(format!("file-{}", i).into_bytes(), 5);
+                sw.add_file(&mut &b"hello"[..], &meta).unwrap();
+            }
+
+            global.comment = Some(b"second".to_vec());
+            sw.add_global_meta(&global).unwrap();
+            let meta = pax::Metadata::new_file(b"last".to_vec(), 5);
+            sw.add_file(&mut &b"hello"[..], &meta).unwrap();
+        });
+        let sr = ScarReader::new(io::Cursor::new(data)).unwrap();
+        let items: Vec<IndexItem> = sr.index().unwrap().map(|item| item.unwrap()).collect();
+        assert_eq!(items.len(), 4);
+
+        // Items between two global headers share one copy
+        assert!(Arc::ptr_eq(&items[0].global_meta, &items[2].global_meta));
+        assert!(!Arc::ptr_eq(&items[2].global_meta, &items[3].global_meta));
+        assert_eq!(items[0].global_meta.comment.as_ref().unwrap().len(), 10000);
+        assert_eq!(items[3].global_meta.comment.as_deref(), Some(&b"second"[..]));
+
+        let mut pr = sr.read_item(&items[1]).unwrap();
+        let meta = pr.next_header().unwrap().unwrap();
+        assert_eq!(meta.path, b"file-1");
+        assert_eq!(meta.comment.unwrap().len(), 10000);
+        assert_eq!(Arc::strong_count(&items[1].global_meta), 4);
+    }
+
+    #[test]
+    fn cursors_are_independent() {
+        let data: Vec<u8> = (0..100u8).collect();
+        let mut a = RSCell::new(Box::new(io::Cursor::new(data)));
+        let mut b = a.clone();
+
+        a.seek(io::SeekFrom::Start(10)).unwrap();
+        b.seek(io::SeekFrom::Start(50)).unwrap();
+
+        let mut buf = [0u8; 2];
+        a.read_exact(&mut buf).unwrap();
+        assert_eq!(buf, [10, 11]);
+        b.read_exact(&mut buf).unwrap();
+        assert_eq!(buf, [50, 51]);
+        a.read_exact(&mut buf).unwrap();
+        assert_eq!(buf, [12, 13]);
+    }
+}
@@ -0,0 +1,36 @@
+use crate::compression::GzipCompressorFactory;
+use crate::write::ScarWriter;
+use std::cell::RefCell;
+use std::io::{self, Write};
+use std::rc::Rc;
+
+// A writer which appends to a buffer the test keeps a handle to,
+// since the ScarWriter owns the writer it's given
+pub struct SharedVec(pub Rc<RefCell<Vec<u8>>>);
+
+impl Write for SharedVec {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0.borrow_mut().extend_from_slice(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+// Write a gzip compressed archive with whatever 'add' puts in it
+pub fn make_archive<F: FnOnce(&mut ScarWriter)>(add: F) -> Vec<u8> {
+    let buf = Rc::new(RefCell::new(Vec::new()));
+    let mut sw = ScarWriter::new(
+        Box::new(GzipCompressorFactory::new(6)),
+        Box::new(SharedVec(buf.clone())),
+    )
+    .unwrap();
+
+    add(&mut sw);
+
+    sw.finish().unwrap();
+    let data = buf.borrow().clone();
+    data
+}
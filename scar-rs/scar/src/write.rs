@@ -1,9 +1,12 @@
 use crate::compression::{Compressor, CompressorFactory};
 use crate::pax;
 use crate::util::{log10_ceil, Checkpoint};
-use std::io::{self, Read, Write};
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Read, Seek, Write};
+use std::path::PathBuf;
+use std::process;
 use std::rc::Rc;
-use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
 use anyhow::Result;
 
 pub struct TrackedWrite<W: Write> {
@@ -33,10 +36,107 @@ impl<W: Write> Write for TrackedWrite<W> {
     }
 }
 
-struct IndexEntry {
+/// A spill threshold which keeps the writer's memory use modest,
+/// for use with ScarWriter::set_spill_threshold.
+pub const DEFAULT_SPILL_THRESHOLD: usize = 64 * 1024 * 1024;
+
+struct IndexEntry<'a> {
     pub raw_loc: u64,
     pub typeflag: u8,
-    pub data: Vec<u8>,
+    pub data: &'a [u8],
+}
+
+/// A buffer which keeps what's written to it in memory until it passes
+/// 'threshold' bytes, and moves it all to a temporary file then,
+/// so that memory use stays flat no matter how much is written.
+/// A 'threshold' of 0 means it never spills.
+struct SpillBuffer {
+    mem: Vec<u8>,
+    file: Option<File>,
+    threshold: usize,
+
+    // The temporary file's path, if it couldn't be removed right away
+    // (which is the case on Windows while it's open)
+    path: Option<PathBuf>,
+}
+
+static SPILL_COUNTER: AtomicUsize = AtomicUsize::new(0);
+
+impl SpillBuffer {
+    fn new() -> Self {
+        Self {
+            mem: Vec::new(),
+            file: None,
+            threshold: 0,
+            path: None,
+        }
+    }
+
+    fn spill(&mut self) -> io::Result<()> {
+        let path = std::env::temp_dir().join(format!(
+            "scar-spill-{}-{}",
+            process::id(),
+            SPILL_COUNTER.fetch_add(1, Ordering::Relaxed)
+        ));
+        let mut file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create_new(true)
+            .open(&path)?;
+        if fs::remove_file(&path).is_err() {
+            self.path = Some(path);
+        }
+
+        file.write_all(&self.mem)?;
+        self.mem = Vec::new();
+        self.file = Some(file);
+        Ok(())
+    }
+
+    /// Write everything which has been written to the buffer to 'w'.
+    fn copy_to<W: Write>(&mut self, w: &mut W) -> io::Result<()> {
+        match &mut self.file {
+            Some(file) => {
+                file.seek(io::SeekFrom::Start(0))?;
+                io::copy(file, w)?;
+                file.seek(io::SeekFrom::End(0))?;
+                Ok(())
+            }
+            None => w.write_all(&self.mem),
+        }
+    }
+}
+
+impl Write for SpillBuffer {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        if self.file.is_none()
+            && self.threshold > 0
+            && self.mem.len() + buf.len() > self.threshold
+        {
+            self.spill()?;
+        }
+
+        match &mut self.file {
+            Some(file) => file.write(buf),
+            None => self.mem.write(buf),
+        }
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        match &mut self.file {
+            Some(file) => file.flush(),
+            None => Ok(()),
+        }
+    }
+}
+
+impl Drop for SpillBuffer {
+    fn drop(&mut self) {
+        self.file = None;
+        if let Some(path) = &self.path {
+            let _ = fs::remove_file(path);
+        }
+    }
 }
 
 pub struct ScarWriter {
@@ -46,7 +146,9 @@ pub struct ScarWriter {
     raw_loc: Rc<AtomicU64>,
 
     checkpoints: Vec<Checkpoint>,
-    scar_index: Vec<IndexEntry>,
+
+    // The uncompressed SCAR-INDEX entries, written as we go
+    scar_index: SpillBuffer,
     checkpoint_interval: u64,
     last_checkpoint_compressed_loc: u64,
 }
@@ -66,12 +168,21 @@ impl ScarWriter {
             raw_loc,
 
             checkpoints: Vec::new(),
-            scar_index: Vec::new(),
+            scar_index: SpillBuffer::new(),
             checkpoint_interval: 1024 * 1024,
             last_checkpoint_compressed_loc: 0,
         })
     }
 
+    /// Keep at most 'threshold' bytes of the index in memory.
+    /// Once it passes that, it's moved to a temporary file, and the rest
+    /// of it is appended there, so that memory use stays flat no matter
+    /// how many entries are written. A threshold of 0 (the default)
+    /// keeps everything in memory.
+    pub fn set_spill_threshold(&mut self, threshold: usize) {
+        self.scar_index.threshold = threshold;
+    }
+
     pub fn add_file<R: Read>(&mut self, r: &mut R, meta: &pax::Metadata) -> Result<()> {
         self.add_entry(meta)?;
         pax::write_content(self.w.as_mut().unwrap(), r, meta.size)
@@ -80,11 +191,12 @@ impl ScarWriter {
     pub fn add_entry(&mut self, meta: &pax::Metadata) -> Result<()> {
         self.consider_checkpoint()?;
 
-        self.scar_index.push(IndexEntry {
+        let entry = IndexEntry {
             raw_loc: self.raw_loc.load(Ordering::Relaxed),
             typeflag: meta.typeflag.char(),
-            data: meta.path.clone(),
-        });
+            data: &meta.path,
+        };
+        Self::write_entry(&mut self.scar_index, &entry)?;
 
         pax::write_header(self.w.as_mut().unwrap(), meta)?;
 
@@ -102,11 +214,12 @@ impl ScarWriter {
             &data,
         )?;
 
-        self.scar_index.push(IndexEntry {
+        let entry = IndexEntry {
             raw_loc: loc,
             typeflag: b'g',
-            data,
-        });
+            data: &data,
+        };
+        Self::write_entry(&mut self.scar_index, &entry)?;
 
         Ok(())
     }
@@ -119,9 +232,7 @@ impl ScarWriter {
         self.checkpoint()?;
         let index_checkpoint = self.checkpoints.last().unwrap().clone();
         self.w.as_mut().unwrap().write_all(b"SCAR-INDEX\n")?;
-        for entry in &self.scar_index {
-            Self::write_entry(self.w.as_mut().unwrap(), entry)?;
-        }
+        self.scar_index.copy_to(self.w.as_mut().unwrap())?;
 
         self.checkpoint()?;
         let checkpoints_checkpoint = self.checkpoints.last().unwrap().clone();
@@ -183,14 +294,18 @@ impl ScarWriter {
         Ok(())
     }
 
-    fn write_entry(w: &mut TrackedWrite<Box<dyn Compressor>>, ent: &IndexEntry) -> Result<()> {
-        let len: u64 = 3 + log10_ceil(ent.raw_loc) + 1 + ent.data.len() as u64 + 1;
+    fn write_entry<W: Write>(w: &mut W, ent: &IndexEntry) -> Result<()> {
+        // Global entries end with the pax records' own newline,
+        // every other entry gets one after its path
+        let is_global = ent.typeflag == pax::MetaType::PaxGlobal.char();
+        let newline_len: u64 = if is_global { 0 } else { 1 };
+        let len: u64 = 3 + log10_ceil(ent.raw_loc) + 1 + ent.data.len() as u64 + newline_len;
         let mut num_digits = log10_ceil(len);
         if log10_ceil(len + num_digits) > num_digits {
             num_digits += 1;
         }
 
-        if ent.typeflag == pax::MetaType::PaxGlobal.char() {
+        if is_global {
             write!(
                 w,
                 "{} {} {} ",
@@ -198,7 +313,7 @@ impl ScarWriter {
                 ent.typeflag as char,
                 ent.raw_loc
             )?;
-            w.write_all(ent.data.as_slice())?;
+            w.write_all(ent.data)?;
         } else {
             write!(
                 w,
@@ -207,9 +322,44 @@ impl ScarWriter {
                 ent.typeflag as char,
                 ent.raw_loc
             )?;
-            w.write_all(ent.data.as_slice())?;
+            w.write_all(ent.data)?;
             w.write_all(b"\n")?;
         }
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::test_util;
+
+    fn make_archive(threshold: usize) -> Vec<u8> {
+        test_util::make_archive(|sw| {
+            sw.set_spill_threshold(threshold);
+            for i in 0..2000 {
+                let path = format!("dir-{}/file-{}.txt", i % 17, i);
+                let meta = pax::Metadata::new_file(path.into_bytes(), 2);
+                sw.add_file(&mut &b"hi"[..], &meta).unwrap();
+            }
+        })
+    }
+
+    #[test]
+    fn spilled_index_is_the_same() {
+        let mut buf = SpillBuffer::new();
+        buf.threshold = 100;
+        for i in 0..1000u32 {
+            buf.write_all(&i.to_le_bytes()).unwrap();
+        }
+        assert!(buf.file.is_some());
+        assert!(buf.mem.is_empty());
+
+        let mut out = Vec::new();
+        buf.copy_to(&mut out).unwrap();
+        let expected: Vec<u8> = (0..1000u32).flat_map(|i| i.to_le_bytes()).collect();
+        assert_eq!(out, expected);
+
+        assert_eq!(make_archive(256), make_archive(0));
+    }
+}